@@ -0,0 +1,143 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "sqlite3.h"
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+
+namespace SQLiteWrapper
+{
+	class SQLite;
+
+	/**
+	 * @brief Incremental read and write access to a single BLOB value.
+	 *
+	 * Uses sqlite3_blob_open() to access a BLOB in chunks, without loading the whole value into memory.
+	 * A BLOB can not change its size through this interface, the space has to be allocated
+	 * beforehand using allocate() or insertZeroBlob().
+	 * A single BLOB is limited to SQLITE_MAX_LENGTH bytes (1GB by default), larger payloads
+	 * can be split over multiple rows and accessed one after the other using reopen().
+	 *
+	 * @example
+	 * sqlite3_int64 rowid = BlobStream::insertZeroBlob(db, "Files", "Data", fileSize);
+	 * BlobStream blob(db, "Files", "Data", rowid, BlobStream::Mode::readWrite);
+	 * BlobOStream out(blob);
+	 * out << file.rdbuf();
+	 */
+	class SQLITE_WRAPPER_EXPORT BlobStream
+	{
+	public:
+		enum Mode
+		{
+			readOnly,
+			readWrite
+		};
+
+		BlobStream(SQLite& db, const std::string& table, const std::string& column, sqlite3_int64 rowid,
+				   Mode mode = Mode::readOnly, const std::string& schema = "main");
+		~BlobStream();
+
+		BlobStream(const BlobStream&) = delete;
+		BlobStream& operator=(const BlobStream&) = delete;
+
+		bool isOpen() const { return m_blob != nullptr; }
+		Mode getMode() const { return m_mode; }
+
+		/**
+		 * @brief Moves the stream to the BLOB of another row in the same table and column.
+		 * This is faster than opening a new BlobStream. The position is reset to 0.
+		 */
+		bool reopen(sqlite3_int64 rowid);
+		void close();
+
+		size_t size() const { return m_size; }
+		size_t tell() const { return m_position; }
+		bool atEnd() const { return m_position >= m_size; }
+		bool seek(size_t position);
+
+		/**
+		 * @brief Reads up to count bytes from the current position.
+		 * @return The number of bytes read
+		 */
+		size_t read(void* buffer, size_t count);
+
+		/**
+		 * @brief Writes up to count bytes to the current position.
+		 * Writing stops at the end of the BLOB, it does not grow.
+		 * @return The number of bytes written
+		 */
+		size_t write(const void* data, size_t count);
+
+		/**
+		 * @brief Sets the column of an existing row to a zero filled BLOB of the given size.
+		 */
+		static bool allocate(SQLite& db, const std::string& table, const std::string& column,
+							 sqlite3_int64 rowid, size_t size);
+
+		/**
+		 * @brief Inserts a new row with a zero filled BLOB of the given size.
+		 * @return The rowid of the new row, -1 on failure
+		 */
+		static sqlite3_int64 insertZeroBlob(SQLite& db, const std::string& table, const std::string& column, size_t size);
+
+	private:
+		sqlite3* m_db;
+		sqlite3_blob* m_blob;
+		Mode m_mode;
+		size_t m_size;
+		size_t m_position;
+	};
+
+	/**
+	 * @brief std::streambuf on top of a BlobStream, transfers the data in chunks.
+	 */
+	class SQLITE_WRAPPER_EXPORT BlobStreamBuffer : public std::streambuf
+	{
+	public:
+		BlobStreamBuffer(BlobStream& blob, size_t chunkSize = 64 * 1024);
+		~BlobStreamBuffer();
+
+	protected:
+		int_type underflow() override;
+		int_type overflow(int_type ch) override;
+		int sync() override;
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+	private:
+		bool flushPutArea();
+
+		BlobStream& m_blob;
+		size_t m_chunkSize;
+		std::vector<char> m_getBuffer;
+		std::vector<char> m_putBuffer;
+	};
+
+	/**
+	 * @brief std::istream reading from a BLOB.
+	 */
+	class SQLITE_WRAPPER_EXPORT BlobIStream : public std::istream
+	{
+	public:
+		BlobIStream(BlobStream& blob, size_t chunkSize = 64 * 1024);
+
+	private:
+		BlobStreamBuffer m_buffer;
+	};
+
+	/**
+	 * @brief std::ostream writing to a BLOB.
+	 */
+	class SQLITE_WRAPPER_EXPORT BlobOStream : public std::ostream
+	{
+	public:
+		BlobOStream(BlobStream& blob, size_t chunkSize = 64 * 1024);
+		~BlobOStream();
+
+	private:
+		BlobStreamBuffer m_buffer;
+	};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "sqlite3.h"
+#include <chrono>
+#include <mutex>
+#include <random>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Busy handler for a connection, called by SQLite when a lock held by another connection blocks a statement.
+	 *
+	 * The first calls of a busy event only yield the thread, short write transactions of other
+	 * processes often finish within that time. After that the handler sleeps with an exponential
+	 * backoff, randomized by the jitter so that competing writers do not retry in lockstep.
+	 * The statement fails with SQLITE_BUSY once the timeout of the event has elapsed.
+	 *
+	 * Installing the handler replaces a busy timeout set by sqlite3_busy_timeout().
+	 */
+	class SQLITE_WRAPPER_EXPORT BusyHandler
+	{
+	public:
+		struct Policy
+		{
+			unsigned int spinCount = 4;                          // calls answered with a yield before sleeping
+			std::chrono::microseconds initialBackoff{ 100 };     // first sleep after the spinning
+			std::chrono::microseconds maxBackoff{ 50000 };       // the backoff doubles up to this value
+			double jitter = 0.5;                                 // part of the backoff which gets randomized, 0 to 1
+			std::chrono::milliseconds timeout{ 5000 };           // 0 fails immediately like without a handler
+		};
+		struct Statistics
+		{
+			size_t busyEvents = 0;  // statements which found the database locked
+			size_t retries = 0;     // calls of the handler which retried
+			size_t timeouts = 0;    // busy events which failed with SQLITE_BUSY
+			std::chrono::microseconds totalWait{ 0 }; // time spent in the handler
+			std::chrono::microseconds maxWait{ 0 };   // longest single busy event
+		};
+
+		BusyHandler();
+
+		void setPolicy(const Policy& policy);
+		Policy getPolicy() const;
+
+		/**
+		 * @brief Registers the handler on the connection with sqlite3_busy_handler().
+		 */
+		bool install(sqlite3* db);
+
+		/**
+		 * @brief Fails busy events once the deadline has passed, even before the timeout of the policy.
+		 * time_point::max() removes the deadline.
+		 */
+		void setDeadline(std::chrono::steady_clock::time_point deadline);
+
+		Statistics getStatistics() const;
+		void resetStatistics();
+
+	private:
+		static int onBusy(void* context, int count);
+		bool handleBusy(int count);
+
+		mutable std::mutex m_mutex;
+		Policy m_policy;
+		Statistics m_statistics;
+		std::minstd_rand m_random;
+
+		// State of the running busy event
+		std::chrono::steady_clock::time_point m_eventStart;
+		std::chrono::microseconds m_eventWait;
+		std::chrono::microseconds m_backoff;
+		std::chrono::steady_clock::time_point m_deadline;
+	};
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <memory>
+#include <atomic>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Cancels the statements executed with an SQLite::ExecutionBudget holding this token.
+	 *
+	 * Copies share the same state, a copy can be handed to another thread which cancels the work.
+	 * The running statement notices the cancellation in the progress handler of the connection,
+	 * after at most SQLite::getProgressCheckInterval() virtual machine instructions.
+	 */
+	class SQLITE_WRAPPER_EXPORT CancellationToken
+	{
+	public:
+		CancellationToken();
+
+		void cancel();
+		bool isCancelled() const;
+
+		/**
+		 * @brief Allows the token to be used again after a cancellation.
+		 */
+		void reset();
+
+	private:
+		std::shared_ptr<std::atomic<bool>> m_cancelled;
+	};
+}
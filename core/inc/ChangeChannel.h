@@ -0,0 +1,82 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Publishes the commits to a database through a POSIX shared memory segment.
+	 *
+	 * The segment holds a commit sequence number and the changed tables of the last commits,
+	 * protected by a seqlock, so readers never block the writer. The writer holding the seqlock
+	 * is tagged with its process id, a writer of a crashed process is detected with kill(pid, 0)
+	 * and its lock taken over. All processes have to share the pid namespace. Listeners sleep on a futex
+	 * in the segment and get woken by each publish, without touching the database file.
+	 *
+	 * The segment is named after the absolute database path and stays in /dev/shm,
+	 * the sequence continues when the processes are restarted.
+	 * Only commits published through this class are seen, writes of other programs are not.
+	 *
+	 * Linux only, open() returns false on other platforms.
+	 */
+	class SQLITE_WRAPPER_EXPORT ChangeChannel
+	{
+	public:
+		using Callback = std::function<void(uint64_t sequence)>;
+
+		ChangeChannel(const std::string& dbPath);
+		~ChangeChannel();
+
+		static std::string getSegmentName(const std::string& dbPath);
+
+		/**
+		 * @brief Creates or maps the shared memory segment.
+		 */
+		bool open();
+		void close();
+		bool isOpen() const { return m_segment != nullptr; }
+
+		/**
+		 * @brief Increments the commit sequence, stores the tables and wakes the listeners.
+		 * @param tables The changed tables, empty if unknown
+		 * @return The sequence number of the commit, 0 if the channel is not open
+		 */
+		uint64_t publish(const std::vector<std::string>& tables);
+
+		uint64_t getSequence() const;
+
+		/**
+		 * @brief Reads the tables changed by the commits after the given sequence.
+		 * @param sequence Receives the current sequence
+		 * @param tables Receives the changed tables, sorted and unique
+		 * @param complete False if the tables of some commits are not known any more,
+		 *        because they were overwritten by newer commits or were too long
+		 */
+		bool readSince(uint64_t since, uint64_t& sequence, std::vector<std::string>& tables, bool& complete) const;
+
+		/**
+		 * @brief Starts a thread which calls the callback after each publish by any process.
+		 * The callback is called from the listener thread.
+		 */
+		bool startListening(const Callback& callback);
+		void stopListening();
+
+	private:
+		struct Segment;
+
+		void listen(uint64_t seen);
+		void wake();
+
+		const std::string m_name;
+		Segment* m_segment;
+		Callback m_callback;
+		std::thread* m_listenThread;
+		std::atomic<bool> m_stopListening;
+	};
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "sqlite3.h"
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <thread>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Collects the sqlite3_stmt_status counters per query fingerprint and takes snapshots
+	 * of the sqlite3_db_status values of a connection and the process wide sqlite3_status64 values.
+	 *
+	 * Snapshots are plain values, a monitoring thread can take one per second and
+	 * diff() it with the previous one to get the rates.
+	 *
+	 * The thread which executes the statements is the only writer. It updates atomic counters
+	 * and publishes the list of fingerprints and the status values through double buffers,
+	 * so takeSnapshot() never waits for a running query and never blocks it.
+	 */
+	class SQLITE_WRAPPER_EXPORT ConnectionMetrics
+	{
+	public:
+		// Upper bounds of the duration histogram in microseconds, the last bucket has no bound
+		static constexpr std::array<int64_t, 5> durationBucketBounds = { 100, 1000, 10000, 100000, 1000000 };
+		static constexpr size_t durationBucketCount = durationBucketBounds.size() + 1;
+
+		struct StatementStats
+		{
+			std::string fingerprint;
+			std::string query; // First executed query with this fingerprint
+			uint64_t runs = 0;
+			uint64_t vmSteps = 0;
+			uint64_t fullscanSteps = 0;
+			uint64_t sorts = 0;
+			uint64_t autoIndexes = 0;
+			std::chrono::microseconds totalDuration{ 0 };
+			std::chrono::microseconds maxDuration{ 0 };
+			std::array<uint64_t, durationBucketCount> durationBuckets{}; // runs per bucket, not cumulative
+		};
+
+		struct Snapshot
+		{
+			std::string database;
+			std::string connection; // Name of the connection, set by the MetricsExporter
+			std::chrono::system_clock::time_point timestamp;
+
+			// sqlite3_db_status of the connection, the ...Used values are gauges, the others counters
+			int64_t lookasideUsed = 0;
+			int64_t lookasideHit = 0;
+			int64_t lookasideMissSize = 0;
+			int64_t lookasideMissFull = 0;
+			int64_t cacheUsed = 0;    // bytes
+			int64_t cacheHit = 0;
+			int64_t cacheMiss = 0;
+			int64_t cacheWrite = 0;
+			int64_t cacheSpill = 0;
+			int64_t schemaUsed = 0;   // bytes
+			int64_t statementUsed = 0; // bytes
+
+			// sqlite3_status64 of the process, all gauges
+			int64_t memoryUsed = 0;
+			int64_t memoryHighwater = 0;
+			int64_t mallocCount = 0; // outstanding allocations
+			int64_t pageCacheOverflow = 0;
+
+			std::vector<StatementStats> statements; // sorted by fingerprint
+
+			/**
+			 * @brief Subtracts the counters of the previous snapshot, the gauges keep their current values.
+			 * Statements which did not run in between are left out.
+			 * Counters below their previous value were reset in between (clear() or reopen),
+			 * their current values are taken as the delta.
+			 */
+			Snapshot diff(const Snapshot& previous) const;
+		};
+
+		/**
+		 * @param maxFingerprints Upper bound of distinct fingerprints, further fingerprints are ignored.
+		 */
+		ConnectionMetrics(size_t maxFingerprints = 1000);
+
+		void setEnabled(bool enable) { m_enabled.store(enable); }
+		bool isEnabled() const { return m_enabled.load(); }
+
+		/**
+		 * @brief Sets how often the status values are read again by recordStatement(), default 1s.
+		 */
+		void setStatusInterval(std::chrono::milliseconds interval) { m_statusInterval.store(interval.count()); }
+		std::chrono::milliseconds getStatusInterval() const { return std::chrono::milliseconds(m_statusInterval.load()); }
+
+		/**
+		 * @brief Adds the counters of a finished statement, must be called before it gets finalized.
+		 * Refreshes the published status values once the status interval has elapsed.
+		 * @param db The connection of the statement.
+		 * @param stmt The statement or nullptr if not available (sqlite3_exec), only the run is counted.
+		 */
+		void recordStatement(sqlite3* db, sqlite3_stmt* stmt, const std::string& query, std::chrono::microseconds duration);
+
+		/**
+		 * @brief Reads the status values of the connection and the process and publishes them for takeSnapshot().
+		 * Must be called from the thread which executes the statements.
+		 */
+		void refreshStatus(sqlite3* db);
+
+		/**
+		 * @brief Copies the published status values and statement counters.
+		 * May be called from any thread, the status values are at most one status interval old.
+		 */
+		Snapshot takeSnapshot() const;
+
+		/**
+		 * @brief Removes all statement counters, must be called from the thread which executes the statements.
+		 */
+		void clear();
+
+	private:
+		struct Entry
+		{
+			std::string fingerprint;
+			std::string query;
+			std::atomic<uint64_t> runs{ 0 };
+			std::atomic<uint64_t> vmSteps{ 0 };
+			std::atomic<uint64_t> fullscanSteps{ 0 };
+			std::atomic<uint64_t> sorts{ 0 };
+			std::atomic<uint64_t> autoIndexes{ 0 };
+			std::atomic<int64_t> totalDuration{ 0 }; // microseconds
+			std::atomic<int64_t> maxDuration{ 0 };
+			std::array<std::atomic<uint64_t>, durationBucketCount> durationBuckets{};
+		};
+		typedef std::vector<std::shared_ptr<Entry>> EntryList;
+
+		// The single writer fills the buffer the readers do not use and switches them over to it.
+		// Readers never wait, the writer only waits for readers still copying the buffer it overwrites,
+		// which started before its previous publish
+		template<typename T>
+		class DoubleBuffer
+		{
+		public:
+			DoubleBuffer()
+				: m_active(0)
+			{
+				m_readers[0].store(0);
+				m_readers[1].store(0);
+			}
+
+			void publish(T value)
+			{
+				int inactive = 1 - m_active.load(std::memory_order_relaxed);
+				while (m_readers[inactive].load() != 0)
+					std::this_thread::yield();
+				m_buffers[inactive] = std::move(value);
+				m_active.store(inactive);
+			}
+
+			template<typename Function>
+			void read(Function&& function) const
+			{
+				int index;
+				while (true)
+				{
+					index = m_active.load();
+					m_readers[index].fetch_add(1);
+					if (m_active.load() == index)
+						break;
+					m_readers[index].fetch_sub(1); // Switched in between, the writer may be overwriting it
+				}
+				function(m_buffers[index]);
+				m_readers[index].fetch_sub(1);
+			}
+
+		private:
+			T m_buffers[2];
+			std::atomic<int> m_active;
+			mutable std::atomic<uint32_t> m_readers[2];
+		};
+
+		std::atomic<bool> m_enabled;
+		std::atomic<int64_t> m_statusInterval; // milliseconds
+		size_t m_maxFingerprints;
+
+		// Only accessed by the thread which executes the statements
+		std::unordered_map<std::string, std::shared_ptr<Entry>> m_entries;
+		EntryList m_entryList;
+		std::chrono::steady_clock::time_point m_lastStatusRefresh;
+
+		// Read by takeSnapshot()
+		DoubleBuffer<EntryList> m_publishedEntries;
+		DoubleBuffer<Snapshot> m_publishedStatus;
+	};
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "SQLiteWrapper_base.h"
+#include "WatchService.h"
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <atomic>
 #include <QObject>
 #include <QTimer>
 
@@ -19,9 +24,26 @@ namespace SQLiteWrapper
 	public:
 		enum Mode
 		{
-			polling,  // checks for a file change when asked
-			winApi    // Uses the "FindFirstChangeNotification" function to monitor file changes (does not work on network drives)
+			polling,       // checks for a file change when asked, hashes the whole file
+			winApi,        // Uses the "FindFirstChangeNotification" function to monitor file changes (does not work on network drives)
+			changeCounter, // polls the file change counter of the database header and the WAL index, independent of the file size
+			dataVersion,   // polls "PRAGMA data_version" through the provider set by setDataVersionProvider()
+			inotify,       // Linux only, uses inotify to get notified about writes to the file and its -wal and -journal files
+			shared         // registers the file at the process wide WatchService, no thread or timer per watcher
 		};
+		/**
+		 * @brief Controls how bursts of changes are merged into fewer onFileChanged signals.
+		 * The default policy emits every detected change immediately.
+		 */
+		struct DebouncePolicy
+		{
+			bool leading = true;                     // emit on the first change of a burst
+			bool trailing = true;                    // emit the merged changes once the burst is over, without it they are dropped
+			std::chrono::milliseconds window{ 0 };   // a burst is over after no change for this duration, 0 disables debouncing
+			std::chrono::milliseconds maxWait{ 0 };  // emit at the latest after this duration during a long burst, 0 for no limit
+			unsigned int maxEventsPerSecond = 0;     // further changes are held back and merged into the next signal, 0 for no limit
+		};
+
 		FileChangeWatcher(const std::string& path);
 		FileChangeWatcher(const std::string& path, Mode mode);
 		~FileChangeWatcher();
@@ -29,8 +51,23 @@ namespace SQLiteWrapper
 		void setMode(Mode mode);
 		Mode getMode() const { return m_mode; }
 		const std::string& getPath() const { return m_path; }
-		
-		
+
+		/**
+		 * @brief Sets the function used in the dataVersion mode.
+		 * The function has to return the result of "PRAGMA data_version" or -1 if not available.
+		 * It is called from the thread the watcher lives in.
+		 */
+		void setDataVersionProvider(const std::function<long long()>& provider);
+
+		/**
+		 * @brief Reads the file change counter at offset 24 of the database header
+		 * and the header of the WAL index (<path>-shm), if the database is in WAL mode.
+		 * @return A fingerprint which changes with each commit to the database
+		 */
+		static std::string readChangeCounter(const std::string& path, bool& success);
+
+		void setDebouncePolicy(const DebouncePolicy& policy);
+		const DebouncePolicy& getDebouncePolicy() const { return m_debouncePolicy; }
 
 		void pause();
 		void unpause();
@@ -39,13 +76,27 @@ namespace SQLiteWrapper
 	signals:
 		void onFileChanged(const std::string& path);
 
+		/**
+		 * @brief Emitted together with onFileChanged.
+		 * @param count Number of detected changes merged into this signal
+		 */
+		void onFileChangesCoalesced(const std::string& path, unsigned int count);
+
 		void onFileChangedInternal(QPrivateSignal*);
 	private slots:
 		void onFileChangedInternalSlot(QPrivateSignal*);
 		void onPollingTimerTimeout();
+		void onDebounceTimeout();
+		void onInitialFingerprintReady();
 	private:
-		bool hasChanged();
-		void clearFileChangedFlag();
+		// All detected changes end up here, called in the thread of the watcher
+		void reportChange(unsigned int count);
+		void emitPendingChanges();
+		void resetPendingChanges();
+
+		// Lock free handoff of detected changes to the thread of the watcher
+		void publishChange();
+		void consumeChanges();
 
 		void startWatching();
 		void stopWatching();
@@ -55,20 +106,53 @@ namespace SQLiteWrapper
 		// For WinAPI mode
 		void monitorFile();
 		std::thread* m_watchThread = nullptr;
+#ifdef _WIN32
 		std::atomic<HANDLE> m_eventHandle;
-		std::mutex m_mutex;
-		std::condition_variable m_cv;
+#endif
 		std::atomic<bool> m_stopFlag;
 
-		// For polling mode
+		// For inotify mode
+#ifdef __linux__
+		void monitorFileInotify();
+		int m_wakeupFd = -1;
+#endif
+
+		// For shared mode
+		void onSharedWatchChanged();
+		WatchService::Id m_sharedWatchId = 0;
+
+		// For polling, changeCounter and dataVersion mode
+		bool isPollingMode() const { return m_mode != Mode::winApi && m_mode != Mode::inotify && m_mode != Mode::shared; }
 		void checkFile();
-		std::string m_md5;
+		std::string calculateFingerprint(bool& success);
+		std::string m_fingerprint;
+		std::function<long long()> m_dataVersionProvider;
 		QTimer m_timer;
 
+		// Initial fingerprint of the polling modes, calculated in the background
+		void calculateInitialFingerprint();
+		void stopInitialFingerprint();
+		std::thread* m_initialFingerprintThread = nullptr;
+		std::string m_initialFingerprint;
+		bool m_initialFingerprintSuccess = false;
+
+		// Debouncing
+		DebouncePolicy m_debouncePolicy;
+		QTimer m_debounceTimer;
+		QTimer m_rateLimitTimer;
+		unsigned int m_pendingChanges = 0;
+		unsigned int m_deferredChanges = 0; // part of m_pendingChanges whose signal is held back by the rate limit
+		std::chrono::steady_clock::time_point m_burstStart;
+		std::chrono::steady_clock::time_point m_lastChange;
+		std::chrono::steady_clock::time_point m_rateWindowStart;
+		unsigned int m_eventsInWindow = 0;
+
 		const std::string m_path;
 		Mode m_mode;
 		std::filesystem::file_time_type m_lastModificationTime;
-		std::atomic<bool> m_fileChanged;
+		std::atomic<unsigned long long> m_changeSequence;   // incremented for each detected change
+		std::atomic<bool> m_notificationPending;           // a queued onFileChangedInternal has not been consumed yet
+		unsigned long long m_consumedSequence = 0;
 		std::atomic<bool> m_paused;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "QueryWorkload.h"
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace SQLiteWrapper
+{
+	class SQLite;
+
+	/**
+	 * @brief Suggests indexes for a captured query workload.
+	 *
+	 * Uses the sqlite3expert extension (the ".expert" command of the SQLite shell)
+	 * to find indexes that would improve the query plans of the workload.
+	 * Optionally the suggestions are measured on a scratch copy of the database.
+	 *
+	 * @example
+	 * db.startWorkloadCapture();
+	 * ... run the application ...
+	 * db.stopWorkloadCapture();
+	 * IndexAdvisor advisor(db);
+	 * IndexAdvisor::Report report = advisor.analyze(db.getWorkload().getEntries());
+	 */
+	class SQLITE_WRAPPER_EXPORT IndexAdvisor
+	{
+	public:
+		struct Recommendation
+		{
+			QueryWorkload::Entry workload;
+			std::vector<std::string> createIndexStatements;
+			std::vector<std::string> currentPlan;
+			std::vector<std::string> proposedPlan;
+
+			// Estimated improvement, QueryPlanLinter issues of the current plan
+			// which are no longer present in the proposed plan
+			std::vector<std::string> resolvedIssues;
+
+			// Only set if the measurement on a scratch copy is enabled
+			bool measured = false;
+			std::chrono::microseconds durationBefore{ 0 };
+			std::chrono::microseconds durationAfter{ 0 };
+
+			std::string toString() const;
+		};
+		struct Report
+		{
+			std::vector<Recommendation> recommendations;
+			std::vector<std::string> createIndexStatements; ///< All suggested indexes, without duplicates
+			std::vector<std::string> errors;
+
+			std::string toString() const;
+		};
+
+		IndexAdvisor(SQLite& db);
+
+		/**
+		 * @brief Percentage of rows sampled to compute the statistics of the candidate indexes.
+		 * 0 uses no statistics at all and is the fastest option, 100 analyzes the whole table.
+		 */
+		void setSamplePercentage(int percentage) { m_samplePercentage = percentage; }
+		int getSamplePercentage() const { return m_samplePercentage; }
+
+		/**
+		 * @brief Enables the measurement of each recommendation on a scratch copy of the database.
+		 * @param enable
+		 * @param repetitions How many times each query gets executed before and after creating the indexes
+		 * @param scratchPath Path of the scratch copy, ":memory:" keeps the copy in RAM
+		 */
+		void setMeasureOnScratchCopy(bool enable, unsigned int repetitions = 3, const std::string& scratchPath = ":memory:");
+		bool isMeasureOnScratchCopyEnabled() const { return m_measure; }
+
+		/**
+		 * @brief Analyzes the queries and suggests indexes for them.
+		 * @param workload The captured queries, as returned by QueryWorkload::getEntries()
+		 */
+		Report analyze(const std::vector<QueryWorkload::Entry>& workload);
+
+	private:
+		void measure(Report& report);
+
+		SQLite& m_db;
+		int m_samplePercentage;
+		bool m_measure;
+		unsigned int m_repetitions;
+		std::string m_scratchPath;
+	};
+}
@@ -2,12 +2,23 @@
 
 #include "SQLiteWrapper_base.h"
 #include <string>
+#include <chrono>
+#include <array>
+#include <mutex>
+#include <condition_variable>
 
 namespace SQLiteWrapper
 {
 	/**
-	 * @brief This class creates a lock file. 
-	 * A locked lockfile can not be deleted by any other process.
+	 * @brief This class creates a lock file.
+	 *
+	 * The lock can be held shared by many readers or exclusive by a single writer.
+	 * On Windows LockFileEx is used, on other platforms fcntl open file description locks,
+	 * with a fallback to flock if the kernel does not support them.
+	 * The file is deleted when an exclusive lock is released.
+	 * On Windows the file can not be deleted while another process has it open. The POSIX locks
+	 * are advisory and do not prevent the deletion, a lock is only taken if the locked file
+	 * is still the one at the path afterwards.
 	 */
 	class SQLITE_WRAPPER_EXPORT LockFile
 	{
@@ -18,6 +29,8 @@ namespace SQLiteWrapper
 			alreadyLocked,
 			unableToCreateLockFile,
 			unableToLock,
+			timeout,
+			cancelled,
 		};
 		enum UnlockStatus
 		{
@@ -25,18 +38,134 @@ namespace SQLiteWrapper
 			alreadyUnlocked,
 			unableToUnlock
 		};
+		enum LockMode
+		{
+			none,
+			shared,
+			exclusive
+		};
+		struct Statistics
+		{
+			static constexpr size_t histogramBuckets = 32;
+
+			size_t attempts = 0;      // calls of the tryGet... functions
+			size_t acquisitions = 0;  // successful calls
+			size_t contentions = 0;   // tries which found the lock held by another process
+			size_t failures = 0;      // calls which failed for another reason than contention
+			std::chrono::microseconds totalAcquireTime{ 0 }; // summed duration of the successful calls
+			std::chrono::microseconds maxAcquireTime{ 0 };
+
+			// Acquire time of the successful calls, bucket i counts the durations in [2^i, 2^(i+1)) microseconds
+			std::array<size_t, histogramBuckets> acquireTimeHistogram{};
+		};
+
+		/**
+		 * @brief Ends a waiting acquire() from another thread.
+		 * The token stays cancelled until reset() is called.
+		 */
+		class SQLITE_WRAPPER_EXPORT CancelToken
+		{
+		public:
+			CancelToken();
+			CancelToken(const CancelToken&) = delete;
+			CancelToken& operator=(const CancelToken&) = delete;
+
+			void cancel();
+			void reset();
+			bool isCancelled() const;
+
+			/**
+			 * @brief Waits until the token gets cancelled or the duration has elapsed.
+			 * @return true if the token is cancelled
+			 */
+			bool waitFor(std::chrono::milliseconds duration);
+
+		private:
+			friend class LockFile;
+
+			mutable std::mutex m_mutex;
+			std::condition_variable m_cv;
+			bool m_cancelled;
+		};
+
 		LockFile(const std::string& path);
 		~LockFile();
 
 		const std::string& getPath() const { return m_path; }
 
+		/**
+		 * @brief Tries to get the exclusive lock, same as tryGetExclusiveLock()
+		 */
 		LockStatus tryGetLock();
+
+		LockStatus tryGetSharedLock();
+		LockStatus tryGetExclusiveLock();
+
+		/**
+		 * @brief Retries to get the lock until the timeout has elapsed.
+		 * @return LockStatus::timeout if the lock is still held by another process
+		 */
+		LockStatus tryGetSharedLock(std::chrono::milliseconds timeout);
+		LockStatus tryGetExclusiveLock(std::chrono::milliseconds timeout);
+
+		/**
+		 * @brief Waits until the lock is available or the timeout has elapsed.
+		 * Windows waits for an overlapped LockFileEx without polling. Other platforms retry with
+		 * backoff like the timed tryGet... functions, unless setSignalWakeupEnabled() was called.
+		 * @return LockStatus::timeout if the lock is still held by another process
+		 */
+		LockStatus acquire(std::chrono::milliseconds timeout, LockMode mode = LockMode::exclusive);
+
+		/**
+		 * @brief Waits without a timeout until the lock is available or the token gets cancelled.
+		 * The wait blocks like the timed acquire(), cancel() wakes it up immediately.
+		 * @return LockStatus::cancelled if the token was cancelled before the lock was taken
+		 */
+		LockStatus acquire(CancelToken& cancel, LockMode mode = LockMode::exclusive);
+
+		/**
+		 * @brief Lets acquire() block in fcntl(F_OFD_SETLKW) on Linux instead of retrying, for all lock files.
+		 *
+		 * Each contended wait starts a timer thread, which interrupts the fcntl call at the timeout
+		 * or the cancellation with the signal SQLW_LOCKFILE_WAKEUP_SIGNAL (SIGRTMIN + 7 by default).
+		 * The first blocking wait installs a process wide handler for that signal, it is not used
+		 * if the application has installed its own handler. Define SQLW_LOCKFILE_WAKEUP_SIGNAL
+		 * to another signal when building the library if the application needs this one.
+		 * Disabled by default, ignored on other platforms.
+		 */
+		static void setSignalWakeupEnabled(bool enable);
+		static bool isSignalWakeupEnabled();
+
 		UnlockStatus releaseLock();
-		bool isLocked() const { return m_locked; }
+		bool isLocked() const { return m_lockMode != LockMode::none; }
+		LockMode getLockMode() const { return m_lockMode; }
+
+		const Statistics& getStatistics() const { return m_statistics; }
+		void resetStatistics();
 
 	private:
+		LockStatus lockWithRetry(LockMode mode, std::chrono::milliseconds timeout);
+		LockStatus acquireUntil(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel);
+		void recordAcquisition(std::chrono::steady_clock::duration duration);
+
+		// Tries with backoff until the deadline, only counts the contentions in the statistics
+		LockStatus retryLock(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel = nullptr);
+
+		// Blocking try until the deadline or the cancellation, retry is set if the caller should try again
+		LockStatus waitForLock(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel, bool& retry);
+
+		// Single non blocking try, unableToLock if the lock is held by another process
+		LockStatus tryLock(LockMode mode);
+		bool unlock();
+
 		const std::string m_path;
+#ifdef _WIN32
 		HANDLE m_handle;
-		bool m_locked;
+#else
+		int m_fd;
+		bool m_useFlock; ///< The kernel does not support OFD locks, set by the first tryLock()
+#endif
+		LockMode m_lockMode;
+		Statistics m_statistics;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "ConnectionMetrics.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+
+namespace SQLiteWrapper
+{
+	class SQLite;
+
+	/**
+	 * @brief Periodically writes the metrics of connections in the Prometheus text format or as JSON.
+	 *
+	 * The export runs on its own thread and only reads the snapshots the connections publish,
+	 * so it never blocks a query. A file is written to a temporary file first and renamed,
+	 * which is what the textfile collector of the node exporter expects.
+	 *
+	 * Samples are labelled with the database path and the connection name, statement metrics also
+	 * with the query fingerprint, so several connections to the same database give distinct series.
+	 * Process wide memory values are exported once, taken from the first connection.
+	 */
+	class SQLITE_WRAPPER_EXPORT MetricsExporter
+	{
+	public:
+		enum class Format
+		{
+			prometheus,
+			json
+		};
+		typedef std::function<void(const std::string& content)> Sink;
+
+		MetricsExporter(Format format = Format::prometheus);
+		~MetricsExporter();
+
+		void setFormat(Format format);
+		Format getFormat() const;
+
+		/**
+		 * @brief Sets the time between two exports, default 10s.
+		 */
+		void setInterval(std::chrono::milliseconds interval);
+		std::chrono::milliseconds getInterval() const;
+
+		/**
+		 * @brief Writes the exports to the file, an empty path disables the file.
+		 */
+		void setFile(const std::string& path);
+		std::string getFile() const;
+
+		/**
+		 * @brief Passes each export to the sink, called from the export thread.
+		 */
+		void setSink(const Sink& sink);
+
+		/**
+		 * @brief Adds a connection to the export, the metrics of the connection have to be enabled.
+		 * The connection has to be removed before it is destroyed.
+		 * @param name Value of the connection label, the number of the added connection if empty
+		 */
+		void addConnection(const SQLite* db, const std::string& name = std::string());
+		void removeConnection(const SQLite* db);
+
+		bool start();
+		void stop();
+		bool isRunning() const;
+
+		/**
+		 * @brief Exports the current snapshots immediately, independent of the timer.
+		 */
+		bool exportNow();
+
+		static std::string toPrometheus(const std::vector<ConnectionMetrics::Snapshot>& snapshots);
+		static std::string toJson(const std::vector<ConnectionMetrics::Snapshot>& snapshots);
+
+	private:
+		void run();
+		bool writeFile(const std::string& path, const std::string& content);
+
+		// Guards the settings and the connections, never taken by the connections themselves
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cv;
+		Format m_format;
+		std::chrono::milliseconds m_interval;
+		std::string m_file;
+		Sink m_sink;
+		std::vector<std::pair<const SQLite*, std::string>> m_connections;
+		size_t m_addedConnections;
+
+		// Serializes the timer and exportNow() on the output
+		std::mutex m_exportMutex;
+
+		std::thread* m_thread;
+		bool m_stop;
+	};
+}
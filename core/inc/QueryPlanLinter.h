@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Inspects query plans for full table scans, temporary sort B-trees and automatic indexes.
+	 *
+	 * Each query fingerprint is inspected only once, the result is cached,
+	 * so the check costs a hash lookup after the first execution of a query.
+	 * The cache holds a bounded number of fingerprints, queries beyond it are not inspected.
+	 */
+	class SQLITE_WRAPPER_EXPORT QueryPlanLinter
+	{
+	public:
+		enum Mode
+		{
+			disabled,
+			warn,   // Logs a warning for each flagged query
+			strict  // Like warn, additionally asserts in debug builds
+		};
+		struct Result
+		{
+			std::string fingerprint;
+			std::string query;
+			std::vector<std::string> queryPlan;
+			std::vector<std::string> issues;
+
+			bool hasIssues() const { return !issues.empty(); }
+			std::string toString() const;
+		};
+
+		/**
+		 * @param maxFingerprints Upper bound of cached fingerprints, further queries are not inspected.
+		 */
+		QueryPlanLinter(size_t maxFingerprints = 1000);
+
+		void setMode(Mode mode) { m_mode = mode; }
+		Mode getMode() const { return m_mode; }
+		bool isEnabled() const { return m_mode != Mode::disabled; }
+
+		bool contains(const std::string& fingerprint) const;
+		bool isFull() const { return m_cache.size() >= m_maxFingerprints; }
+		const Result& store(Result&& result);
+
+		/**
+		 * @brief Gets all cached results that have at least one issue.
+		 */
+		std::vector<Result> getFindings() const;
+		void clear();
+
+		/**
+		 * @brief Searches the detail lines of a query plan for problematic steps.
+		 * @param queryPlan The detail lines as returned by SQLite::explainQueryPlan()
+		 * @return A description for each problematic step
+		 */
+		static std::vector<std::string> analyze(const std::vector<std::string>& queryPlan);
+
+	private:
+		Mode m_mode;
+		size_t m_maxFingerprints;
+		std::unordered_map<std::string, Result> m_cache;
+	};
+}
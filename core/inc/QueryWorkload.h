@@ -0,0 +1,54 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Aggregates the executed queries of a connection per query fingerprint over a time window.
+	 *
+	 * The captured workload is the input for the IndexAdvisor.
+	 */
+	class SQLITE_WRAPPER_EXPORT QueryWorkload
+	{
+	public:
+		struct Entry
+		{
+			std::string fingerprint;
+			std::string query; ///< First executed query with this fingerprint
+			size_t executions = 0;
+			std::chrono::microseconds totalDuration{ 0 };
+			std::chrono::microseconds maxDuration{ 0 };
+		};
+
+		/**
+		 * @param maxFingerprints Upper bound of distinct fingerprints, further fingerprints are ignored.
+		 */
+		QueryWorkload(size_t maxFingerprints = 1000);
+
+		void start();
+		void stop();
+		bool isCapturing() const { return m_capturing; }
+
+		void record(const std::string& query, std::chrono::microseconds duration);
+
+		/**
+		 * @brief Gets the captured queries, sorted by their total duration, longest first.
+		 */
+		std::vector<Entry> getEntries() const;
+		std::chrono::system_clock::time_point getStartTime() const { return m_startTime; }
+		std::chrono::system_clock::time_point getStopTime() const { return m_stopTime; }
+		void clear();
+
+	private:
+		std::unordered_map<std::string, Entry> m_entries;
+		size_t m_maxFingerprints;
+		bool m_capturing;
+		std::chrono::system_clock::time_point m_startTime;
+		std::chrono::system_clock::time_point m_stopTime;
+	};
+}
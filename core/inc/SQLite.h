@@ -2,10 +2,29 @@
 
 #include "SQLiteWrapper_base.h"
 #include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <set>
 #include <QObject>
+#include <QStringList>
+#include <QMetaMethod>
 #include "sqlite3.h"
 #include "FileChangeWatcher.h"
 #include "LockFile.h"
+#include "SlowQueryLog.h"
+#include "QueryPlanLinter.h"
+#include "QueryWorkload.h"
+#include "SerializedDatabase.h"
+#include "TableChangeTracker.h"
+#include "BusyHandler.h"
+#include "ChangeChannel.h"
+#include "CancellationToken.h"
+#include "ConnectionMetrics.h"
+#include "Strand.h"
 
 namespace SQLiteWrapper
 {
@@ -23,6 +42,46 @@ namespace SQLiteWrapper
     {
 		Q_OBJECT
     public:
+        /**
+         * @brief A single row change, reported by the row change notifications.
+         */
+        struct RowChange
+        {
+            enum Operation
+            {
+                insert,
+                update,
+                remove
+            };
+            std::string database;
+            std::string table;
+            Operation operation;
+            sqlite3_int64 rowid;
+        };
+
+        /**
+         * @brief Result of the calls which take an ExecutionBudget.
+         */
+        enum ExecutionStatus
+        {
+            succeeded,
+            failed,           ///< SQLite error, logged by the connection.
+            interrupted,      ///< Stopped by interrupt().
+            deadlineExceeded, ///< The deadline of the budget has passed, also while waiting for a lock.
+            cancelled         ///< The token of the budget was cancelled.
+        };
+
+        /**
+         * @brief Deadline and cancellation token of a single call.
+         */
+        struct ExecutionBudget
+        {
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+            CancellationToken token;
+
+            static ExecutionBudget withTimeout(std::chrono::microseconds timeout);
+        };
+
         /**
          * @brief Constructor. It does not open the database.
          *
@@ -42,6 +101,21 @@ namespace SQLiteWrapper
          */
         bool open();
 
+        /**
+         * @brief Opens the following connections with SQLITE_OPEN_READONLY.
+         *
+         * Takes effect with the next open(), an open connection is not changed.
+         * The change counter triggers of the table change tracking are not installed on a read only connection.
+         *
+         * @param readOnly True to open the database read only.
+         */
+        void setReadOnly(bool readOnly);
+
+        /**
+         * @brief Checks if the database gets opened read only.
+         */
+        bool isReadOnly() const { return m_readOnly; }
+
         /**
          * @brief Closes the SQLite database connection.
          *
@@ -59,6 +133,9 @@ namespace SQLiteWrapper
         /**
          * @brief Executes a simple SQL query without parameters.
          *
+         * A query with several statements is recorded statement by statement
+         * in the metrics, the slow query log and the workload capture.
+         *
          * @param query The SQL query to execute.
          *
          * @return True if the query was successfully executed, false otherwise.
@@ -120,6 +197,36 @@ namespace SQLiteWrapper
          */
         std::vector<std::vector<std::string>> fetchAll(const std::string& query);
 
+        /**
+         * @brief Same as execute(), executeWithParams() and fetchAll(), stopped when the budget is exhausted.
+         *
+         * The progress handler of the connection checks the deadline and the token while the
+         * statements run. A stopped statement inside an explicit transaction may roll back the
+         * whole transaction, as documented for sqlite3_interrupt().
+         * fetchAll() keeps the rows fetched before the stop.
+         *
+         * @return The reason if the call was stopped, succeeded or failed otherwise.
+         */
+        ExecutionStatus execute(const std::string& query, const ExecutionBudget& budget);
+        ExecutionStatus executeWithParams(const std::string& query, const std::vector<std::string>& params, const ExecutionBudget& budget);
+        ExecutionStatus fetchAll(const std::string& query, std::vector<std::vector<std::string>>& results, const ExecutionBudget& budget);
+
+        /**
+         * @brief Stops the running statement, it returns ExecutionStatus::interrupted.
+         *
+         * May be called from any thread, also while the connection gets closed or the hot copy swapped.
+         * Without a budget, the running call fails like on any other error.
+         */
+        void interrupt();
+
+        /**
+         * @brief Sets after how many virtual machine instructions the budget is checked.
+         *
+         * Lower values stop the statements faster and cost more time while they run.
+         */
+        void setProgressCheckInterval(int instructions);
+        int getProgressCheckInterval() const { return m_progressCheckInterval; }
+
         /**
          * @brief Begins a database transaction.
          *
@@ -171,9 +278,395 @@ namespace SQLiteWrapper
          */
         const std::string& getDBPath() const { return m_dbPath; }
 
+        /**
+         * @brief Sets how long and how often a statement is retried if another connection holds the lock.
+         *
+         * The busy handler is installed by open(), the policy can be changed at any time.
+         */
+        void setBusyPolicy(const BusyHandler::Policy& policy);
+
+        /**
+         * @brief Gets the busy handler to read the lock contention statistics of this connection.
+         */
+        BusyHandler& getBusyHandler() { return m_busyHandler; }
+
+        /**
+         * @brief Runs "EXPLAIN QUERY PLAN" for the given query.
+         *
+         * @param query The SQL query to explain. Parameters may stay unbound.
+         *
+         * @return The detail lines of the query plan, indented by their depth in the plan tree.
+         */
+        std::vector<std::string> explainQueryPlan(const std::string& query);
+
+        /**
+         * @brief Sets the duration after which a statement is recorded in the slow query log.
+         *
+         * The query plan of a slow statement is captured deferred, after the statement has completed,
+         * so that the slow call itself is not slowed down further.
+         *
+         * @param threshold The threshold. 0 disables the slow query log.
+         */
+        void setSlowQueryThreshold(std::chrono::microseconds threshold);
+
+        /**
+         * @brief Gets the slow query log to configure its capacity and rate limit.
+         */
+        SlowQueryLog& getSlowQueryLog() { return m_slowQueryLog; }
+
+        /**
+         * @brief Gets the recorded slow queries, oldest first.
+         *
+         * Query plans which are not yet captured are resolved before returning.
+         */
+        std::vector<SlowQueryLog::Entry> getSlowQueries();
+
+        /**
+         * @brief Enables the inspection of the query plan of newly prepared statements.
+         *
+         * Statements prepared by executeWithParams() and fetchAll() get their query plan
+         * checked once per query fingerprint for full table scans, temporary B-trees
+         * used for ORDER BY and automatic indexes.
+         *
+         * @param mode QueryPlanLinter::strict asserts on flagged queries in debug builds.
+         */
+        void setQueryPlanLintMode(QueryPlanLinter::Mode mode);
+
+        /**
+         * @brief Gets the query plan linter holding the cached lint results.
+         */
+        const QueryPlanLinter& getQueryPlanLinter() const { return m_queryPlanLinter; }
+
+        /**
+         * @brief Serializes the calls on this connection on an internal strand, so it can be shared between threads.
+         *
+         * Calls from any thread run one after another. An uncontended call claims the strand without a lock
+         * and runs in the calling thread, contended calls are queued and run by the thread holding the strand.
+         * Calls which have to stay together, like the statements of a transaction, belong into serialized().
+         * Enable it before the connection is shared. interrupt() and getMetricsSnapshot() never wait for the strand.
+         *
+         * The thread holding the strand may run the calls of other threads, the signals are therefore
+         * emitted in the thread of this object, queued if the call ran elsewhere. Only backupProgress()
+         * comes directly from the backup worker.
+         * The objects returned by getSlowQueryLog(), getBusyHandler(), getWorkload() and getTableChangeTracker()
+         * are used by the calls on the strand, use them inside serialized() while the connection is shared.
+         * The change detection setters (setChangeDetectionEnabled(), setChangeDetectionMode(),
+         * setChangeDebouncePolicy() and setChangeChannelEnabled()) create and configure the file watcher
+         * and have to be called in the thread of this object.
+         */
+        void setThreadSafe(bool enable) { m_threadSafe.store(enable); }
+        bool isThreadSafe() const { return m_threadSafe.load(); }
+
+        /**
+         * @brief Runs the function without calls of other threads on this connection in between.
+         *
+         * Calls of this connection inside the function run inline. Without the thread-safe mode
+         * the function is called directly.
+         *
+         * @return The result of the function, its exceptions are rethrown in the calling thread.
+         */
+        template<typename Function>
+        auto serialized(Function&& function) -> decltype(function())
+        {
+            if (!needsStrand())
+                return function();
+            return m_strand.dispatch(std::forward<Function>(function));
+        }
+
+        /**
+         * @brief Collects the statement counters per query fingerprint for getMetricsSnapshot().
+         */
+        void setMetricsEnabled(bool enable);
+        bool isMetricsEnabled() const { return m_metrics.isEnabled(); }
+
+        /**
+         * @brief Sets how often the executing thread refreshes the sqlite3_db_status values for getMetricsSnapshot().
+         */
+        void setMetricsStatusInterval(std::chrono::milliseconds interval);
+
+        /**
+         * @brief Takes a snapshot of the sqlite3_db_status values, the statement counters and the process wide memory status.
+         *
+         * May be called from a monitoring thread while the connection is open, it never waits for a running query.
+         * The status values are at most one status interval old.
+         * Use ConnectionMetrics::Snapshot::diff() to get the changes between two snapshots.
+         */
+        ConnectionMetrics::Snapshot getMetricsSnapshot() const;
+
+        /**
+         * @brief Starts to capture the executed queries per query fingerprint.
+         *
+         * A previously captured workload gets cleared.
+         * The workload can be passed to the IndexAdvisor to get index recommendations.
+         */
+        void startWorkloadCapture();
+
+        /**
+         * @brief Stops capturing queries, the captured workload stays available.
+         */
+        void stopWorkloadCapture();
+
+        /**
+         * @brief Gets the captured workload.
+         */
+        const QueryWorkload& getWorkload() const { return m_workload; }
+
+        /**
+         * @brief Starts an online backup of the database to the given path.
+         *
+         * The backup runs on a worker thread and copies a few pages per step using sqlite3_backup_step().
+         * The source database is only locked while a step is copied, writers can continue between the steps.
+         * Progress is reported through the backupProgress() signal and the optional callback,
+         * the end through the backupFinished() signal.
+         * A backup file which did not exist before gets removed if the backup fails or gets canceled.
+         * In the in-memory hot copy mode, a reload of the copy cancels the running backup.
+         *
+         * @param path The path of the backup file.
+         * @param pagesPerStep The number of pages copied per step. -1 copies everything in one step.
+         * @param pauseBetweenSteps The time the worker pauses between two steps to let writers through.
+         * @param progressCallback Optional, called from the worker thread after each step.
+         *
+         * @return True if the backup was started, false if the database is not open or a backup is already running.
+         */
+        bool backupTo(const std::string& path, int pagesPerStep = 100,
+                      std::chrono::milliseconds pauseBetweenSteps = std::chrono::milliseconds(10),
+                      const std::function<void(int remainingPages, int totalPages)>& progressCallback = nullptr);
+
+        /**
+         * @brief Cancels a running backup. Does not wait for the worker to stop.
+         */
+        void cancelBackup();
+
+        /**
+         * @brief Checks if a backup is currently running.
+         */
+        bool isBackupRunning() const { return m_backupRunning.load(); }
+
+        /**
+         * @brief Blocks until the running backup is finished.
+         */
+        void waitForBackup();
+
+        /**
+         * @brief Enables the in-memory hot copy mode. Must be set before open() is called.
+         *
+         * In this mode open() loads the whole database file into an in-memory database
+         * and all queries are answered from RAM. The connection is read only.
+         * When the file gets changed by another process, a new copy is loaded in the background
+         * and swapped in atomically, afterwards onDBChanged() is emitted.
+         * open() enables the change detection, the copy follows the file also without a receiver of onDBChanged().
+         * Meant for read-mostly reference databases, the file stays the source of truth.
+         *
+         * @param enable True to enable the hot copy mode.
+         */
+        void setInMemoryHotCopy(bool enable);
+
+        /**
+         * @brief Checks if the in-memory hot copy mode is enabled.
+         */
+        bool isInMemoryHotCopy() const { return m_inMemoryHotCopy; }
+
+        /**
+         * @brief Creates a memory image of the database.
+         *
+         * If the database was loaded by deserialize(), the image borrows the memory of the connection
+         * without copying it (SQLITE_SERIALIZE_NOCOPY). A borrowed image is only valid until the
+         * database gets modified or closed. Otherwise the image is a copy owned by the caller.
+         *
+         * @param schema The schema to serialize.
+         *
+         * @return The image, empty on failure.
+         */
+        SerializedDatabase serialize(const std::string& schema = "main");
+
+        /**
+         * @brief Replaces the content of the open database by the given image.
+         *
+         * The connection takes the ownership of an owned image without copying it.
+         * A borrowed image gets copied first. The database file is not modified,
+         * the connection works on the image in memory afterwards.
+         *
+         * @param image The image to load. It is empty after the call.
+         * @param readOnly If true, the image can't be modified.
+         *
+         * @return True if the image was loaded, false otherwise.
+         */
+        bool deserialize(SerializedDatabase&& image, bool readOnly);
+
+        /**
+         * @brief Enables the row change notifications of this connection.
+         *
+         * Row changes made through this connection are collected and delivered per commit
+         * through the onRowsChanged() signal and the row change callback.
+         * Changes of rolled back transactions are discarded.
+         * Changes made by other connections are not reported, use onDBChanged() for those.
+         * The update hook of SQLite does not fire for changes of WITHOUT ROWID tables and for
+         * "DELETE FROM t" without WHERE clause (truncate optimization), such changes are not reported.
+         *
+         * @param enable True to enable the notifications.
+         */
+        void setRowChangeNotificationsEnabled(bool enable);
+
+        /**
+         * @brief Checks if the row change notifications are enabled.
+         */
+        bool isRowChangeNotificationsEnabled() const { return m_rowChangeNotifications; }
+
+        /**
+         * @brief Sets a callback which receives the changed rows of each commit.
+         *
+         * The callback is called before the onRowsChanged() signal is emitted.
+         *
+         * @param callback The callback, nullptr to remove it.
+         */
+        void setRowChangeCallback(const std::function<void(const std::vector<RowChange>& changes)>& callback);
+
+        /**
+         * @brief Sets how changes of the database file by other processes are detected.
+         *
+         * The default is FileChangeWatcher::Mode::changeCounter, which only reads the file change counter
+         * of the database header and the WAL index, independent of the database size.
+         * FileChangeWatcher::Mode::dataVersion polls "PRAGMA data_version" on the open connection instead,
+         * it only reports commits of other connections and is not available in the in-memory hot copy mode.
+         *
+         * @param mode The detection mode.
+         */
+        void setChangeDetectionMode(FileChangeWatcher::Mode mode);
+
+        /**
+         * @brief Gets the current change detection mode.
+         */
+        FileChangeWatcher::Mode getChangeDetectionMode() const { return m_changeDetectionMode; }
+
+        /**
+         * @brief Starts or stops watching the database file for changes by other processes.
+         *
+         * The watcher is not created by the constructor, it starts when the first receiver
+         * connects to onDBChanged or tablesChanged, or when enabled explicitly.
+         *
+         * @param enable True to start the watcher, false to stop it.
+         */
+        void setChangeDetectionEnabled(bool enable);
+
+        /**
+         * @brief Checks if the database file is watched for changes.
+         */
+        bool isChangeDetectionEnabled() const { return m_watcher != nullptr || m_changeChannelListening; }
+
+        /**
+         * @brief Uses the shared memory ChangeChannel for the change notifications between processes.
+         *
+         * The commits of this connection are published to the channel together with the changed tables.
+         * While the change detection is enabled, onDBChanged and tablesChanged are driven by the
+         * commits other processes publish, instead of the file watcher. Writes of programs which
+         * do not publish to the channel are not detected.
+         *
+         * Call it in the thread of this object, it restarts the change detection.
+         *
+         * @param enable True to use the channel.
+         *
+         * @return False if the channel is not available (only on Linux), the file watcher stays in use.
+         */
+        bool setChangeChannelEnabled(bool enable);
+
+        /**
+         * @brief Checks if the commits are published to the shared memory channel.
+         */
+        bool isChangeChannelEnabled() const { return m_changeChannel != nullptr; }
+
+        /**
+         * @brief Sets how bursts of external changes are merged into fewer onDBChanged signals.
+         *
+         * A bulk write of another process can be detected many times in quick succession.
+         * With a debounce window, the changes of such a burst are emitted once at its start and/or end,
+         * maxWait and maxEventsPerSecond bound the latency and the rate of the signals during long bursts.
+         *
+         * @param policy The debounce policy, the default policy emits every detected change.
+         */
+        void setChangeDebouncePolicy(const FileChangeWatcher::DebouncePolicy& policy);
+
+        /**
+         * @brief Gets the current debounce policy of the change detection.
+         */
+        const FileChangeWatcher::DebouncePolicy& getChangeDebouncePolicy() const { return m_changeDebouncePolicy; }
+
+        /**
+         * @brief Reads "PRAGMA data_version" of the connection.
+         *
+         * The value changes whenever another connection commits a change to the database.
+         *
+         * @return The data version or -1 if the database is not open.
+         */
+        long long getDataVersion();
+
+        /**
+         * @brief Enables the detection of the tables which changed with an external change.
+         *
+         * After each onDBChanged caused by a change of the database file, tablesChanged is emitted
+         * with the tables whose fingerprints differ. See TableChangeTracker for the available modes.
+         * The triggers mode installs its triggers when enabled and each time the database is opened.
+         * If open() can't install them, it logs a warning and falls back to the fingerprint mode.
+         * Leaving the triggers mode on an open connection removes the triggers from the database.
+         *
+         * @param mode The tracking mode.
+         *
+         * @return False if the triggers could not be installed or removed.
+         */
+        bool setTableChangeTracking(TableChangeTracker::Mode mode);
+
+        /**
+         * @brief Gets the current table change tracking mode.
+         */
+        TableChangeTracker::Mode getTableChangeTracking() const { return m_tableChangeTracker.getMode(); }
+
+        /**
+         * @brief Gets the table change tracker, e.g. to change the sample size.
+         */
+        TableChangeTracker& getTableChangeTracker() { return m_tableChangeTracker; }
+
     signals:
         void onDBChanged();
 
+        /**
+         * @brief Emitted after onDBChanged with the number of detected file changes merged into it.
+         *
+         * Larger than 1 if the debounce policy merged a burst of changes, see setChangeDebouncePolicy().
+         * In the in-memory hot copy mode it is emitted when the reload of the copy starts.
+         */
+        void onDBChangesCoalesced(unsigned int count);
+
+        /**
+         * @brief Emitted after onDBChanged with the tables which differ from the last check.
+         *
+         * Only emitted if the table change tracking is enabled and at least one table changed.
+         */
+        void tablesChanged(const QStringList& tables);
+
+        /**
+         * @brief Emitted after a commit with the rows changed by this connection.
+         *
+         * Only emitted if the row change notifications are enabled.
+         */
+        void onRowsChanged(const std::vector<SQLite::RowChange>& changes);
+
+        /**
+         * @brief Emitted from the backup worker thread after each backup step.
+         */
+        void backupProgress(int remainingPages, int totalPages);
+
+        /**
+         * @brief Emitted in the thread of this object when the backup has ended.
+         *
+         * @param success False if the backup failed or was canceled.
+         */
+        void backupFinished(bool success);
+
+    protected:
+        /**
+         * @brief Starts the change detection when the first receiver connects to onDBChanged, onDBChangesCoalesced or tablesChanged.
+         */
+        void connectNotify(const QMetaMethod& signal) override;
+
     private slots:
         /**
          * @brief Slot for handling database file changes.
@@ -182,7 +675,24 @@ namespace SQLiteWrapper
          */
         void onDBFileChanged(const std::string& path);
 
+        /**
+         * @brief Joins the reload worker and swaps in the hot copy it loaded.
+         *
+         * A running backup gets canceled first, it reads from the replaced handle.
+         */
+        void applyHotCopyReload();
+
+        /**
+         * @brief Handles the commits published to the change channel by other processes.
+         */
+        void onChannelCommit();
+
     private:
+        /**
+         * @brief True if the call has to be passed to the strand of the thread-safe mode.
+         */
+        bool needsStrand() const { return m_threadSafe.load(std::memory_order_relaxed) && !m_strand.isRunningInThisThread(); }
+
         /**
          * @brief Handles SQLite logError codes and logs any issues.
          *
@@ -192,13 +702,186 @@ namespace SQLiteWrapper
          */
         int handleSQLiteError(int rc);
 
-	
+        /**
+         * @brief Closes the current handle and uses the given one, under the lock interrupt() takes.
+         *
+         * @return The result of sqlite3_close, the handle is kept if it failed.
+         */
+        int replaceHandle(sqlite3* db);
+
+        /**
+         * @brief Records the execution of a statement in the workload and the slow query log.
+         *
+         * Must be called before the statement gets finalized, the counters are read from it.
+         *
+         * @param stmt The executed statement or nullptr if no statement is available (sqlite3_exec).
+         * @param query The SQL query.
+         * @param params The bound parameters.
+         * @param start The time the execution started.
+         */
+        void recordExecution(sqlite3_stmt* stmt, const std::string& query, const std::vector<std::string>& params, std::chrono::steady_clock::time_point start);
+
+        /**
+         * @brief Runs the query and appends its rows to the results, shared by both fetchAll() variants.
+         *
+         * @return False if preparing, stepping or finalizing the statement failed, the rows before the error are kept.
+         */
+        bool fetchRows(const std::string& query, std::vector<std::vector<std::string>>& results);
+
+        /**
+         * @brief Records the statement in the slow query log if it took longer than the threshold.
+         */
+        void checkSlowQuery(sqlite3_stmt* stmt, const std::string& query, const std::vector<std::string>& params, std::chrono::microseconds duration);
+
+        /**
+         * @brief Captures the query plans of the pending slow queries and stores them in the log.
+         */
+        void processPendingSlowQueries();
+
+        /**
+         * @brief Inspects the query plan of the query if it was not inspected before.
+         *
+         * @param query The SQL query.
+         */
+        void lintQueryPlan(const std::string& query);
+
+        /**
+         * @brief Runs the backup steps, executed on the backup worker thread.
+         */
+        void backupWorker(const std::string& path, int pagesPerStep, std::chrono::milliseconds pauseBetweenSteps,
+                          const std::function<void(int remainingPages, int totalPages)>& progressCallback);
+
+        /**
+         * @brief Installs the progress handler which enforces the budget until endBudget() is called.
+         */
+        void beginBudget(const ExecutionBudget& budget);
+
+        /**
+         * @brief Removes the progress handler and finds out why a failed call was stopped.
+         */
+        ExecutionStatus endBudget(bool success);
+
+        static int progressHandler(void* context);
+
+        /**
+         * @brief Enables the change detection in the thread of this object.
+         */
+        void startChangeDetection();
+
+        /**
+         * @brief Logs a message of a worker thread in the thread of this object.
+         */
+        void postLog(Log::Level level, const std::string& message);
+
+        /**
+         * @brief Registers or removes the update, commit and rollback hooks on the connection.
+         */
+        void installHooks();
+
+        static void updateHook(void* context, int operation, const char* database, const char* table, sqlite3_int64 rowid);
+        static int commitHook(void* context);
+        static void rollbackHook(void* context);
+
+        /**
+         * @brief Runs the function in the thread of this object, directly if the caller already runs there.
+         *
+         * Used for the signals, a call on the strand can run in the thread of another caller.
+         */
+        void postToObjectThread(std::function<void()> function);
+
+        /**
+         * @brief Emits tablesChanged with the tables which changed since the last check.
+         *
+         * Only called on the strand, from the change notification slots and the hot copy reload.
+         */
+        void emitChangedTables();
+
+        /**
+         * @brief Delivers the committed row changes to the subscribers and publishes the commits to the change channel.
+         *
+         * Called after a statement has finished, the hooks are not allowed to use the connection.
+         */
+        void deliverRowChanges();
+
+        /**
+         * @brief Publishes the commits since the last call to the change channel.
+         */
+        void publishCommit();
+
+        /**
+         * @brief Loads the database file into a new read only in-memory database.
+         *
+         * Retries within the timeout of the busy handler policy while the file is locked.
+         * Called on the reload worker thread.
+         *
+         * @return The in-memory database or nullptr on failure.
+         */
+        sqlite3* loadHotCopy();
+
+        /**
+         * @brief Starts the worker which loads a new hot copy in the background.
+         *
+         * The worker always posts applyHotCopyReload(), which joins it, also if the load failed.
+         * Called in another thread, the start is posted to the thread of this object.
+         */
+        void startHotCopyReload();
+
+        /**
+         * @brief Joins the reload worker and discards a hot copy which was not yet swapped in.
+         */
+        void stopHotCopyReload();
 
 
         const std::string m_dbPath; ///< Path to the SQLite database file.
         sqlite3* m_db; ///< SQLite database connection.
+        std::mutex m_handleMutex; ///< Held by interrupt() and while m_db gets replaced or closed.
         Log::LogObject m_logger; ///< Logger for logError handling.
-		FileChangeWatcher m_watcher; ///< File change watcher for database file changes.
+        BusyHandler m_busyHandler; ///< Retries statements blocked by the locks of other connections.
+        bool m_readOnly = false; ///< Open the connection with SQLITE_OPEN_READONLY.
+
+        std::atomic<const ExecutionBudget*> m_activeBudget; ///< Budget of the running call, checked by the progress handler.
+        ExecutionStatus m_budgetStop = ExecutionStatus::succeeded; ///< Why the progress handler stopped the statement.
+        std::atomic<bool> m_interruptRequested; ///< interrupt() was called during the running call.
+        int m_progressCheckInterval = 1000; ///< Virtual machine instructions between two budget checks.
+        FileChangeWatcher* m_watcher = nullptr; ///< File change watcher, created when the change detection gets enabled.
+        FileChangeWatcher::Mode m_changeDetectionMode = FileChangeWatcher::Mode::changeCounter; ///< Mode of the watcher.
+        FileChangeWatcher::DebouncePolicy m_changeDebouncePolicy; ///< Debounce policy of the watcher.
+
+        SlowQueryLog m_slowQueryLog; ///< Ring of statements that exceeded the slow query threshold.
+        std::vector<SlowQueryLog::Entry> m_pendingSlowQueries; ///< Slow queries waiting for their query plan.
+        QueryPlanLinter m_queryPlanLinter; ///< Cached query plan inspections.
+        QueryWorkload m_workload; ///< Captured queries for the index advisor.
+        ConnectionMetrics m_metrics; ///< Statement counters per query fingerprint.
+
+        std::thread* m_backupThread = nullptr; ///< Worker of the running online backup.
+        std::atomic<bool> m_backupRunning; ///< True while the backup worker is copying.
+        std::atomic<bool> m_backupCancel; ///< Set to stop the backup worker.
+
+        bool m_inMemoryHotCopy = false; ///< Serve all queries from an in-memory copy of the file.
+        std::thread* m_reloadThread = nullptr; ///< Worker loading a new hot copy.
+        std::atomic<sqlite3*> m_reloadedDb; ///< Hot copy loaded by the worker, waiting to be swapped in.
+        bool m_reloadPending = false; ///< The file changed again while a reload was running.
+
+        bool m_rowChangeNotifications = false; ///< True if the update, commit and rollback hooks are installed.
+        std::vector<RowChange> m_uncommittedRowChanges; ///< Changes of the running transaction.
+        std::vector<RowChange> m_committedRowChanges; ///< Committed changes waiting for delivery.
+        std::function<void(const std::vector<RowChange>& changes)> m_rowChangeCallback; ///< Receives the committed changes.
+
+        TableChangeTracker m_tableChangeTracker; ///< Per table fingerprints for tablesChanged.
+
+        ChangeChannel* m_changeChannel = nullptr; ///< Shared memory channel for the commits of all processes.
+        bool m_changeChannelListening = false; ///< The change detection listens on the channel instead of the watcher.
+        std::atomic<bool> m_channelCommitPending; ///< A commit notification of the listener thread is queued.
+        uint64_t m_channelSequence = 0; ///< Last commit sequence handled or published by this connection.
+        bool m_channelCommitted = false; ///< A transaction was committed since the last publish.
+        std::set<std::string> m_uncommittedTables; ///< Tables changed by the running transaction.
+        std::set<std::string> m_committedTables; ///< Tables of the commits waiting to be published.
+
+        std::atomic<bool> m_threadSafe; ///< Calls are serialized on m_strand.
+        Strand m_strand; ///< Serializes the calls of all threads in the thread-safe mode.
     };
 
-}
\ No newline at end of file
+}
+
+Q_DECLARE_METATYPE(SQLiteWrapper::SQLite::RowChange)
+Q_DECLARE_METATYPE(std::vector<SQLiteWrapper::SQLite::RowChange>)
\ No newline at end of file
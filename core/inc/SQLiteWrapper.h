@@ -8,4 +8,10 @@
 
 /// USER_SECTION_START 2
 #include "SQLite.h"
+#include "IndexAdvisor.h"
+#include "BlobStream.h"
+#include "WriterElection.h"
+#include "WriteForwardServer.h"
+#include "WriteForwardClient.h"
+#include "MetricsExporter.h"
 /// USER_SECTION_END
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "sqlite3.h"
+#include <cstddef>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Memory image of a database, as created by sqlite3_serialize().
+	 *
+	 * The image either owns its buffer, which was allocated by sqlite3_malloc64(),
+	 * or borrows it from the connection which serialized it.
+	 * A borrowed image stays valid until the connection modifies or closes the database.
+	 * Owned images can be passed to SQLite::deserialize() without being copied.
+	 */
+	class SQLITE_WRAPPER_EXPORT SerializedDatabase
+	{
+		friend class SQLite;
+	public:
+		SerializedDatabase();
+		SerializedDatabase(SerializedDatabase&& other) noexcept;
+		SerializedDatabase(const SerializedDatabase&) = delete;
+		~SerializedDatabase();
+
+		SerializedDatabase& operator=(SerializedDatabase&& other) noexcept;
+		SerializedDatabase& operator=(const SerializedDatabase&) = delete;
+
+		/**
+		 * @brief Creates an owned image by copying the given bytes.
+		 */
+		static SerializedDatabase fromBytes(const void* data, size_t size);
+
+		const unsigned char* data() const { return m_data; }
+		size_t size() const { return static_cast<size_t>(m_size); }
+		bool isEmpty() const { return m_data == nullptr || m_size == 0; }
+
+		/**
+		 * @brief Checks if the buffer is owned by the connection which serialized it.
+		 */
+		bool isBorrowed() const { return m_data != nullptr && !m_owned; }
+
+		/**
+		 * @brief Creates an owned copy of the image.
+		 */
+		SerializedDatabase copy() const;
+
+	private:
+		SerializedDatabase(unsigned char* data, sqlite3_int64 size, bool owned);
+
+		/**
+		 * @brief Gives up the ownership of the buffer, the caller has to free it with sqlite3_free().
+		 */
+		unsigned char* release();
+		void reset();
+
+		unsigned char* m_data;
+		sqlite3_int64 m_size;
+		bool m_owned;
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Bounded in-memory ring of statements that exceeded the slow query threshold.
+	 *
+	 * The ring never grows beyond its capacity, the oldest entry gets overwritten.
+	 * Writing to the logger is rate limited separately, so a burst of slow queries
+	 * can not turn the log itself into a hotspot.
+	 */
+	class SQLITE_WRAPPER_EXPORT SlowQueryLog
+	{
+	public:
+		struct Entry
+		{
+			std::string query;
+			std::vector<std::string> params;
+			std::vector<std::string> queryPlan; ///< Detail lines of "EXPLAIN QUERY PLAN"
+			std::chrono::microseconds duration;
+			std::chrono::system_clock::time_point timestamp;
+
+			// sqlite3_stmt_status counters, -1 if not available (e.g. for sqlite3_exec)
+			int fullscanSteps = -1;
+			int sorts = -1;
+			int autoIndexes = -1;
+			int vmSteps = -1;
+
+			std::string toString() const;
+		};
+
+		SlowQueryLog(size_t capacity = 64);
+
+		/**
+		 * @brief Sets the duration after which a statement is recorded.
+		 * A threshold of 0 disables the slow query log.
+		 */
+		void setThreshold(std::chrono::microseconds threshold);
+		std::chrono::microseconds getThreshold() const { return m_threshold.load(); }
+		bool isEnabled() const { return m_threshold.load().count() > 0; }
+
+		void setCapacity(size_t capacity);
+		size_t getCapacity() const;
+
+		/**
+		 * @brief Limits how many entries per second are written to the logger.
+		 * Entries are always stored in the ring, only the logging gets suppressed.
+		 */
+		void setMaxLogsPerSecond(unsigned int maxLogsPerSecond);
+		unsigned int getMaxLogsPerSecond() const;
+
+		/**
+		 * @brief Stores the entry in the ring.
+		 * @return true if the entry may be written to the logger, false if rate limited
+		 */
+		bool add(Entry&& entry);
+
+		/**
+		 * @brief Returns the stored entries, oldest first.
+		 */
+		std::vector<Entry> getEntries() const;
+		size_t getSuppressedLogCount() const;
+		void clear();
+
+	private:
+		bool tryAcquireLogSlot();
+
+		mutable std::mutex m_mutex;
+		std::vector<Entry> m_ring;
+		size_t m_capacity;
+		size_t m_next;
+
+		std::atomic<std::chrono::microseconds> m_threshold; // read for every statement, without the mutex
+		unsigned int m_maxLogsPerSecond;
+		std::chrono::steady_clock::time_point m_logWindowStart;
+		unsigned int m_logsInWindow;
+		size_t m_suppressedLogs;
+	};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Runs calls from any thread one after another, in the order they claim the strand.
+	 *
+	 * The strand has no thread of its own. A call on an idle strand claims it with a single
+	 * compare-and-swap and runs inline in the calling thread, without taking a lock.
+	 * A call on a busy strand is queued and the caller waits on a future, the thread holding
+	 * the strand runs the queued calls before it releases it. Calls made from within a running
+	 * call run inline, so a serialized function may use the serialized API again.
+	 *
+	 * A holder runs at most maxQueuedCallsPerRelease queued calls of other threads. After that
+	 * it hands the strand over to the caller of the next queued call, which runs its call itself
+	 * and continues with the queue. A busy strand therefore never keeps one thread away from
+	 * its own work for longer than this many calls.
+	 */
+	class SQLITE_WRAPPER_EXPORT Strand
+	{
+	public:
+		Strand();
+		Strand(const Strand&) = delete;
+		Strand& operator=(const Strand&) = delete;
+
+		/// Queued calls one release runs before the strand is handed over
+		static constexpr size_t maxQueuedCallsPerRelease = 32;
+
+		/**
+		 * @brief Runs the function on the strand and returns its result.
+		 * Exceptions of the function are rethrown in the calling thread.
+		 */
+		template<typename Function>
+		auto dispatch(Function&& function) -> decltype(function())
+		{
+			typedef decltype(function()) Result;
+			if (isRunningInThisThread())
+				return function();
+
+			size_t idle = 0;
+			if (m_pending.compare_exchange_strong(idle, 1, std::memory_order_acq_rel))
+			{
+				m_runningThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+				Release release(*this);
+				return function();
+			}
+
+			// std::function needs a copyable target
+			std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+			std::future<Result> result = task->get_future();
+			std::shared_ptr<QueuedCall> call = std::make_shared<QueuedCall>();
+			call->run = [task]() { (*task)(); };
+			enqueue(call);
+			return result.get();
+		}
+
+		/**
+		 * @brief True while the calling thread holds the strand.
+		 */
+		bool isRunningInThisThread() const
+		{
+			return m_runningThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+		}
+
+	private:
+		// Releases the strand when the inline call returns or throws
+		struct Release
+		{
+			Strand& strand;
+			explicit Release(Strand& s) : strand(s) {}
+			~Release() { strand.release(); }
+		};
+
+		// A queued call, run by the strand holder or handed over to its own caller
+		struct QueuedCall
+		{
+			std::function<void()> run;
+			std::mutex mutex;
+			std::condition_variable stateChanged;
+			bool finished = false;
+			bool handedOver = false;
+		};
+
+		void enqueue(const std::shared_ptr<QueuedCall>& call);
+		void wait(QueuedCall& call);
+		void runQueued(QueuedCall& call);
+		std::shared_ptr<QueuedCall> popQueued();
+		void release();
+
+		// Calls holding or waiting for the strand, the call which raises it from 0 holds it
+		std::atomic<size_t> m_pending;
+		std::atomic<std::thread::id> m_runningThread;
+		std::mutex m_queueMutex;
+		std::deque<std::shared_ptr<QueuedCall>> m_queue;
+	};
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "sqlite3.h"
+#include <string>
+#include <vector>
+#include <map>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Keeps a fingerprint per table to find the tables which differ after an external change.
+	 *
+	 * Two ways to fingerprint a table are available:
+	 *  - fingerprint: count(*), max(rowid) and a hash of the first and last rows (sampleSize each).
+	 *    Nothing is written to the database. The cost grows with the number of tables and count(*)
+	 *    has to read the smallest index of each table. A change to a row in the middle of a table
+	 *    which does not change the count is not detected.
+	 *  - triggers: AFTER INSERT, UPDATE and DELETE triggers on each table increment a counter
+	 *    in the table _sqlw_table_changes. Reading all fingerprints is a single query,
+	 *    but the triggers are stored in the database and each changed row costs an extra update.
+	 *    Tables created later get their triggers the next time installTriggers() is called.
+	 *    Virtual tables can't have triggers, they are sampled like in the fingerprint mode
+	 *    and their shadow tables are skipped.
+	 *    The triggers stay in the database until removeTriggers() is called, also for other programs
+	 *    writing to it.
+	 *
+	 * In both modes, created, dropped and altered tables are reported as changed.
+	 */
+	class SQLITE_WRAPPER_EXPORT TableChangeTracker
+	{
+	public:
+		enum Mode
+		{
+			disabled,
+			fingerprint,
+			triggers
+		};
+
+		static const char* const changeCounterTable;
+
+		TableChangeTracker();
+
+		/**
+		 * @brief Sets the mode, the database is not changed. Triggers of the triggers mode stay installed, see removeTriggers().
+		 */
+		void setMode(Mode mode);
+		Mode getMode() const { return m_mode; }
+		bool isEnabled() const { return m_mode != Mode::disabled; }
+
+		/**
+		 * @brief Number of rows hashed at the start and at the end of a table in the fingerprint mode.
+		 */
+		void setSampleSize(int rows);
+		int getSampleSize() const { return m_sampleSize; }
+
+		/**
+		 * @brief Creates the change counter table and the triggers for all tables which do not have them yet.
+		 */
+		bool installTriggers(sqlite3* db);
+
+		/**
+		 * @brief Drops the triggers and the change counter table created by installTriggers().
+		 *
+		 * Other connections using the triggers mode on the same database lose their counters as well.
+		 */
+		bool removeTriggers(sqlite3* db);
+
+		/**
+		 * @brief Stores the current fingerprints as reference for the next update().
+		 */
+		void snapshot(sqlite3* db);
+
+		/**
+		 * @brief Compares the current fingerprints with the stored ones and stores the current ones.
+		 * @return The names of the tables which have changed, sorted by name.
+		 *         Empty if no snapshot was taken before, the snapshot is taken instead.
+		 */
+		std::vector<std::string> update(sqlite3* db);
+
+		void clear();
+
+	private:
+		struct Table
+		{
+			enum class Kind
+			{
+				ordinary,
+				virtualTable,
+				shadow
+			};
+
+			std::string name;
+			std::string sql;
+			Kind kind;
+		};
+
+		std::vector<Table> getTables(sqlite3* db) const;
+		std::map<std::string, std::string> calculateFingerprints(sqlite3* db) const;
+		std::string calculateSampledFingerprint(sqlite3* db, const Table& table) const;
+
+		Mode m_mode;
+		int m_sampleSize;
+		bool m_hasSnapshot;
+		std::map<std::string, std::string> m_fingerprints;
+	};
+}
@@ -2,12 +2,14 @@
 
 #include "SQLiteWrapper_base.h"
 #include <string>
+#include <cctype>
 
 
 namespace SQLiteWrapper
 {
 	namespace Utilities
 	{
+#ifdef _WIN32
 		inline std::string getLastErrorString(DWORD error)
 		{
 			std::string errorString;
@@ -24,5 +26,104 @@ namespace SQLiteWrapper
 			LocalFree(messageBuffer);
 			return errorString;
 		}
+#endif
+
+		/**
+		 * @brief Creates a fingerprint of a SQL query.
+		 * Literals are replaced by '?', whitespace is collapsed and keywords are lower cased,
+		 * so that queries that only differ in their values share the same fingerprint.
+		 */
+		inline std::string getQueryFingerprint(const std::string& query)
+		{
+			std::string fingerprint;
+			fingerprint.reserve(query.size());
+			bool pendingSpace = false;
+			for (size_t i = 0; i < query.size(); ++i)
+			{
+				char c = query[i];
+				if (std::isspace(static_cast<unsigned char>(c)))
+				{
+					pendingSpace = !fingerprint.empty();
+					continue;
+				}
+				if (pendingSpace)
+				{
+					fingerprint += ' ';
+					pendingSpace = false;
+				}
+				if (c == '\'')
+				{
+					// String literal, '' is an escaped quote
+					++i;
+					while (i < query.size())
+					{
+						if (query[i] == '\'')
+						{
+							if (i + 1 < query.size() && query[i + 1] == '\'')
+								++i;
+							else
+								break;
+						}
+						++i;
+					}
+					fingerprint += '?';
+					continue;
+				}
+				if (c == '"' || c == '`' || c == '[')
+				{
+					// Quoted identifier, keep it as it is
+					char end = c == '[' ? ']' : c;
+					size_t endPos = query.find(end, i + 1);
+					if (endPos == std::string::npos)
+						endPos = query.size() - 1;
+					fingerprint += query.substr(i, endPos - i + 1);
+					i = endPos;
+					continue;
+				}
+				bool previousIsWordChar = i > 0 && (std::isalnum(static_cast<unsigned char>(query[i - 1])) || query[i - 1] == '_');
+				if (std::isdigit(static_cast<unsigned char>(c)) && !previousIsWordChar)
+				{
+					// Numeric literal
+					while (i + 1 < query.size() && (std::isalnum(static_cast<unsigned char>(query[i + 1])) || query[i + 1] == '.'))
+						++i;
+					fingerprint += '?';
+					continue;
+				}
+				fingerprint += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			}
+			while (!fingerprint.empty() && (fingerprint.back() == ';' || fingerprint.back() == ' '))
+				fingerprint.pop_back();
+			return fingerprint;
+		}
+
+		/**
+		 * @brief Quotes a table or column name for the use in a SQL statement.
+		 */
+		inline std::string quoteIdentifier(const std::string& name)
+		{
+			std::string quoted = "\"";
+			for (char c : name)
+			{
+				if (c == '"')
+					quoted += '"';
+				quoted += c;
+			}
+			return quoted + "\"";
+		}
+
+		/**
+		 * @brief Quotes a string as SQL string literal.
+		 */
+		inline std::string quoteLiteral(const std::string& text)
+		{
+			std::string quoted = "'";
+			for (char c : text)
+			{
+				if (c == '\'')
+					quoted += '\'';
+				quoted += c;
+			}
+			return quoted + "'";
+		}
 	}
 }
\ No newline at end of file
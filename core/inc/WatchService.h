@@ -0,0 +1,111 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <functional>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Process wide service which watches many database files with a single thread.
+	 *
+	 * On Linux the thread waits on one inotify descriptor for all watched directories,
+	 * on other platforms it polls the files, each one in its own interval.
+	 * A change is confirmed by comparing FileChangeWatcher::readChangeCounter(), so only commits are reported.
+	 * Registrations of the same path share one watch and are reference counted.
+	 *
+	 * The callbacks are called from the service thread and must not block.
+	 * After remove() returned, the callback of the registration is not called anymore.
+	 */
+	class SQLITE_WRAPPER_EXPORT WatchService
+	{
+	public:
+		typedef unsigned long long Id;
+		typedef std::function<void(const std::string& path)> Callback;
+
+		static WatchService& instance();
+
+		WatchService(const WatchService&) = delete;
+		WatchService& operator=(const WatchService&) = delete;
+
+		/**
+		 * @brief Registers a callback for changes of the file.
+		 * @param pollingInterval Interval in which the file is checked, if it can not be watched by inotify.
+		 *        If the same path is registered multiple times, the shortest interval is used.
+		 * @return The id of the registration, 0 on failure
+		 */
+		Id add(const std::string& path, const Callback& callback,
+			   std::chrono::milliseconds pollingInterval = std::chrono::milliseconds(50));
+		void remove(Id id);
+
+		size_t getRegistrationCount() const;
+		size_t getWatchedPathCount() const;
+
+	private:
+		WatchService();
+		~WatchService();
+
+		struct Registration
+		{
+			std::string path;
+			std::string watchedPath; ///< Normalized absolute path, key of m_paths
+			Callback callback;
+			std::chrono::milliseconds pollingInterval;
+		};
+		struct WatchedPath
+		{
+			std::string directory;
+			std::string fingerprint;
+			std::chrono::milliseconds pollingInterval;
+			std::chrono::steady_clock::time_point nextCheck;
+			size_t refCount = 0;
+			bool polled = true;   // false while the directory is watched by inotify
+			bool dirty = true;    // fingerprint has to be read in the next iteration
+			bool confirm = false; // check once more after nextCheck, the -shm file is written through mmap without inotify events
+		};
+
+		void startThread();
+		void stopThread();
+		void wakeUp();
+		void run();
+		void waitForEvents();
+		void updatePollingInterval(WatchedPath& watchedPath, const std::string& key);
+		std::chrono::steady_clock::time_point nextDeadline() const;
+		void checkPaths();
+
+		mutable std::mutex m_mutex;
+		std::mutex m_dispatchMutex;
+		std::condition_variable m_cv;
+		std::thread* m_thread = nullptr;
+		std::thread::id m_threadId;
+		std::atomic<bool> m_stopFlag;
+		bool m_wakeUp = false;
+
+		Id m_nextId = 1;
+		std::map<Id, Registration> m_registrations;
+		std::map<std::string, WatchedPath> m_paths;
+
+#ifdef __linux__
+		bool watchDirectory(const std::string& directory);
+		void unwatchDirectory(const std::string& directory);
+		void readInotifyEvents();
+
+		struct WatchedDirectory
+		{
+			int wd = -1;
+			size_t refCount = 0;
+		};
+		int m_inotifyFd = -1;
+		int m_wakeupFd = -1;
+		int m_epollFd = -1;
+		std::map<std::string, WatchedDirectory> m_directories;
+		std::map<int, std::string> m_directoryByWd;
+#endif
+	};
+}
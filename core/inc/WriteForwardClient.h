@@ -0,0 +1,70 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "WriteForwardProtocol.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Forwards writes to the WriteForwardServer of the elected writer process.
+	 *
+	 * Requests are pipelined: submit() only buffers the request, flush() sends all buffered
+	 * requests and the acks are read afterwards in the order of the requests.
+	 * execute() is the round trip for a single request.
+	 *
+	 * A client is used by one thread at a time. Not available on Windows, connect() returns false.
+	 */
+	class SQLITE_WRAPPER_EXPORT WriteForwardClient
+	{
+	public:
+		using Value = WriteForwardProtocol::Value;
+		using Ack = WriteForwardProtocol::Ack;
+
+		WriteForwardClient(const std::string& socketPath);
+		~WriteForwardClient();
+
+		bool connect();
+		void disconnect();
+		bool isConnected() const { return m_fd >= 0; }
+
+		/**
+		 * @brief Buffers a request, the buffer gets flushed once it exceeds 64 KiB.
+		 * @return The id of the request, 0 if the client is not connected or the request has more than
+		 *         WriteForwardProtocol::maxParams parameters or does not fit into WriteForwardProtocol::maxFrameSize
+		 */
+		uint64_t submit(uint32_t statementId, const std::vector<Value>& params);
+
+		/**
+		 * @brief Sends all buffered requests.
+		 */
+		bool flush();
+
+		/**
+		 * @brief Blocks until the ack of the oldest unacknowledged request has arrived.
+		 * Flushes the buffered requests first.
+		 */
+		bool waitForAck(Ack& ack);
+
+		/**
+		 * @brief Submits the request and waits for its ack.
+		 * The acks of requests submitted before are discarded.
+		 */
+		bool execute(uint32_t statementId, const std::vector<Value>& params, Ack& ack);
+
+		size_t getPendingCount() const { return m_pendingAcks; }
+
+	private:
+		bool fail(const std::string& message);
+
+		const std::string m_socketPath;
+		int m_fd;
+		uint64_t m_nextRequestId;
+		size_t m_pendingAcks;
+		std::string m_output;
+		std::string m_input;
+		size_t m_inputPos;
+	};
+}
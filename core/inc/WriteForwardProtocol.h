@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Binary frames exchanged by the WriteForwardClient and the WriteForwardServer.
+	 *
+	 * Each frame is a 32 bit payload size followed by the payload.
+	 * Request payload: request id (u64), statement id (u32), parameter count (u16), parameters.
+	 * A parameter is a type byte followed by an i64, a double, or a u32 size and the bytes of a text or blob.
+	 * Ack payload: request id (u64), SQLite result code (i32), changed rows (i64), last insert rowid (i64).
+	 *
+	 * Both ends run on the same machine, all numbers are in the native byte order.
+	 */
+	class SQLITE_WRAPPER_EXPORT WriteForwardProtocol
+	{
+	public:
+		static constexpr uint32_t maxFrameSize = 16 * 1024 * 1024;
+		static constexpr size_t maxParams = 0xFFFF;
+
+		struct Value
+		{
+			enum Type : uint8_t
+			{
+				null,
+				integer,
+				real,
+				text,
+				blob
+			};
+			Type type = Type::null;
+			int64_t intValue = 0;
+			double realValue = 0;
+			std::string bytes; // text or blob
+
+			static Value fromInt(int64_t value);
+			static Value fromReal(double value);
+			static Value fromText(const std::string& value);
+			static Value fromBlob(const std::string& value);
+		};
+		struct Request
+		{
+			uint64_t id = 0;
+			uint32_t statementId = 0;
+			std::vector<Value> params;
+		};
+		struct Ack
+		{
+			uint64_t requestId = 0;
+			int32_t resultCode = 0; // SQLITE_OK if the statement was committed
+			int64_t changes = 0;
+			int64_t lastInsertRowId = 0;
+		};
+
+		/**
+		 * @brief Appends the frame to the buffer.
+		 * @return False if the request has more than maxParams parameters or exceeds maxFrameSize,
+		 *         nothing is appended then.
+		 */
+		static bool encodeRequest(const Request& request, std::string& buffer);
+		static void encodeAck(const Ack& ack, std::string& buffer);
+
+		/**
+		 * @brief Decodes the first frame of the data.
+		 * @return The size of the frame, 0 if the frame is not complete yet or malformed (error is set)
+		 */
+		static size_t decodeRequest(const char* data, size_t size, Request& request, bool& error);
+		static size_t decodeAck(const char* data, size_t size, Ack& ack, bool& error);
+	};
+}
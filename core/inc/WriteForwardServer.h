@@ -0,0 +1,124 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "WriteForwardProtocol.h"
+#include "BusyHandler.h"
+#include "sqlite3.h"
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+namespace SQLiteWrapper
+{
+	/**
+	 * @brief Executes the writes forwarded by WriteForwardClients on a Unix domain socket.
+	 *
+	 * Runs in the process elected as writer (see WriterElection) with its own connection and thread.
+	 * Clients refer to the statements by the ids registered with registerStatement().
+	 * All requests which have arrived while the previous batch was committed get executed
+	 * in one transaction (group commit), then each client gets the acks of its requests in order.
+	 * A failing statement only fails its own request, a failing commit fails the whole batch.
+	 * If SQLite rolls the transaction back after a failing statement, the requests executed before
+	 * it fail as well and the rest of the batch is executed in the next transaction.
+	 * A client is not read from while a complete frame of it is waiting or while it has not read
+	 * 1 MiB of acks, a fast or stuck client can not exhaust the memory of the writer.
+	 *
+	 * Not available on Windows, start() returns false.
+	 */
+	class SQLITE_WRAPPER_EXPORT WriteForwardServer
+	{
+	public:
+		struct Statistics
+		{
+			size_t requests = 0;        // executed requests
+			size_t failedRequests = 0;  // requests acknowledged with an error
+			size_t batches = 0;         // committed transactions
+			size_t maxBatchSize = 0;
+			size_t clients = 0;         // connected clients
+			std::chrono::microseconds totalCommitTime{ 0 }; // duration of the batches including the statements
+		};
+
+		WriteForwardServer(const std::string& dbPath, const std::string& socketPath);
+		~WriteForwardServer();
+
+		static std::string getDefaultSocketPath(const std::string& dbPath) { return dbPath + ".write.sock"; }
+		const std::string& getSocketPath() const { return m_socketPath; }
+
+		/**
+		 * @brief Registers the SQL of a statement id, before start() is called.
+		 */
+		void registerStatement(uint32_t statementId, const std::string& sql);
+
+		/**
+		 * @brief Limits the number of requests committed in one transaction.
+		 */
+		void setMaxBatchSize(size_t maxBatchSize);
+		size_t getMaxBatchSize() const { return m_maxBatchSize; }
+
+		BusyHandler& getBusyHandler() { return m_busyHandler; }
+
+		/**
+		 * @brief Opens the connection, prepares the statements and starts listening.
+		 */
+		bool start();
+		void stop();
+		bool isRunning() const { return m_running.load(); }
+
+		Statistics getStatistics() const;
+
+	private:
+		static constexpr size_t maxClientInput = WriteForwardProtocol::maxFrameSize + sizeof(uint32_t); // One complete frame
+		static constexpr size_t maxClientOutput = 1024 * 1024;
+
+		struct Client
+		{
+			int fd = -1;
+			std::string input;
+			std::string output;
+			bool closed = false;
+
+			// Backpressure, the client is read again once its buffers are drained
+			bool acceptsInput() const { return input.size() < maxClientInput && output.size() < maxClientOutput; }
+		};
+		struct PendingRequest
+		{
+			uint64_t clientId;
+			WriteForwardProtocol::Request request;
+		};
+
+		void serve();
+		void acceptClients();
+		void readClient(Client& client);
+		bool collectRequests();
+		void writeClient(Client& client);
+		void executeBatch();
+		int executeRequest(const WriteForwardProtocol::Request& request);
+		void closeClient(Client& client);
+		void cleanup();
+
+		const std::string m_dbPath;
+		const std::string m_socketPath;
+		std::map<uint32_t, std::string> m_statementSql;
+		std::map<uint32_t, sqlite3_stmt*> m_statements;
+		size_t m_maxBatchSize;
+
+		sqlite3* m_db;
+		BusyHandler m_busyHandler;
+		int m_listenFd;
+		int m_wakeupFds[2];
+		std::thread* m_thread;
+		std::atomic<bool> m_running;
+
+		// Owned by the server thread
+		std::map<uint64_t, Client> m_clients;
+		uint64_t m_nextClientId;
+		std::vector<PendingRequest> m_batch;
+
+		mutable std::mutex m_statisticsMutex;
+		Statistics m_statistics;
+	};
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "SQLiteWrapper_base.h"
+#include "LockFile.h"
+#include <string>
+#include <thread>
+#include <atomic>
+#include <QObject>
+
+namespace SQLiteWrapper
+{
+	class SQLite;
+
+	/**
+	 * @brief Elects a single writer among the processes using the same database.
+	 *
+	 * The process which holds the exclusive lock of the lock file is the leader,
+	 * all other processes are followers and block in LockFile::acquire() until they get the lock,
+	 * stop() cancels the wait.
+	 * The operating system releases the lock when the leader exits or crashes,
+	 * so one of the followers becomes the leader without any heartbeat.
+	 *
+	 * A database set with setDatabase() is opened read only as follower and
+	 * reopened read-write when the process becomes the leader.
+	 */
+	class SQLITE_WRAPPER_EXPORT WriterElection : public QObject
+	{
+		Q_OBJECT
+	public:
+		enum Role
+		{
+			none,     // not started
+			leader,
+			follower
+		};
+		Q_ENUM(Role)
+
+		/**
+		 * @param lockPath Path of the lock file, use getDefaultLockPath() to derive it from the database path.
+		 */
+		WriterElection(const std::string& lockPath, QObject* parent = nullptr);
+		~WriterElection();
+
+		static std::string getDefaultLockPath(const std::string& dbPath) { return dbPath + ".writer.lock"; }
+		const std::string& getLockPath() const { return m_lockFile.getPath(); }
+
+		/**
+		 * @brief Sets the connection whose open mode follows the role.
+		 * An open connection gets reopened on each role change, a closed one is only configured.
+		 */
+		void setDatabase(SQLite* db);
+
+		/**
+		 * @brief Joins the election, the role is known when the function returns.
+		 * @return false if the lock file could not be used
+		 */
+		bool start();
+
+		/**
+		 * @brief Leaves the election and hands the writer role over to a follower.
+		 */
+		void stop();
+
+		Role getRole() const { return m_role.load(); }
+		bool isLeader() const { return m_role.load() == Role::leader; }
+
+	signals:
+		void roleChanged(WriterElection::Role role);
+
+	private slots:
+		void onLeadershipAcquired();
+
+	private:
+		void waitForLeadership();
+		void applyRole(Role role);
+
+		LockFile m_lockFile;
+		SQLite* m_db;
+		std::atomic<Role> m_role;
+		std::thread* m_waitThread;
+		LockFile::CancelToken m_stopWaiting;
+	};
+}
@@ -0,0 +1,252 @@
+#include "BlobStream.h"
+#include "SQLite.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <climits>
+
+namespace SQLiteWrapper
+{
+	BlobStream::BlobStream(SQLite& db, const std::string& table, const std::string& column, sqlite3_int64 rowid,
+						   Mode mode, const std::string& schema)
+		: m_db(db.getDB())
+		, m_blob(nullptr)
+		, m_mode(mode)
+		, m_size(0)
+		, m_position(0)
+	{
+		if (!m_db)
+		{
+			Logger::logError("BlobStream: Database is not open");
+			return;
+		}
+		int rc = sqlite3_blob_open(m_db, schema.c_str(), table.c_str(), column.c_str(), rowid,
+								   mode == Mode::readWrite ? 1 : 0, &m_blob);
+		if (rc != SQLITE_OK)
+		{
+			Logger::logError("BlobStream: Opening " + table + "." + column + " rowid " + std::to_string(rowid) + ": " + sqlite3_errmsg(m_db));
+			sqlite3_blob_close(m_blob);
+			m_blob = nullptr;
+			return;
+		}
+		m_size = static_cast<size_t>(sqlite3_blob_bytes(m_blob));
+	}
+	BlobStream::~BlobStream()
+	{
+		close();
+	}
+
+	bool BlobStream::reopen(sqlite3_int64 rowid)
+	{
+		if (!m_blob)
+			return false;
+		if (sqlite3_blob_reopen(m_blob, rowid) != SQLITE_OK)
+		{
+			// The handle is aborted, it can only be closed
+			Logger::logError("BlobStream: Reopening rowid " + std::to_string(rowid) + ": " + sqlite3_errmsg(m_db));
+			close();
+			return false;
+		}
+		m_size = static_cast<size_t>(sqlite3_blob_bytes(m_blob));
+		m_position = 0;
+		return true;
+	}
+	void BlobStream::close()
+	{
+		if (!m_blob)
+			return;
+		sqlite3_blob_close(m_blob);
+		m_blob = nullptr;
+		m_size = 0;
+		m_position = 0;
+	}
+
+	bool BlobStream::seek(size_t position)
+	{
+		if (!m_blob || position > m_size)
+			return false;
+		m_position = position;
+		return true;
+	}
+
+	size_t BlobStream::read(void* buffer, size_t count)
+	{
+		if (!m_blob || atEnd())
+			return 0;
+		count = std::min(count, m_size - m_position);
+		if (sqlite3_blob_read(m_blob, buffer, static_cast<int>(count), static_cast<int>(m_position)) != SQLITE_OK)
+		{
+			Logger::logError("BlobStream: Reading: " + std::string(sqlite3_errmsg(m_db)));
+			return 0;
+		}
+		m_position += count;
+		return count;
+	}
+	size_t BlobStream::write(const void* data, size_t count)
+	{
+		if (!m_blob || m_mode != Mode::readWrite || atEnd())
+			return 0;
+		count = std::min(count, m_size - m_position);
+		if (sqlite3_blob_write(m_blob, data, static_cast<int>(count), static_cast<int>(m_position)) != SQLITE_OK)
+		{
+			Logger::logError("BlobStream: Writing: " + std::string(sqlite3_errmsg(m_db)));
+			return 0;
+		}
+		m_position += count;
+		return count;
+	}
+
+	bool BlobStream::allocate(SQLite& db, const std::string& table, const std::string& column,
+							  sqlite3_int64 rowid, size_t size)
+	{
+		sqlite3* sqlDb = db.getDB();
+		if (!sqlDb)
+			return false;
+		std::string query = "UPDATE " + Utilities::quoteIdentifier(table) + " SET " + Utilities::quoteIdentifier(column) + " = zeroblob(?) WHERE rowid = ?;";
+		sqlite3_stmt* stmt = nullptr;
+		if (sqlite3_prepare_v2(sqlDb, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("BlobStream: Allocating: " + std::string(sqlite3_errmsg(sqlDb)));
+			return false;
+		}
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(size));
+		sqlite3_bind_int64(stmt, 2, rowid);
+		int rc = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			Logger::logError("BlobStream: Allocating: " + std::string(sqlite3_errmsg(sqlDb)));
+			return false;
+		}
+		return sqlite3_changes(sqlDb) > 0;
+	}
+
+	sqlite3_int64 BlobStream::insertZeroBlob(SQLite& db, const std::string& table, const std::string& column, size_t size)
+	{
+		sqlite3* sqlDb = db.getDB();
+		if (!sqlDb)
+			return -1;
+		std::string query = "INSERT INTO " + Utilities::quoteIdentifier(table) + " (" + Utilities::quoteIdentifier(column) + ") VALUES (zeroblob(?));";
+		sqlite3_stmt* stmt = nullptr;
+		if (sqlite3_prepare_v2(sqlDb, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("BlobStream: Inserting: " + std::string(sqlite3_errmsg(sqlDb)));
+			return -1;
+		}
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(size));
+		int rc = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			Logger::logError("BlobStream: Inserting: " + std::string(sqlite3_errmsg(sqlDb)));
+			return -1;
+		}
+		return sqlite3_last_insert_rowid(sqlDb);
+	}
+
+
+
+	BlobStreamBuffer::BlobStreamBuffer(BlobStream& blob, size_t chunkSize)
+		: m_blob(blob)
+		, m_chunkSize(chunkSize > 0 ? chunkSize : 1)
+	{
+		setg(nullptr, nullptr, nullptr);
+		setp(nullptr, nullptr);
+	}
+	BlobStreamBuffer::~BlobStreamBuffer()
+	{
+		sync();
+	}
+
+	BlobStreamBuffer::int_type BlobStreamBuffer::underflow()
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		if (!flushPutArea())
+			return traits_type::eof();
+
+		if (m_getBuffer.empty())
+			m_getBuffer.resize(m_chunkSize);
+		size_t count = m_blob.read(m_getBuffer.data(), m_getBuffer.size());
+		if (count == 0)
+			return traits_type::eof();
+		setg(m_getBuffer.data(), m_getBuffer.data(), m_getBuffer.data() + count);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	BlobStreamBuffer::int_type BlobStreamBuffer::overflow(int_type ch)
+	{
+		if (!flushPutArea())
+			return traits_type::eof();
+		if (m_putBuffer.empty())
+			m_putBuffer.resize(m_chunkSize);
+		setp(m_putBuffer.data(), m_putBuffer.data() + m_putBuffer.size());
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	int BlobStreamBuffer::sync()
+	{
+		return flushPutArea() ? 0 : -1;
+	}
+
+	BlobStreamBuffer::pos_type BlobStreamBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		SQLW_UNUSED(which);
+		if (!flushPutArea())
+			return pos_type(off_type(-1));
+
+		// flushPutArea() has already moved the blob to the logical position
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = static_cast<off_type>(m_blob.tell());
+		else if (dir == std::ios_base::end)
+			base = static_cast<off_type>(m_blob.size());
+		off_type target = base + off;
+		if (target < 0 || !m_blob.seek(static_cast<size_t>(target)))
+			return pos_type(off_type(-1));
+		return pos_type(target);
+	}
+	BlobStreamBuffer::pos_type BlobStreamBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+	bool BlobStreamBuffer::flushPutArea()
+	{
+		// Drop the read ahead data, the blob has to be at the logical position
+		if (gptr() < egptr())
+			m_blob.seek(m_blob.tell() - static_cast<size_t>(egptr() - gptr()));
+		setg(nullptr, nullptr, nullptr);
+
+		size_t count = static_cast<size_t>(pptr() - pbase());
+		if (count == 0)
+			return true;
+		size_t written = m_blob.write(pbase(), count);
+		setp(pbase(), epptr());
+		return written == count;
+	}
+
+
+
+	BlobIStream::BlobIStream(BlobStream& blob, size_t chunkSize)
+		: std::istream(nullptr)
+		, m_buffer(blob, chunkSize)
+	{
+		rdbuf(&m_buffer);
+	}
+
+	BlobOStream::BlobOStream(BlobStream& blob, size_t chunkSize)
+		: std::ostream(nullptr)
+		, m_buffer(blob, chunkSize)
+	{
+		rdbuf(&m_buffer);
+	}
+	BlobOStream::~BlobOStream()
+	{
+		flush();
+	}
+}
@@ -0,0 +1,114 @@
+#include "BusyHandler.h"
+#include <algorithm>
+#include <thread>
+
+namespace SQLiteWrapper
+{
+	BusyHandler::BusyHandler()
+		: m_random(std::random_device{}())
+		, m_eventWait(0)
+		, m_backoff(0)
+		, m_deadline(std::chrono::steady_clock::time_point::max())
+	{
+
+	}
+
+	void BusyHandler::setPolicy(const Policy& policy)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_policy = policy;
+		m_policy.jitter = std::min(std::max(m_policy.jitter, 0.0), 1.0);
+		m_policy.maxBackoff = std::max(m_policy.maxBackoff, m_policy.initialBackoff);
+	}
+	BusyHandler::Policy BusyHandler::getPolicy() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_policy;
+	}
+
+	bool BusyHandler::install(sqlite3* db)
+	{
+		if (!db)
+			return false;
+		if (sqlite3_busy_handler(db, &BusyHandler::onBusy, this) != SQLITE_OK)
+		{
+			Logger::logError("BusyHandler: Installing the busy handler: " + std::string(sqlite3_errmsg(db)));
+			return false;
+		}
+		return true;
+	}
+
+	void BusyHandler::setDeadline(std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_deadline = deadline;
+	}
+
+	BusyHandler::Statistics BusyHandler::getStatistics() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_statistics;
+	}
+	void BusyHandler::resetStatistics()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_statistics = Statistics();
+	}
+
+	int BusyHandler::onBusy(void* context, int count)
+	{
+		return static_cast<BusyHandler*>(context)->handleBusy(count) ? 1 : 0;
+	}
+
+	bool BusyHandler::handleBusy(int count)
+	{
+		std::chrono::microseconds sleepTime(0);
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (count == 0)
+			{
+				// SQLite restarts the count for each busy event
+				++m_statistics.busyEvents;
+				m_eventStart = now;
+				m_eventWait = std::chrono::microseconds(0);
+				m_backoff = m_policy.initialBackoff;
+			}
+
+			std::chrono::microseconds waited = std::chrono::duration_cast<std::chrono::microseconds>(now - m_eventStart);
+			m_statistics.totalWait += waited - m_eventWait;
+			m_statistics.maxWait = std::max(m_statistics.maxWait, waited);
+			m_eventWait = waited;
+			if (waited >= m_policy.timeout || now >= m_deadline)
+			{
+				++m_statistics.timeouts;
+				return false;
+			}
+			++m_statistics.retries;
+
+			if (static_cast<unsigned int>(count) >= m_policy.spinCount)
+			{
+				std::uniform_real_distribution<double> distribution(0.0, 1.0);
+				double factor = 1.0 - m_policy.jitter * distribution(m_random);
+				sleepTime = std::chrono::microseconds(static_cast<long long>(m_backoff.count() * factor));
+				sleepTime = std::min(sleepTime, std::chrono::duration_cast<std::chrono::microseconds>(m_policy.timeout) - waited);
+				if (m_deadline != std::chrono::steady_clock::time_point::max())
+					sleepTime = std::min(sleepTime, std::chrono::duration_cast<std::chrono::microseconds>(m_deadline - now));
+				m_backoff = std::min(m_backoff * 2, m_policy.maxBackoff);
+			}
+		}
+
+		if (sleepTime.count() > 0)
+			std::this_thread::sleep_for(sleepTime);
+		else
+			std::this_thread::yield();
+
+		// Count the sleep, the retry may succeed without calling the handler again
+		std::unique_lock<std::mutex> lock(m_mutex);
+		std::chrono::microseconds waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_eventStart);
+		m_statistics.totalWait += waited - m_eventWait;
+		m_statistics.maxWait = std::max(m_statistics.maxWait, waited);
+		m_eventWait = waited;
+		return true;
+	}
+}
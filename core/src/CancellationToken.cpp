@@ -0,0 +1,23 @@
+#include "CancellationToken.h"
+
+namespace SQLiteWrapper
+{
+	CancellationToken::CancellationToken()
+		: m_cancelled(std::make_shared<std::atomic<bool>>(false))
+	{
+
+	}
+
+	void CancellationToken::cancel()
+	{
+		m_cancelled->store(true, std::memory_order_relaxed);
+	}
+	bool CancellationToken::isCancelled() const
+	{
+		return m_cancelled->load(std::memory_order_relaxed);
+	}
+	void CancellationToken::reset()
+	{
+		m_cancelled->store(false, std::memory_order_relaxed);
+	}
+}
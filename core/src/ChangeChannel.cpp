@@ -0,0 +1,312 @@
+#include "ChangeChannel.h"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <cstring>
+
+#ifdef __linux__
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <signal.h>
+	#include <linux/futex.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <climits>
+	#include <cerrno>
+#endif
+
+namespace SQLiteWrapper
+{
+	struct ChangeChannel::Segment
+	{
+		static constexpr uint32_t magicValue = 0x53514c43; // "SQLC", zero for a new segment
+		static constexpr size_t entryCount = 16;
+		static constexpr size_t tableBytes = 496;
+
+		// Tables of one commit, NUL separated
+		struct Entry
+		{
+			uint64_t sequence;
+			uint32_t size;
+			uint32_t overflow;
+			char tables[tableBytes];
+		};
+
+		std::atomic<uint32_t> magic;
+		std::atomic<uint32_t> futexWord; // incremented by each publish, the listeners wait on it
+		std::atomic<uint32_t> waiters;
+		std::atomic<int32_t> writer;     // process id of the writer holding the seqlock, 0 if none
+		std::atomic<uint64_t> lock;      // seqlock, odd while a writer updates the entries
+		std::atomic<uint64_t> sequence;
+		Entry entries[entryCount];
+	};
+
+	namespace
+	{
+		// A reader gives up if the seqlock stays odd, a crashed writer leaves it so until the next publish
+		const std::chrono::milliseconds seqlockTimeout(50);
+	}
+
+	ChangeChannel::ChangeChannel(const std::string& dbPath)
+		: m_name(getSegmentName(dbPath))
+		, m_segment(nullptr)
+		, m_listenThread(nullptr)
+		, m_stopListening(false)
+	{
+
+	}
+
+	ChangeChannel::~ChangeChannel()
+	{
+		close();
+	}
+
+	std::string ChangeChannel::getSegmentName(const std::string& dbPath)
+	{
+		// Segment names can not contain slashes, use a hash of the absolute path
+		std::error_code error;
+		std::string path = std::filesystem::absolute(dbPath, error).lexically_normal().string();
+		uint64_t hash = 14695981039346656037ULL;
+		for (char c : path)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+		static const char hexDigits[] = "0123456789abcdef";
+		std::string name = "/sqlw-";
+		for (int shift = 60; shift >= 0; shift -= 4)
+			name += hexDigits[(hash >> shift) & 0x0F];
+		return name;
+	}
+
+	uint64_t ChangeChannel::getSequence() const
+	{
+		return m_segment ? m_segment->sequence.load(std::memory_order_acquire) : 0;
+	}
+
+	bool ChangeChannel::readSince(uint64_t since, uint64_t& sequence, std::vector<std::string>& tables, bool& complete) const
+	{
+		tables.clear();
+		complete = false;
+		sequence = 0;
+		if (!m_segment)
+			return false;
+
+		std::vector<Segment::Entry> entries;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (true)
+		{
+			uint64_t lock = m_segment->lock.load(std::memory_order_acquire);
+			if (lock & 1)
+			{
+				if (std::chrono::steady_clock::now() - start > seqlockTimeout)
+					return false;
+				std::this_thread::yield();
+				continue;
+			}
+			sequence = m_segment->sequence.load(std::memory_order_relaxed);
+			uint64_t first = std::max(since + 1, sequence >= Segment::entryCount ? sequence - Segment::entryCount + 1 : 1);
+			entries.clear();
+			for (uint64_t s = first; s <= sequence; ++s)
+				entries.push_back(m_segment->entries[s % Segment::entryCount]);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_segment->lock.load(std::memory_order_relaxed) == lock)
+				break;
+		}
+
+		// A sequence lower than the known one means the segment was recreated
+		complete = since <= sequence && sequence - since <= entries.size();
+		std::set<std::string> names;
+		uint64_t expected = sequence - entries.size() + 1;
+		for (const Segment::Entry& entry : entries)
+		{
+			if (entry.sequence != expected++ || entry.overflow)
+				complete = false;
+			size_t size = std::min<size_t>(entry.size, Segment::tableBytes);
+			for (size_t pos = 0; pos < size;)
+			{
+				const char* name = entry.tables + pos;
+				size_t length = strnlen(name, size - pos);
+				names.insert(std::string(name, length));
+				pos += length + 1;
+			}
+		}
+		tables.assign(names.begin(), names.end());
+		return true;
+	}
+
+	bool ChangeChannel::startListening(const Callback& callback)
+	{
+		if (!m_segment)
+			return false;
+		stopListening();
+		m_callback = callback;
+		m_stopListening.store(false);
+		// The commits after this call are reported, even if they come before the thread runs
+		m_listenThread = new std::thread(&ChangeChannel::listen, this, getSequence());
+		return true;
+	}
+
+	void ChangeChannel::stopListening()
+	{
+		if (!m_listenThread)
+			return;
+		m_stopListening.store(true);
+		// Also wakes the listeners of other processes, they go back to sleep when the sequence is unchanged
+		m_segment->futexWord.fetch_add(1);
+		wake();
+		m_listenThread->join();
+		delete m_listenThread;
+		m_listenThread = nullptr;
+	}
+
+#ifdef __linux__
+	bool ChangeChannel::open()
+	{
+		if (m_segment)
+			return true;
+		static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+			"The atomics in the shared memory segment have to be lock free");
+
+		int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+		if (fd < 0)
+		{
+			Logger::logError("ChangeChannel: Opening shared memory " + m_name + ": " + strerror(errno));
+			return false;
+		}
+		// A new segment is zero filled, which is a valid empty state
+		struct stat info;
+		if (fstat(fd, &info) != 0 || (static_cast<size_t>(info.st_size) < sizeof(Segment) && ftruncate(fd, sizeof(Segment)) != 0))
+		{
+			Logger::logError("ChangeChannel: Resizing shared memory " + m_name + ": " + strerror(errno));
+			::close(fd);
+			return false;
+		}
+		void* memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (memory == MAP_FAILED)
+		{
+			Logger::logError("ChangeChannel: Mapping shared memory " + m_name + ": " + strerror(errno));
+			return false;
+		}
+
+		Segment* segment = static_cast<Segment*>(memory);
+		uint32_t magic = 0;
+		if (!segment->magic.compare_exchange_strong(magic, Segment::magicValue) && magic != Segment::magicValue)
+		{
+			Logger::logError("ChangeChannel: Shared memory " + m_name + " has an unknown layout");
+			munmap(memory, sizeof(Segment));
+			return false;
+		}
+		m_segment = segment;
+		return true;
+	}
+
+	void ChangeChannel::close()
+	{
+		if (!m_segment)
+			return;
+		stopListening();
+		munmap(m_segment, sizeof(Segment));
+		m_segment = nullptr;
+	}
+
+	uint64_t ChangeChannel::publish(const std::vector<std::string>& tables)
+	{
+		if (!m_segment)
+			return 0;
+
+		// Writers of several processes take turns on the seqlock, the owner is tagged with its process id.
+		// A writer only takes the lock over if the owner process does not exist any more,
+		// a live writer is never interrupted however long it holds the lock
+		int32_t self = static_cast<int32_t>(getpid());
+		int32_t owner = 0;
+		while (!m_segment->writer.compare_exchange_weak(owner, self, std::memory_order_acquire))
+		{
+			if (owner != 0 && owner != self && kill(owner, 0) != 0 && errno == ESRCH &&
+				m_segment->writer.compare_exchange_strong(owner, self, std::memory_order_acquire))
+				break; // Taken over from a crashed writer
+			owner = 0;
+			std::this_thread::yield();
+		}
+
+		// A crashed writer may have left the seqlock odd, the readers keep waiting until it is even again
+		uint64_t owned = m_segment->lock.load(std::memory_order_relaxed) | 1;
+		m_segment->lock.store(owned, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		uint64_t sequence = m_segment->sequence.load(std::memory_order_relaxed) + 1;
+		Segment::Entry& entry = m_segment->entries[sequence % Segment::entryCount];
+		entry.sequence = sequence;
+		entry.size = 0;
+		entry.overflow = 0;
+		for (const std::string& table : tables)
+		{
+			if (entry.size + table.size() + 1 > Segment::tableBytes)
+			{
+				entry.overflow = 1;
+				break;
+			}
+			std::memcpy(entry.tables + entry.size, table.c_str(), table.size() + 1);
+			entry.size += static_cast<uint32_t>(table.size() + 1);
+		}
+		m_segment->sequence.store(sequence, std::memory_order_release);
+		m_segment->lock.store(owned + 1, std::memory_order_release);
+		m_segment->writer.store(0, std::memory_order_release);
+
+		m_segment->futexWord.fetch_add(1);
+		if (m_segment->waiters.load() > 0)
+			wake();
+		return sequence;
+	}
+
+	void ChangeChannel::listen(uint64_t seen)
+	{
+		while (!m_stopListening.load())
+		{
+			uint32_t word = m_segment->futexWord.load();
+			uint64_t sequence = getSequence();
+			if (sequence != seen)
+			{
+				seen = sequence;
+				m_callback(sequence);
+				continue;
+			}
+			// Returns immediately if a publish has changed the word in the meantime
+			m_segment->waiters.fetch_add(1);
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_segment->futexWord), FUTEX_WAIT, word, nullptr, nullptr, 0);
+			m_segment->waiters.fetch_sub(1);
+		}
+	}
+
+	void ChangeChannel::wake()
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_segment->futexWord), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+#else
+	bool ChangeChannel::open()
+	{
+		Logger::logError("ChangeChannel: Shared memory change notifications are only available on Linux");
+		return false;
+	}
+	void ChangeChannel::close()
+	{
+
+	}
+	uint64_t ChangeChannel::publish(const std::vector<std::string>& tables)
+	{
+		SQLW_UNUSED(tables);
+		return 0;
+	}
+	void ChangeChannel::listen(uint64_t seen)
+	{
+		SQLW_UNUSED(seen);
+	}
+	void ChangeChannel::wake()
+	{
+
+	}
+#endif
+}
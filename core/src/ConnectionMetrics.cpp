@@ -0,0 +1,200 @@
+#include "ConnectionMetrics.h"
+#include "Utilities.h"
+#include <algorithm>
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		int64_t readDbStatus(sqlite3* db, int op, bool highwater)
+		{
+			int current = 0;
+			int highest = 0;
+			if (sqlite3_db_status(db, op, &current, &highest, 0) != SQLITE_OK)
+				return 0;
+			return highwater ? highest : current;
+		}
+		void readStatus(int op, int64_t* current, int64_t* highwater)
+		{
+			sqlite3_int64 cur = 0;
+			sqlite3_int64 high = 0;
+			if (sqlite3_status64(op, &cur, &high, 0) != SQLITE_OK)
+				return;
+			if (current)
+				*current = cur;
+			if (highwater)
+				*highwater = high;
+		}
+
+		// A counter below its previous value was reset in between (reopen or clear())
+		int64_t counterDelta(int64_t current, int64_t previous)
+		{
+			return current < previous ? current : current - previous;
+		}
+		bool wasReset(const ConnectionMetrics::StatementStats& current, const ConnectionMetrics::StatementStats& previous)
+		{
+			if (current.runs < previous.runs || current.vmSteps < previous.vmSteps ||
+				current.fullscanSteps < previous.fullscanSteps || current.sorts < previous.sorts ||
+				current.autoIndexes < previous.autoIndexes || current.totalDuration < previous.totalDuration)
+				return true;
+			for (size_t i = 0; i < ConnectionMetrics::durationBucketCount; ++i)
+				if (current.durationBuckets[i] < previous.durationBuckets[i])
+					return true;
+			return false;
+		}
+	}
+
+	ConnectionMetrics::Snapshot ConnectionMetrics::Snapshot::diff(const Snapshot& previous) const
+	{
+		Snapshot delta = *this;
+		delta.lookasideHit = counterDelta(lookasideHit, previous.lookasideHit);
+		delta.lookasideMissSize = counterDelta(lookasideMissSize, previous.lookasideMissSize);
+		delta.lookasideMissFull = counterDelta(lookasideMissFull, previous.lookasideMissFull);
+		delta.cacheHit = counterDelta(cacheHit, previous.cacheHit);
+		delta.cacheMiss = counterDelta(cacheMiss, previous.cacheMiss);
+		delta.cacheWrite = counterDelta(cacheWrite, previous.cacheWrite);
+		delta.cacheSpill = counterDelta(cacheSpill, previous.cacheSpill);
+
+		// Both lists are sorted by fingerprint
+		delta.statements.clear();
+		auto prev = previous.statements.begin();
+		for (const StatementStats& current : statements)
+		{
+			while (prev != previous.statements.end() && prev->fingerprint < current.fingerprint)
+				++prev;
+			StatementStats stats = current;
+			// A reset statement started again from zero, its current values are the delta
+			if (prev != previous.statements.end() && prev->fingerprint == current.fingerprint &&
+				!wasReset(current, *prev))
+			{
+				stats.runs -= prev->runs;
+				stats.vmSteps -= prev->vmSteps;
+				stats.fullscanSteps -= prev->fullscanSteps;
+				stats.sorts -= prev->sorts;
+				stats.autoIndexes -= prev->autoIndexes;
+				stats.totalDuration -= prev->totalDuration;
+				for (size_t i = 0; i < durationBucketCount; ++i)
+					stats.durationBuckets[i] -= prev->durationBuckets[i];
+			}
+			if (stats.runs > 0)
+				delta.statements.push_back(std::move(stats));
+		}
+		return delta;
+	}
+
+	ConnectionMetrics::ConnectionMetrics(size_t maxFingerprints)
+		: m_enabled(false)
+		, m_statusInterval(1000)
+		, m_maxFingerprints(maxFingerprints)
+	{
+
+	}
+
+	void ConnectionMetrics::recordStatement(sqlite3* db, sqlite3_stmt* stmt, const std::string& query, std::chrono::microseconds duration)
+	{
+		if (!m_enabled.load(std::memory_order_relaxed))
+			return;
+		std::string fingerprint = Utilities::getQueryFingerprint(query);
+
+		auto it = m_entries.find(fingerprint);
+		if (it == m_entries.end())
+		{
+			if (m_entries.size() >= m_maxFingerprints)
+				return;
+			std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+			entry->fingerprint = fingerprint;
+			entry->query = query;
+			it = m_entries.emplace(fingerprint, entry).first;
+
+			// New fingerprints are rare, copying the list keeps the readers lock free
+			m_entryList.push_back(entry);
+			m_publishedEntries.publish(m_entryList);
+		}
+
+		// Single writer, the readers only need to see each value untorn
+		Entry& entry = *it->second;
+		int64_t micros = duration.count();
+		entry.runs.fetch_add(1, std::memory_order_relaxed);
+		entry.totalDuration.fetch_add(micros, std::memory_order_relaxed);
+		if (micros > entry.maxDuration.load(std::memory_order_relaxed))
+			entry.maxDuration.store(micros, std::memory_order_relaxed);
+		size_t bucket = std::upper_bound(durationBucketBounds.begin(), durationBucketBounds.end(), micros - 1) - durationBucketBounds.begin();
+		entry.durationBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		if (stmt)
+		{
+			entry.vmSteps.fetch_add(static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0)), std::memory_order_relaxed);
+			entry.fullscanSteps.fetch_add(static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0)), std::memory_order_relaxed);
+			entry.sorts.fetch_add(static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0)), std::memory_order_relaxed);
+			entry.autoIndexes.fetch_add(static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0)), std::memory_order_relaxed);
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - m_lastStatusRefresh >= std::chrono::milliseconds(m_statusInterval.load(std::memory_order_relaxed)))
+			refreshStatus(db);
+	}
+
+	void ConnectionMetrics::refreshStatus(sqlite3* db)
+	{
+		m_lastStatusRefresh = std::chrono::steady_clock::now();
+		Snapshot status;
+		status.timestamp = std::chrono::system_clock::now();
+		if (db)
+		{
+			status.lookasideUsed = readDbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_USED, false);
+			status.lookasideHit = readDbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, true);
+			status.lookasideMissSize = readDbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true);
+			status.lookasideMissFull = readDbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true);
+			status.cacheUsed = readDbStatus(db, SQLITE_DBSTATUS_CACHE_USED, false);
+			status.cacheHit = readDbStatus(db, SQLITE_DBSTATUS_CACHE_HIT, false);
+			status.cacheMiss = readDbStatus(db, SQLITE_DBSTATUS_CACHE_MISS, false);
+			status.cacheWrite = readDbStatus(db, SQLITE_DBSTATUS_CACHE_WRITE, false);
+			status.cacheSpill = readDbStatus(db, SQLITE_DBSTATUS_CACHE_SPILL, false);
+			status.schemaUsed = readDbStatus(db, SQLITE_DBSTATUS_SCHEMA_USED, false);
+			status.statementUsed = readDbStatus(db, SQLITE_DBSTATUS_STMT_USED, false);
+		}
+		readStatus(SQLITE_STATUS_MEMORY_USED, &status.memoryUsed, &status.memoryHighwater);
+		readStatus(SQLITE_STATUS_MALLOC_COUNT, &status.mallocCount, nullptr);
+		readStatus(SQLITE_STATUS_PAGECACHE_OVERFLOW, &status.pageCacheOverflow, nullptr);
+		m_publishedStatus.publish(std::move(status));
+	}
+
+	ConnectionMetrics::Snapshot ConnectionMetrics::takeSnapshot() const
+	{
+		Snapshot snapshot;
+		m_publishedStatus.read([&snapshot](const Snapshot& status) { snapshot = status; });
+		snapshot.timestamp = std::chrono::system_clock::now();
+
+		m_publishedEntries.read([&snapshot](const EntryList& entries)
+			{
+				snapshot.statements.reserve(entries.size());
+				for (const std::shared_ptr<Entry>& entry : entries)
+				{
+					StatementStats stats;
+					stats.fingerprint = entry->fingerprint;
+					stats.query = entry->query;
+					stats.runs = entry->runs.load(std::memory_order_relaxed);
+					stats.vmSteps = entry->vmSteps.load(std::memory_order_relaxed);
+					stats.fullscanSteps = entry->fullscanSteps.load(std::memory_order_relaxed);
+					stats.sorts = entry->sorts.load(std::memory_order_relaxed);
+					stats.autoIndexes = entry->autoIndexes.load(std::memory_order_relaxed);
+					stats.totalDuration = std::chrono::microseconds(entry->totalDuration.load(std::memory_order_relaxed));
+					stats.maxDuration = std::chrono::microseconds(entry->maxDuration.load(std::memory_order_relaxed));
+					for (size_t i = 0; i < durationBucketCount; ++i)
+						stats.durationBuckets[i] = entry->durationBuckets[i].load(std::memory_order_relaxed);
+					snapshot.statements.push_back(std::move(stats));
+				}
+			});
+		std::sort(snapshot.statements.begin(), snapshot.statements.end(), [](const StatementStats& a, const StatementStats& b)
+			{
+				return a.fingerprint < b.fingerprint;
+			});
+		return snapshot;
+	}
+
+	void ConnectionMetrics::clear()
+	{
+		m_entries.clear();
+		m_entryList.clear();
+		m_publishedEntries.publish(EntryList());
+	}
+}
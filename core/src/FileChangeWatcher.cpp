@@ -5,8 +5,15 @@
 #include <QDir>
 #include <QCryptographicHash>
 #include <QByteArray>
-#include <QApplication>
 
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
 
 namespace SQLiteWrapper
 {
@@ -16,9 +23,17 @@ namespace SQLiteWrapper
 	{
 		m_stopFlag.store(false);
 		m_paused.store(false);
-		m_fileChanged.store(false);
+		m_changeSequence.store(0);
+		m_notificationPending.store(false);
+#ifdef _WIN32
 		m_eventHandle.store(nullptr);
+#endif
 		connect(&m_timer, &QTimer::timeout, this, &FileChangeWatcher::onPollingTimerTimeout);
+		m_debounceTimer.setSingleShot(true);
+		m_debounceTimer.setTimerType(Qt::PreciseTimer);
+		m_rateLimitTimer.setSingleShot(true);
+		connect(&m_debounceTimer, &QTimer::timeout, this, &FileChangeWatcher::onDebounceTimeout);
+		connect(&m_rateLimitTimer, &QTimer::timeout, this, &FileChangeWatcher::emitPendingChanges);
 		connect(this, &FileChangeWatcher::onFileChangedInternal, this, &FileChangeWatcher::onFileChangedInternalSlot, Qt::QueuedConnection);
 		startWatching();
 	}
@@ -28,9 +43,17 @@ namespace SQLiteWrapper
 	{
 		m_stopFlag.store(false);
 		m_paused.store(false);
-		m_fileChanged.store(false);
+		m_changeSequence.store(0);
+		m_notificationPending.store(false);
+#ifdef _WIN32
 		m_eventHandle.store(nullptr);
+#endif
 		connect(&m_timer, &QTimer::timeout, this, &FileChangeWatcher::onPollingTimerTimeout);
+		m_debounceTimer.setSingleShot(true);
+		m_debounceTimer.setTimerType(Qt::PreciseTimer);
+		m_rateLimitTimer.setSingleShot(true);
+		connect(&m_debounceTimer, &QTimer::timeout, this, &FileChangeWatcher::onDebounceTimeout);
+		connect(&m_rateLimitTimer, &QTimer::timeout, this, &FileChangeWatcher::emitPendingChanges);
 		connect(this, &FileChangeWatcher::onFileChangedInternal, this, &FileChangeWatcher::onFileChangedInternalSlot, Qt::QueuedConnection);
 		startWatching();
 	}
@@ -48,32 +71,49 @@ namespace SQLiteWrapper
 		m_mode = mode;
 		startWatching();
 	}
-	bool FileChangeWatcher::hasChanged()
+	void FileChangeWatcher::setDebouncePolicy(const DebouncePolicy& policy)
+	{
+		m_debouncePolicy = policy;
+		// Changes held back by the old policy are not lost
+		m_debounceTimer.stop();
+		m_rateLimitTimer.stop();
+		emitPendingChanges();
+	}
+	void FileChangeWatcher::setDataVersionProvider(const std::function<long long()>& provider)
 	{
-		if (m_mode == Mode::polling)
-			checkFile();
-		std::unique_lock<std::mutex> lock(m_mutex);
-		return m_fileChanged;
+		m_dataVersionProvider = provider;
 	}
-	void FileChangeWatcher::clearFileChangedFlag()
+
+	void FileChangeWatcher::publishChange()
+	{
+		// Called from any thread, never waits for the consumer
+		m_changeSequence.fetch_add(1);
+		Logger::logInfo("FileChangeWatcher: File changed: " + m_path);
+		if (!m_notificationPending.exchange(true))
+			emit onFileChangedInternal(nullptr);
+	}
+	void FileChangeWatcher::consumeChanges()
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_fileChanged.store(false);
-		if (m_mode == Mode::winApi)
-			m_cv.notify_all();
+		// Clear the flag before reading the sequence, a change published in between queues a new notification
+		m_notificationPending.store(false);
+		unsigned long long sequence = m_changeSequence.load();
+		unsigned long long count = sequence - m_consumedSequence;
+		m_consumedSequence = sequence;
+		if (count > 0)
+			reportChange(static_cast<unsigned int>(count));
 	}
 
 
 	void FileChangeWatcher::pause()
 	{
 		m_paused.store(true);
-		if (m_mode == Mode::polling)
+		if (isPollingMode())
 			m_timer.stop();
 	}
 	void FileChangeWatcher::unpause()
 	{
 		m_paused.store(false);
-		if(m_mode == Mode::polling)
+		if (isPollingMode() && !m_initialFingerprintThread)
 			m_timer.start();
 	}
 	bool FileChangeWatcher::isPaused() const
@@ -83,41 +123,98 @@ namespace SQLiteWrapper
 
 	void FileChangeWatcher::startWatching()
 	{
-		if (m_mode == Mode::polling)
+		if (isPollingMode())
 		{
-			// start polling
-			checkFile();
-			m_timer.start(10);
+			if (m_mode == Mode::dataVersion)
+			{
+				// The provider has to be called in this thread, reading the data version is cheap
+				checkFile();
+				m_timer.start(10);
+			}
+			else if (!m_initialFingerprintThread)
+			{
+				// Hashing a large file takes a while, polling starts once the initial fingerprint is known
+				m_fingerprint.clear();
+				m_initialFingerprintThread = new std::thread(&FileChangeWatcher::calculateInitialFingerprint, this);
+			}
 		}
-		else
+		else if (m_mode == Mode::winApi)
 		{
+#ifdef _WIN32
 			if (!m_watchThread)
 			{
 				fileChanged();
 				m_stopFlag.store(false);
 				m_watchThread = new std::thread(&FileChangeWatcher::monitorFile, this);
 			}
+#else
+			Logger::logError("FileChangeWatcher: The winApi mode is only available on Windows");
+#endif
+		}
+		else if (m_mode == Mode::inotify)
+		{
+#ifdef __linux__
+			if (!m_watchThread)
+			{
+				// Without the wakeup, stopWatching() would wait for the next change in the directory
+				m_wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+				if (m_wakeupFd < 0)
+				{
+					Logger::logError("FileChangeWatcher: eventfd: " + std::string(strerror(errno)));
+					return;
+				}
+				m_stopFlag.store(false);
+				m_watchThread = new std::thread(&FileChangeWatcher::monitorFileInotify, this);
+			}
+#else
+			Logger::logError("FileChangeWatcher: The inotify mode is only available on Linux");
+#endif
+		}
+		else if (m_mode == Mode::shared)
+		{
+			if (m_sharedWatchId == 0)
+				m_sharedWatchId = WatchService::instance().add(m_path, [this](const std::string&) { onSharedWatchChanged(); });
 		}
 	}
 	void FileChangeWatcher::stopWatching()
 	{
-		if (m_mode == Mode::polling)
+		if (isPollingMode())
 		{
 			// stop polling
 			m_timer.stop();
+			stopInitialFingerprint();
+		}
+		else if (m_mode == Mode::shared)
+		{
+			if (m_sharedWatchId != 0)
+			{
+				WatchService::instance().remove(m_sharedWatchId);
+				m_sharedWatchId = 0;
+			}
 		}
 		else
 		{
 			if (m_watchThread)
 			{
+				m_stopFlag.store(true);
+#ifdef __linux__
+				if (m_wakeupFd >= 0)
 				{
-					std::unique_lock<std::mutex> lock(m_mutex);
-					m_stopFlag.store(true);
-					m_cv.notify_all();
+					uint64_t value = 1;
+					ssize_t res = write(m_wakeupFd, &value, sizeof(value));
+					SQLW_UNUSED(res);
 				}
+#endif
 				m_watchThread->join();
 				delete m_watchThread;
 				m_watchThread = nullptr;
+#ifdef __linux__
+				if (m_wakeupFd >= 0)
+				{
+					::close(m_wakeupFd);
+					m_wakeupFd = -1;
+				}
+#endif
 			}
 		}
 	}
@@ -125,19 +222,115 @@ namespace SQLiteWrapper
 
 	void FileChangeWatcher::onFileChangedInternalSlot(QPrivateSignal*)
 	{
-		// This function is called when the file has changed
-		// Emit the onFileChanged signal
-		clearFileChangedFlag();
-		emit onFileChanged(m_path);
+		// Queued from the thread which detected the change
+		consumeChanges();
 	}
 	void FileChangeWatcher::onPollingTimerTimeout()
 	{
-		if (hasChanged())
+		checkFile();
+		consumeChanges();
+	}
+	void FileChangeWatcher::onDebounceTimeout()
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::milliseconds quiet = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastChange);
+		if (quiet >= m_debouncePolicy.window)
+		{
+			// The burst is over
+			if (m_debouncePolicy.trailing)
+				emitPendingChanges();
+			else
+				resetPendingChanges();
+			return;
+		}
+
+		std::chrono::milliseconds delay = m_debouncePolicy.window - quiet;
+		if (m_debouncePolicy.maxWait.count() > 0)
+		{
+			if (now - m_burstStart >= m_debouncePolicy.maxWait)
+			{
+				// maxWait reached while the burst is still going on
+				emitPendingChanges();
+				m_burstStart = now;
+			}
+			std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(m_burstStart + m_debouncePolicy.maxWait - now);
+			delay = std::max(std::chrono::milliseconds(0), std::min(delay, remaining));
+		}
+		m_debounceTimer.start(static_cast<int>(delay.count()));
+	}
+
+	void FileChangeWatcher::reportChange(unsigned int count)
+	{
+		m_pendingChanges += count;
+		if (m_debouncePolicy.window.count() <= 0)
+		{
+			emitPendingChanges();
+			return;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		m_lastChange = now;
+		if (!m_debounceTimer.isActive())
+		{
+			// First change of a burst
+			m_burstStart = now;
+			if (m_debouncePolicy.leading)
+				emitPendingChanges();
+		}
+
+		std::chrono::milliseconds delay = m_debouncePolicy.window;
+		if (m_debouncePolicy.maxWait.count() > 0)
 		{
-			emit onFileChanged(m_path);
+			std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(m_burstStart + m_debouncePolicy.maxWait - now);
+			delay = std::max(std::chrono::milliseconds(0), std::min(delay, remaining));
 		}
+		m_debounceTimer.start(static_cast<int>(delay.count()));
 	}
+	void FileChangeWatcher::emitPendingChanges()
+	{
+		if (m_pendingChanges == 0)
+			return;
 
+		if (m_debouncePolicy.maxEventsPerSecond > 0)
+		{
+			// Fixed one second window, changes above the limit are merged into the first signal of the next window
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now - m_rateWindowStart >= std::chrono::seconds(1))
+			{
+				m_rateWindowStart = now;
+				m_eventsInWindow = 0;
+			}
+			if (m_eventsInWindow >= m_debouncePolicy.maxEventsPerSecond)
+			{
+				m_deferredChanges = m_pendingChanges;
+				if (!m_rateLimitTimer.isActive())
+				{
+					std::chrono::milliseconds remaining = std::chrono::ceil<std::chrono::milliseconds>(m_rateWindowStart + std::chrono::seconds(1) - now);
+					m_rateLimitTimer.start(static_cast<int>(remaining.count()));
+				}
+				return;
+			}
+			++m_eventsInWindow;
+		}
+
+		unsigned int count = m_pendingChanges;
+		m_pendingChanges = 0;
+		m_deferredChanges = 0;
+		emit onFileChanged(m_path);
+		emit onFileChangesCoalesced(m_path, count);
+	}
+	void FileChangeWatcher::resetPendingChanges()
+	{
+		m_debounceTimer.stop();
+
+		// Changes held back by the rate limit were due before the burst ended,
+		// they are still emitted once the rate window reopens
+		m_pendingChanges = m_deferredChanges;
+		if (m_pendingChanges == 0)
+			m_rateLimitTimer.stop();
+	}
+
+#ifdef _WIN32
 	bool FileChangeWatcher::fileChanged()
 	{
 		std::filesystem::path file(m_path);
@@ -252,20 +445,8 @@ namespace SQLiteWrapper
 
 				if (fileChanged() && !m_paused.load())
 				{
-					SQLW_FILE_WATCHER_PROFILING_BLOCK("Change detectd, waitForLockRelease", SQLW_COLOR_STAGE_9);
-					std::unique_lock<std::mutex> lock(m_mutex);
-
-					m_fileChanged.store(true);
-					Logger::logInfo("FileChangeWatcher: File changed: " + m_path);
-					emit onFileChangedInternal(nullptr);
-					while (m_fileChanged && !m_stopFlag.load()) {
-						QApplication::processEvents();
-						m_cv.wait(lock);
-					}
-
-					if (m_stopFlag.load()) {
-						break;
-					}
+					SQLW_FILE_WATCHER_PROFILING_BLOCK("Change detected", SQLW_COLOR_STAGE_9);
+					publishChange();
 				}
 			}
 #ifdef SQLW_DEBUG
@@ -280,23 +461,209 @@ namespace SQLiteWrapper
 		FindCloseChangeNotification(m_eventHandle.load());
 		m_eventHandle.store(nullptr);
 	}
+#endif
+
+#ifdef __linux__
+	void FileChangeWatcher::monitorFileInotify()
+	{
+		SQLW_FILE_WATCHER_PROFILING_THREAD("FileChangeWatcher");
+		std::filesystem::path file = std::filesystem::absolute(m_path);
+		const std::string directory = file.parent_path().string();
+		const std::string name = file.filename().string();
+
+		int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0)
+		{
+			Logger::logError("FileChangeWatcher: inotify_init1: " + std::string(strerror(errno)));
+			return;
+		}
+		// Watch the directory, SQLite creates and deletes the -wal and -journal files
+		if (inotify_add_watch(inotifyFd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			Logger::logError("FileChangeWatcher: inotify_add_watch: " + directory + ": " + std::string(strerror(errno)));
+			::close(inotifyFd);
+			return;
+		}
+
+		int epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollFd < 0)
+		{
+			Logger::logError("FileChangeWatcher: epoll_create1: " + std::string(strerror(errno)));
+			::close(inotifyFd);
+			return;
+		}
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = inotifyFd;
+		bool added = epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &event) == 0;
+		if (added)
+		{
+			event.data.fd = m_wakeupFd;
+			added = epoll_ctl(epollFd, EPOLL_CTL_ADD, m_wakeupFd, &event) == 0;
+		}
+		if (!added)
+		{
+			Logger::logError("FileChangeWatcher: epoll_ctl: " + std::string(strerror(errno)));
+			::close(epollFd);
+			::close(inotifyFd);
+			return;
+		}
+
+		alignas(inotify_event) char buffer[4096];
+		while (!m_stopFlag.load())
+		{
+			epoll_event events[2];
+			int count = epoll_wait(epollFd, events, 2, -1);
+			if (count < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				Logger::logError("FileChangeWatcher: epoll_wait: " + std::string(strerror(errno)));
+				break;
+			}
+
+			bool changed = false;
+			for (int i = 0; i < count; ++i)
+			{
+				if (events[i].data.fd != inotifyFd)
+					continue; // Woken up by stopWatching()
+
+				ssize_t length;
+				while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+				{
+					for (char* ptr = buffer; ptr < buffer + length; )
+					{
+						const inotify_event* notification = reinterpret_cast<const inotify_event*>(ptr);
+						if (notification->len > 0)
+						{
+							std::string changedName(notification->name);
+							if (changedName == name || changedName == name + "-wal" || changedName == name + "-journal")
+								changed = true;
+						}
+						ptr += sizeof(inotify_event) + notification->len;
+					}
+				}
+			}
+			if (changed && !m_paused.load() && !m_stopFlag.load())
+			{
+				SQLW_FILE_WATCHER_PROFILING_BLOCK("Change detected", SQLW_COLOR_STAGE_9);
+				publishChange();
+			}
+		}
+
+		::close(epollFd);
+		::close(inotifyFd);
+	}
+#endif
+
+	void FileChangeWatcher::onSharedWatchChanged()
+	{
+		// Called from the WatchService thread, which is shared and must not be blocked
+		if (!m_paused.load())
+			publishChange();
+	}
+	void FileChangeWatcher::calculateInitialFingerprint()
+	{
+		SQLW_FILE_WATCHER_PROFILING_THREAD("FileChangeWatcher initial fingerprint");
+		m_initialFingerprint = calculateFingerprint(m_initialFingerprintSuccess);
+		QMetaObject::invokeMethod(this, &FileChangeWatcher::onInitialFingerprintReady, Qt::QueuedConnection);
+	}
+	void FileChangeWatcher::stopInitialFingerprint()
+	{
+		if (!m_initialFingerprintThread)
+			return;
+		m_initialFingerprintThread->join();
+		delete m_initialFingerprintThread;
+		m_initialFingerprintThread = nullptr;
+	}
+	void FileChangeWatcher::onInitialFingerprintReady()
+	{
+		if (!m_initialFingerprintThread)
+			return; // Stopped in the meantime
+		stopInitialFingerprint();
+		if (m_initialFingerprintSuccess)
+			m_fingerprint = m_initialFingerprint;
+		if (!m_paused.load())
+			m_timer.start(10);
+		else
+			m_timer.setInterval(10);
+	}
+
 	void FileChangeWatcher::checkFile()
 	{
 		bool success;
-		std::string md5 = calculateMD5Hash(success);
+		std::string fingerprint = calculateFingerprint(success);
 		if (!success)
 		{
 #ifdef SQLW_DEBUG
-			Logger::logError("FileChangeWatcher: Could not calculate the MD5 hash of the file: " + m_path);
+			Logger::logError("FileChangeWatcher: Could not calculate the fingerprint of the file: " + m_path);
 #endif
 			return;
 		}
-		if (md5 != m_md5 && m_md5 != "")
+		if (fingerprint != m_fingerprint && m_fingerprint != "")
 		{
-			m_fileChanged.store(true);
+			// Runs in the thread of the watcher, the caller consumes the change directly
+			m_changeSequence.fetch_add(1);
 			Logger::logInfo("FileChangeWatcher: File changed: " + m_path);
 		}
-		m_md5 = md5;
+		m_fingerprint = fingerprint;
+	}
+
+	std::string FileChangeWatcher::calculateFingerprint(bool& success)
+	{
+		switch (m_mode)
+		{
+			case Mode::changeCounter:
+				return readChangeCounter(m_path, success);
+			case Mode::dataVersion:
+			{
+				long long version = m_dataVersionProvider ? m_dataVersionProvider() : -1;
+				success = version >= 0;
+				return success ? std::to_string(version) : "";
+			}
+			default:
+				return calculateMD5Hash(success);
+		}
+	}
+
+	std::string FileChangeWatcher::readChangeCounter(const std::string& path, bool& success)
+	{
+		static const char hexDigits[] = "0123456789abcdef";
+		auto appendHex = [](std::string& str, const char* data, std::streamsize size)
+			{
+				for (std::streamsize i = 0; i < size; ++i)
+				{
+					unsigned char c = static_cast<unsigned char>(data[i]);
+					str += hexDigits[c >> 4];
+					str += hexDigits[c & 0x0F];
+				}
+			};
+
+		// File change counter, 4 bytes at offset 24 of the database header
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			success = false;
+			return "";
+		}
+		char counter[4] = { 0 };
+		file.seekg(24);
+		file.read(counter, sizeof(counter));
+		std::string fingerprint;
+		appendHex(fingerprint, counter, file.gcount());
+
+		// In WAL mode the counter is not updated by each commit.
+		// The WAL index header contains the change counter, the last valid frame and the salts of the WAL.
+		std::ifstream walIndex(path + "-shm", std::ios::binary);
+		if (walIndex.is_open())
+		{
+			char header[48] = { 0 };
+			walIndex.read(header, sizeof(header));
+			fingerprint += ':';
+			appendHex(fingerprint, header, walIndex.gcount());
+		}
+		success = true;
+		return fingerprint;
 	}
 
 	std::string FileChangeWatcher::calculateMD5Hash(bool& success)
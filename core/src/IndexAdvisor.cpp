@@ -0,0 +1,250 @@
+#include "IndexAdvisor.h"
+#include "SQLite.h"
+#include "QueryPlanLinter.h"
+#include <set>
+#include <algorithm>
+
+// The sqlite3expert extension is compiled as part of the vendored shell.c
+extern "C"
+{
+	typedef struct sqlite3expert sqlite3expert;
+	sqlite3expert* sqlite3_expert_new(sqlite3* db, char** pzErr);
+	int sqlite3_expert_config(sqlite3expert* p, int op, ...);
+	int sqlite3_expert_sql(sqlite3expert* p, const char* zSql, char** pzErr);
+	int sqlite3_expert_analyze(sqlite3expert* p, char** pzErr);
+	int sqlite3_expert_count(sqlite3expert* p);
+	const char* sqlite3_expert_report(sqlite3expert* p, int iStmt, int eReport);
+	void sqlite3_expert_destroy(sqlite3expert* p);
+}
+#ifndef EXPERT_CONFIG_SAMPLE
+	#define EXPERT_CONFIG_SAMPLE 1
+#endif
+#ifndef EXPERT_REPORT_INDEXES
+	#define EXPERT_REPORT_INDEXES 2
+#endif
+#ifndef EXPERT_REPORT_PLAN
+	#define EXPERT_REPORT_PLAN 3
+#endif
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		std::string takeErrorMessage(char*& errMsg)
+		{
+			std::string msg = errMsg ? errMsg : "unknown error";
+			sqlite3_free(errMsg);
+			errMsg = nullptr;
+			return msg;
+		}
+
+		void appendLines(const char* text, std::vector<std::string>& lines)
+		{
+			if (!text)
+				return;
+			std::string str(text);
+			size_t begin = 0;
+			while (begin < str.size())
+			{
+				size_t end = str.find('\n', begin);
+				if (end == std::string::npos)
+					end = str.size();
+				if (end > begin)
+					lines.push_back(str.substr(begin, end - begin));
+				begin = end + 1;
+			}
+		}
+
+		// Runs all statements of the query, changes are rolled back.
+		// Unbound parameters are NULL.
+		std::chrono::microseconds timeQuery(sqlite3* db, const std::string& query, unsigned int repetitions)
+		{
+			std::chrono::microseconds total(0);
+			for (unsigned int i = 0; i < repetitions; ++i)
+			{
+				sqlite3_exec(db, "SAVEPOINT sqlw_index_advisor;", nullptr, nullptr, nullptr);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				const char* tail = query.c_str();
+				while (tail && *tail)
+				{
+					sqlite3_stmt* stmt = nullptr;
+					if (sqlite3_prepare_v2(db, tail, -1, &stmt, &tail) != SQLITE_OK)
+						break;
+					if (!stmt)
+						continue; // Whitespace or comment
+					while (sqlite3_step(stmt) == SQLITE_ROW) {}
+					sqlite3_finalize(stmt);
+				}
+				total += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+				sqlite3_exec(db, "ROLLBACK TO sqlw_index_advisor; RELEASE sqlw_index_advisor;", nullptr, nullptr, nullptr);
+			}
+			return repetitions > 0 ? total / repetitions : total;
+		}
+	}
+
+	std::string IndexAdvisor::Recommendation::toString() const
+	{
+		std::string str = "Query (" + std::to_string(workload.executions) + " executions, " +
+			std::to_string(workload.totalDuration.count() / 1000.0) + " ms total): " + workload.query;
+		for (const std::string& index : createIndexStatements)
+			str += "\n  " + index;
+		for (const std::string& issue : resolvedIssues)
+			str += "\n  Resolves: " + issue;
+		if (measured)
+		{
+			str += "\n  Measured: " + std::to_string(durationBefore.count() / 1000.0) + " ms -> " +
+				std::to_string(durationAfter.count() / 1000.0) + " ms";
+		}
+		return str;
+	}
+	std::string IndexAdvisor::Report::toString() const
+	{
+		std::string str = "Index advisor: " + std::to_string(createIndexStatements.size()) + " suggested indexes";
+		for (const Recommendation& rec : recommendations)
+			str += "\n" + rec.toString();
+		for (const std::string& error : errors)
+			str += "\nError: " + error;
+		return str;
+	}
+
+	IndexAdvisor::IndexAdvisor(SQLite& db)
+		: m_db(db)
+		, m_samplePercentage(0)
+		, m_measure(false)
+		, m_repetitions(3)
+		, m_scratchPath(":memory:")
+	{
+
+	}
+
+	void IndexAdvisor::setMeasureOnScratchCopy(bool enable, unsigned int repetitions, const std::string& scratchPath)
+	{
+		m_measure = enable;
+		m_repetitions = repetitions;
+		m_scratchPath = scratchPath;
+	}
+
+	IndexAdvisor::Report IndexAdvisor::analyze(const std::vector<QueryWorkload::Entry>& workload)
+	{
+		Report report;
+		sqlite3* db = m_db.getDB();
+		if (!db)
+		{
+			report.errors.push_back("Database is not open");
+			return report;
+		}
+
+		char* errMsg = nullptr;
+		sqlite3expert* expert = sqlite3_expert_new(db, &errMsg);
+		if (!expert)
+		{
+			report.errors.push_back("Creating sqlite3expert: " + takeErrorMessage(errMsg));
+			return report;
+		}
+		sqlite3_expert_config(expert, EXPERT_CONFIG_SAMPLE, m_samplePercentage);
+
+		// A query can contain multiple statements, remember which statements belong to which query
+		struct StatementRange
+		{
+			size_t workloadIndex;
+			int first;
+			int last;
+		};
+		std::vector<StatementRange> ranges;
+		for (size_t i = 0; i < workload.size(); ++i)
+		{
+			int first = sqlite3_expert_count(expert);
+			if (sqlite3_expert_sql(expert, workload[i].query.c_str(), &errMsg) != SQLITE_OK)
+			{
+				report.errors.push_back(workload[i].query + ": " + takeErrorMessage(errMsg));
+				continue;
+			}
+			ranges.push_back({ i, first, sqlite3_expert_count(expert) });
+		}
+
+		if (sqlite3_expert_analyze(expert, &errMsg) != SQLITE_OK)
+		{
+			report.errors.push_back("Analyzing workload: " + takeErrorMessage(errMsg));
+			sqlite3_expert_destroy(expert);
+			return report;
+		}
+
+		std::set<std::string> suggestedIndexes;
+		for (const StatementRange& range : ranges)
+		{
+			Recommendation rec;
+			rec.workload = workload[range.workloadIndex];
+			for (int stmt = range.first; stmt < range.last; ++stmt)
+			{
+				appendLines(sqlite3_expert_report(expert, stmt, EXPERT_REPORT_INDEXES), rec.createIndexStatements);
+				appendLines(sqlite3_expert_report(expert, stmt, EXPERT_REPORT_PLAN), rec.proposedPlan);
+			}
+			if (rec.createIndexStatements.empty())
+				continue;
+
+			rec.currentPlan = m_db.explainQueryPlan(rec.workload.query);
+			std::vector<std::string> currentIssues = QueryPlanLinter::analyze(rec.currentPlan);
+			std::vector<std::string> proposedIssues = QueryPlanLinter::analyze(rec.proposedPlan);
+			for (const std::string& issue : currentIssues)
+			{
+				if (std::find(proposedIssues.begin(), proposedIssues.end(), issue) == proposedIssues.end())
+					rec.resolvedIssues.push_back(issue);
+			}
+
+			for (const std::string& index : rec.createIndexStatements)
+			{
+				if (suggestedIndexes.insert(index).second)
+					report.createIndexStatements.push_back(index);
+			}
+			report.recommendations.push_back(std::move(rec));
+		}
+		sqlite3_expert_destroy(expert);
+
+		if (m_measure && !report.recommendations.empty())
+			measure(report);
+		return report;
+	}
+
+	void IndexAdvisor::measure(Report& report)
+	{
+		sqlite3* scratch = nullptr;
+		if (sqlite3_open(m_scratchPath.c_str(), &scratch) != SQLITE_OK)
+		{
+			report.errors.push_back("Opening scratch database " + m_scratchPath + ": " + sqlite3_errmsg(scratch));
+			sqlite3_close(scratch);
+			return;
+		}
+
+		sqlite3_backup* backup = sqlite3_backup_init(scratch, "main", m_db.getDB(), "main");
+		if (!backup)
+		{
+			report.errors.push_back("Copying database to scratch database: " + std::string(sqlite3_errmsg(scratch)));
+			sqlite3_close(scratch);
+			return;
+		}
+		sqlite3_backup_step(backup, -1);
+		if (sqlite3_backup_finish(backup) != SQLITE_OK)
+		{
+			report.errors.push_back("Copying database to scratch database: " + std::string(sqlite3_errmsg(scratch)));
+			sqlite3_close(scratch);
+			return;
+		}
+
+		for (Recommendation& rec : report.recommendations)
+			rec.durationBefore = timeQuery(scratch, rec.workload.query, m_repetitions);
+
+		for (const std::string& index : report.createIndexStatements)
+		{
+			char* errMsg = nullptr;
+			if (sqlite3_exec(scratch, index.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+				report.errors.push_back("Creating index on scratch database: " + index + ": " + takeErrorMessage(errMsg));
+		}
+
+		for (Recommendation& rec : report.recommendations)
+		{
+			rec.durationAfter = timeQuery(scratch, rec.workload.query, m_repetitions);
+			rec.measured = true;
+		}
+		sqlite3_close(scratch);
+	}
+}
@@ -1,18 +1,55 @@
 #include "LockFile.h"
 #include "Utilities.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/file.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
+#if !defined(_WIN32) && defined(F_OFD_SETLKW)
+	#include <signal.h>
+	#include <pthread.h>
+	#include <mutex>
+	#include <condition_variable>
+
+	#define SQLW_LOCKFILE_BLOCKING_WAIT
+	#ifndef SQLW_LOCKFILE_WAKEUP_SIGNAL
+		// Interrupts a blocking F_OFD_SETLKW at the timeout, define it to another signal if the application uses this one
+		#define SQLW_LOCKFILE_WAKEUP_SIGNAL (SIGRTMIN + 7)
+	#endif
+#endif
+#ifdef _WIN32
+	#define SQLW_LOCKFILE_BLOCKING_WAIT
+#endif
 
 namespace SQLiteWrapper
 {
+	namespace
+	{
+		std::atomic<bool> signalWakeupEnabled(false);
+	}
+
 	LockFile::LockFile(const std::string& path)
 		: m_path(path)
+#ifdef _WIN32
 		, m_handle(INVALID_HANDLE_VALUE)
-		, m_locked(false)
+#else
+		, m_fd(-1)
+		, m_useFlock(false)
+#endif
+		, m_lockMode(LockMode::none)
 	{
 
 	}
 	LockFile::~LockFile()
 	{
-		if (m_locked)
+		if (isLocked())
 			releaseLock();
 
 	}
@@ -20,65 +57,527 @@ namespace SQLiteWrapper
 
 	LockFile::LockStatus LockFile::tryGetLock()
 	{
-		if (m_locked)
+		return tryGetExclusiveLock();
+	}
+	LockFile::LockStatus LockFile::tryGetSharedLock()
+	{
+		return lockWithRetry(LockMode::shared, std::chrono::milliseconds(0));
+	}
+	LockFile::LockStatus LockFile::tryGetExclusiveLock()
+	{
+		return lockWithRetry(LockMode::exclusive, std::chrono::milliseconds(0));
+	}
+	LockFile::LockStatus LockFile::tryGetSharedLock(std::chrono::milliseconds timeout)
+	{
+		return lockWithRetry(LockMode::shared, timeout);
+	}
+	LockFile::LockStatus LockFile::tryGetExclusiveLock(std::chrono::milliseconds timeout)
+	{
+		return lockWithRetry(LockMode::exclusive, timeout);
+	}
+
+	LockFile::CancelToken::CancelToken()
+		: m_cancelled(false)
+	{
+
+	}
+	void LockFile::CancelToken::cancel()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cancelled = true;
+		}
+		m_cv.notify_all();
+	}
+	void LockFile::CancelToken::reset()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cancelled = false;
+	}
+	bool LockFile::CancelToken::isCancelled() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_cancelled;
+	}
+	bool LockFile::CancelToken::waitFor(std::chrono::milliseconds duration)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_cv.wait_for(lock, duration, [this]() { return m_cancelled; });
+	}
+
+	LockFile::LockStatus LockFile::acquire(std::chrono::milliseconds timeout, LockMode mode)
+	{
+#ifdef SQLW_LOCKFILE_BLOCKING_WAIT
+		return acquireUntil(mode, std::chrono::steady_clock::now() + timeout, nullptr);
+#else
+		return lockWithRetry(mode, timeout);
+#endif
+	}
+	LockFile::LockStatus LockFile::acquire(CancelToken& cancel, LockMode mode)
+	{
+		return acquireUntil(mode, std::chrono::steady_clock::time_point::max(), &cancel);
+	}
+
+	void LockFile::setSignalWakeupEnabled(bool enable)
+	{
+		signalWakeupEnabled.store(enable);
+	}
+	bool LockFile::isSignalWakeupEnabled()
+	{
+		return signalWakeupEnabled.load();
+	}
+
+	LockFile::UnlockStatus LockFile::releaseLock()
+	{
+		if (!isLocked())
+			return UnlockStatus::alreadyUnlocked;
+		bool success = unlock();
+		m_lockMode = LockMode::none;
+		return success ? UnlockStatus::unlocked : UnlockStatus::unableToUnlock;
+	}
+
+	void LockFile::resetStatistics()
+	{
+		m_statistics = Statistics();
+	}
+
+	LockFile::LockStatus LockFile::lockWithRetry(LockMode mode, std::chrono::milliseconds timeout)
+	{
+		if (isLocked())
+			return LockStatus::alreadyLocked;
+
+		++m_statistics.attempts;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		LockStatus status = retryLock(mode, start + timeout);
+		if (status == LockStatus::locked)
+		{
+			recordAcquisition(std::chrono::steady_clock::now() - start);
+			m_lockMode = mode;
+		}
+		else if (status == LockStatus::timeout && timeout.count() == 0)
+			status = LockStatus::unableToLock;
+		else if (status != LockStatus::unableToLock && status != LockStatus::timeout)
+			++m_statistics.failures;
+		return status;
+	}
+
+	LockFile::LockStatus LockFile::acquireUntil(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel)
+	{
+		if (isLocked())
 			return LockStatus::alreadyLocked;
+		if (mode == LockMode::none)
+			return LockStatus::unableToLock;
+
+		++m_statistics.attempts;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifdef SQLW_LOCKFILE_BLOCKING_WAIT
+		LockStatus status;
+		while (true)
+		{
+			if (cancel && cancel->isCancelled())
+			{
+				status = LockStatus::cancelled;
+				break;
+			}
+			status = tryLock(mode);
+			bool retry = true;
+			if (status == LockStatus::unableToLock)
+				status = waitForLock(mode, deadline, cancel, retry);
+			if (status != LockStatus::unableToLock || !retry)
+				break;
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				status = LockStatus::timeout;
+				break;
+			}
+		}
+#else
+		LockStatus status = retryLock(mode, deadline, cancel);
+#endif
+		if (status == LockStatus::locked)
+		{
+			recordAcquisition(std::chrono::steady_clock::now() - start);
+			m_lockMode = mode;
+		}
+		else if (status != LockStatus::timeout && status != LockStatus::cancelled)
+			++m_statistics.failures;
+		return status;
+	}
+
+	LockFile::LockStatus LockFile::retryLock(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel)
+	{
+		std::chrono::milliseconds backoff(1);
+		while (true)
+		{
+			if (cancel && cancel->isCancelled())
+				return LockStatus::cancelled;
+			LockStatus status = tryLock(mode);
+			if (status != LockStatus::unableToLock)
+				return status;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now >= deadline)
+				return LockStatus::timeout;
+
+			std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+			std::chrono::milliseconds sleep = std::min(backoff, std::max(remaining, std::chrono::milliseconds(1)));
+			if (cancel)
+			{
+				if (cancel->waitFor(sleep))
+					return LockStatus::cancelled;
+			}
+			else
+				std::this_thread::sleep_for(sleep);
+			backoff = std::min(backoff * 2, std::chrono::milliseconds(50));
+		}
+	}
+
+	void LockFile::recordAcquisition(std::chrono::steady_clock::duration duration)
+	{
+		std::chrono::microseconds us = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+		++m_statistics.acquisitions;
+		m_statistics.totalAcquireTime += us;
+		m_statistics.maxAcquireTime = std::max(m_statistics.maxAcquireTime, us);
+
+		size_t bucket = 0;
+		for (long long value = us.count(); value > 1 && bucket < Statistics::histogramBuckets - 1; value >>= 1)
+			++bucket;
+		++m_statistics.acquireTimeHistogram[bucket];
+	}
+
+#ifdef _WIN32
+	LockFile::LockStatus LockFile::tryLock(LockMode mode)
+	{
+		// Readers share the file, no one can delete it while it is open
 		HANDLE fileHandle = CreateFile(
 #ifdef UNICODE
 			Utilities::strToWstr(m_path).c_str(),
 #else
 			m_path.c_str(),
 #endif
-			GENERIC_WRITE,
-			0,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
 			nullptr,
-			CREATE_ALWAYS,
+			OPEN_ALWAYS,
 			FILE_ATTRIBUTE_NORMAL,
 			nullptr
 		);
 
 		if (fileHandle == INVALID_HANDLE_VALUE) {
-			// Failed to open the file, indicating it might be locked
-			m_locked = false;
-			Logger::logError("LockFile: Creating lock file: " + Utilities::getLastErrorString(GetLastError()) + "\n");
-			return LockStatus::unableToCreateLockFile; // File is possibly locked
+			DWORD error = GetLastError();
+			if (error == ERROR_SHARING_VIOLATION)
+			{
+				// Another process is just deleting the file
+				++m_statistics.contentions;
+				return LockStatus::unableToLock;
+			}
+			Logger::logError("LockFile: Creating lock file: " + Utilities::getLastErrorString(error) + "\n");
+			return LockStatus::unableToCreateLockFile;
 		}
 
-		if (!::LockFile(fileHandle, 0, 0, MAXDWORD, MAXDWORD))
+		OVERLAPPED overlapped = {};
+		DWORD flags = LOCKFILE_FAIL_IMMEDIATELY;
+		if (mode == LockMode::exclusive)
+			flags |= LOCKFILE_EXCLUSIVE_LOCK;
+		if (!LockFileEx(fileHandle, flags, 0, MAXDWORD, MAXDWORD, &overlapped))
 		{
-			m_locked = false;
-			Logger::logError("LockFile: Locking lock file: " + Utilities::getLastErrorString(GetLastError()) + "\n");
+			DWORD error = GetLastError();
 			CloseHandle(fileHandle);
-			m_handle = INVALID_HANDLE_VALUE;
+			if (error == ERROR_LOCK_VIOLATION || error == ERROR_IO_PENDING)
+			{
+				++m_statistics.contentions;
+				return LockStatus::unableToLock;
+			}
+			Logger::logError("LockFile: Locking lock file: " + Utilities::getLastErrorString(error) + "\n");
 			return LockStatus::unableToLock;
 		}
 		m_handle = fileHandle;
-		m_locked = true;
 		return LockStatus::locked;
 	}
-	LockFile::UnlockStatus LockFile::releaseLock()
+	bool LockFile::unlock()
 	{
-		if (!m_locked)
-			return UnlockStatus::alreadyUnlocked;
-		if (!UnlockFile(m_handle, 0, 0, MAXDWORD, MAXDWORD))
-		{
+		OVERLAPPED overlapped = {};
+		bool success = UnlockFileEx(m_handle, 0, MAXDWORD, MAXDWORD, &overlapped) != FALSE;
+		if (!success)
 			Logger::logError("LockFile: Unlocking lock file: " + Utilities::getLastErrorString(GetLastError()) + "\n");
-			CloseHandle(m_handle);
-			m_handle = INVALID_HANDLE_VALUE;
-			return UnlockStatus::unableToUnlock;
-		}
 		CloseHandle(m_handle);
 		m_handle = INVALID_HANDLE_VALUE;
-		// Delete file
-		DeleteFile(
+		if (success && m_lockMode == LockMode::exclusive)
+		{
+			// Delete file, fails if a reader has it open, which is fine
+			DeleteFile(
+#ifdef UNICODE
+				Utilities::strToWstr(m_path).c_str()
+#else
+				m_path.c_str()
+#endif
+				);
+		}
+		return success;
+	}
+	LockFile::LockStatus LockFile::waitForLock(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel, bool& retry)
+	{
+		retry = false;
+		HANDLE fileHandle = CreateFile(
 #ifdef UNICODE
-			Utilities::strToWstr(m_path).c_str()
+			Utilities::strToWstr(m_path).c_str(),
 #else
-			m_path.c_str()
+			m_path.c_str(),
 #endif
-			);
-		
-		
-		m_locked = false;
-		return LockFile::unlocked;		
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+			nullptr
+		);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+		{
+			retry = GetLastError() == ERROR_SHARING_VIOLATION;
+			return retry ? LockStatus::unableToLock : LockStatus::unableToCreateLockFile;
+		}
+
+		OVERLAPPED overlapped = {};
+		overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		DWORD flags = mode == LockMode::exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+		bool success = LockFileEx(fileHandle, flags, 0, MAXDWORD, MAXDWORD, &overlapped) != FALSE;
+		if (!success && GetLastError() == ERROR_IO_PENDING)
+		{
+			// Wakes up as soon as the owner releases the lock, a cancellable wait checks the token in short slices
+			DWORD transferred = 0;
+			bool signaled = false;
+			bool cancelled = false;
+			while (true)
+			{
+				std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+				long long waitTime = std::max<long long>(0, remaining.count());
+				if (cancel)
+					waitTime = std::min<long long>(waitTime, 50);
+				waitTime = std::min<long long>(waitTime, INFINITE - 1);
+				if (WaitForSingleObject(overlapped.hEvent, static_cast<DWORD>(waitTime)) == WAIT_OBJECT_0)
+				{
+					signaled = true;
+					break;
+				}
+				cancelled = cancel && cancel->isCancelled();
+				if (cancelled || std::chrono::steady_clock::now() >= deadline)
+					break;
+			}
+			if (signaled)
+			{
+				success = GetOverlappedResult(fileHandle, &overlapped, &transferred, FALSE) != FALSE;
+			}
+			else
+			{
+				CancelIoEx(fileHandle, &overlapped);
+				// The lock may have been granted before the cancellation
+				success = GetOverlappedResult(fileHandle, &overlapped, &transferred, TRUE) != FALSE;
+				if (!success)
+				{
+					CloseHandle(overlapped.hEvent);
+					CloseHandle(fileHandle);
+					return cancelled ? LockStatus::cancelled : LockStatus::timeout;
+				}
+			}
+		}
+		CloseHandle(overlapped.hEvent);
+		if (!success)
+		{
+			Logger::logError("LockFile: Locking lock file: " + Utilities::getLastErrorString(GetLastError()) + "\n");
+			CloseHandle(fileHandle);
+			return LockStatus::unableToLock;
+		}
+		m_handle = fileHandle;
+		return LockStatus::locked;
 	}
-}
\ No newline at end of file
+#else
+	LockFile::LockStatus LockFile::tryLock(LockMode mode)
+	{
+		int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+		{
+			Logger::logError("LockFile: Creating lock file: " + std::string(strerror(errno)));
+			return LockStatus::unableToCreateLockFile;
+		}
+
+		bool contended = false;
+		bool success = false;
+#ifdef F_OFD_SETLK
+		// Open file description locks belong to this descriptor, not to the process like classic fcntl locks
+		struct flock lock = {};
+		lock.l_type = mode == LockMode::exclusive ? F_WRLCK : F_RDLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 0;
+		if (!m_useFlock)
+		{
+			if (fcntl(fd, F_OFD_SETLK, &lock) == 0)
+				success = true;
+			else if (errno == EAGAIN || errno == EACCES)
+				contended = true;
+			else if (errno == EINVAL)
+				m_useFlock = true; // Kernel older than 3.15, waitForLock() can't block in F_OFD_SETLKW either
+			else
+				Logger::logError("LockFile: Locking lock file: " + std::string(strerror(errno)));
+		}
+		if (m_useFlock)
+#endif
+		{
+			if (flock(fd, (mode == LockMode::exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) == 0)
+				success = true;
+			else if (errno == EWOULDBLOCK)
+				contended = true;
+			else
+				Logger::logError("LockFile: Locking lock file: " + std::string(strerror(errno)));
+		}
+
+		if (success)
+		{
+			// The previous owner may have deleted the file after we opened it,
+			// the lock is only valid if it is still the file at m_path
+			struct stat locked, current;
+			if (fstat(fd, &locked) == 0 && stat(m_path.c_str(), &current) == 0 &&
+				locked.st_dev == current.st_dev && locked.st_ino == current.st_ino)
+			{
+				m_fd = fd;
+				return LockStatus::locked;
+			}
+			success = false;
+			contended = true;
+		}
+		::close(fd);
+		if (contended)
+			++m_statistics.contentions;
+		return LockStatus::unableToLock;
+	}
+	bool LockFile::unlock()
+	{
+		// Delete the file while the exclusive lock is still held, waiting processes notice it after locking
+		if (m_lockMode == LockMode::exclusive)
+			unlink(m_path.c_str());
+		// Closing the descriptor releases the OFD and the flock lock
+		bool success = ::close(m_fd) == 0;
+		if (!success)
+			Logger::logError("LockFile: Unlocking lock file: " + std::string(strerror(errno)));
+		m_fd = -1;
+		return success;
+	}
+
+#ifdef SQLW_LOCKFILE_BLOCKING_WAIT
+	namespace
+	{
+		void onWakeupSignal(int)
+		{
+			// Only interrupts the blocking fcntl call
+		}
+		bool installWakeupHandler()
+		{
+			static const bool installed = []()
+				{
+					struct sigaction current = {};
+					sigaction(SQLW_LOCKFILE_WAKEUP_SIGNAL, nullptr, &current);
+					if ((current.sa_flags & SA_SIGINFO) || (current.sa_handler != SIG_DFL && current.sa_handler != SIG_IGN))
+					{
+						Logger::logError("LockFile: The wakeup signal is used by the application, define SQLW_LOCKFILE_WAKEUP_SIGNAL to another signal");
+						return false;
+					}
+					struct sigaction action = {};
+					action.sa_handler = &onWakeupSignal;
+					sigemptyset(&action.sa_mask);
+					action.sa_flags = 0; // No SA_RESTART, fcntl has to return with EINTR
+					return sigaction(SQLW_LOCKFILE_WAKEUP_SIGNAL, &action, nullptr) == 0;
+				}();
+			return installed;
+		}
+	}
+
+	LockFile::LockStatus LockFile::waitForLock(LockMode mode, std::chrono::steady_clock::time_point deadline, CancelToken* cancel, bool& retry)
+	{
+		retry = false;
+		if (m_useFlock || !signalWakeupEnabled.load() || !installWakeupHandler())
+		{
+			// Without OFD locks or the signal there is no blocking wait, the caller records the statistics
+			return retryLock(mode, deadline, cancel);
+		}
+
+		int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+		{
+			Logger::logError("LockFile: Creating lock file: " + std::string(strerror(errno)));
+			return LockStatus::unableToCreateLockFile;
+		}
+
+		// The signal must reach this thread
+		sigset_t wakeupSet, previousSet;
+		sigemptyset(&wakeupSet);
+		sigaddset(&wakeupSet, SQLW_LOCKFILE_WAKEUP_SIGNAL);
+		pthread_sigmask(SIG_UNBLOCK, &wakeupSet, &previousSet);
+
+		// The timer wakes the wait at the deadline or when the token gets cancelled and keeps
+		// signaling until the wait has ended, a single signal could arrive before fcntl blocks
+		CancelToken localToken;
+		CancelToken& token = cancel ? *cancel : localToken;
+		bool done = false;
+		pthread_t waiter = pthread_self();
+		std::thread* timer = new std::thread([&]()
+			{
+				std::unique_lock<std::mutex> lock(token.m_mutex);
+				auto wake = [&]() { return done || token.m_cancelled; };
+				if (deadline == std::chrono::steady_clock::time_point::max())
+					token.m_cv.wait(lock, wake);
+				else
+					token.m_cv.wait_until(lock, deadline, wake);
+				while (!done)
+				{
+					pthread_kill(waiter, SQLW_LOCKFILE_WAKEUP_SIGNAL);
+					token.m_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() { return done; });
+				}
+			});
+
+		struct flock lock = {};
+		lock.l_type = mode == LockMode::exclusive ? F_WRLCK : F_RDLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 0;
+		int rc = fcntl(fd, F_OFD_SETLKW, &lock);
+		int error = errno;
+
+		{
+			std::unique_lock<std::mutex> guard(token.m_mutex);
+			done = true;
+		}
+		token.m_cv.notify_all();
+		timer->join();
+		delete timer;
+		pthread_sigmask(SIG_SETMASK, &previousSet, nullptr);
+
+		if (rc == 0)
+		{
+			// Same check as in tryLock(), the previous owner may have deleted the file
+			struct stat locked, current;
+			if (fstat(fd, &locked) == 0 && stat(m_path.c_str(), &current) == 0 &&
+				locked.st_dev == current.st_dev && locked.st_ino == current.st_ino)
+			{
+				m_fd = fd;
+				return LockStatus::locked;
+			}
+			::close(fd);
+			++m_statistics.contentions;
+			retry = true;
+			return LockStatus::unableToLock;
+		}
+		::close(fd);
+		if (error == EINTR)
+		{
+			if (token.isCancelled())
+				return LockStatus::cancelled;
+			if (std::chrono::steady_clock::now() >= deadline)
+				return LockStatus::timeout;
+			retry = true; // Interrupted by another signal
+			return LockStatus::unableToLock;
+		}
+		Logger::logError("LockFile: Waiting for lock file: " + std::string(strerror(error)));
+		return LockStatus::unableToLock;
+	}
+#endif
+#endif
+}
@@ -0,0 +1,412 @@
+#include "MetricsExporter.h"
+#include "SQLite.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		struct DatabaseMetric
+		{
+			const char* name;
+			const char* type;
+			const char* help;
+			int64_t ConnectionMetrics::Snapshot::* value;
+		};
+		const DatabaseMetric databaseMetrics[] = {
+			{ "sqlite_lookaside_used", "gauge", "Lookaside memory slots in use.", &ConnectionMetrics::Snapshot::lookasideUsed },
+			{ "sqlite_lookaside_hits_total", "counter", "Allocations served from the lookaside memory.", &ConnectionMetrics::Snapshot::lookasideHit },
+			{ "sqlite_lookaside_miss_size_total", "counter", "Allocations too large for the lookaside memory.", &ConnectionMetrics::Snapshot::lookasideMissSize },
+			{ "sqlite_lookaside_miss_full_total", "counter", "Allocations which found the lookaside memory full.", &ConnectionMetrics::Snapshot::lookasideMissFull },
+			{ "sqlite_cache_used_bytes", "gauge", "Heap memory used by the page cache.", &ConnectionMetrics::Snapshot::cacheUsed },
+			{ "sqlite_cache_hits_total", "counter", "Page cache hits.", &ConnectionMetrics::Snapshot::cacheHit },
+			{ "sqlite_cache_misses_total", "counter", "Page cache misses.", &ConnectionMetrics::Snapshot::cacheMiss },
+			{ "sqlite_cache_writes_total", "counter", "Dirty pages written to the database file.", &ConnectionMetrics::Snapshot::cacheWrite },
+			{ "sqlite_cache_spills_total", "counter", "Dirty pages written in the middle of a transaction.", &ConnectionMetrics::Snapshot::cacheSpill },
+			{ "sqlite_schema_used_bytes", "gauge", "Heap memory used by the schema.", &ConnectionMetrics::Snapshot::schemaUsed },
+			{ "sqlite_statement_used_bytes", "gauge", "Heap memory used by prepared statements.", &ConnectionMetrics::Snapshot::statementUsed },
+		};
+		const DatabaseMetric processMetrics[] = {
+			{ "sqlite_memory_used_bytes", "gauge", "Memory allocated by SQLite in the process.", &ConnectionMetrics::Snapshot::memoryUsed },
+			{ "sqlite_memory_highwater_bytes", "gauge", "Highest memory allocated by SQLite in the process.", &ConnectionMetrics::Snapshot::memoryHighwater },
+			{ "sqlite_malloc_count", "gauge", "Outstanding allocations of SQLite in the process.", &ConnectionMetrics::Snapshot::mallocCount },
+			{ "sqlite_pagecache_overflow_bytes", "gauge", "Page cache memory which did not fit into the configured page cache.", &ConnectionMetrics::Snapshot::pageCacheOverflow },
+		};
+
+		struct StatementMetric
+		{
+			const char* name;
+			const char* help;
+			uint64_t ConnectionMetrics::StatementStats::* value;
+		};
+		const StatementMetric statementMetrics[] = {
+			{ "sqlite_statement_runs_total", "Executions of the statement.", &ConnectionMetrics::StatementStats::runs },
+			{ "sqlite_statement_vm_steps_total", "Virtual machine operations of the statement.", &ConnectionMetrics::StatementStats::vmSteps },
+			{ "sqlite_statement_fullscan_steps_total", "Full table scan steps of the statement.", &ConnectionMetrics::StatementStats::fullscanSteps },
+			{ "sqlite_statement_sorts_total", "Sort operations of the statement.", &ConnectionMetrics::StatementStats::sorts },
+			{ "sqlite_statement_autoindexes_total", "Rows inserted into automatic indexes of the statement.", &ConnectionMetrics::StatementStats::autoIndexes },
+		};
+
+		std::string escapeLabel(const std::string& value)
+		{
+			std::string escaped;
+			escaped.reserve(value.size());
+			for (char c : value)
+			{
+				switch (c)
+				{
+					case '\\': escaped += "\\\\"; break;
+					case '"': escaped += "\\\""; break;
+					case '\n': escaped += "\\n"; break;
+					default: escaped += c; break;
+				}
+			}
+			return escaped;
+		}
+
+		std::string escapeJson(const std::string& value)
+		{
+			std::string escaped;
+			escaped.reserve(value.size() + 2);
+			escaped += '"';
+			for (char c : value)
+			{
+				switch (c)
+				{
+					case '\\': escaped += "\\\\"; break;
+					case '"': escaped += "\\\""; break;
+					case '\n': escaped += "\\n"; break;
+					case '\r': escaped += "\\r"; break;
+					case '\t': escaped += "\\t"; break;
+					default:
+						if (static_cast<unsigned char>(c) < 0x20)
+						{
+							static const char hexDigits[] = "0123456789abcdef";
+							escaped += "\\u00";
+							escaped += hexDigits[(c >> 4) & 0x0F];
+							escaped += hexDigits[c & 0x0F];
+						}
+						else
+							escaped += c;
+						break;
+				}
+			}
+			escaped += '"';
+			return escaped;
+		}
+
+		std::string seconds(std::chrono::microseconds duration)
+		{
+			std::ostringstream stream;
+			stream << std::setprecision(9) << duration.count() / 1e6;
+			return stream.str();
+		}
+
+		// Labels which identify the connection of a sample
+		std::string connectionLabels(const ConnectionMetrics::Snapshot& snapshot)
+		{
+			return "database=\"" + escapeLabel(snapshot.database) + "\",connection=\"" + escapeLabel(snapshot.connection) + "\"";
+		}
+
+		void writeHeader(std::ostringstream& out, const char* name, const char* type, const char* help)
+		{
+			out << "# HELP " << name << " " << help << "\n";
+			out << "# TYPE " << name << " " << type << "\n";
+		}
+	}
+
+	MetricsExporter::MetricsExporter(Format format)
+		: m_format(format)
+		, m_interval(10000)
+		, m_addedConnections(0)
+		, m_thread(nullptr)
+		, m_stop(false)
+	{
+
+	}
+
+	MetricsExporter::~MetricsExporter()
+	{
+		stop();
+	}
+
+	void MetricsExporter::setFormat(Format format)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_format = format;
+	}
+	MetricsExporter::Format MetricsExporter::getFormat() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_format;
+	}
+
+	void MetricsExporter::setInterval(std::chrono::milliseconds interval)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_interval = std::max(interval, std::chrono::milliseconds(1));
+		m_cv.notify_all();
+	}
+	std::chrono::milliseconds MetricsExporter::getInterval() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_interval;
+	}
+
+	void MetricsExporter::setFile(const std::string& path)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_file = path;
+	}
+	std::string MetricsExporter::getFile() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_file;
+	}
+
+	void MetricsExporter::setSink(const Sink& sink)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_sink = sink;
+	}
+
+	void MetricsExporter::addConnection(const SQLite* db, const std::string& name)
+	{
+		if (!db)
+			return;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto it = std::find_if(m_connections.begin(), m_connections.end(), [db](const std::pair<const SQLite*, std::string>& connection) { return connection.first == db; });
+		if (it != m_connections.end())
+			return;
+		m_connections.emplace_back(db, name.empty() ? std::to_string(m_addedConnections) : name);
+		++m_addedConnections;
+	}
+	void MetricsExporter::removeConnection(const SQLite* db)
+	{
+		// Waits for a running export, the connection may be destroyed afterwards
+		std::unique_lock<std::mutex> exportLock(m_exportMutex);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_connections.erase(std::remove_if(m_connections.begin(), m_connections.end(),
+			[db](const std::pair<const SQLite*, std::string>& connection) { return connection.first == db; }), m_connections.end());
+	}
+
+	bool MetricsExporter::start()
+	{
+		if (m_thread)
+			return true;
+		m_stop = false;
+		m_thread = new std::thread(&MetricsExporter::run, this);
+		return true;
+	}
+
+	void MetricsExporter::stop()
+	{
+		if (!m_thread)
+			return;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_cv.notify_all();
+		}
+		m_thread->join();
+		delete m_thread;
+		m_thread = nullptr;
+	}
+
+	bool MetricsExporter::isRunning() const
+	{
+		return m_thread != nullptr;
+	}
+
+	void MetricsExporter::run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop)
+		{
+			std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + m_interval;
+			m_cv.wait_until(lock, next, [this, next] { return m_stop || std::chrono::steady_clock::now() >= next; });
+			if (m_stop)
+				break;
+			lock.unlock();
+			exportNow();
+			lock.lock();
+		}
+	}
+
+	bool MetricsExporter::exportNow()
+	{
+		std::unique_lock<std::mutex> exportLock(m_exportMutex);
+		Format format;
+		std::string file;
+		Sink sink;
+		std::vector<std::pair<const SQLite*, std::string>> connections;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			format = m_format;
+			file = m_file;
+			sink = m_sink;
+			connections = m_connections;
+		}
+
+		std::vector<ConnectionMetrics::Snapshot> snapshots;
+		snapshots.reserve(connections.size());
+		for (const std::pair<const SQLite*, std::string>& connection : connections)
+		{
+			snapshots.push_back(connection.first->getMetricsSnapshot());
+			snapshots.back().connection = connection.second;
+		}
+
+		std::string content = format == Format::json ? toJson(snapshots) : toPrometheus(snapshots);
+		bool success = true;
+		if (!file.empty())
+			success = writeFile(file, content);
+		if (sink)
+			sink(content);
+		return success;
+	}
+
+	bool MetricsExporter::writeFile(const std::string& path, const std::string& content)
+	{
+		// Readers never see a partially written file
+		std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				Logger::logError("MetricsExporter: Opening " + temporaryPath + " failed");
+				return false;
+			}
+			file.write(content.data(), static_cast<std::streamsize>(content.size()));
+			if (!file.good())
+			{
+				Logger::logError("MetricsExporter: Writing " + temporaryPath + " failed");
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			Logger::logError("MetricsExporter: Renaming " + temporaryPath + " to " + path + ": " + error.message());
+			return false;
+		}
+		return true;
+	}
+
+	std::string MetricsExporter::toPrometheus(const std::vector<ConnectionMetrics::Snapshot>& snapshots)
+	{
+		// All samples of a metric have to follow its header
+		std::ostringstream out;
+		for (const DatabaseMetric& metric : databaseMetrics)
+		{
+			writeHeader(out, metric.name, metric.type, metric.help);
+			for (const ConnectionMetrics::Snapshot& snapshot : snapshots)
+				out << metric.name << "{" << connectionLabels(snapshot) << "} " << snapshot.*metric.value << "\n";
+		}
+		if (!snapshots.empty())
+		{
+			for (const DatabaseMetric& metric : processMetrics)
+			{
+				writeHeader(out, metric.name, metric.type, metric.help);
+				out << metric.name << " " << snapshots.front().*metric.value << "\n";
+			}
+		}
+
+		for (const StatementMetric& metric : statementMetrics)
+		{
+			writeHeader(out, metric.name, "counter", metric.help);
+			for (const ConnectionMetrics::Snapshot& snapshot : snapshots)
+			{
+				std::string labels = connectionLabels(snapshot);
+				for (const ConnectionMetrics::StatementStats& stats : snapshot.statements)
+					out << metric.name << "{" << labels << ",fingerprint=\"" << escapeLabel(stats.fingerprint) << "\"} " << stats.*metric.value << "\n";
+			}
+		}
+
+		writeHeader(out, "sqlite_statement_duration_seconds", "histogram", "Execution time of the statement.");
+		for (const ConnectionMetrics::Snapshot& snapshot : snapshots)
+		{
+			std::string connection = connectionLabels(snapshot);
+			for (const ConnectionMetrics::StatementStats& stats : snapshot.statements)
+			{
+				std::string labels = connection + ",fingerprint=\"" + escapeLabel(stats.fingerprint) + "\"";
+				uint64_t cumulative = 0;
+				for (size_t i = 0; i < ConnectionMetrics::durationBucketCount; ++i)
+				{
+					cumulative += stats.durationBuckets[i];
+					std::string bound = i < ConnectionMetrics::durationBucketBounds.size() ?
+						seconds(std::chrono::microseconds(ConnectionMetrics::durationBucketBounds[i])) : "+Inf";
+					out << "sqlite_statement_duration_seconds_bucket{" << labels << ",le=\"" << bound << "\"} " << cumulative << "\n";
+				}
+				out << "sqlite_statement_duration_seconds_sum{" << labels << "} " << seconds(stats.totalDuration) << "\n";
+				out << "sqlite_statement_duration_seconds_count{" << labels << "} " << stats.runs << "\n";
+			}
+		}
+
+		writeHeader(out, "sqlite_statement_duration_max_seconds", "gauge", "Longest execution time of the statement.");
+		for (const ConnectionMetrics::Snapshot& snapshot : snapshots)
+		{
+			std::string labels = connectionLabels(snapshot);
+			for (const ConnectionMetrics::StatementStats& stats : snapshot.statements)
+				out << "sqlite_statement_duration_max_seconds{" << labels << ",fingerprint=\"" << escapeLabel(stats.fingerprint) << "\"} " << seconds(stats.maxDuration) << "\n";
+		}
+		return out.str();
+	}
+
+	std::string MetricsExporter::toJson(const std::vector<ConnectionMetrics::Snapshot>& snapshots)
+	{
+		std::ostringstream out;
+		long long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		out << "{\"timestamp\":" << now;
+		if (!snapshots.empty())
+		{
+			out << ",\"process\":{";
+			const char* separator = "";
+			for (const DatabaseMetric& metric : processMetrics)
+			{
+				out << separator << "\"" << metric.name << "\":" << snapshots.front().*metric.value;
+				separator = ",";
+			}
+			out << "}";
+		}
+
+		out << ",\"connections\":[";
+		for (size_t c = 0; c < snapshots.size(); ++c)
+		{
+			const ConnectionMetrics::Snapshot& snapshot = snapshots[c];
+			long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(snapshot.timestamp.time_since_epoch()).count();
+			out << (c > 0 ? "," : "") << "{\"database\":" << escapeJson(snapshot.database) << ",\"connection\":" << escapeJson(snapshot.connection) << ",\"timestamp\":" << timestamp;
+			for (const DatabaseMetric& metric : databaseMetrics)
+				out << ",\"" << metric.name << "\":" << snapshot.*metric.value;
+
+			out << ",\"statements\":[";
+			for (size_t s = 0; s < snapshot.statements.size(); ++s)
+			{
+				const ConnectionMetrics::StatementStats& stats = snapshot.statements[s];
+				out << (s > 0 ? "," : "") << "{\"fingerprint\":" << escapeJson(stats.fingerprint) << ",\"query\":" << escapeJson(stats.query);
+				for (const StatementMetric& metric : statementMetrics)
+					out << ",\"" << metric.name << "\":" << stats.*metric.value;
+				out << ",\"sqlite_statement_duration_seconds_sum\":" << seconds(stats.totalDuration);
+				out << ",\"sqlite_statement_duration_max_seconds\":" << seconds(stats.maxDuration);
+				out << ",\"duration_buckets\":[";
+				for (size_t i = 0; i < ConnectionMetrics::durationBucketCount; ++i)
+				{
+					out << (i > 0 ? "," : "") << "{\"le\":";
+					if (i < ConnectionMetrics::durationBucketBounds.size())
+						out << seconds(std::chrono::microseconds(ConnectionMetrics::durationBucketBounds[i]));
+					else
+						out << "null";
+					out << ",\"count\":" << stats.durationBuckets[i] << "}";
+				}
+				out << "]}";
+			}
+			out << "]}";
+		}
+		out << "]}";
+		return out.str();
+	}
+}
@@ -0,0 +1,89 @@
+#include "QueryPlanLinter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SQLiteWrapper
+{
+	std::string QueryPlanLinter::Result::toString() const
+	{
+		std::string str = "Query plan issues for: " + query;
+		for (const std::string& issue : issues)
+			str += "\n  " + issue;
+		return str;
+	}
+
+	QueryPlanLinter::QueryPlanLinter(size_t maxFingerprints)
+		: m_mode(Mode::disabled)
+		, m_maxFingerprints(maxFingerprints)
+	{
+
+	}
+
+	bool QueryPlanLinter::contains(const std::string& fingerprint) const
+	{
+		return m_cache.find(fingerprint) != m_cache.end();
+	}
+	const QueryPlanLinter::Result& QueryPlanLinter::store(Result&& result)
+	{
+		std::string fingerprint = result.fingerprint;
+		return m_cache[fingerprint] = std::move(result);
+	}
+
+	std::vector<QueryPlanLinter::Result> QueryPlanLinter::getFindings() const
+	{
+		std::vector<Result> findings;
+		for (const auto& it : m_cache)
+		{
+			if (it.second.hasIssues())
+				findings.push_back(it.second);
+		}
+		return findings;
+	}
+	void QueryPlanLinter::clear()
+	{
+		m_cache.clear();
+	}
+
+	std::vector<std::string> QueryPlanLinter::analyze(const std::vector<std::string>& queryPlan)
+	{
+		std::vector<std::string> issues;
+		std::vector<std::string> subqueries; // Materialized subqueries and CTEs
+		for (const std::string& line : queryPlan)
+		{
+			size_t begin = line.find_first_not_of(' ');
+			if (begin == std::string::npos)
+				continue;
+			std::string detail = line.substr(begin);
+
+			for (const char* prefix : { "MATERIALIZE ", "CO-ROUTINE " })
+			{
+				size_t length = strlen(prefix);
+				if (detail.rfind(prefix, 0) == 0)
+					subqueries.push_back(detail.substr(length, detail.find(' ', length) - length));
+			}
+			if (detail.rfind("SCAN ", 0) == 0)
+			{
+				// "SCAN t USING INDEX i" and "SCAN t USING COVERING INDEX i" use an index,
+				// constant rows, virtual tables and the schema table are not worth reporting.
+				// Scans of subqueries and CTEs, "SCAN (subquery-1)", "SCAN SUBQUERY 1" or "SCAN cte",
+				// read a result the plan already built, their own steps are inspected separately.
+				std::string table = detail.substr(5, detail.find(' ', 5) - 5);
+				if (detail.find(" USING ") == std::string::npos &&
+					detail.find("VIRTUAL TABLE") == std::string::npos &&
+					table != "CONSTANT" &&
+					table != "SUBQUERY" &&
+					table.rfind("(", 0) != 0 &&
+					table.rfind("sqlite_", 0) != 0 &&
+					std::find(subqueries.begin(), subqueries.end(), table) == subqueries.end())
+				{
+					issues.push_back("Full table scan: " + detail);
+				}
+			}
+			if (detail.find("USE TEMP B-TREE FOR ORDER BY") != std::string::npos)
+				issues.push_back("Temporary B-tree for sorting: " + detail);
+			if (detail.find("AUTOMATIC") != std::string::npos && detail.find("INDEX") != std::string::npos)
+				issues.push_back("Automatic index: " + detail);
+		}
+		return issues;
+	}
+}
@@ -0,0 +1,67 @@
+#include "QueryWorkload.h"
+#include "Utilities.h"
+#include <algorithm>
+
+namespace SQLiteWrapper
+{
+	QueryWorkload::QueryWorkload(size_t maxFingerprints)
+		: m_maxFingerprints(maxFingerprints)
+		, m_capturing(false)
+	{
+
+	}
+
+	void QueryWorkload::start()
+	{
+		if (m_capturing)
+			return;
+		m_capturing = true;
+		m_startTime = std::chrono::system_clock::now();
+	}
+	void QueryWorkload::stop()
+	{
+		if (!m_capturing)
+			return;
+		m_capturing = false;
+		m_stopTime = std::chrono::system_clock::now();
+	}
+
+	void QueryWorkload::record(const std::string& query, std::chrono::microseconds duration)
+	{
+		if (!m_capturing)
+			return;
+		std::string fingerprint = Utilities::getQueryFingerprint(query);
+		auto it = m_entries.find(fingerprint);
+		if (it == m_entries.end())
+		{
+			if (m_entries.size() >= m_maxFingerprints)
+				return;
+			Entry entry;
+			entry.fingerprint = fingerprint;
+			entry.query = query;
+			it = m_entries.emplace(fingerprint, std::move(entry)).first;
+		}
+		Entry& entry = it->second;
+		++entry.executions;
+		entry.totalDuration += duration;
+		if (duration > entry.maxDuration)
+			entry.maxDuration = duration;
+	}
+
+	std::vector<QueryWorkload::Entry> QueryWorkload::getEntries() const
+	{
+		std::vector<Entry> entries;
+		entries.reserve(m_entries.size());
+		for (const auto& it : m_entries)
+			entries.push_back(it.second);
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+			{
+				return a.totalDuration > b.totalDuration;
+			});
+		return entries;
+	}
+	void QueryWorkload::clear()
+	{
+		m_entries.clear();
+	}
+}
@@ -1,4 +1,11 @@
 #include "SQLite.h"
+#include "Utilities.h"
+#include <map>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <QTimer>
+#include <QThread>
 
 namespace SQLiteWrapper
 {
@@ -7,43 +14,95 @@ namespace SQLiteWrapper
 		: m_dbPath(dbPath)
 		, m_db(nullptr)
 		, m_logger("SQLite:" + dbPath)
-		, m_watcher(dbPath, FileChangeWatcher::Mode::polling)
 	{
-		connect(&m_watcher, &FileChangeWatcher::onFileChanged, this, &SQLite::onDBFileChanged);
+		// The watcher is created on demand, constructing a SQLite object does not touch the file
+		m_backupRunning.store(false);
+		m_backupCancel.store(false);
+		m_reloadedDb.store(nullptr);
+		m_channelCommitPending.store(false);
+		m_interruptRequested.store(false);
+		m_activeBudget.store(nullptr);
+		m_threadSafe.store(false);
+
+		// For queued connections to onRowsChanged
+		qRegisterMetaType<SQLite::RowChange>("SQLite::RowChange");
+		qRegisterMetaType<std::vector<SQLite::RowChange>>("std::vector<SQLite::RowChange>");
 	}
 
 	SQLite::~SQLite()
 	{
+		setChangeDetectionEnabled(false);
+		setChangeChannelEnabled(false);
 		if (m_db)
 			close();
 	}
 
 	bool SQLite::open()
 	{
+		if (needsStrand())
+			return serialized([&]() { return open(); });
 		if (m_db)
 		{
 			m_logger.logWarning("Database is already open");
 			return true;
 		}
-		if (handleSQLiteError(sqlite3_open(m_dbPath.c_str(), &m_db)) != SQLITE_OK)
+		if (m_inMemoryHotCopy)
 		{
-			m_logger.logError("Failed to open database: " + m_dbPath);
+			sqlite3* copy = loadHotCopy();
+			if (!copy)
+			{
+				m_logger.logError("Failed to load the in-memory hot copy of: " + m_dbPath);
+				return false;
+			}
+			replaceHandle(copy);
+			m_tableChangeTracker.snapshot(m_db);
+
+			// The copy has to follow the file, also without a receiver of onDBChanged
+			startChangeDetection();
+			m_logger.logInfo("Database loaded into memory");
+			return true;
+		}
+		int flags = m_readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+		sqlite3* db = nullptr;
+		int rc = sqlite3_open_v2(m_dbPath.c_str(), &db, flags, nullptr);
+		if (rc != SQLITE_OK)
+		{
+			// sqlite3_open_v2 returns a handle for the error message, even if the open failed
+			m_logger.logError("Failed to open database: " + m_dbPath + ": " + std::string(db ? sqlite3_errmsg(db) : sqlite3_errstr(rc)));
+			sqlite3_close(db);
 			return false;
 		}
+		replaceHandle(db);
+		m_busyHandler.install(m_db);
+		installHooks();
+		if (m_tableChangeTracker.getMode() == TableChangeTracker::Mode::triggers && !m_readOnly &&
+			!m_tableChangeTracker.installTriggers(m_db))
+		{
+			m_logger.logWarning("The change counter triggers could not be installed, the table change tracking uses the fingerprints");
+			m_tableChangeTracker.setMode(TableChangeTracker::Mode::fingerprint);
+		}
+		m_tableChangeTracker.snapshot(m_db);
 		m_logger.logInfo("Database opened successfully");
 		return true;
 	}
 
 	bool SQLite::close()
 	{
+		if (needsStrand())
+			return serialized([&]() { return close(); });
+		if (m_backupThread)
+		{
+			cancelBackup();
+			waitForBackup();
+		}
+		stopHotCopyReload();
 		if (m_db)
 		{
-			if (handleSQLiteError(sqlite3_close(m_db)) != SQLITE_OK)
+			if (handleSQLiteError(replaceHandle(nullptr)) != SQLITE_OK)
 			{
 				m_logger.logError("Failed to close database");
 				return false;
 			}
-			m_db = nullptr;
 			m_logger.logInfo("Database closed");
 			return true;
 		}
@@ -53,12 +112,49 @@ namespace SQLiteWrapper
 
 	bool SQLite::execute(const std::string& query)
 	{
-		char* errMsg = nullptr;
-		int rc = sqlite3_exec(m_db, query.c_str(), nullptr, nullptr, &errMsg);
+		if (needsStrand())
+			return serialized([&]() { return execute(query); });
+		int rc = SQLITE_OK;
+		std::string error;
+		const char* tail = query.c_str();
+		while (rc == SQLITE_OK && *tail)
+		{
+			// One statement after the other, like sqlite3_exec()
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			sqlite3_stmt* stmt = nullptr;
+			rc = sqlite3_prepare_v2(m_db, tail, -1, &stmt, &tail);
+			if (rc != SQLITE_OK)
+			{
+				error = sqlite3_errmsg(m_db);
+				continue;
+			}
+			if (!stmt)
+				continue; // Only whitespace and comments left
+
+			size_t changeMark = m_uncommittedRowChanges.size();
+			int stepRc;
+			do
+			{
+				stepRc = sqlite3_step(stmt);
+			} while (stepRc == SQLITE_ROW);
+			if (stepRc != SQLITE_DONE)
+			{
+				// Taken before the recording, which may use the connection
+				error = sqlite3_errmsg(m_db);
+				if (!sqlite3_get_autocommit(m_db) && m_uncommittedRowChanges.size() > changeMark)
+				{
+					// The failed statement got undone, the transaction stays open
+					m_uncommittedRowChanges.resize(changeMark);
+				}
+			}
+			// Each statement is recorded with its own text and counters, before it gets finalized
+			recordExecution(stmt, sqlite3_sql(stmt), {}, start);
+			rc = sqlite3_finalize(stmt);
+		}
+		deliverRowChanges();
 		if (rc != SQLITE_OK)
 		{
-			m_logger.logError("Failed to execute query: " + query + " logError: " + errMsg);
-			sqlite3_free(errMsg);
+			m_logger.logError("Failed to execute query: " + query + " logError: " + error);
 			return false;
 		}
 		return true;
@@ -66,11 +162,15 @@ namespace SQLiteWrapper
 
 	bool SQLite::executeWithParams(const std::string& query, const std::vector<std::string>& params)
 	{
+		if (needsStrand())
+			return serialized([&]() { return executeWithParams(query, params); });
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 		sqlite3_stmt* stmt = nullptr;
 		if (handleSQLiteError(sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, nullptr)) != SQLITE_OK)
 		{
 			return false;
 		}
+		lintQueryPlan(query);
 
 		for (size_t i = 0; i < params.size(); ++i)
 		{
@@ -81,8 +181,17 @@ namespace SQLiteWrapper
 			}
 		}
 
+		size_t changeMark = m_uncommittedRowChanges.size();
 		int rc = sqlite3_step(stmt);
+		recordExecution(stmt, query, params, start);
 		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE && m_db && !sqlite3_get_autocommit(m_db))
+		{
+			// The failed statement got undone, the transaction stays open
+			if (m_uncommittedRowChanges.size() > changeMark)
+				m_uncommittedRowChanges.resize(changeMark);
+		}
+		deliverRowChanges();
 		return (rc == SQLITE_DONE);
 	}
 
@@ -126,26 +235,157 @@ namespace SQLiteWrapper
 
 	std::vector<std::vector<std::string>> SQLite::fetchAll(const std::string& query)
 	{
+		if (needsStrand())
+			return serialized([&]() { return fetchAll(query); });
 		std::vector<std::vector<std::string>> results;
+		fetchRows(query, results);
+		return results;
+	}
+
+	bool SQLite::fetchRows(const std::string& query, std::vector<std::vector<std::string>>& results)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 		sqlite3_stmt* stmt = nullptr;
 		if (handleSQLiteError(sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, nullptr)) != SQLITE_OK)
 		{
-			return results;
+			return false;
 		}
+		lintQueryPlan(query);
 
-		while (sqlite3_step(stmt) == SQLITE_ROW)
+		int rc;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
 		{
 			int columnCount = sqlite3_column_count(stmt);
 			std::vector<std::string> row;
 			for (int i = 0; i < columnCount; ++i)
 			{
+				// Use the byte count, values can contain NUL bytes
 				const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-				row.push_back(text ? text : "");
+				row.push_back(text ? std::string(text, static_cast<size_t>(sqlite3_column_bytes(stmt, i))) : "");
 			}
 			results.push_back(row);
 		}
-		sqlite3_finalize(stmt);
-		return results;
+		// The result codes are taken here, the recording and the delivery below may use the connection
+		std::string error = rc != SQLITE_DONE ? std::string(sqlite3_errmsg(m_db)) : std::string();
+		recordExecution(stmt, query, {}, start);
+		int finalizeRc = sqlite3_finalize(stmt);
+		deliverRowChanges();
+		if (rc != SQLITE_DONE || finalizeRc != SQLITE_OK)
+		{
+			m_logger.logError("Failed to fetch query: " + query + " logError: " + (error.empty() ? std::string(sqlite3_errstr(finalizeRc)) : error));
+			return false;
+		}
+		return true;
+	}
+
+	SQLite::ExecutionBudget SQLite::ExecutionBudget::withTimeout(std::chrono::microseconds timeout)
+	{
+		ExecutionBudget budget;
+		budget.deadline = std::chrono::steady_clock::now() + timeout;
+		return budget;
+	}
+
+	SQLite::ExecutionStatus SQLite::execute(const std::string& query, const ExecutionBudget& budget)
+	{
+		if (needsStrand())
+			return serialized([&]() { return execute(query, budget); });
+		beginBudget(budget);
+		return endBudget(execute(query));
+	}
+
+	SQLite::ExecutionStatus SQLite::executeWithParams(const std::string& query, const std::vector<std::string>& params, const ExecutionBudget& budget)
+	{
+		if (needsStrand())
+			return serialized([&]() { return executeWithParams(query, params, budget); });
+		beginBudget(budget);
+		return endBudget(executeWithParams(query, params));
+	}
+
+	SQLite::ExecutionStatus SQLite::fetchAll(const std::string& query, std::vector<std::vector<std::string>>& results, const ExecutionBudget& budget)
+	{
+		if (needsStrand())
+			return serialized([&]() { return fetchAll(query, results, budget); });
+		beginBudget(budget);
+		results.clear();
+		return endBudget(fetchRows(query, results));
+	}
+
+	void SQLite::interrupt()
+	{
+		// close() and the hot copy reload replace the handle under the same lock
+		std::unique_lock<std::mutex> lock(m_handleMutex);
+		if (!m_db)
+			return;
+		// Only a budgeted call reports the interrupt, a plain call just fails
+		if (m_activeBudget.load())
+			m_interruptRequested.store(true);
+		sqlite3_interrupt(m_db);
+	}
+
+	int SQLite::replaceHandle(sqlite3* db)
+	{
+		std::unique_lock<std::mutex> lock(m_handleMutex);
+		if (m_db)
+		{
+			int rc = sqlite3_close(m_db);
+			if (rc != SQLITE_OK)
+				return rc;
+		}
+		m_db = db;
+		return SQLITE_OK;
+	}
+
+	void SQLite::setProgressCheckInterval(int instructions)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setProgressCheckInterval(instructions); });
+		m_progressCheckInterval = instructions > 0 ? instructions : 1;
+	}
+
+	void SQLite::beginBudget(const ExecutionBudget& budget)
+	{
+		m_budgetStop = ExecutionStatus::succeeded;
+		m_interruptRequested.store(false);
+		m_activeBudget.store(&budget);
+		if (!m_db)
+			return;
+		sqlite3_progress_handler(m_db, m_progressCheckInterval, &SQLite::progressHandler, this);
+		m_busyHandler.setDeadline(budget.deadline);
+	}
+
+	SQLite::ExecutionStatus SQLite::endBudget(bool success)
+	{
+		const ExecutionBudget* budget = m_activeBudget.exchange(nullptr);
+		if (m_db)
+		{
+			sqlite3_progress_handler(m_db, 0, nullptr, nullptr);
+			m_busyHandler.setDeadline(std::chrono::steady_clock::time_point::max());
+		}
+		bool interruptRequested = m_interruptRequested.exchange(false);
+		if (m_budgetStop != ExecutionStatus::succeeded)
+			return m_budgetStop;
+		if (success)
+			return ExecutionStatus::succeeded;
+		if (interruptRequested)
+			return ExecutionStatus::interrupted;
+		if (budget && std::chrono::steady_clock::now() >= budget->deadline)
+			return ExecutionStatus::deadlineExceeded; // The busy handler gave up waiting for a lock
+		return ExecutionStatus::failed;
+	}
+
+	int SQLite::progressHandler(void* context)
+	{
+		SQLite* self = static_cast<SQLite*>(context);
+		const ExecutionBudget* budget = self->m_activeBudget.load(std::memory_order_relaxed);
+		if (!budget)
+			return 0;
+		if (budget->token.isCancelled())
+			self->m_budgetStop = ExecutionStatus::cancelled;
+		else if (std::chrono::steady_clock::now() >= budget->deadline)
+			self->m_budgetStop = ExecutionStatus::deadlineExceeded;
+		else
+			return 0;
+		return 1; // The statement fails with SQLITE_INTERRUPT
 	}
 
 	bool SQLite::beginTransaction()
@@ -173,6 +413,8 @@ namespace SQLiteWrapper
 
 	sqlite3_int64 SQLite::getLastInsertRowId()
 	{
+		if (needsStrand())
+			return serialized([&]() { return getLastInsertRowId(); });
 		return sqlite3_last_insert_rowid(m_db);
 	}
 
@@ -181,6 +423,346 @@ namespace SQLiteWrapper
 		return m_db != nullptr;
 	}
 
+	std::vector<std::string> SQLite::explainQueryPlan(const std::string& query)
+	{
+		if (needsStrand())
+			return serialized([&]() { return explainQueryPlan(query); });
+		std::vector<std::string> plan;
+		sqlite3_stmt* stmt = nullptr;
+		if (handleSQLiteError(sqlite3_prepare_v2(m_db, ("EXPLAIN QUERY PLAN " + query).c_str(), -1, &stmt, nullptr)) != SQLITE_OK)
+		{
+			return plan;
+		}
+
+		// Columns: id, parent, notused, detail
+		std::map<int, size_t> depths;
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			int id = sqlite3_column_int(stmt, 0);
+			int parent = sqlite3_column_int(stmt, 1);
+			const char* detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+
+			auto it = depths.find(parent);
+			size_t depth = it != depths.end() ? it->second + 1 : 0;
+			depths[id] = depth;
+			plan.push_back(std::string(depth * 2, ' ') + (detail ? detail : ""));
+		}
+		sqlite3_finalize(stmt);
+		return plan;
+	}
+
+	void SQLite::setBusyPolicy(const BusyHandler::Policy& policy)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setBusyPolicy(policy); });
+		m_busyHandler.setPolicy(policy);
+	}
+
+	void SQLite::setSlowQueryThreshold(std::chrono::microseconds threshold)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setSlowQueryThreshold(threshold); });
+		m_slowQueryLog.setThreshold(threshold);
+	}
+
+	std::vector<SlowQueryLog::Entry> SQLite::getSlowQueries()
+	{
+		if (needsStrand())
+			return serialized([&]() { return getSlowQueries(); });
+		processPendingSlowQueries();
+		return m_slowQueryLog.getEntries();
+	}
+
+	void SQLite::setQueryPlanLintMode(QueryPlanLinter::Mode mode)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setQueryPlanLintMode(mode); });
+		m_queryPlanLinter.setMode(mode);
+	}
+
+	void SQLite::startWorkloadCapture()
+	{
+		if (needsStrand())
+			return serialized([&]() { return startWorkloadCapture(); });
+		m_workload.clear();
+		m_workload.start();
+	}
+	void SQLite::stopWorkloadCapture()
+	{
+		if (needsStrand())
+			return serialized([&]() { return stopWorkloadCapture(); });
+		m_workload.stop();
+	}
+
+	bool SQLite::backupTo(const std::string& path, int pagesPerStep, std::chrono::milliseconds pauseBetweenSteps,
+		const std::function<void(int remainingPages, int totalPages)>& progressCallback)
+	{
+		if (needsStrand())
+			return serialized([&]() { return backupTo(path, pagesPerStep, pauseBetweenSteps, progressCallback); });
+		if (!m_db)
+		{
+			m_logger.logError("Can't backup, database is not open");
+			return false;
+		}
+		if (m_backupRunning.load())
+		{
+			m_logger.logWarning("Can't backup, a backup is already running");
+			return false;
+		}
+		// Join a finished worker
+		waitForBackup();
+
+		m_backupCancel.store(false);
+		m_backupRunning.store(true);
+		m_backupThread = new std::thread(&SQLite::backupWorker, this, path, pagesPerStep, pauseBetweenSteps, progressCallback);
+		return true;
+	}
+
+	void SQLite::cancelBackup()
+	{
+		m_backupCancel.store(true);
+	}
+
+	void SQLite::waitForBackup()
+	{
+		if (!m_backupThread)
+			return;
+		m_backupThread->join();
+		delete m_backupThread;
+		m_backupThread = nullptr;
+	}
+
+	void SQLite::setReadOnly(bool readOnly)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setReadOnly(readOnly); });
+		m_readOnly = readOnly;
+	}
+
+	void SQLite::setInMemoryHotCopy(bool enable)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setInMemoryHotCopy(enable); });
+		if (m_db)
+		{
+			m_logger.logWarning("The in-memory hot copy mode can only be changed while the database is closed");
+			return;
+		}
+		m_inMemoryHotCopy = enable;
+	}
+
+	SerializedDatabase SQLite::serialize(const std::string& schema)
+	{
+		if (needsStrand())
+			return serialized([&]() { return serialize(schema); });
+		if (!m_db)
+		{
+			m_logger.logError("Can't serialize, database is not open");
+			return SerializedDatabase();
+		}
+		sqlite3_int64 size = 0;
+
+		// Only works for in-memory databases
+		unsigned char* data = sqlite3_serialize(m_db, schema.c_str(), &size, SQLITE_SERIALIZE_NOCOPY);
+		if (data)
+			return SerializedDatabase(data, size, false);
+
+		data = sqlite3_serialize(m_db, schema.c_str(), &size, 0);
+		if (!data)
+		{
+			m_logger.logError("Failed to serialize schema: " + schema);
+			return SerializedDatabase();
+		}
+		return SerializedDatabase(data, size, true);
+	}
+
+	bool SQLite::deserialize(SerializedDatabase&& image, bool readOnly)
+	{
+		if (needsStrand())
+			return serialized([&]() { return deserialize(std::move(image), readOnly); });
+		if (!m_db)
+		{
+			m_logger.logError("Can't deserialize, database is not open");
+			return false;
+		}
+		if (image.isEmpty())
+		{
+			m_logger.logError("Can't deserialize an empty image");
+			return false;
+		}
+		SerializedDatabase owned = image.isBorrowed() ? image.copy() : std::move(image);
+		image.reset();
+		if (owned.isEmpty())
+		{
+			m_logger.logError("Can't deserialize, out of memory");
+			return false;
+		}
+
+		sqlite3_int64 size = owned.m_size;
+		unsigned int flags = SQLITE_DESERIALIZE_FREEONCLOSE | (readOnly ? SQLITE_DESERIALIZE_READONLY : SQLITE_DESERIALIZE_RESIZEABLE);
+
+		// SQLite frees the buffer even if the call fails
+		unsigned char* data = owned.release();
+		if (handleSQLiteError(sqlite3_deserialize(m_db, "main", data, size, size, flags)) != SQLITE_OK)
+		{
+			m_logger.logError("Failed to deserialize the database image");
+			return false;
+		}
+		return true;
+	}
+
+	void SQLite::setRowChangeNotificationsEnabled(bool enable)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setRowChangeNotificationsEnabled(enable); });
+		m_rowChangeNotifications = enable;
+		if (!enable)
+		{
+			m_uncommittedRowChanges.clear();
+			m_committedRowChanges.clear();
+		}
+		installHooks();
+	}
+
+	void SQLite::setRowChangeCallback(const std::function<void(const std::vector<RowChange>& changes)>& callback)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setRowChangeCallback(callback); });
+		m_rowChangeCallback = callback;
+	}
+
+	void SQLite::setChangeDetectionMode(FileChangeWatcher::Mode mode)
+	{
+		m_changeDetectionMode = mode;
+		if (m_watcher)
+			m_watcher->setMode(mode);
+	}
+	void SQLite::setChangeDetectionEnabled(bool enable)
+	{
+		if (enable == isChangeDetectionEnabled())
+			return;
+		if (enable)
+		{
+			if (m_changeChannel)
+			{
+				m_channelSequence = m_changeChannel->getSequence();
+				m_changeChannelListening = m_changeChannel->startListening([this](uint64_t)
+					{
+						// Called by the listener thread, the commits are read in the thread of this object
+						if (!m_channelCommitPending.exchange(true))
+							QMetaObject::invokeMethod(this, &SQLite::onChannelCommit, Qt::QueuedConnection);
+					});
+				if (m_changeChannelListening)
+					return;
+			}
+			m_watcher = new FileChangeWatcher(m_dbPath, m_changeDetectionMode);
+			m_watcher->setDataVersionProvider([this]() { return getDataVersion(); });
+			m_watcher->setDebouncePolicy(m_changeDebouncePolicy);
+			connect(m_watcher, &FileChangeWatcher::onFileChanged, this, &SQLite::onDBFileChanged);
+			connect(m_watcher, &FileChangeWatcher::onFileChangesCoalesced, this, [this](const std::string&, unsigned int count)
+				{
+					emit onDBChangesCoalesced(count);
+				});
+		}
+		else
+		{
+			if (m_changeChannelListening)
+			{
+				m_changeChannel->stopListening();
+				m_changeChannelListening = false;
+			}
+			delete m_watcher;
+			m_watcher = nullptr;
+		}
+	}
+	bool SQLite::setChangeChannelEnabled(bool enable)
+	{
+		if (enable == (m_changeChannel != nullptr))
+			return true;
+		// The watcher lives in the thread of this object, the channel is used by the hooks on the strand
+		bool detection = isChangeDetectionEnabled();
+		setChangeDetectionEnabled(false);
+		bool success = serialized([&]()
+			{
+				if (enable)
+				{
+					m_changeChannel = new ChangeChannel(m_dbPath);
+					if (!m_changeChannel->open())
+					{
+						m_logger.logError("Change channel not available, the file watcher stays in use");
+						delete m_changeChannel;
+						m_changeChannel = nullptr;
+						return false;
+					}
+				}
+				else
+				{
+					delete m_changeChannel;
+					m_changeChannel = nullptr;
+					m_uncommittedTables.clear();
+					m_committedTables.clear();
+					m_channelCommitted = false;
+				}
+				installHooks();
+				return true;
+			});
+		setChangeDetectionEnabled(detection);
+		return success;
+	}
+	bool SQLite::setTableChangeTracking(TableChangeTracker::Mode mode)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setTableChangeTracking(mode); });
+		TableChangeTracker::Mode previous = m_tableChangeTracker.getMode();
+		m_tableChangeTracker.setMode(mode);
+		if (!m_db)
+			return true;
+		bool success = true;
+		bool writable = !m_inMemoryHotCopy && !m_readOnly;
+		if (mode == TableChangeTracker::Mode::triggers && writable)
+			success = m_tableChangeTracker.installTriggers(m_db);
+		else if (previous == TableChangeTracker::Mode::triggers && writable)
+			success = m_tableChangeTracker.removeTriggers(m_db);
+		m_tableChangeTracker.snapshot(m_db);
+		return success;
+	}
+
+	void SQLite::emitChangedTables()
+	{
+		if (!m_db || !m_tableChangeTracker.isEnabled())
+			return;
+		std::vector<std::string> tables = m_tableChangeTracker.update(m_db);
+		if (tables.empty())
+			return;
+		QStringList names;
+		for (const std::string& table : tables)
+			names << QString::fromStdString(table);
+		postToObjectThread([this, names]() { emit tablesChanged(names); });
+	}
+
+	void SQLite::setChangeDebouncePolicy(const FileChangeWatcher::DebouncePolicy& policy)
+	{
+		m_changeDebouncePolicy = policy;
+		if (m_watcher)
+			m_watcher->setDebouncePolicy(policy);
+	}
+
+	long long SQLite::getDataVersion()
+	{
+		if (needsStrand())
+			return serialized([&]() { return getDataVersion(); });
+		if (!m_db || m_inMemoryHotCopy)
+			return -1;
+		sqlite3_stmt* stmt = nullptr;
+		if (sqlite3_prepare_v2(m_db, "PRAGMA data_version;", -1, &stmt, nullptr) != SQLITE_OK)
+			return -1;
+		long long version = -1;
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+			version = sqlite3_column_int64(stmt, 0);
+		sqlite3_finalize(stmt);
+		return version;
+	}
+
 	int SQLite::handleSQLiteError(int rc)
 	{
 		if (rc != SQLITE_OK && m_db)
@@ -191,11 +773,468 @@ namespace SQLiteWrapper
 	}
 
 
+	void SQLite::recordExecution(sqlite3_stmt* stmt, const std::string& query, const std::vector<std::string>& params, std::chrono::steady_clock::time_point start)
+	{
+		if (!m_slowQueryLog.isEnabled() && !m_workload.isCapturing() && !m_metrics.isEnabled())
+			return;
+		std::chrono::microseconds duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		m_workload.record(query, duration);
+		m_metrics.recordStatement(m_db, stmt, query, duration);
+		checkSlowQuery(stmt, query, params, duration);
+	}
+
+	void SQLite::setMetricsStatusInterval(std::chrono::milliseconds interval)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setMetricsStatusInterval(interval); });
+		m_metrics.setStatusInterval(interval);
+	}
+
+	void SQLite::setMetricsEnabled(bool enable)
+	{
+		if (needsStrand())
+			return serialized([&]() { return setMetricsEnabled(enable); });
+		m_metrics.setEnabled(enable);
+		if (enable && m_db)
+			m_metrics.refreshStatus(m_db);
+	}
+
+	ConnectionMetrics::Snapshot SQLite::getMetricsSnapshot() const
+	{
+		ConnectionMetrics::Snapshot snapshot = m_metrics.takeSnapshot();
+		snapshot.database = m_dbPath;
+		return snapshot;
+	}
+
+	void SQLite::checkSlowQuery(sqlite3_stmt* stmt, const std::string& query, const std::vector<std::string>& params, std::chrono::microseconds duration)
+	{
+		if (!m_slowQueryLog.isEnabled())
+			return;
+		if (duration < m_slowQueryLog.getThreshold())
+			return;
+
+		SlowQueryLog::Entry entry;
+		entry.query = query;
+		entry.params = params;
+		entry.duration = duration;
+		entry.timestamp = std::chrono::system_clock::now();
+		if (stmt)
+		{
+			entry.fullscanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+			entry.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+			entry.autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+			entry.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+		}
+
+		// The query plan is captured later, outside of the slow call
+		if (m_pendingSlowQueries.size() >= m_slowQueryLog.getCapacity())
+			m_pendingSlowQueries.erase(m_pendingSlowQueries.begin());
+		m_pendingSlowQueries.push_back(std::move(entry));
+		if (m_pendingSlowQueries.size() == 1)
+			QTimer::singleShot(0, this, &SQLite::processPendingSlowQueries);
+	}
+
+	void SQLite::processPendingSlowQueries()
+	{
+		if (needsStrand())
+			return serialized([&]() { return processPendingSlowQueries(); });
+		if (m_pendingSlowQueries.empty())
+			return;
+		std::vector<SlowQueryLog::Entry> pending;
+		pending.swap(m_pendingSlowQueries);
+		for (SlowQueryLog::Entry& entry : pending)
+		{
+			if (m_db)
+				entry.queryPlan = explainQueryPlan(entry.query);
+			std::string message = entry.toString();
+			if (m_slowQueryLog.add(std::move(entry)))
+				m_logger.logWarning(message);
+		}
+	}
+
+	void SQLite::lintQueryPlan(const std::string& query)
+	{
+		if (!m_queryPlanLinter.isEnabled())
+			return;
+		std::string fingerprint = Utilities::getQueryFingerprint(query);
+		if (m_queryPlanLinter.contains(fingerprint) || m_queryPlanLinter.isFull())
+			return;
+
+		QueryPlanLinter::Result result;
+		result.fingerprint = fingerprint;
+		result.query = query;
+		result.queryPlan = explainQueryPlan(query);
+		result.issues = QueryPlanLinter::analyze(result.queryPlan);
+		const QueryPlanLinter::Result& stored = m_queryPlanLinter.store(std::move(result));
+		if (stored.hasIssues())
+		{
+			m_logger.logWarning(stored.toString());
+#ifdef SQLW_DEBUG
+			assert(m_queryPlanLinter.getMode() != QueryPlanLinter::Mode::strict && "Query plan lint failed, see log for details");
+#endif
+		}
+	}
+
+	void SQLite::backupWorker(const std::string& path, int pagesPerStep, std::chrono::milliseconds pauseBetweenSteps,
+		const std::function<void(int remainingPages, int totalPages)>& progressCallback)
+	{
+		bool existedBefore = std::filesystem::exists(path);
+		bool success = false;
+		sqlite3* dest = nullptr;
+		if (sqlite3_open(path.c_str(), &dest) == SQLITE_OK)
+		{
+			sqlite3_backup* backup = sqlite3_backup_init(dest, "main", m_db, "main");
+			if (backup)
+			{
+				int rc = SQLITE_OK;
+				while (!m_backupCancel.load())
+				{
+					// The source is only locked during the step
+					rc = sqlite3_backup_step(backup, pagesPerStep);
+					int remaining = sqlite3_backup_remaining(backup);
+					int total = sqlite3_backup_pagecount(backup);
+					if (progressCallback)
+						progressCallback(remaining, total);
+					emit backupProgress(remaining, total);
+
+					if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED)
+						break;
+					if (pauseBetweenSteps.count() > 0)
+						std::this_thread::sleep_for(pauseBetweenSteps);
+					else
+						std::this_thread::yield();
+				}
+				sqlite3_backup_finish(backup);
+				success = (rc == SQLITE_DONE);
+				if (!success && !m_backupCancel.load())
+					postLog(Log::Level::error, "Backup to " + path + " failed: " + std::string(sqlite3_errstr(rc)));
+			}
+			else
+			{
+				postLog(Log::Level::error, "Backup to " + path + " failed: " + std::string(sqlite3_errmsg(dest)));
+			}
+		}
+		else
+		{
+			postLog(Log::Level::error, "Backup to " + path + " failed, can't open the destination: " + std::string(sqlite3_errmsg(dest)));
+		}
+		sqlite3_close(dest);
+
+		if (success)
+			postLog(Log::Level::info, "Backup to " + path + " finished");
+		else if (!existedBefore)
+			std::remove(path.c_str());
+
+		m_backupRunning.store(false);
+		postToObjectThread([this, success]() { emit backupFinished(success); });
+	}
+
+	sqlite3* SQLite::loadHotCopy()
+	{
+		sqlite3* file = nullptr;
+		sqlite3* memory = nullptr;
+		if (sqlite3_open_v2(m_dbPath.c_str(), &file, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+		{
+			postLog(Log::Level::error, "Hot copy: can't open " + m_dbPath + ": " + std::string(sqlite3_errmsg(file)));
+			sqlite3_close(file);
+			return nullptr;
+		}
+		if (sqlite3_open(":memory:", &memory) != SQLITE_OK)
+		{
+			postLog(Log::Level::error, "Hot copy: can't create the in-memory database: " + std::string(sqlite3_errmsg(memory)));
+			sqlite3_close(memory);
+			sqlite3_close(file);
+			return nullptr;
+		}
+
+		int rc = SQLITE_ERROR;
+		sqlite3_backup* backup = sqlite3_backup_init(memory, "main", file, "main");
+		if (backup)
+		{
+			// A writer of another process may hold the file lock, retry within the busy timeout
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + m_busyHandler.getPolicy().timeout;
+			rc = sqlite3_backup_step(backup, -1);
+			while ((rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				rc = sqlite3_backup_step(backup, -1);
+			}
+			int finishRc = sqlite3_backup_finish(backup);
+			rc = (rc == SQLITE_DONE) ? finishRc : rc;
+		}
+		sqlite3_close(file);
+		if (rc != SQLITE_OK)
+		{
+			postLog(Log::Level::error, "Hot copy: loading " + m_dbPath + " failed: " + std::string(sqlite3_errstr(rc)));
+			sqlite3_close(memory);
+			return nullptr;
+		}
+		// Changes would get lost with the next reload
+		sqlite3_exec(memory, "PRAGMA query_only = 1;", nullptr, nullptr, nullptr);
+		return memory;
+	}
+
+	void SQLite::startHotCopyReload()
+	{
+		if (QThread::currentThread() != thread())
+		{
+			// Run on the strand by another thread, the worker is started from the thread of this object
+			QMetaObject::invokeMethod(this, [this]()
+				{
+					serialized([this]()
+						{
+							if (m_db && m_inMemoryHotCopy)
+								startHotCopyReload();
+						});
+				}, Qt::QueuedConnection);
+			return;
+		}
+		if (m_reloadThread)
+		{
+			// Reload again once the running one is swapped in
+			m_reloadPending = true;
+			return;
+		}
+		m_reloadPending = false;
+		m_reloadThread = new std::thread([this]()
+			{
+				// The completion is posted on failure too, it joins this thread
+				m_reloadedDb.store(loadHotCopy());
+				QMetaObject::invokeMethod(this, &SQLite::applyHotCopyReload, Qt::QueuedConnection);
+			});
+	}
+
+	void SQLite::stopHotCopyReload()
+	{
+		if (m_reloadThread)
+		{
+			m_reloadThread->join();
+			delete m_reloadThread;
+			m_reloadThread = nullptr;
+		}
+		m_reloadPending = false;
+		sqlite3* unused = m_reloadedDb.exchange(nullptr);
+		if (unused)
+			sqlite3_close(unused);
+	}
+
+	void SQLite::applyHotCopyReload()
+	{
+		if (needsStrand())
+			return serialized([&]() { return applyHotCopyReload(); });
+		if (m_reloadThread)
+		{
+			m_reloadThread->join();
+			delete m_reloadThread;
+			m_reloadThread = nullptr;
+		}
+		sqlite3* db = m_reloadedDb.exchange(nullptr);
+		if (!m_db || !m_inMemoryHotCopy)
+		{
+			// Closed while the reload was running
+			if (db)
+				sqlite3_close(db);
+			return;
+		}
+
+		if (db)
+		{
+			// The backup worker reads from the handle which gets closed
+			if (m_backupThread)
+			{
+				if (m_backupRunning.load())
+					m_logger.logWarning("The hot copy reload cancels the running backup");
+				cancelBackup();
+				waitForBackup();
+			}
+			if (replaceHandle(db) != SQLITE_OK)
+			{
+				m_logger.logError("Hot copy: closing the old copy failed: " + std::string(sqlite3_errmsg(m_db)));
+				sqlite3_close(db);
+				return;
+			}
+			installHooks();
+			m_logger.logInfo("Hot copy reloaded");
+			postToObjectThread([this]() { emit onDBChanged(); });
+			emitChangedTables();
+		}
+
+		// After a failed load too, the file may be readable again
+		if (m_reloadPending)
+			startHotCopyReload();
+	}
+
+	void SQLite::postLog(Log::Level level, const std::string& message)
+	{
+		// Direct call in the thread of this object
+		QMetaObject::invokeMethod(this, [this, level, message]() { m_logger.log(message, level); }, Qt::AutoConnection);
+	}
+
+	void SQLite::postToObjectThread(std::function<void()> function)
+	{
+		if (QThread::currentThread() == thread())
+			function();
+		else
+			QMetaObject::invokeMethod(this, std::move(function), Qt::QueuedConnection);
+	}
+
+	void SQLite::installHooks()
+	{
+		if (!m_db)
+			return;
+		if (m_rowChangeNotifications || m_changeChannel)
+		{
+			sqlite3_update_hook(m_db, &SQLite::updateHook, this);
+			sqlite3_commit_hook(m_db, &SQLite::commitHook, this);
+			sqlite3_rollback_hook(m_db, &SQLite::rollbackHook, this);
+		}
+		else
+		{
+			sqlite3_update_hook(m_db, nullptr, nullptr);
+			sqlite3_commit_hook(m_db, nullptr, nullptr);
+			sqlite3_rollback_hook(m_db, nullptr, nullptr);
+		}
+	}
+
+	void SQLite::updateHook(void* context, int operation, const char* database, const char* table, sqlite3_int64 rowid)
+	{
+		SQLite* self = static_cast<SQLite*>(context);
+		if (self->m_changeChannel && table)
+			self->m_uncommittedTables.insert(table);
+		if (!self->m_rowChangeNotifications)
+			return;
+		RowChange change;
+		switch (operation)
+		{
+			case SQLITE_INSERT: change.operation = RowChange::Operation::insert; break;
+			case SQLITE_UPDATE: change.operation = RowChange::Operation::update; break;
+			default:            change.operation = RowChange::Operation::remove; break;
+		}
+		change.database = database ? database : "";
+		change.table = table ? table : "";
+		change.rowid = rowid;
+		self->m_uncommittedRowChanges.push_back(std::move(change));
+	}
+	int SQLite::commitHook(void* context)
+	{
+		SQLite* self = static_cast<SQLite*>(context);
+		// Not allowed to use the connection here, the changes are delivered after the statement has finished
+		if (self->m_committedRowChanges.empty())
+			self->m_committedRowChanges.swap(self->m_uncommittedRowChanges);
+		else
+		{
+			self->m_committedRowChanges.insert(self->m_committedRowChanges.end(),
+				self->m_uncommittedRowChanges.begin(), self->m_uncommittedRowChanges.end());
+			self->m_uncommittedRowChanges.clear();
+		}
+		if (self->m_changeChannel)
+		{
+			self->m_committedTables.insert(self->m_uncommittedTables.begin(), self->m_uncommittedTables.end());
+			self->m_uncommittedTables.clear();
+			self->m_channelCommitted = true;
+		}
+		return 0;
+	}
+	void SQLite::rollbackHook(void* context)
+	{
+		SQLite* self = static_cast<SQLite*>(context);
+		self->m_uncommittedRowChanges.clear();
+		self->m_uncommittedTables.clear();
+	}
+
+	void SQLite::deliverRowChanges()
+	{
+		publishCommit();
+		if (m_committedRowChanges.empty())
+			return;
+		// A subscriber may execute queries, which deliver their own changes
+		std::vector<RowChange> changes;
+		changes.swap(m_committedRowChanges);
+		if (m_rowChangeCallback)
+			m_rowChangeCallback(changes);
+		postToObjectThread([this, changes]() { emit onRowsChanged(changes); });
+	}
+
+	void SQLite::publishCommit()
+	{
+		if (!m_changeChannel || !m_channelCommitted)
+			return;
+		std::vector<std::string> tables(m_committedTables.begin(), m_committedTables.end());
+		m_committedTables.clear();
+		m_channelCommitted = false;
+		uint64_t sequence = m_changeChannel->publish(tables);
+		// The own commit is no external change, unless another process has published in between
+		if (sequence == m_channelSequence + 1)
+			m_channelSequence = sequence;
+	}
+
+	void SQLite::connectNotify(const QMetaMethod& signal)
+	{
+		if (m_watcher)
+			return;
+		if (signal != QMetaMethod::fromSignal(&SQLite::onDBChanged) &&
+			signal != QMetaMethod::fromSignal(&SQLite::onDBChangesCoalesced) &&
+			signal != QMetaMethod::fromSignal(&SQLite::tablesChanged))
+			return;
+		startChangeDetection();
+	}
+
+	void SQLite::startChangeDetection()
+	{
+		// Called from connect() or open(), which may run in another thread.
+		// The watcher has to live in the thread of this object
+		if (QThread::currentThread() == thread())
+			setChangeDetectionEnabled(true);
+		else
+			QMetaObject::invokeMethod(this, [this]() { setChangeDetectionEnabled(true); }, Qt::QueuedConnection);
+	}
+
 	void SQLite::onDBFileChanged(const std::string& path)
 	{
+		if (needsStrand())
+			return serialized([&]() { return onDBFileChanged(path); });
 		SQLW_UNUSED(path);
-		emit onDBChanged();
+		if (m_inMemoryHotCopy)
+		{
+			// onDBChanged gets emitted once the new copy is swapped in
+			if (m_db)
+				startHotCopyReload();
+			return;
+		}
+		postToObjectThread([this]() { emit onDBChanged(); });
+		emitChangedTables();
 	}
 
 
-}
\ No newline at end of file
+	void SQLite::onChannelCommit()
+	{
+		if (needsStrand())
+			return serialized([&]() { return onChannelCommit(); });
+		m_channelCommitPending.store(false);
+		if (!m_changeChannel)
+			return;
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = false;
+		if (!m_changeChannel->readSince(m_channelSequence, sequence, tables, complete) || sequence == m_channelSequence)
+			return;
+		m_channelSequence = sequence;
+		if (m_inMemoryHotCopy)
+		{
+			if (m_db)
+				startHotCopyReload();
+			return;
+		}
+		postToObjectThread([this]() { emit onDBChanged(); });
+		if (!complete || tables.empty())
+		{
+			// The tables of some commits are unknown, compare the fingerprints instead
+			emitChangedTables();
+			return;
+		}
+		QStringList names;
+		for (const std::string& table : tables)
+			names << QString::fromStdString(table);
+		postToObjectThread([this, names]() { emit tablesChanged(names); });
+	}
+}
@@ -0,0 +1,80 @@
+#include "SerializedDatabase.h"
+#include <cstring>
+
+namespace SQLiteWrapper
+{
+	SerializedDatabase::SerializedDatabase()
+		: m_data(nullptr)
+		, m_size(0)
+		, m_owned(false)
+	{
+
+	}
+	SerializedDatabase::SerializedDatabase(unsigned char* data, sqlite3_int64 size, bool owned)
+		: m_data(data)
+		, m_size(size)
+		, m_owned(owned)
+	{
+
+	}
+	SerializedDatabase::SerializedDatabase(SerializedDatabase&& other) noexcept
+		: m_data(other.m_data)
+		, m_size(other.m_size)
+		, m_owned(other.m_owned)
+	{
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_owned = false;
+	}
+	SerializedDatabase::~SerializedDatabase()
+	{
+		reset();
+	}
+
+	SerializedDatabase& SerializedDatabase::operator=(SerializedDatabase&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		reset();
+		m_data = other.m_data;
+		m_size = other.m_size;
+		m_owned = other.m_owned;
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_owned = false;
+		return *this;
+	}
+
+	SerializedDatabase SerializedDatabase::fromBytes(const void* data, size_t size)
+	{
+		if (!data || size == 0)
+			return SerializedDatabase();
+		unsigned char* buffer = static_cast<unsigned char*>(sqlite3_malloc64(size));
+		if (!buffer)
+			return SerializedDatabase();
+		std::memcpy(buffer, data, size);
+		return SerializedDatabase(buffer, static_cast<sqlite3_int64>(size), true);
+	}
+
+	SerializedDatabase SerializedDatabase::copy() const
+	{
+		return fromBytes(m_data, size());
+	}
+
+	unsigned char* SerializedDatabase::release()
+	{
+		unsigned char* data = m_data;
+		m_data = nullptr;
+		m_size = 0;
+		m_owned = false;
+		return data;
+	}
+	void SerializedDatabase::reset()
+	{
+		if (m_owned && m_data)
+			sqlite3_free(m_data);
+		m_data = nullptr;
+		m_size = 0;
+		m_owned = false;
+	}
+}
@@ -0,0 +1,144 @@
+#include "SlowQueryLog.h"
+
+namespace SQLiteWrapper
+{
+	std::string SlowQueryLog::Entry::toString() const
+	{
+		std::string str = "Slow query (" + std::to_string(duration.count() / 1000.0) + " ms): " + query;
+		if (!params.empty())
+		{
+			str += "\n  Params: ";
+			for (size_t i = 0; i < params.size(); ++i)
+			{
+				str += "'" + params[i] + "'";
+				if (i < params.size() - 1)
+					str += ", ";
+			}
+		}
+		str += "\n  Stats: fullscanSteps=" + std::to_string(fullscanSteps) +
+			" sorts=" + std::to_string(sorts) +
+			" autoIndexes=" + std::to_string(autoIndexes) +
+			" vmSteps=" + std::to_string(vmSteps);
+		if (!queryPlan.empty())
+		{
+			str += "\n  Query plan:";
+			for (const std::string& line : queryPlan)
+				str += "\n    " + line;
+		}
+		return str;
+	}
+
+	SlowQueryLog::SlowQueryLog(size_t capacity)
+		: m_capacity(capacity)
+		, m_next(0)
+		, m_threshold(std::chrono::microseconds(0))
+		, m_maxLogsPerSecond(10)
+		, m_logWindowStart(std::chrono::steady_clock::now())
+		, m_logsInWindow(0)
+		, m_suppressedLogs(0)
+	{
+		m_ring.reserve(m_capacity);
+	}
+
+	void SlowQueryLog::setThreshold(std::chrono::microseconds threshold)
+	{
+		m_threshold.store(threshold);
+	}
+
+	void SlowQueryLog::setCapacity(size_t capacity)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (capacity == m_capacity)
+			return;
+
+		// Keep the newest entries
+		std::vector<Entry> entries;
+		entries.reserve(m_ring.size());
+		size_t start = m_ring.size() < m_capacity ? 0 : m_next;
+		for (size_t i = 0; i < m_ring.size(); ++i)
+			entries.push_back(std::move(m_ring[(start + i) % m_ring.size()]));
+		if (entries.size() > capacity)
+			entries.erase(entries.begin(), entries.begin() + (entries.size() - capacity));
+
+		m_ring = std::move(entries);
+		m_ring.reserve(capacity);
+		m_capacity = capacity;
+		m_next = capacity > 0 ? m_ring.size() % capacity : 0;
+	}
+	size_t SlowQueryLog::getCapacity() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_capacity;
+	}
+
+	void SlowQueryLog::setMaxLogsPerSecond(unsigned int maxLogsPerSecond)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_maxLogsPerSecond = maxLogsPerSecond;
+	}
+	unsigned int SlowQueryLog::getMaxLogsPerSecond() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_maxLogsPerSecond;
+	}
+
+	bool SlowQueryLog::add(Entry&& entry)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_capacity > 0)
+		{
+			if (m_ring.size() < m_capacity)
+			{
+				m_ring.push_back(std::move(entry));
+				m_next = m_ring.size() % m_capacity;
+			}
+			else
+			{
+				m_ring[m_next] = std::move(entry);
+				m_next = (m_next + 1) % m_capacity;
+			}
+		}
+		return tryAcquireLogSlot();
+	}
+
+	std::vector<SlowQueryLog::Entry> SlowQueryLog::getEntries() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		std::vector<Entry> entries;
+		entries.reserve(m_ring.size());
+		size_t start = m_ring.size() < m_capacity ? 0 : m_next;
+		for (size_t i = 0; i < m_ring.size(); ++i)
+			entries.push_back(m_ring[(start + i) % m_ring.size()]);
+		return entries;
+	}
+	size_t SlowQueryLog::getSuppressedLogCount() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_suppressedLogs;
+	}
+	void SlowQueryLog::clear()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_ring.clear();
+		m_next = 0;
+		m_suppressedLogs = 0;
+	}
+
+	bool SlowQueryLog::tryAcquireLogSlot()
+	{
+		// Fixed one second window, cheap enough to be checked for every entry
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - m_logWindowStart >= std::chrono::seconds(1))
+		{
+			m_logWindowStart = now;
+			m_logsInWindow = 0;
+		}
+		if (m_logsInWindow >= m_maxLogsPerSecond)
+		{
+			++m_suppressedLogs;
+			return false;
+		}
+		++m_logsInWindow;
+		return true;
+	}
+}
@@ -0,0 +1,83 @@
+#include "Strand.h"
+
+namespace SQLiteWrapper
+{
+	Strand::Strand()
+		: m_pending(0)
+		, m_runningThread(std::thread::id())
+	{
+
+	}
+
+	void Strand::enqueue(const std::shared_ptr<QueuedCall>& call)
+	{
+		// The call is queued before it is counted, a counted call is always in the queue
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			m_queue.push_back(call);
+		}
+		if (m_pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+		{
+			// The strand became idle in the meantime, run the queue in this thread
+			m_runningThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+			runQueued(*popQueued());
+			release();
+		}
+		// The release above may have stopped before the own call or handed it back to this thread
+		wait(*call);
+	}
+
+	void Strand::wait(QueuedCall& call)
+	{
+		{
+			std::unique_lock<std::mutex> lock(call.mutex);
+			call.stateChanged.wait(lock, [&call]() { return call.finished || call.handedOver; });
+			if (call.finished)
+				return;
+		}
+
+		// The holder passed the strand on, this thread holds it now
+		m_runningThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		call.run();
+		release();
+	}
+
+	void Strand::runQueued(QueuedCall& call)
+	{
+		// A packaged_task passes exceptions to its waiting caller
+		call.run();
+		std::unique_lock<std::mutex> lock(call.mutex);
+		call.finished = true;
+		call.stateChanged.notify_one();
+	}
+
+	std::shared_ptr<Strand::QueuedCall> Strand::popQueued()
+	{
+		std::unique_lock<std::mutex> lock(m_queueMutex);
+		std::shared_ptr<QueuedCall> next = std::move(m_queue.front());
+		m_queue.pop_front();
+		return next;
+	}
+
+	void Strand::release()
+	{
+		// Cleared before the strand can be claimed by another thread
+		m_runningThread.store(std::thread::id(), std::memory_order_relaxed);
+		size_t ran = 0;
+		while (m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			std::shared_ptr<QueuedCall> next = popQueued();
+			if (ran++ == maxQueuedCallsPerRelease)
+			{
+				// The count of the next call stays, its caller holds the strand from here on
+				std::unique_lock<std::mutex> lock(next->mutex);
+				next->handedOver = true;
+				next->stateChanged.notify_one();
+				return;
+			}
+			m_runningThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+			runQueued(*next);
+			m_runningThread.store(std::thread::id(), std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,300 @@
+#include "TableChangeTracker.h"
+#include "Utilities.h"
+#include <cstdint>
+
+namespace SQLiteWrapper
+{
+	const char* const TableChangeTracker::changeCounterTable = "_sqlw_table_changes";
+
+	namespace
+	{
+		// FNV-1a, only used to compare the samples of a table with its previous samples
+		void hashBytes(uint64_t& hash, const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+		}
+
+		// Hashes all rows of the statement, returns false if the statement failed
+		bool hashRows(uint64_t& hash, sqlite3_stmt* stmt)
+		{
+			int rc;
+			while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+			{
+				int columns = sqlite3_column_count(stmt);
+				for (int i = 0; i < columns; ++i)
+				{
+					int type = sqlite3_column_type(stmt, i);
+					hashBytes(hash, &type, sizeof(type));
+					const void* data = sqlite3_column_blob(stmt, i);
+					int size = sqlite3_column_bytes(stmt, i);
+					if (data && size > 0)
+						hashBytes(hash, data, static_cast<size_t>(size));
+				}
+			}
+			return rc == SQLITE_DONE;
+		}
+	}
+
+	TableChangeTracker::TableChangeTracker()
+		: m_mode(Mode::disabled)
+		, m_sampleSize(32)
+		, m_hasSnapshot(false)
+	{
+
+	}
+
+	void TableChangeTracker::setMode(Mode mode)
+	{
+		if (mode == m_mode)
+			return;
+		m_mode = mode;
+		clear();
+	}
+	void TableChangeTracker::setSampleSize(int rows)
+	{
+		m_sampleSize = rows > 0 ? rows : 0;
+	}
+
+	bool TableChangeTracker::installTriggers(sqlite3* db)
+	{
+		if (!db)
+			return false;
+		std::string counterTable = Utilities::quoteIdentifier(changeCounterTable);
+		// A savepoint also works inside a transaction of the caller
+		std::string script = "SAVEPOINT _sqlw_install_triggers;"
+			"CREATE TABLE IF NOT EXISTS " + counterTable + " (name TEXT PRIMARY KEY, counter INTEGER NOT NULL DEFAULT 0);";
+		for (const Table& table : getTables(db))
+		{
+			// Virtual tables can't have triggers, the writes of a virtual table to its shadow tables
+			// would fire them recursively
+			if (table.kind != Table::Kind::ordinary)
+				continue;
+			std::string name = Utilities::quoteLiteral(table.name);
+			script += "INSERT OR IGNORE INTO " + counterTable + " (name) VALUES (" + name + ");";
+			for (const char* operation : { "INSERT", "UPDATE", "DELETE" })
+			{
+				script += "CREATE TRIGGER IF NOT EXISTS " + Utilities::quoteIdentifier(std::string("_sqlw_") + table.name + "_" + operation) +
+					" AFTER " + operation + " ON " + Utilities::quoteIdentifier(table.name) +
+					" BEGIN UPDATE " + counterTable + " SET counter = counter + 1 WHERE name = " + name + "; END;";
+			}
+		}
+		script += "RELEASE _sqlw_install_triggers;";
+
+		char* errorMessage = nullptr;
+		if (sqlite3_exec(db, script.c_str(), nullptr, nullptr, &errorMessage) != SQLITE_OK)
+		{
+			Logger::logError("TableChangeTracker: Installing the triggers: " + std::string(errorMessage ? errorMessage : ""));
+			sqlite3_free(errorMessage);
+			sqlite3_exec(db, "ROLLBACK TO _sqlw_install_triggers; RELEASE _sqlw_install_triggers;", nullptr, nullptr, nullptr);
+			return false;
+		}
+		return true;
+	}
+
+	bool TableChangeTracker::removeTriggers(sqlite3* db)
+	{
+		if (!db)
+			return false;
+		std::vector<std::string> triggers;
+		sqlite3_stmt* stmt = nullptr;
+		const char* query = "SELECT name FROM sqlite_master WHERE type = 'trigger' "
+			"AND name IN ('_sqlw_' || tbl_name || '_INSERT', '_sqlw_' || tbl_name || '_UPDATE', '_sqlw_' || tbl_name || '_DELETE');";
+		if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("TableChangeTracker: Reading the schema: " + std::string(sqlite3_errmsg(db)));
+			return false;
+		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+			if (name)
+				triggers.push_back(name);
+		}
+		sqlite3_finalize(stmt);
+
+		std::string script = "SAVEPOINT _sqlw_remove_triggers;";
+		for (const std::string& trigger : triggers)
+			script += "DROP TRIGGER IF EXISTS " + Utilities::quoteIdentifier(trigger) + ";";
+		script += "DROP TABLE IF EXISTS " + Utilities::quoteIdentifier(changeCounterTable) + ";"
+			"RELEASE _sqlw_remove_triggers;";
+
+		char* errorMessage = nullptr;
+		if (sqlite3_exec(db, script.c_str(), nullptr, nullptr, &errorMessage) != SQLITE_OK)
+		{
+			Logger::logError("TableChangeTracker: Removing the triggers: " + std::string(errorMessage ? errorMessage : ""));
+			sqlite3_free(errorMessage);
+			sqlite3_exec(db, "ROLLBACK TO _sqlw_remove_triggers; RELEASE _sqlw_remove_triggers;", nullptr, nullptr, nullptr);
+			return false;
+		}
+		return true;
+	}
+
+	void TableChangeTracker::snapshot(sqlite3* db)
+	{
+		if (!db || m_mode == Mode::disabled)
+			return;
+		m_fingerprints = calculateFingerprints(db);
+		m_hasSnapshot = true;
+	}
+
+	std::vector<std::string> TableChangeTracker::update(sqlite3* db)
+	{
+		std::vector<std::string> changed;
+		if (!db || m_mode == Mode::disabled)
+			return changed;
+		if (!m_hasSnapshot)
+		{
+			snapshot(db);
+			return changed;
+		}
+
+		std::map<std::string, std::string> fingerprints = calculateFingerprints(db);
+		// Both maps are sorted by name, walk them side by side
+		auto oldIt = m_fingerprints.begin();
+		auto newIt = fingerprints.begin();
+		while (oldIt != m_fingerprints.end() || newIt != fingerprints.end())
+		{
+			if (newIt == fingerprints.end() || (oldIt != m_fingerprints.end() && oldIt->first < newIt->first))
+			{
+				changed.push_back(oldIt->first); // Dropped
+				++oldIt;
+			}
+			else if (oldIt == m_fingerprints.end() || newIt->first < oldIt->first)
+			{
+				changed.push_back(newIt->first); // Created
+				++newIt;
+			}
+			else
+			{
+				if (oldIt->second != newIt->second)
+					changed.push_back(newIt->first);
+				++oldIt;
+				++newIt;
+			}
+		}
+		m_fingerprints = std::move(fingerprints);
+		return changed;
+	}
+
+	void TableChangeTracker::clear()
+	{
+		m_fingerprints.clear();
+		m_hasSnapshot = false;
+	}
+
+	std::vector<TableChangeTracker::Table> TableChangeTracker::getTables(sqlite3* db) const
+	{
+		std::vector<Table> tables;
+		sqlite3_stmt* stmt = nullptr;
+		// The type of pragma_table_list tells the virtual tables and their shadow tables apart
+		const char* query = "SELECT m.name, m.sql, t.type FROM sqlite_master m JOIN pragma_table_list t ON t.schema = 'main' AND t.name = m.name "
+			"WHERE m.type = 'table' AND m.name NOT LIKE 'sqlite\\_%' ESCAPE '\\' AND m.name != ?;";
+		if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("TableChangeTracker: Reading the schema: " + std::string(sqlite3_errmsg(db)));
+			return tables;
+		}
+		sqlite3_bind_text(stmt, 1, changeCounterTable, -1, SQLITE_STATIC);
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+			const char* sql = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+			const char* type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+			Table::Kind kind = Table::Kind::ordinary;
+			if (type && std::string(type) == "virtual")
+				kind = Table::Kind::virtualTable;
+			else if (type && std::string(type) == "shadow")
+				kind = Table::Kind::shadow;
+			tables.push_back(Table{ name ? name : "", sql ? sql : "", kind });
+		}
+		sqlite3_finalize(stmt);
+		return tables;
+	}
+
+	std::map<std::string, std::string> TableChangeTracker::calculateFingerprints(sqlite3* db) const
+	{
+		std::map<std::string, std::string> fingerprints;
+		std::vector<Table> tables = getTables(db);
+		if (m_mode == Mode::fingerprint)
+		{
+			for (const Table& table : tables)
+				fingerprints[table.name] = calculateSampledFingerprint(db, table);
+			return fingerprints;
+		}
+
+		// Trigger mode, the schema detects created, dropped and altered tables, the counter all other changes.
+		// Virtual tables have no counter and get sampled, their shadow tables are covered by them
+		for (const Table& table : tables)
+		{
+			if (table.kind == Table::Kind::ordinary)
+				fingerprints[table.name] = table.sql;
+			else if (table.kind == Table::Kind::virtualTable)
+				fingerprints[table.name] = calculateSampledFingerprint(db, table);
+		}
+		std::string query = "SELECT name, counter FROM " + Utilities::quoteIdentifier(changeCounterTable) + ";";
+		sqlite3_stmt* stmt = nullptr;
+		if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("TableChangeTracker: Reading the change counters: " + std::string(sqlite3_errmsg(db)));
+			return fingerprints;
+		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+			auto it = name ? fingerprints.find(name) : fingerprints.end();
+			if (it != fingerprints.end())
+				it->second += ":" + std::to_string(sqlite3_column_int64(stmt, 1));
+		}
+		sqlite3_finalize(stmt);
+		return fingerprints;
+	}
+
+	std::string TableChangeTracker::calculateSampledFingerprint(sqlite3* db, const Table& table) const
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		hashBytes(hash, table.sql.data(), table.sql.size());
+
+		std::string name = Utilities::quoteIdentifier(table.name);
+		std::vector<std::string> queries;
+		sqlite3_stmt* stmt = nullptr;
+		std::string query = "SELECT count(*), max(rowid) FROM " + name + ";";
+		bool hasRowid = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK;
+		if (hasRowid)
+		{
+			sqlite3_finalize(stmt);
+			queries.push_back(query);
+			queries.push_back("SELECT * FROM " + name + " ORDER BY rowid ASC LIMIT ?;");
+			queries.push_back("SELECT * FROM " + name + " ORDER BY rowid DESC LIMIT ?;");
+		}
+		else
+		{
+			// WITHOUT ROWID table
+			queries.push_back("SELECT count(*) FROM " + name + ";");
+			queries.push_back("SELECT * FROM " + name + " LIMIT ?;");
+		}
+
+		for (const std::string& sampleQuery : queries)
+		{
+			if (sqlite3_prepare_v2(db, sampleQuery.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+			{
+				Logger::logError("TableChangeTracker: Fingerprinting " + table.name + ": " + sqlite3_errmsg(db));
+				return "";
+			}
+			if (sqlite3_bind_parameter_count(stmt) > 0)
+				sqlite3_bind_int(stmt, 1, m_sampleSize);
+			bool success = hashRows(hash, stmt);
+			sqlite3_finalize(stmt);
+			if (!success)
+			{
+				Logger::logError("TableChangeTracker: Fingerprinting " + table.name + ": " + sqlite3_errmsg(db));
+				return "";
+			}
+		}
+		return std::to_string(hash);
+	}
+}
@@ -0,0 +1,366 @@
+#include "WatchService.h"
+#include "FileChangeWatcher.h"
+#include <filesystem>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
+
+namespace SQLiteWrapper
+{
+	WatchService& WatchService::instance()
+	{
+		static WatchService service;
+		return service;
+	}
+
+	WatchService::WatchService()
+	{
+		m_stopFlag.store(false);
+	}
+	WatchService::~WatchService()
+	{
+		stopThread();
+	}
+
+	WatchService::Id WatchService::add(const std::string& path, const Callback& callback,
+									   std::chrono::milliseconds pollingInterval)
+	{
+		if (!callback)
+			return 0;
+		std::error_code error;
+		std::filesystem::path absolutePath = std::filesystem::absolute(path, error);
+		if (error)
+		{
+			Logger::logError("WatchService: Invalid path: " + path + ": " + error.message());
+			return 0;
+		}
+		std::string key = absolutePath.lexically_normal().string();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_thread)
+			startThread();
+
+		Id id = m_nextId++;
+		m_registrations[id] = Registration{ path, key, callback, pollingInterval };
+
+		WatchedPath& watchedPath = m_paths[key];
+		if (watchedPath.refCount++ == 0)
+		{
+			watchedPath.directory = std::filesystem::path(key).parent_path().string();
+			watchedPath.pollingInterval = pollingInterval;
+			watchedPath.nextCheck = std::chrono::steady_clock::now();
+			watchedPath.dirty = true; // Reads the initial fingerprint
+#ifdef __linux__
+			watchedPath.polled = !watchDirectory(watchedPath.directory);
+#endif
+		}
+		else
+		{
+			watchedPath.pollingInterval = std::min(watchedPath.pollingInterval, pollingInterval);
+		}
+		wakeUp();
+		return id;
+	}
+	void WatchService::remove(Id id)
+	{
+		bool calledFromCallback;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			calledFromCallback = std::this_thread::get_id() == m_threadId;
+			auto it = m_registrations.find(id);
+			if (it == m_registrations.end())
+				return;
+			std::string key = it->second.watchedPath;
+			m_registrations.erase(it);
+
+			auto pathIt = m_paths.find(key);
+			if (pathIt != m_paths.end())
+			{
+				if (--pathIt->second.refCount == 0)
+				{
+#ifdef __linux__
+					if (!pathIt->second.polled)
+						unwatchDirectory(pathIt->second.directory);
+#endif
+					m_paths.erase(pathIt);
+				}
+				else
+				{
+					updatePollingInterval(pathIt->second, key);
+				}
+			}
+		}
+		// Wait until a running dispatch has finished, unless we are called from a callback
+		if (!calledFromCallback)
+		{
+			std::unique_lock<std::mutex> dispatchLock(m_dispatchMutex);
+		}
+	}
+
+	size_t WatchService::getRegistrationCount() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_registrations.size();
+	}
+	size_t WatchService::getWatchedPathCount() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_paths.size();
+	}
+
+	void WatchService::startThread()
+	{
+#ifdef __linux__
+		m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_inotifyFd < 0)
+			Logger::logError("WatchService: inotify_init1: " + std::string(strerror(errno)) + ", falling back to polling");
+		m_wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = m_wakeupFd;
+		epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &event);
+		if (m_inotifyFd >= 0)
+		{
+			event.data.fd = m_inotifyFd;
+			epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_inotifyFd, &event);
+		}
+#endif
+		m_stopFlag.store(false);
+		m_thread = new std::thread(&WatchService::run, this);
+		m_threadId = m_thread->get_id();
+	}
+	void WatchService::stopThread()
+	{
+		if (!m_thread)
+			return;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stopFlag.store(true);
+			wakeUp();
+		}
+		m_thread->join();
+		delete m_thread;
+		m_thread = nullptr;
+		m_threadId = std::thread::id();
+#ifdef __linux__
+		for (const auto& directory : m_directories)
+			inotify_rm_watch(m_inotifyFd, directory.second.wd);
+		m_directories.clear();
+		m_directoryByWd.clear();
+		for (int* fd : { &m_epollFd, &m_wakeupFd, &m_inotifyFd })
+		{
+			if (*fd >= 0)
+				::close(*fd);
+			*fd = -1;
+		}
+#endif
+	}
+
+	void WatchService::wakeUp()
+	{
+		// m_mutex is locked by the caller
+#ifdef __linux__
+		if (m_wakeupFd >= 0)
+		{
+			uint64_t value = 1;
+			ssize_t res = write(m_wakeupFd, &value, sizeof(value));
+			SQLW_UNUSED(res);
+		}
+#endif
+		m_wakeUp = true;
+		m_cv.notify_all();
+	}
+
+	void WatchService::run()
+	{
+		while (!m_stopFlag.load())
+		{
+			waitForEvents();
+			if (m_stopFlag.load())
+				break;
+			checkPaths();
+		}
+	}
+
+	void WatchService::waitForEvents()
+	{
+#ifdef __linux__
+		int timeout = -1;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			std::chrono::steady_clock::time_point deadline = nextDeadline();
+			if (deadline != std::chrono::steady_clock::time_point::max())
+			{
+				std::chrono::milliseconds remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+				timeout = static_cast<int>(std::max<long long>(0, remaining.count()));
+			}
+			m_wakeUp = false;
+		}
+
+		epoll_event events[2];
+		int count = epoll_wait(m_epollFd, events, 2, timeout);
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.fd == m_wakeupFd)
+			{
+				uint64_t value;
+				ssize_t res = read(m_wakeupFd, &value, sizeof(value));
+				SQLW_UNUSED(res);
+			}
+			else if (events[i].data.fd == m_inotifyFd)
+			{
+				readInotifyEvents();
+			}
+		}
+#else
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto wokenUp = [this]() { return m_wakeUp || m_stopFlag.load(); };
+		std::chrono::steady_clock::time_point deadline = nextDeadline();
+		if (deadline == std::chrono::steady_clock::time_point::max())
+			m_cv.wait(lock, wokenUp);
+		else
+			m_cv.wait_until(lock, deadline, wokenUp);
+		m_wakeUp = false;
+#endif
+	}
+
+	void WatchService::updatePollingInterval(WatchedPath& watchedPath, const std::string& key)
+	{
+		std::chrono::milliseconds interval = std::chrono::milliseconds::max();
+		for (const auto& registration : m_registrations)
+		{
+			if (registration.second.watchedPath == key)
+				interval = std::min(interval, registration.second.pollingInterval);
+		}
+		watchedPath.pollingInterval = interval;
+	}
+
+	std::chrono::steady_clock::time_point WatchService::nextDeadline() const
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		for (const auto& path : m_paths)
+		{
+			const WatchedPath& watchedPath = path.second;
+			if (watchedPath.dirty)
+				return std::chrono::steady_clock::now();
+			if (watchedPath.polled || watchedPath.confirm)
+				deadline = std::min(deadline, watchedPath.nextCheck);
+		}
+		return deadline;
+	}
+
+	void WatchService::checkPaths()
+	{
+		std::unique_lock<std::mutex> dispatchLock(m_dispatchMutex);
+		std::vector<std::pair<Callback, std::string>> callbacks;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			std::set<std::string> changed;
+			for (auto& path : m_paths)
+			{
+				WatchedPath& watchedPath = path.second;
+				bool due = (watchedPath.polled || watchedPath.confirm) && now >= watchedPath.nextCheck;
+				if (!watchedPath.dirty && !due)
+					continue;
+
+				// An event triggered check is confirmed once more, a timed check does not need a confirmation
+				watchedPath.confirm = watchedPath.dirty && !watchedPath.polled;
+				watchedPath.dirty = false;
+				watchedPath.nextCheck = now + watchedPath.pollingInterval;
+
+				bool success;
+				std::string fingerprint = FileChangeWatcher::readChangeCounter(path.first, success);
+				if (!success)
+					continue;
+				if (!watchedPath.fingerprint.empty() && fingerprint != watchedPath.fingerprint)
+					changed.insert(path.first);
+				watchedPath.fingerprint = fingerprint;
+			}
+			if (changed.empty())
+				return;
+			for (const auto& registration : m_registrations)
+			{
+				if (changed.count(registration.second.watchedPath))
+					callbacks.emplace_back(registration.second.callback, registration.second.path);
+			}
+		}
+		for (const auto& callback : callbacks)
+			callback.first(callback.second);
+	}
+
+#ifdef __linux__
+	bool WatchService::watchDirectory(const std::string& directory)
+	{
+		if (m_inotifyFd < 0)
+			return false;
+		WatchedDirectory& watchedDirectory = m_directories[directory];
+		if (watchedDirectory.refCount == 0)
+		{
+			// SQLite creates and deletes the -wal and -journal files, so the directory is watched
+			watchedDirectory.wd = inotify_add_watch(m_inotifyFd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+			if (watchedDirectory.wd < 0)
+			{
+				Logger::logError("WatchService: inotify_add_watch: " + directory + ": " + std::string(strerror(errno)) + ", falling back to polling");
+				m_directories.erase(directory);
+				return false;
+			}
+			m_directoryByWd[watchedDirectory.wd] = directory;
+		}
+		++watchedDirectory.refCount;
+		return true;
+	}
+	void WatchService::unwatchDirectory(const std::string& directory)
+	{
+		auto it = m_directories.find(directory);
+		if (it == m_directories.end() || --it->second.refCount > 0)
+			return;
+		inotify_rm_watch(m_inotifyFd, it->second.wd);
+		m_directoryByWd.erase(it->second.wd);
+		m_directories.erase(it);
+	}
+	void WatchService::readInotifyEvents()
+	{
+		static const char* const suffixes[] = { "-wal", "-journal" };
+		alignas(inotify_event) char buffer[4096];
+		std::unique_lock<std::mutex> lock(m_mutex);
+		ssize_t length;
+		while ((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length; )
+			{
+				const inotify_event* notification = reinterpret_cast<const inotify_event*>(ptr);
+				ptr += sizeof(inotify_event) + notification->len;
+
+				auto directory = m_directoryByWd.find(notification->wd);
+				if (notification->len == 0 || directory == m_directoryByWd.end())
+					continue;
+				std::string name(notification->name);
+				for (const char* suffix : suffixes)
+				{
+					size_t suffixLength = strlen(suffix);
+					if (name.size() > suffixLength && name.compare(name.size() - suffixLength, suffixLength, suffix) == 0)
+					{
+						name.resize(name.size() - suffixLength);
+						break;
+					}
+				}
+				auto path = m_paths.find((std::filesystem::path(directory->second) / name).string());
+				if (path != m_paths.end())
+					path->second.dirty = true;
+			}
+		}
+	}
+#endif
+}
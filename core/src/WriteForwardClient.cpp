@@ -0,0 +1,177 @@
+#include "WriteForwardClient.h"
+
+#ifndef _WIN32
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		const size_t autoFlushSize = 64 * 1024;
+	}
+
+	WriteForwardClient::WriteForwardClient(const std::string& socketPath)
+		: m_socketPath(socketPath)
+		, m_fd(-1)
+		, m_nextRequestId(1)
+		, m_pendingAcks(0)
+		, m_inputPos(0)
+	{
+
+	}
+
+	WriteForwardClient::~WriteForwardClient()
+	{
+		disconnect();
+	}
+
+	uint64_t WriteForwardClient::submit(uint32_t statementId, const std::vector<Value>& params)
+	{
+		if (!isConnected())
+			return 0;
+		WriteForwardProtocol::Request request;
+		request.id = m_nextRequestId;
+		request.statementId = statementId;
+		request.params = params;
+		if (!WriteForwardProtocol::encodeRequest(request, m_output))
+		{
+			// Not sent, the connection and the other pending requests stay intact
+			Logger::logError("WriteForwardClient: The request exceeds the limits of the protocol");
+			return 0;
+		}
+		++m_nextRequestId;
+		++m_pendingAcks;
+		if (m_output.size() >= autoFlushSize && !flush())
+			return 0;
+		return request.id;
+	}
+
+	bool WriteForwardClient::execute(uint32_t statementId, const std::vector<Value>& params, Ack& ack)
+	{
+		uint64_t id = submit(statementId, params);
+		if (id == 0)
+			return false;
+		while (waitForAck(ack))
+		{
+			if (ack.requestId == id)
+				return true;
+		}
+		return false;
+	}
+
+	bool WriteForwardClient::fail(const std::string& message)
+	{
+		Logger::logError("WriteForwardClient: " + message);
+		disconnect();
+		return false;
+	}
+
+#ifdef _WIN32
+	bool WriteForwardClient::connect()
+	{
+		Logger::logError("WriteForwardClient: Unix domain sockets are not supported on this platform");
+		return false;
+	}
+	void WriteForwardClient::disconnect()
+	{
+
+	}
+	bool WriteForwardClient::flush()
+	{
+		return false;
+	}
+	bool WriteForwardClient::waitForAck(Ack& ack)
+	{
+		SQLW_UNUSED(ack);
+		return false;
+	}
+#else
+	bool WriteForwardClient::connect()
+	{
+		if (isConnected())
+			return true;
+		sockaddr_un address = {};
+		if (m_socketPath.size() >= sizeof(address.sun_path))
+			return fail("Socket path is too long: " + m_socketPath);
+
+		m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_fd < 0)
+			return fail("Creating the socket: " + std::string(strerror(errno)));
+		fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+		if (::connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+			return fail("Connecting to " + m_socketPath + ": " + strerror(errno));
+		return true;
+	}
+
+	void WriteForwardClient::disconnect()
+	{
+		if (m_fd >= 0)
+			close(m_fd);
+		m_fd = -1;
+		m_pendingAcks = 0;
+		m_output.clear();
+		m_input.clear();
+		m_inputPos = 0;
+	}
+
+	bool WriteForwardClient::flush()
+	{
+		size_t written = 0;
+		while (written < m_output.size())
+		{
+			ssize_t count = send(m_fd, m_output.data() + written, m_output.size() - written, MSG_NOSIGNAL);
+			if (count < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return fail("Sending requests: " + std::string(strerror(errno)));
+			}
+			written += static_cast<size_t>(count);
+		}
+		m_output.clear();
+		return true;
+	}
+
+	bool WriteForwardClient::waitForAck(Ack& ack)
+	{
+		if (m_pendingAcks == 0 || !flush())
+			return false;
+		while (true)
+		{
+			bool error = false;
+			size_t size = WriteForwardProtocol::decodeAck(m_input.data() + m_inputPos, m_input.size() - m_inputPos, ack, error);
+			if (error)
+				return fail("Malformed ack");
+			if (size > 0)
+			{
+				m_inputPos += size;
+				if (m_inputPos == m_input.size())
+				{
+					m_input.clear();
+					m_inputPos = 0;
+				}
+				--m_pendingAcks;
+				return true;
+			}
+
+			char buffer[65536];
+			ssize_t count = recv(m_fd, buffer, sizeof(buffer), 0);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return fail(count == 0 ? "Connection closed by the server" : "Receiving acks: " + std::string(strerror(errno)));
+			m_input.erase(0, m_inputPos);
+			m_inputPos = 0;
+			m_input.append(buffer, static_cast<size_t>(count));
+		}
+	}
+#endif
+}
@@ -0,0 +1,227 @@
+#include "WriteForwardProtocol.h"
+#include <cstring>
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		template<typename T>
+		void append(std::string& buffer, T value)
+		{
+			buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		// Reads from a payload, fails once the payload is exhausted
+		struct Reader
+		{
+			const char* data;
+			size_t size;
+			size_t pos;
+			bool failed;
+
+			template<typename T>
+			T read()
+			{
+				T value{};
+				if (failed || size - pos < sizeof(T))
+				{
+					failed = true;
+					return value;
+				}
+				std::memcpy(&value, data + pos, sizeof(T));
+				pos += sizeof(T);
+				return value;
+			}
+			std::string readBytes(uint32_t count)
+			{
+				if (failed || size - pos < count)
+				{
+					failed = true;
+					return std::string();
+				}
+				std::string bytes(data + pos, count);
+				pos += count;
+				return bytes;
+			}
+		};
+
+		// Returns the payload of the first frame, nullptr if it is incomplete
+		const char* framePayload(const char* data, size_t size, uint32_t& payloadSize, bool& error)
+		{
+			error = false;
+			if (size < sizeof(uint32_t))
+				return nullptr;
+			std::memcpy(&payloadSize, data, sizeof(uint32_t));
+			if (payloadSize > WriteForwardProtocol::maxFrameSize)
+			{
+				error = true;
+				return nullptr;
+			}
+			if (size - sizeof(uint32_t) < payloadSize)
+				return nullptr;
+			return data + sizeof(uint32_t);
+		}
+
+		void beginFrame(std::string& buffer, size_t& sizePos)
+		{
+			sizePos = buffer.size();
+			append<uint32_t>(buffer, 0);
+		}
+		void endFrame(std::string& buffer, size_t sizePos)
+		{
+			uint32_t payloadSize = static_cast<uint32_t>(buffer.size() - sizePos - sizeof(uint32_t));
+			std::memcpy(&buffer[sizePos], &payloadSize, sizeof(payloadSize));
+		}
+	}
+
+	WriteForwardProtocol::Value WriteForwardProtocol::Value::fromInt(int64_t value)
+	{
+		Value v;
+		v.type = Type::integer;
+		v.intValue = value;
+		return v;
+	}
+	WriteForwardProtocol::Value WriteForwardProtocol::Value::fromReal(double value)
+	{
+		Value v;
+		v.type = Type::real;
+		v.realValue = value;
+		return v;
+	}
+	WriteForwardProtocol::Value WriteForwardProtocol::Value::fromText(const std::string& value)
+	{
+		Value v;
+		v.type = Type::text;
+		v.bytes = value;
+		return v;
+	}
+	WriteForwardProtocol::Value WriteForwardProtocol::Value::fromBlob(const std::string& value)
+	{
+		Value v;
+		v.type = Type::blob;
+		v.bytes = value;
+		return v;
+	}
+
+	bool WriteForwardProtocol::encodeRequest(const Request& request, std::string& buffer)
+	{
+		// The server drops the connection on a frame it can't decode, check the limits before encoding
+		if (request.params.size() > maxParams)
+			return false;
+		size_t payloadSize = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t);
+		for (const Value& value : request.params)
+		{
+			payloadSize += sizeof(uint8_t);
+			if (value.type == Value::Type::integer || value.type == Value::Type::real)
+				payloadSize += sizeof(int64_t);
+			else if (value.type == Value::Type::text || value.type == Value::Type::blob)
+				payloadSize += sizeof(uint32_t) + value.bytes.size();
+		}
+		if (payloadSize > maxFrameSize)
+			return false;
+
+		size_t sizePos;
+		beginFrame(buffer, sizePos);
+		append<uint64_t>(buffer, request.id);
+		append<uint32_t>(buffer, request.statementId);
+		append<uint16_t>(buffer, static_cast<uint16_t>(request.params.size()));
+		for (const Value& value : request.params)
+		{
+			append<uint8_t>(buffer, value.type);
+			switch (value.type)
+			{
+			case Value::Type::integer:
+				append<int64_t>(buffer, value.intValue);
+				break;
+			case Value::Type::real:
+				append<double>(buffer, value.realValue);
+				break;
+			case Value::Type::text:
+			case Value::Type::blob:
+				append<uint32_t>(buffer, static_cast<uint32_t>(value.bytes.size()));
+				buffer.append(value.bytes);
+				break;
+			default:
+				break;
+			}
+		}
+		endFrame(buffer, sizePos);
+		return true;
+	}
+
+	void WriteForwardProtocol::encodeAck(const Ack& ack, std::string& buffer)
+	{
+		size_t sizePos;
+		beginFrame(buffer, sizePos);
+		append<uint64_t>(buffer, ack.requestId);
+		append<int32_t>(buffer, ack.resultCode);
+		append<int64_t>(buffer, ack.changes);
+		append<int64_t>(buffer, ack.lastInsertRowId);
+		endFrame(buffer, sizePos);
+	}
+
+	size_t WriteForwardProtocol::decodeRequest(const char* data, size_t size, Request& request, bool& error)
+	{
+		uint32_t payloadSize = 0;
+		const char* payload = framePayload(data, size, payloadSize, error);
+		if (!payload)
+			return 0;
+
+		Reader reader{ payload, payloadSize, 0, false };
+		request.id = reader.read<uint64_t>();
+		request.statementId = reader.read<uint32_t>();
+		uint16_t paramCount = reader.read<uint16_t>();
+		request.params.clear();
+		request.params.reserve(paramCount);
+		for (uint16_t i = 0; i < paramCount && !reader.failed; ++i)
+		{
+			Value value;
+			value.type = static_cast<Value::Type>(reader.read<uint8_t>());
+			switch (value.type)
+			{
+			case Value::Type::null:
+				break;
+			case Value::Type::integer:
+				value.intValue = reader.read<int64_t>();
+				break;
+			case Value::Type::real:
+				value.realValue = reader.read<double>();
+				break;
+			case Value::Type::text:
+			case Value::Type::blob:
+				value.bytes = reader.readBytes(reader.read<uint32_t>());
+				break;
+			default:
+				reader.failed = true;
+				break;
+			}
+			request.params.push_back(std::move(value));
+		}
+		if (reader.failed || reader.pos != payloadSize)
+		{
+			error = true;
+			return 0;
+		}
+		return sizeof(uint32_t) + payloadSize;
+	}
+
+	size_t WriteForwardProtocol::decodeAck(const char* data, size_t size, Ack& ack, bool& error)
+	{
+		uint32_t payloadSize = 0;
+		const char* payload = framePayload(data, size, payloadSize, error);
+		if (!payload)
+			return 0;
+
+		Reader reader{ payload, payloadSize, 0, false };
+		ack.requestId = reader.read<uint64_t>();
+		ack.resultCode = reader.read<int32_t>();
+		ack.changes = reader.read<int64_t>();
+		ack.lastInsertRowId = reader.read<int64_t>();
+		if (reader.failed || reader.pos != payloadSize)
+		{
+			error = true;
+			return 0;
+		}
+		return sizeof(uint32_t) + payloadSize;
+	}
+}
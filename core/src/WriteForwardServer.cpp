@@ -0,0 +1,466 @@
+#include "WriteForwardServer.h"
+#include <algorithm>
+
+#ifndef _WIN32
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	#include <cstring>
+#endif
+
+namespace SQLiteWrapper
+{
+	WriteForwardServer::WriteForwardServer(const std::string& dbPath, const std::string& socketPath)
+		: m_dbPath(dbPath)
+		, m_socketPath(socketPath)
+		, m_maxBatchSize(1024)
+		, m_db(nullptr)
+		, m_listenFd(-1)
+		, m_wakeupFds{ -1, -1 }
+		, m_thread(nullptr)
+		, m_running(false)
+		, m_nextClientId(0)
+	{
+
+	}
+
+	WriteForwardServer::~WriteForwardServer()
+	{
+		stop();
+	}
+
+	void WriteForwardServer::registerStatement(uint32_t statementId, const std::string& sql)
+	{
+		if (m_running.load())
+		{
+			Logger::logError("WriteForwardServer: Statements can only be registered before start()");
+			return;
+		}
+		m_statementSql[statementId] = sql;
+	}
+
+	void WriteForwardServer::setMaxBatchSize(size_t maxBatchSize)
+	{
+		m_maxBatchSize = std::max<size_t>(maxBatchSize, 1);
+	}
+
+	WriteForwardServer::Statistics WriteForwardServer::getStatistics() const
+	{
+		std::unique_lock<std::mutex> lock(m_statisticsMutex);
+		return m_statistics;
+	}
+
+#ifdef _WIN32
+	bool WriteForwardServer::start()
+	{
+		Logger::logError("WriteForwardServer: Unix domain sockets are not supported on this platform");
+		return false;
+	}
+	void WriteForwardServer::stop()
+	{
+
+	}
+#else
+	bool WriteForwardServer::start()
+	{
+		if (m_running.load())
+			return true;
+
+		sockaddr_un address = {};
+		if (m_socketPath.size() >= sizeof(address.sun_path))
+		{
+			Logger::logError("WriteForwardServer: Socket path is too long: " + m_socketPath);
+			return false;
+		}
+
+		if (sqlite3_open_v2(m_dbPath.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+		{
+			Logger::logError("WriteForwardServer: Opening the database: " + std::string(m_db ? sqlite3_errmsg(m_db) : m_dbPath));
+			cleanup();
+			return false;
+		}
+		m_busyHandler.install(m_db);
+		for (const auto& statement : m_statementSql)
+		{
+			sqlite3_stmt* stmt = nullptr;
+			if (sqlite3_prepare_v3(m_db, statement.second.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+			{
+				Logger::logError("WriteForwardServer: Preparing statement " + std::to_string(statement.first) + ": " + sqlite3_errmsg(m_db));
+				cleanup();
+				return false;
+			}
+			m_statements[statement.first] = stmt;
+		}
+
+		m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_listenFd < 0 || pipe(m_wakeupFds) != 0)
+		{
+			Logger::logError("WriteForwardServer: Creating the socket: " + std::string(strerror(errno)));
+			cleanup();
+			return false;
+		}
+		fcntl(m_listenFd, F_SETFD, FD_CLOEXEC);
+		fcntl(m_listenFd, F_SETFL, O_NONBLOCK);
+
+		// Only the elected writer runs the server, a socket left by a crashed writer can be removed
+		unlink(m_socketPath.c_str());
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+		if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(m_listenFd, 64) != 0)
+		{
+			Logger::logError("WriteForwardServer: Listening on " + m_socketPath + ": " + strerror(errno));
+			cleanup();
+			return false;
+		}
+
+		m_running.store(true);
+		m_thread = new std::thread(&WriteForwardServer::serve, this);
+		return true;
+	}
+
+	void WriteForwardServer::stop()
+	{
+		if (m_thread)
+		{
+			char wakeup = 0;
+			if (write(m_wakeupFds[1], &wakeup, 1) != 1)
+				Logger::logError("WriteForwardServer: Waking up the server thread: " + std::string(strerror(errno)));
+			m_thread->join();
+			delete m_thread;
+			m_thread = nullptr;
+		}
+		cleanup();
+		m_running.store(false);
+	}
+
+	void WriteForwardServer::serve()
+	{
+		std::vector<pollfd> fds;
+		std::vector<uint64_t> fdClients;
+		bool moreRequests = false;
+		while (true)
+		{
+			fds.clear();
+			fdClients.clear();
+			fds.push_back(pollfd{ m_wakeupFds[0], POLLIN, 0 });
+			fds.push_back(pollfd{ m_listenFd, POLLIN, 0 });
+			for (const auto& entry : m_clients)
+			{
+				short events = entry.second.acceptsInput() ? POLLIN : 0;
+				if (!entry.second.output.empty())
+					events |= POLLOUT;
+				fds.push_back(pollfd{ entry.second.fd, events, 0 });
+				fdClients.push_back(entry.first);
+			}
+
+			// Requests left over from a full batch are executed without waiting
+			if (poll(fds.data(), static_cast<nfds_t>(fds.size()), moreRequests ? 0 : -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				Logger::logError("WriteForwardServer: poll: " + std::string(strerror(errno)));
+				break;
+			}
+			if (fds[0].revents & POLLIN)
+				break;
+			if (fds[1].revents & POLLIN)
+				acceptClients();
+
+			for (size_t i = 0; i < fdClients.size(); ++i)
+			{
+				Client& client = m_clients[fdClients[i]];
+				short revents = fds[i + 2].revents;
+				if (revents & (POLLIN | POLLHUP | POLLERR))
+					readClient(client);
+				if ((revents & POLLOUT) && !client.closed)
+					writeClient(client);
+			}
+
+			moreRequests = collectRequests();
+			if (!m_batch.empty())
+			{
+				executeBatch();
+				// Requests left after a rolled back batch run in the next round
+				moreRequests = moreRequests || !m_batch.empty();
+				for (auto& entry : m_clients)
+				{
+					if (!entry.second.output.empty() && !entry.second.closed)
+						writeClient(entry.second);
+				}
+			}
+
+			for (auto it = m_clients.begin(); it != m_clients.end();)
+			{
+				if (it->second.closed)
+				{
+					closeClient(it->second);
+					it = m_clients.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			std::unique_lock<std::mutex> lock(m_statisticsMutex);
+			m_statistics.clients = m_clients.size();
+		}
+	}
+
+	void WriteForwardServer::acceptClients()
+	{
+		while (true)
+		{
+			int fd = accept(m_listenFd, nullptr, nullptr);
+			if (fd < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					Logger::logError("WriteForwardServer: accept: " + std::string(strerror(errno)));
+				return;
+			}
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			Client& client = m_clients[m_nextClientId++];
+			client.fd = fd;
+		}
+	}
+
+	void WriteForwardServer::readClient(Client& client)
+	{
+		char buffer[65536];
+		while (!client.closed && client.acceptsInput())
+		{
+			ssize_t count = recv(client.fd, buffer, sizeof(buffer), 0);
+			if (count > 0)
+			{
+				client.input.append(buffer, static_cast<size_t>(count));
+				continue;
+			}
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return;
+			client.closed = true; // Disconnected or failed
+		}
+	}
+
+	void WriteForwardServer::writeClient(Client& client)
+	{
+		size_t written = 0;
+		while (written < client.output.size())
+		{
+			ssize_t count = send(client.fd, client.output.data() + written, client.output.size() - written, MSG_NOSIGNAL);
+			if (count > 0)
+			{
+				written += static_cast<size_t>(count);
+				continue;
+			}
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break; // The rest is sent when the socket is writable again
+			client.closed = true;
+			break;
+		}
+		client.output.erase(0, written);
+	}
+
+	bool WriteForwardServer::collectRequests()
+	{
+		// One request per client and round, a client with a long pipeline can not starve the others
+		bool added = true;
+		while (added)
+		{
+			added = false;
+			for (auto& entry : m_clients)
+			{
+				Client& client = entry.second;
+				if (m_batch.size() >= m_maxBatchSize)
+					return true;
+				if (client.closed || client.input.empty() || client.output.size() >= maxClientOutput)
+					continue;
+
+				PendingRequest pending{ entry.first, WriteForwardProtocol::Request() };
+				bool error = false;
+				size_t size = WriteForwardProtocol::decodeRequest(client.input.data(), client.input.size(), pending.request, error);
+				if (error)
+				{
+					Logger::logError("WriteForwardServer: Malformed request, closing the connection");
+					client.closed = true;
+					continue;
+				}
+				if (size == 0)
+					continue;
+				client.input.erase(0, size);
+				m_batch.push_back(std::move(pending));
+				added = true;
+			}
+		}
+		return false;
+	}
+
+	void WriteForwardServer::executeBatch()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t count = m_batch.size();
+		std::vector<WriteForwardProtocol::Ack> acks(count);
+		for (size_t i = 0; i < count; ++i)
+			acks[i].requestId = m_batch[i].request.id;
+
+		int rc = sqlite3_exec(m_db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+		if (rc == SQLITE_OK)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				acks[i].resultCode = executeRequest(m_batch[i].request);
+				if (acks[i].resultCode == SQLITE_OK)
+				{
+					acks[i].changes = sqlite3_changes64(m_db);
+					acks[i].lastInsertRowId = sqlite3_last_insert_rowid(m_db);
+				}
+				if (!sqlite3_get_autocommit(m_db))
+					continue;
+
+				// The transaction has ended within the request, the rest of the batch waits for the next one
+				if (acks[i].resultCode != SQLITE_OK)
+				{
+					// SQLite has rolled back (OR ROLLBACK conflict, full disk, I/O error), the earlier requests are lost
+					Logger::logError("WriteForwardServer: A failed request rolled back a batch of " + std::to_string(i + 1) + " requests: " + sqlite3_errstr(acks[i].resultCode));
+					for (size_t j = 0; j < i; ++j)
+					{
+						acks[j].resultCode = acks[i].resultCode;
+						acks[j].changes = 0;
+						acks[j].lastInsertRowId = 0;
+					}
+				}
+				count = i + 1;
+				acks.resize(count);
+				break;
+			}
+			if (!sqlite3_get_autocommit(m_db))
+			{
+				rc = sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr);
+				if (rc != SQLITE_OK)
+					sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+			}
+		}
+		if (rc != SQLITE_OK)
+		{
+			Logger::logError("WriteForwardServer: Committing a batch of " + std::to_string(count) + " requests: " + sqlite3_errmsg(m_db));
+			for (WriteForwardProtocol::Ack& ack : acks)
+			{
+				ack.resultCode = rc;
+				ack.changes = 0;
+				ack.lastInsertRowId = 0;
+			}
+		}
+
+		size_t failed = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (acks[i].resultCode != SQLITE_OK)
+				++failed;
+			auto it = m_clients.find(m_batch[i].clientId);
+			if (it != m_clients.end() && !it->second.closed)
+				WriteForwardProtocol::encodeAck(acks[i], it->second.output);
+		}
+
+		std::unique_lock<std::mutex> lock(m_statisticsMutex);
+		m_statistics.requests += count;
+		m_statistics.failedRequests += failed;
+		++m_statistics.batches;
+		m_statistics.maxBatchSize = std::max(m_statistics.maxBatchSize, count);
+		m_statistics.totalCommitTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		m_batch.erase(m_batch.begin(), m_batch.begin() + count);
+	}
+
+	int WriteForwardServer::executeRequest(const WriteForwardProtocol::Request& request)
+	{
+		auto it = m_statements.find(request.statementId);
+		if (it == m_statements.end())
+			return SQLITE_NOTFOUND;
+		sqlite3_stmt* stmt = it->second;
+		if (static_cast<int>(request.params.size()) != sqlite3_bind_parameter_count(stmt))
+			return SQLITE_RANGE;
+
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		for (size_t i = 0; i < request.params.size(); ++i)
+		{
+			const WriteForwardProtocol::Value& value = request.params[i];
+			int index = static_cast<int>(i) + 1;
+			int rc = SQLITE_OK;
+			switch (value.type)
+			{
+			case WriteForwardProtocol::Value::Type::integer:
+				rc = sqlite3_bind_int64(stmt, index, value.intValue);
+				break;
+			case WriteForwardProtocol::Value::Type::real:
+				rc = sqlite3_bind_double(stmt, index, value.realValue);
+				break;
+			case WriteForwardProtocol::Value::Type::text:
+				rc = sqlite3_bind_text(stmt, index, value.bytes.data(), static_cast<int>(value.bytes.size()), SQLITE_STATIC);
+				break;
+			case WriteForwardProtocol::Value::Type::blob:
+				rc = sqlite3_bind_blob(stmt, index, value.bytes.data(), static_cast<int>(value.bytes.size()), SQLITE_STATIC);
+				break;
+			default:
+				rc = sqlite3_bind_null(stmt, index);
+				break;
+			}
+			if (rc != SQLITE_OK)
+				return rc;
+		}
+
+		int rc;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			// Rows of RETURNING clauses are not forwarded
+		}
+		if (rc == SQLITE_DONE)
+			rc = SQLITE_OK;
+		else
+			rc = sqlite3_extended_errcode(m_db);
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt); // The bound values belong to the request
+		return rc;
+	}
+
+	void WriteForwardServer::closeClient(Client& client)
+	{
+		if (client.fd >= 0)
+			close(client.fd);
+		client.fd = -1;
+	}
+
+	void WriteForwardServer::cleanup()
+	{
+		for (auto& entry : m_clients)
+			closeClient(entry.second);
+		m_clients.clear();
+		m_batch.clear();
+		for (auto& statement : m_statements)
+			sqlite3_finalize(statement.second);
+		m_statements.clear();
+		if (m_db)
+		{
+			sqlite3_close(m_db);
+			m_db = nullptr;
+		}
+		if (m_listenFd >= 0)
+		{
+			close(m_listenFd);
+			m_listenFd = -1;
+			unlink(m_socketPath.c_str());
+		}
+		for (int& fd : m_wakeupFds)
+		{
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+		}
+	}
+#endif
+}
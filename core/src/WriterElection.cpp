@@ -0,0 +1,132 @@
+#include "WriterElection.h"
+#include "SQLite.h"
+
+namespace SQLiteWrapper
+{
+	namespace
+	{
+		// Pause before the wait is retried after the lock file could not be used
+		const std::chrono::milliseconds retryDelay(100);
+	}
+
+	WriterElection::WriterElection(const std::string& lockPath, QObject* parent)
+		: QObject(parent)
+		, m_lockFile(lockPath)
+		, m_db(nullptr)
+		, m_role(Role::none)
+		, m_waitThread(nullptr)
+	{
+
+	}
+
+	WriterElection::~WriterElection()
+	{
+		stop();
+	}
+
+	void WriterElection::setDatabase(SQLite* db)
+	{
+		m_db = db;
+		if (m_db && m_role.load() != Role::none)
+			applyRole(m_role.load());
+	}
+
+	bool WriterElection::start()
+	{
+		if (m_role.load() != Role::none)
+			return true;
+
+		LockFile::LockStatus status = m_lockFile.tryGetExclusiveLock();
+		if (status == LockFile::LockStatus::locked)
+		{
+			applyRole(Role::leader);
+			return true;
+		}
+		if (status != LockFile::LockStatus::unableToLock)
+		{
+			Logger::logError("WriterElection: Unable to use the lock file: " + m_lockFile.getPath());
+			return false;
+		}
+
+		applyRole(Role::follower);
+		m_stopWaiting.reset();
+		m_waitThread = new std::thread(&WriterElection::waitForLeadership, this);
+		return true;
+	}
+
+	void WriterElection::stop()
+	{
+		if (m_waitThread)
+		{
+			m_stopWaiting.cancel();
+			m_waitThread->join();
+			delete m_waitThread;
+			m_waitThread = nullptr;
+		}
+		if (m_lockFile.isLocked())
+		{
+			// Close the writer connection first, the next leader must not find the database locked
+			if (m_db && m_db->isOpen())
+			{
+				m_db->close();
+				m_db->setReadOnly(true);
+				m_db->open();
+			}
+			m_lockFile.releaseLock();
+		}
+		if (m_role.load() != Role::none)
+		{
+			m_role.store(Role::none);
+			emit roleChanged(Role::none);
+		}
+	}
+
+	void WriterElection::onLeadershipAcquired()
+	{
+		if (m_waitThread)
+		{
+			m_waitThread->join();
+			delete m_waitThread;
+			m_waitThread = nullptr;
+		}
+		if (m_lockFile.isLocked())
+			applyRole(Role::leader);
+	}
+
+	void WriterElection::waitForLeadership()
+	{
+		// Blocks in the kernel until the leader releases the lock or stop() cancels the wait
+		while (true)
+		{
+			LockFile::LockStatus status = m_lockFile.acquire(m_stopWaiting, LockFile::LockMode::exclusive);
+			if (status == LockFile::LockStatus::locked)
+			{
+				QMetaObject::invokeMethod(this, &WriterElection::onLeadershipAcquired, Qt::QueuedConnection);
+				return;
+			}
+			if (status == LockFile::LockStatus::cancelled || m_stopWaiting.waitFor(retryDelay))
+				return;
+		}
+	}
+
+	void WriterElection::applyRole(Role role)
+	{
+		m_role.store(role);
+		if (m_db)
+		{
+			bool readOnly = role != Role::leader;
+			if (m_db->isOpen() && m_db->isReadOnly() != readOnly)
+			{
+				m_db->close();
+				m_db->setReadOnly(readOnly);
+				if (!m_db->open())
+					Logger::logError("WriterElection: Unable to reopen the database after the role change");
+			}
+			else
+			{
+				m_db->setReadOnly(readOnly);
+			}
+		}
+		emit roleChanged(role);
+	}
+}
@@ -0,0 +1,100 @@
+#ifdef QT_ENABLED
+#include <QCoreApplication>
+#endif
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include "SQLiteWrapper.h"
+
+// Compares the transfer of a whole database between two connections:
+//  1. File round trip: VACUUM INTO a file and open() the file with the second connection
+//  2. Memory image: serialize() the first connection and deserialize() it into the second one
+
+static const int rowCount = 10000;
+static const int repetitions = 20;
+static const char* transferFile = "serializeBenchmark_transfer.db";
+
+void fillDatabase(SQLiteWrapper::SQLite& db);
+double benchmarkFileRoundTrip(SQLiteWrapper::SQLite& source);
+double benchmarkSerialize(SQLiteWrapper::SQLite& source);
+
+int main(int argc, char* argv[])
+{
+#ifdef QT_ENABLED
+	QCoreApplication app(argc, argv);
+#else
+	SQLW_UNUSED(argc);
+	SQLW_UNUSED(argv);
+#endif
+	SQLiteWrapper::LibraryInfo::printInfo();
+
+	SQLiteWrapper::SQLite source(":memory:");
+	if (!source.open())
+	{
+		std::cout << "Can't open the source database\n";
+		return 1;
+	}
+	fillDatabase(source);
+
+	// Move the source into a contiguous memory image, so that serialize() can borrow it
+	source.deserialize(source.serialize(), false);
+
+	double fileMs = benchmarkFileRoundTrip(source);
+	double imageMs = benchmarkSerialize(source);
+
+	std::cout << "Rows: " << rowCount << ", repetitions: " << repetitions << "\n";
+	std::cout << "File round trip:       " << fileMs << " ms per transfer\n";
+	std::cout << "serialize/deserialize: " << imageMs << " ms per transfer\n";
+
+	source.close();
+	std::remove(transferFile);
+	return 0;
+}
+
+void fillDatabase(SQLiteWrapper::SQLite& db)
+{
+	db.execute("CREATE TABLE Items (ID INTEGER PRIMARY KEY, Name TEXT, Value REAL);");
+	db.beginTransaction();
+	for (int i = 0; i < rowCount; ++i)
+	{
+		db.executeWithParams("INSERT INTO Items (Name, Value) VALUES (?, ?);",
+			{ "Item" + std::to_string(i), std::to_string(i * 0.5) });
+	}
+	db.commitTransaction();
+}
+
+double benchmarkFileRoundTrip(SQLiteWrapper::SQLite& source)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repetitions; ++i)
+	{
+		std::remove(transferFile);
+		source.execute(std::string("VACUUM INTO '") + transferFile + "';");
+
+		SQLiteWrapper::SQLite target(transferFile);
+		target.open();
+		if (target.fetchAll("SELECT count(*) FROM Items;").empty())
+			std::cout << "File round trip: transfer failed\n";
+		target.close();
+	}
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+	return duration.count() / repetitions;
+}
+
+double benchmarkSerialize(SQLiteWrapper::SQLite& source)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repetitions; ++i)
+	{
+		SQLiteWrapper::SerializedDatabase image = source.serialize();
+
+		SQLiteWrapper::SQLite target(":memory:");
+		target.open();
+		if (!target.deserialize(std::move(image), true) ||
+			target.fetchAll("SELECT count(*) FROM Items;").empty())
+			std::cout << "serialize/deserialize: transfer failed\n";
+		target.close();
+	}
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+	return duration.count() / repetitions;
+}
@@ -0,0 +1,142 @@
+#ifdef QT_ENABLED
+#include <QCoreApplication>
+#endif
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include "SQLiteWrapper.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Compares concurrent writes of several processes to one database:
+//  1. Direct: each process writes with its own connection and competes for the write lock
+//  2. Forwarded: each process sends its writes to a WriteForwardServer, which group commits them
+
+static const int processCount = 4;
+static const int writesPerProcess = 2000;
+static const size_t pipelineDepth = 64;
+static const char* dbFile = "writeForwardBenchmark.db";
+static const char* insertQuery = "INSERT INTO Items (Process, Value) VALUES (?, ?);";
+
+#ifndef _WIN32
+void createDatabase();
+double benchmarkDirect();
+double benchmarkForwarded(SQLiteWrapper::WriteForwardServer::Statistics& statistics);
+void waitForChildren();
+#endif
+
+int main(int argc, char* argv[])
+{
+#ifdef QT_ENABLED
+	QCoreApplication app(argc, argv);
+#else
+	SQLW_UNUSED(argc);
+	SQLW_UNUSED(argv);
+#endif
+	SQLiteWrapper::LibraryInfo::printInfo();
+#ifdef _WIN32
+	std::cout << "Write forwarding uses Unix domain sockets and is not available on this platform\n";
+	return 0;
+#else
+	createDatabase();
+	double directMs = benchmarkDirect();
+	createDatabase();
+	SQLiteWrapper::WriteForwardServer::Statistics statistics;
+	double forwardedMs = benchmarkForwarded(statistics);
+
+	int writes = processCount * writesPerProcess;
+	std::cout << "Processes: " << processCount << ", writes per process: " << writesPerProcess << "\n";
+	std::cout << "Direct:    " << directMs << " ms, " << writes / directMs * 1000.0 << " writes/s\n";
+	std::cout << "Forwarded: " << forwardedMs << " ms, " << writes / forwardedMs * 1000.0 << " writes/s, "
+		<< statistics.batches << " commits, largest batch " << statistics.maxBatchSize << "\n";
+
+	for (const char* suffix : { "", "-wal", "-shm" })
+		std::remove((std::string(dbFile) + suffix).c_str());
+	return 0;
+#endif
+}
+
+#ifndef _WIN32
+void createDatabase()
+{
+	for (const char* suffix : { "", "-wal", "-shm" })
+		std::remove((std::string(dbFile) + suffix).c_str());
+	SQLiteWrapper::SQLite db(dbFile);
+	db.open();
+	db.execute("PRAGMA journal_mode=WAL;");
+	db.execute("CREATE TABLE Items (ID INTEGER PRIMARY KEY, Process INTEGER, Value TEXT);");
+	db.close();
+}
+
+double benchmarkDirect()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int p = 0; p < processCount; ++p)
+	{
+		if (fork() != 0)
+			continue;
+		SQLiteWrapper::SQLite db(dbFile);
+		db.open();
+		for (int i = 0; i < writesPerProcess; ++i)
+		{
+			if (!db.executeWithParams(insertQuery, { std::to_string(p), "Value" + std::to_string(i) }))
+				std::cout << "Direct: write failed\n";
+		}
+		db.close();
+		_exit(0);
+	}
+	waitForChildren();
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+	return duration.count();
+}
+
+double benchmarkForwarded(SQLiteWrapper::WriteForwardServer::Statistics& statistics)
+{
+	std::string socketPath = SQLiteWrapper::WriteForwardServer::getDefaultSocketPath(dbFile);
+	SQLiteWrapper::WriteForwardServer server(dbFile, socketPath);
+	server.registerStatement(1, insertQuery);
+	if (!server.start())
+	{
+		std::cout << "Forwarded: can't start the server\n";
+		return 0;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int p = 0; p < processCount; ++p)
+	{
+		if (fork() != 0)
+			continue;
+		SQLiteWrapper::WriteForwardClient client(socketPath);
+		client.connect();
+		SQLiteWrapper::WriteForwardClient::Ack ack;
+		for (int i = 0; i < writesPerProcess; ++i)
+		{
+			client.submit(1, { SQLiteWrapper::WriteForwardClient::Value::fromInt(p),
+				SQLiteWrapper::WriteForwardClient::Value::fromText("Value" + std::to_string(i)) });
+			// Keep a limited number of requests in flight
+			while (client.getPendingCount() >= pipelineDepth || (i == writesPerProcess - 1 && client.getPendingCount() > 0))
+			{
+				if (!client.waitForAck(ack) || ack.resultCode != SQLITE_OK)
+				{
+					std::cout << "Forwarded: write failed\n";
+					_exit(1);
+				}
+			}
+		}
+		_exit(0);
+	}
+	waitForChildren();
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+	statistics = server.getStatistics();
+	server.stop();
+	return duration.count();
+}
+
+void waitForChildren()
+{
+	for (int p = 0; p < processCount; ++p)
+		wait(nullptr);
+}
+#endif
@@ -1,11 +1,14 @@
 #include <iostream>
 #include "SQLiteWrapper.h"
 #include <iostream>
+#include <QCoreApplication>
 #include "tests.h"
 
 
 int main(int argc, char* argv[])
 {
+	// Timers and queued signals of the tests need an application object
+	QCoreApplication app(argc, argv);
 	SQLiteWrapper::LibraryInfo::printInfo();
 
 	std::cout << "Running "<< UnitTest::Test::getTests().size() << " tests...\n";
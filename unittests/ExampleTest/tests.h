@@ -2,4 +2,26 @@
 
 #include "test.h"
 #include "tests/TST_simple.h"
+#include "tests/TST_SlowQueryLog.h"
+#include "tests/TST_QueryPlanLinter.h"
+#include "tests/TST_IndexAdvisor.h"
+#include "tests/TST_Backup.h"
+#include "tests/TST_HotCopy.h"
+#include "tests/TST_Serialize.h"
+#include "tests/TST_BlobStream.h"
+#include "tests/TST_RowChanges.h"
+#include "tests/TST_FileChangeWatcher.h"
+#include "tests/TST_WatchService.h"
+#include "tests/TST_DebouncePolicy.h"
+#include "tests/TST_TableChangeTracker.h"
+#include "tests/TST_ChangeDetection.h"
+#include "tests/TST_LockFile.h"
+#include "tests/TST_BusyHandler.h"
+#include "tests/TST_WriterElection.h"
+#include "tests/TST_WriteForward.h"
+#include "tests/TST_ChangeChannel.h"
+#include "tests/TST_ExecutionBudget.h"
+#include "tests/TST_ConnectionMetrics.h"
+#include "tests/TST_MetricsExporter.h"
+#include "tests/TST_Strand.h"
 //#include "test_nasted.h"
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <atomic>
+#include <filesystem>
+
+class TST_Backup : public UnitTest::Test
+{
+	TEST_CLASS(TST_Backup)
+public:
+	TST_Backup()
+		: Test("TST_Backup")
+	{
+		ADD_TEST(TST_Backup::backupCopiesDatabase);
+		ADD_TEST(TST_Backup::canceledBackupRemovesFile);
+		ADD_TEST(TST_Backup::refusesSecondBackup);
+	}
+
+private:
+	static void fill(SQLiteWrapper::SQLite& db, int rows)
+	{
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, data TEXT);");
+		db.execute("BEGIN;");
+		for (int i = 0; i < rows; ++i)
+			db.executeWithParams("INSERT INTO items(data) VALUES(?);", { std::string(500, 'x') });
+		db.execute("COMMIT;");
+	}
+
+	// Tests
+	TEST_FUNCTION(backupCopiesDatabase)
+	{
+		TEST_START;
+		std::string backupPath = TestUtilities::getTempDatabasePath("backup_copy.bak");
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("backup_source.db"));
+		TEST_ASSERT(db.open());
+		fill(db, 200);
+
+		std::atomic<int> steps(0);
+		std::atomic<int> lastRemaining(-1);
+		TEST_ASSERT(db.backupTo(backupPath, 10, std::chrono::milliseconds(0),
+			[&](int remaining, int) { ++steps; lastRemaining = remaining; }));
+		db.waitForBackup();
+		TEST_ASSERT(!db.isBackupRunning());
+		TEST_ASSERT(steps.load() > 1);
+		TEST_COMPARE(lastRemaining.load(), 0);
+		db.close();
+
+		SQLiteWrapper::SQLite copy(backupPath);
+		TEST_ASSERT(copy.open());
+		std::vector<std::vector<std::string>> rows = copy.fetchAll("SELECT COUNT(*) FROM items;");
+		TEST_ASSERT(rows == std::vector<std::vector<std::string>>({ { "200" } }));
+		copy.close();
+	}
+
+	TEST_FUNCTION(canceledBackupRemovesFile)
+	{
+		TEST_START;
+		std::string backupPath = TestUtilities::getTempDatabasePath("backup_cancel.bak");
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("backup_cancel.db"));
+		TEST_ASSERT(db.open());
+		fill(db, 200);
+
+		TEST_ASSERT(db.backupTo(backupPath, 1, std::chrono::milliseconds(20)));
+		db.cancelBackup();
+		db.waitForBackup();
+		TEST_ASSERT(!std::filesystem::exists(backupPath));
+		db.close();
+	}
+
+	TEST_FUNCTION(refusesSecondBackup)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("backup_twice.db"));
+		TEST_ASSERT(!db.backupTo(TestUtilities::getTempDatabasePath("backup_closed.bak")));
+		TEST_ASSERT(db.open());
+		fill(db, 50);
+
+		TEST_ASSERT(db.backupTo(TestUtilities::getTempDatabasePath("backup_twice1.bak"), 1, std::chrono::milliseconds(20)));
+		TEST_ASSERT(!db.backupTo(TestUtilities::getTempDatabasePath("backup_twice2.bak")));
+		db.cancelBackup();
+		db.waitForBackup();
+
+		// A finished worker does not block the next backup
+		TEST_ASSERT(db.backupTo(TestUtilities::getTempDatabasePath("backup_twice3.bak"), -1));
+		db.waitForBackup();
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_Backup);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <iterator>
+
+class TST_BlobStream : public UnitTest::Test
+{
+	TEST_CLASS(TST_BlobStream)
+public:
+	TST_BlobStream()
+		: Test("TST_BlobStream")
+	{
+		ADD_TEST(TST_BlobStream::readAndWrite);
+		ADD_TEST(TST_BlobStream::streamFlushAndSeek);
+		ADD_TEST(TST_BlobStream::writeStopsAtEnd);
+		ADD_TEST(TST_BlobStream::reopenOtherRow);
+	}
+
+private:
+	static std::string readAll(SQLiteWrapper::BlobStream& blob, size_t chunkSize)
+	{
+		blob.seek(0);
+		SQLiteWrapper::BlobIStream in(blob, chunkSize);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	// Tests
+	TEST_FUNCTION(readAndWrite)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("blob_rw.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE files(id INTEGER PRIMARY KEY, data BLOB);"));
+		sqlite3_int64 rowid = SQLiteWrapper::BlobStream::insertZeroBlob(db, "files", "data", 10);
+		TEST_ASSERT(rowid > 0);
+
+		SQLiteWrapper::BlobStream blob(db, "files", "data", rowid, SQLiteWrapper::BlobStream::Mode::readWrite);
+		TEST_ASSERT(blob.isOpen());
+		TEST_COMPARE(blob.size(), size_t(10));
+		TEST_COMPARE(blob.write("0123456789", 10), size_t(10));
+		TEST_ASSERT(blob.atEnd());
+
+		TEST_ASSERT(blob.seek(4));
+		char buffer[4] = { 0 };
+		TEST_COMPARE(blob.read(buffer, 4), size_t(4));
+		TEST_COMPARE(std::string(buffer, 4), std::string("4567"));
+		TEST_COMPARE(blob.tell(), size_t(8));
+		TEST_ASSERT(!blob.seek(11));
+		blob.close();
+		db.close();
+	}
+
+	TEST_FUNCTION(streamFlushAndSeek)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("blob_stream.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE files(id INTEGER PRIMARY KEY, data BLOB);"));
+		sqlite3_int64 rowid = SQLiteWrapper::BlobStream::insertZeroBlob(db, "files", "data", 26);
+		SQLiteWrapper::BlobStream blob(db, "files", "data", rowid, SQLiteWrapper::BlobStream::Mode::readWrite);
+		{
+			// Chunks smaller than the data
+			SQLiteWrapper::BlobOStream out(blob, 4);
+			out << "abcdefghijklmnopqrstuvwxyz";
+			out.flush();
+			TEST_ASSERT(out.good());
+			TEST_COMPARE(blob.tell(), size_t(26));
+
+			// Seeking flushes the pending bytes first
+			out.seekp(2);
+			out << "CD";
+			out.seekp(-1, std::ios_base::end);
+			out << "Z";
+			TEST_ASSERT(out.good());
+		}
+		TEST_COMPARE(readAll(blob, 5), std::string("abCDefghijklmnopqrstuvwxyZ"));
+
+		blob.seek(0);
+		SQLiteWrapper::BlobIStream in(blob, 3);
+		in.seekg(10);
+		char c = 0;
+		in.get(c);
+		TEST_COMPARE(c, 'k');
+		TEST_COMPARE(static_cast<long long>(in.tellg()), 11ll);
+		in.seekg(-2, std::ios_base::cur);
+		in.get(c);
+		TEST_COMPARE(c, 'j');
+		blob.close();
+		db.close();
+	}
+
+	TEST_FUNCTION(writeStopsAtEnd)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("blob_end.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE files(id INTEGER PRIMARY KEY, data BLOB);"));
+		sqlite3_int64 rowid = SQLiteWrapper::BlobStream::insertZeroBlob(db, "files", "data", 4);
+		SQLiteWrapper::BlobStream blob(db, "files", "data", rowid, SQLiteWrapper::BlobStream::Mode::readWrite);
+		TEST_COMPARE(blob.write("abcdef", 6), size_t(4));
+
+		blob.seek(0);
+		SQLiteWrapper::BlobOStream out(blob, 2);
+		out << "123456";
+		out.flush();
+		TEST_ASSERT(!out.good());
+		TEST_COMPARE(readAll(blob, 2), std::string("1234"));
+
+		// A read only blob can't be written
+		SQLiteWrapper::BlobStream readOnly(db, "files", "data", rowid);
+		TEST_COMPARE(readOnly.write("x", 1), size_t(0));
+		readOnly.close();
+		blob.close();
+		db.close();
+	}
+
+	TEST_FUNCTION(reopenOtherRow)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("blob_reopen.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE files(id INTEGER PRIMARY KEY, data BLOB);"));
+		TEST_ASSERT(db.execute("INSERT INTO files(id, data) VALUES(1, X'414243'), (2, X'44454647');"));
+		SQLiteWrapper::BlobStream blob(db, "files", "data", 1);
+		TEST_COMPARE(readAll(blob, 16), std::string("ABC"));
+		TEST_ASSERT(blob.reopen(2));
+		TEST_COMPARE(blob.size(), size_t(4));
+		TEST_COMPARE(readAll(blob, 16), std::string("DEFG"));
+		TEST_ASSERT(!blob.reopen(3));
+		blob.close();
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_BlobStream);
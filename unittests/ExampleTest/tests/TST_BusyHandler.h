@@ -0,0 +1,136 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_BusyHandler : public UnitTest::Test
+{
+	TEST_CLASS(TST_BusyHandler)
+public:
+	TST_BusyHandler()
+		: Test("TST_BusyHandler")
+	{
+		ADD_TEST(TST_BusyHandler::waitsForLockOwner);
+		ADD_TEST(TST_BusyHandler::failsAfterTimeout);
+		ADD_TEST(TST_BusyHandler::deadlineShortensTimeout);
+		ADD_TEST(TST_BusyHandler::zeroTimeoutFailsImmediately);
+	}
+
+private:
+	static std::string prepare(const std::string& name)
+	{
+		std::string path = TestUtilities::getTempDatabasePath(name);
+		SQLiteWrapper::SQLite db(path);
+		db.open();
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+		db.close();
+		return path;
+	}
+	static SQLiteWrapper::BusyHandler::Policy makePolicy(int timeoutMs)
+	{
+		SQLiteWrapper::BusyHandler::Policy policy;
+		policy.timeout = std::chrono::milliseconds(timeoutMs);
+		policy.maxBackoff = std::chrono::microseconds(5000);
+		return policy;
+	}
+
+	// Tests
+	TEST_FUNCTION(waitsForLockOwner)
+	{
+		TEST_START;
+		std::string path = prepare("busy_wait.db");
+		SQLiteWrapper::SQLite owner(path);
+		SQLiteWrapper::SQLite waiter(path);
+		TEST_ASSERT(owner.open());
+		TEST_ASSERT(waiter.open());
+		waiter.setBusyPolicy(makePolicy(3000));
+
+		TEST_ASSERT(owner.execute("BEGIN IMMEDIATE; INSERT INTO items DEFAULT VALUES;"));
+		std::thread committer([&owner]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				owner.execute("COMMIT;");
+			});
+		bool success = waiter.execute("INSERT INTO items DEFAULT VALUES;");
+		committer.join();
+		TEST_ASSERT(success);
+
+		SQLiteWrapper::BusyHandler::Statistics statistics = waiter.getBusyHandler().getStatistics();
+		TEST_COMPARE(statistics.busyEvents, size_t(1));
+		TEST_COMPARE(statistics.timeouts, size_t(0));
+		TEST_ASSERT(statistics.retries > 0);
+		TEST_ASSERT(statistics.totalWait >= std::chrono::milliseconds(50));
+		TEST_ASSERT(statistics.maxWait <= statistics.totalWait);
+		owner.close();
+		waiter.close();
+	}
+
+	TEST_FUNCTION(failsAfterTimeout)
+	{
+		TEST_START;
+		std::string path = prepare("busy_timeout.db");
+		SQLiteWrapper::SQLite owner(path);
+		SQLiteWrapper::SQLite waiter(path);
+		TEST_ASSERT(owner.open());
+		TEST_ASSERT(waiter.open());
+		waiter.setBusyPolicy(makePolicy(100));
+
+		TEST_ASSERT(owner.execute("BEGIN IMMEDIATE;"));
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TEST_ASSERT(!waiter.execute("INSERT INTO items DEFAULT VALUES;"));
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+		TEST_ASSERT(elapsed >= std::chrono::milliseconds(100));
+		TEST_ASSERT(elapsed < std::chrono::milliseconds(1000));
+		TEST_COMPARE(waiter.getBusyHandler().getStatistics().timeouts, size_t(1));
+
+		waiter.getBusyHandler().resetStatistics();
+		TEST_COMPARE(waiter.getBusyHandler().getStatistics().busyEvents, size_t(0));
+		TEST_ASSERT(owner.execute("ROLLBACK;"));
+		owner.close();
+		waiter.close();
+	}
+
+	TEST_FUNCTION(deadlineShortensTimeout)
+	{
+		TEST_START;
+		std::string path = prepare("busy_deadline.db");
+		SQLiteWrapper::SQLite owner(path);
+		SQLiteWrapper::SQLite waiter(path);
+		TEST_ASSERT(owner.open());
+		TEST_ASSERT(waiter.open());
+		waiter.setBusyPolicy(makePolicy(5000));
+
+		TEST_ASSERT(owner.execute("BEGIN IMMEDIATE;"));
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		waiter.getBusyHandler().setDeadline(start + std::chrono::milliseconds(50));
+		TEST_ASSERT(!waiter.execute("INSERT INTO items DEFAULT VALUES;"));
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+		waiter.getBusyHandler().setDeadline(std::chrono::steady_clock::time_point::max());
+		TEST_ASSERT(owner.execute("ROLLBACK;"));
+		owner.close();
+		waiter.close();
+	}
+
+	TEST_FUNCTION(zeroTimeoutFailsImmediately)
+	{
+		TEST_START;
+		std::string path = prepare("busy_zero.db");
+		SQLiteWrapper::SQLite owner(path);
+		SQLiteWrapper::SQLite waiter(path);
+		TEST_ASSERT(owner.open());
+		TEST_ASSERT(waiter.open());
+		waiter.setBusyPolicy(makePolicy(0));
+
+		TEST_ASSERT(owner.execute("BEGIN IMMEDIATE;"));
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TEST_ASSERT(!waiter.execute("INSERT INTO items DEFAULT VALUES;"));
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+		TEST_COMPARE(waiter.getBusyHandler().getStatistics().retries, size_t(0));
+		TEST_ASSERT(owner.execute("ROLLBACK;"));
+		owner.close();
+		waiter.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_BusyHandler);
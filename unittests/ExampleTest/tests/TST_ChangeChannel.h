@@ -0,0 +1,271 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class TST_ChangeChannel : public UnitTest::Test
+{
+	TEST_CLASS(TST_ChangeChannel)
+public:
+	TST_ChangeChannel()
+		: Test("TST_ChangeChannel")
+	{
+		ADD_TEST(TST_ChangeChannel::readSinceCollectsTables);
+		ADD_TEST(TST_ChangeChannel::readSinceDetectsOverwrittenCommits);
+		ADD_TEST(TST_ChangeChannel::readSinceDetectsOverflow);
+		ADD_TEST(TST_ChangeChannel::readSinceDetectsRecreatedSegment);
+		ADD_TEST(TST_ChangeChannel::listenerIsWoken);
+		ADD_TEST(TST_ChangeChannel::liveWriterIsNotInterrupted);
+		ADD_TEST(TST_ChangeChannel::crashedWriterIsTakenOver);
+	}
+
+private:
+	typedef SQLiteWrapper::ChangeChannel ChangeChannel;
+
+	// Header of the shared memory segment, see ChangeChannel.cpp
+	struct SegmentHeader
+	{
+		std::atomic<uint32_t> magic;
+		std::atomic<uint32_t> futexWord;
+		std::atomic<uint32_t> waiters;
+		std::atomic<int32_t> writer;
+		std::atomic<uint64_t> lock;
+		std::atomic<uint64_t> sequence;
+	};
+
+	static std::string makeChannelPath(const std::string& name)
+	{
+		std::string path = TestUtilities::getTempDatabasePath(name);
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+		return path;
+	}
+	static SegmentHeader* mapHeader(const std::string& path)
+	{
+		int fd = shm_open(ChangeChannel::getSegmentName(path).c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return nullptr;
+		void* memory = mmap(nullptr, sizeof(SegmentHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		return memory == MAP_FAILED ? nullptr : static_cast<SegmentHeader*>(memory);
+	}
+	static void unmapHeader(SegmentHeader* header)
+	{
+		munmap(header, sizeof(SegmentHeader));
+	}
+
+	// Tests
+	TEST_FUNCTION(readSinceCollectsTables)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_tables.db");
+		ChangeChannel writer(path);
+		ChangeChannel reader(path);
+		TEST_ASSERT(writer.open());
+		TEST_ASSERT(reader.open());
+		TEST_COMPARE(reader.getSequence(), uint64_t(0));
+
+		TEST_COMPARE(writer.publish({ "b", "a" }), uint64_t(1));
+		TEST_COMPARE(writer.publish({ "c" }), uint64_t(2));
+		TEST_COMPARE(writer.publish({ "a" }), uint64_t(3));
+
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = false;
+		TEST_ASSERT(reader.readSince(0, sequence, tables, complete));
+		TEST_COMPARE(sequence, uint64_t(3));
+		TEST_ASSERT(complete);
+		TEST_COMPARE(tables, std::vector<std::string>({ "a", "b", "c" }));
+
+		TEST_ASSERT(reader.readSince(2, sequence, tables, complete));
+		TEST_ASSERT(complete);
+		TEST_COMPARE(tables, std::vector<std::string>({ "a" }));
+
+		// Nothing new
+		TEST_ASSERT(reader.readSince(3, sequence, tables, complete));
+		TEST_ASSERT(complete);
+		TEST_ASSERT(tables.empty());
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(readSinceDetectsOverwrittenCommits)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_overwritten.db");
+		ChangeChannel channel(path);
+		TEST_ASSERT(channel.open());
+		for (int i = 1; i <= 20; ++i)
+			channel.publish({ "t" + std::to_string(i) });
+
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = true;
+		TEST_ASSERT(channel.readSince(0, sequence, tables, complete));
+		TEST_COMPARE(sequence, uint64_t(20));
+		TEST_ASSERT(!complete);
+		TEST_COMPARE(tables.size(), size_t(16)); // The tables of the commits still in the segment
+
+		// The last 16 commits are known
+		TEST_ASSERT(channel.readSince(4, sequence, tables, complete));
+		TEST_ASSERT(complete);
+		TEST_COMPARE(tables.size(), size_t(16));
+		TEST_ASSERT(channel.readSince(3, sequence, tables, complete));
+		TEST_ASSERT(!complete);
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(readSinceDetectsOverflow)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_overflow.db");
+		ChangeChannel channel(path);
+		TEST_ASSERT(channel.open());
+		std::vector<std::string> many;
+		for (int i = 0; i < 100; ++i)
+			many.push_back("table_with_a_long_name_" + std::to_string(i));
+		channel.publish(many);
+
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = true;
+		TEST_ASSERT(channel.readSince(0, sequence, tables, complete));
+		TEST_ASSERT(!complete);
+		TEST_ASSERT(!tables.empty() && tables.size() < many.size());
+
+		// An empty list is complete, it means the tables are unknown
+		channel.publish({});
+		TEST_ASSERT(channel.readSince(1, sequence, tables, complete));
+		TEST_ASSERT(complete);
+		TEST_ASSERT(tables.empty());
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(readSinceDetectsRecreatedSegment)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_recreated.db");
+		ChangeChannel channel(path);
+		TEST_ASSERT(channel.open());
+		channel.publish({ "a" });
+
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = true;
+		TEST_ASSERT(channel.readSince(5, sequence, tables, complete));
+		TEST_COMPARE(sequence, uint64_t(1));
+		TEST_ASSERT(!complete);
+
+		channel.close();
+		uint64_t closedSequence = 1;
+		TEST_ASSERT(!channel.readSince(0, closedSequence, tables, complete));
+		TEST_COMPARE(closedSequence, uint64_t(0));
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(listenerIsWoken)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_listen.db");
+		ChangeChannel writer(path);
+		ChangeChannel listener(path);
+		TEST_ASSERT(writer.open());
+		TEST_ASSERT(listener.open());
+
+		std::atomic<uint64_t> received(0);
+		TEST_ASSERT(listener.startListening([&received](uint64_t sequence) { received.store(sequence); }));
+		writer.publish({ "a" });
+		writer.publish({ "b" });
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+		while (received.load() != 2 && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		listener.stopListening();
+		TEST_COMPARE(received.load(), uint64_t(2));
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(liveWriterIsNotInterrupted)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_live.db");
+		ChangeChannel channel(path);
+		TEST_ASSERT(channel.open());
+		SegmentHeader* header = mapHeader(path);
+		TEST_ASSERT(header != nullptr);
+		if (!header)
+			return;
+
+		// A live process holds the seqlock far longer than a publish takes
+		pid_t child = fork();
+		if (child == 0)
+		{
+			pause();
+			_exit(0);
+		}
+		header->writer.store(child);
+		header->lock.store(header->lock.load() | 1);
+
+		std::atomic<uint64_t> published(0);
+		std::thread publisher([&channel, &published]() { published.store(channel.publish({ "a" })); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		uint64_t publishedWhileLocked = published.load();
+		int32_t writerWhileLocked = header->writer.load();
+
+		// The writer finishes
+		header->lock.store(header->lock.load() + 1);
+		header->writer.store(0);
+		publisher.join();
+		kill(child, SIGKILL);
+		waitpid(child, nullptr, 0);
+
+		TEST_COMPARE(publishedWhileLocked, uint64_t(0));
+		TEST_COMPARE(writerWhileLocked, int32_t(child));
+		TEST_COMPARE(published.load(), uint64_t(1));
+		TEST_COMPARE(header->lock.load() & 1, uint64_t(0));
+		unmapHeader(header);
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+
+	TEST_FUNCTION(crashedWriterIsTakenOver)
+	{
+		TEST_START;
+		std::string path = makeChannelPath("channel_crashed.db");
+		ChangeChannel channel(path);
+		TEST_ASSERT(channel.open());
+		channel.publish({ "a" });
+		SegmentHeader* header = mapHeader(path);
+		TEST_ASSERT(header != nullptr);
+		if (!header)
+			return;
+
+		// A process which died while it held the seqlock
+		pid_t child = fork();
+		if (child == 0)
+			_exit(0);
+		waitpid(child, nullptr, 0);
+		header->writer.store(child);
+		header->lock.store(header->lock.load() | 1);
+
+		uint64_t sequence = 0;
+		std::vector<std::string> tables;
+		bool complete = true;
+		TEST_ASSERT(!channel.readSince(0, sequence, tables, complete));
+
+		TEST_COMPARE(channel.publish({ "b" }), uint64_t(2));
+		TEST_COMPARE(header->writer.load(), int32_t(0));
+		TEST_COMPARE(header->lock.load() & 1, uint64_t(0));
+		TEST_ASSERT(channel.readSince(0, sequence, tables, complete));
+		TEST_COMPARE(tables, std::vector<std::string>({ "a", "b" }));
+
+		unmapHeader(header);
+		shm_unlink(ChangeChannel::getSegmentName(path).c_str());
+	}
+};
+
+TEST_INSTANTIATE(TST_ChangeChannel);
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_ChangeDetection : public UnitTest::Test
+{
+	TEST_CLASS(TST_ChangeDetection)
+public:
+	TST_ChangeDetection()
+		: Test("TST_ChangeDetection")
+	{
+		ADD_TEST(TST_ChangeDetection::watcherStartsWithFirstReceiver);
+		ADD_TEST(TST_ChangeDetection::hotCopyFollowsFileWithoutReceiver);
+	}
+
+private:
+	static bool insertRow(const std::string& path)
+	{
+		SQLiteWrapper::SQLite db(path);
+		bool success = db.open() && db.execute("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY); INSERT INTO items DEFAULT VALUES;");
+		db.close();
+		return success;
+	}
+
+	// Tests
+	TEST_FUNCTION(watcherStartsWithFirstReceiver)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("lazy_watcher.db");
+		TEST_ASSERT(insertRow(path));
+		SQLiteWrapper::SQLite db(path);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(!db.isChangeDetectionEnabled());
+
+		unsigned int changes = 0;
+		QObject receiver;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::onDBChanged, &receiver, [&changes]() { ++changes; });
+		TEST_ASSERT(db.isChangeDetectionEnabled());
+		TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return changes > 0; }));
+
+		db.setChangeDetectionEnabled(false);
+		TEST_ASSERT(!db.isChangeDetectionEnabled());
+		db.close();
+	}
+
+	TEST_FUNCTION(hotCopyFollowsFileWithoutReceiver)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("lazy_hotcopy.db");
+		TEST_ASSERT(insertRow(path));
+		SQLiteWrapper::SQLite db(path);
+		db.setInMemoryHotCopy(true);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.isChangeDetectionEnabled());
+		TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]()
+			{
+				return db.fetchAll("SELECT COUNT(*) FROM items;") == std::vector<std::vector<std::string>>({ { "2" } });
+			}));
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_ChangeDetection);
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "Utilities.h"
+#include "TestUtilities.h"
+
+class TST_ConnectionMetrics : public UnitTest::Test
+{
+	TEST_CLASS(TST_ConnectionMetrics)
+public:
+	TST_ConnectionMetrics()
+		: Test("TST_ConnectionMetrics")
+	{
+		ADD_TEST(TST_ConnectionMetrics::disabledByDefault);
+		ADD_TEST(TST_ConnectionMetrics::executeRecordsEachStatement);
+		ADD_TEST(TST_ConnectionMetrics::fingerprintsGroupQueries);
+		ADD_TEST(TST_ConnectionMetrics::diffSubtractsCounters);
+		ADD_TEST(TST_ConnectionMetrics::diffAfterReset);
+		ADD_TEST(TST_ConnectionMetrics::maxFingerprints);
+	}
+
+private:
+	typedef SQLiteWrapper::ConnectionMetrics ConnectionMetrics;
+
+	static const ConnectionMetrics::StatementStats* find(const ConnectionMetrics::Snapshot& snapshot, const std::string& fingerprint)
+	{
+		for (const ConnectionMetrics::StatementStats& stats : snapshot.statements)
+		{
+			if (stats.fingerprint == fingerprint)
+				return &stats;
+		}
+		return nullptr;
+	}
+	static uint64_t bucketSum(const ConnectionMetrics::StatementStats& stats)
+	{
+		uint64_t sum = 0;
+		for (uint64_t count : stats.durationBuckets)
+			sum += count;
+		return sum;
+	}
+	static ConnectionMetrics::StatementStats makeStats(const std::string& fingerprint, uint64_t runs, uint64_t vmSteps, int64_t totalMicros)
+	{
+		ConnectionMetrics::StatementStats stats;
+		stats.fingerprint = fingerprint;
+		stats.runs = runs;
+		stats.vmSteps = vmSteps;
+		stats.totalDuration = std::chrono::microseconds(totalMicros);
+		stats.maxDuration = std::chrono::microseconds(totalMicros);
+		stats.durationBuckets[0] = runs;
+		return stats;
+	}
+
+	// Tests
+	TEST_FUNCTION(disabledByDefault)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("metrics_disabled.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER);"));
+		TEST_ASSERT(db.getMetricsSnapshot().statements.empty());
+	}
+
+	TEST_FUNCTION(executeRecordsEachStatement)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("metrics_execute.db"));
+		TEST_ASSERT(db.open());
+		db.setMetricsEnabled(true);
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER, name TEXT); INSERT INTO items VALUES(1, 'a'), (2, 'b');"));
+		TEST_ASSERT(db.execute("SELECT name FROM items ORDER BY name;"));
+
+		ConnectionMetrics::Snapshot snapshot = db.getMetricsSnapshot();
+		TEST_COMPARE(snapshot.statements.size(), size_t(3));
+		const ConnectionMetrics::StatementStats* insert = find(snapshot, SQLiteWrapper::Utilities::getQueryFingerprint("INSERT INTO items VALUES(1, 'a'), (2, 'b');"));
+		const ConnectionMetrics::StatementStats* select = find(snapshot, SQLiteWrapper::Utilities::getQueryFingerprint("SELECT name FROM items ORDER BY name;"));
+		TEST_ASSERT(insert != nullptr);
+		TEST_ASSERT(select != nullptr);
+		if (!insert || !select)
+			return;
+
+		// The statement counters are recorded, not only the run
+		TEST_COMPARE(insert->runs, uint64_t(1));
+		TEST_ASSERT(insert->vmSteps > 0);
+		TEST_COMPARE(select->runs, uint64_t(1));
+		TEST_ASSERT(select->vmSteps > 0);
+		TEST_COMPARE(select->sorts, uint64_t(1));
+		TEST_COMPARE(select->fullscanSteps, uint64_t(1));
+		TEST_COMPARE(bucketSum(*select), uint64_t(1));
+		TEST_COMPARE(snapshot.database, db.getDBPath());
+	}
+
+	TEST_FUNCTION(fingerprintsGroupQueries)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("metrics_fingerprint.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);"));
+		db.setMetricsEnabled(true);
+		for (int i = 0; i < 5; ++i)
+			TEST_ASSERT(db.executeWithParams("INSERT INTO items(name) VALUES(?);", { "name" + std::to_string(i) }));
+		for (int i = 0; i < 3; ++i)
+			db.fetchAll("SELECT name FROM items WHERE id = " + std::to_string(i) + ";");
+
+		ConnectionMetrics::Snapshot snapshot = db.getMetricsSnapshot();
+		TEST_COMPARE(snapshot.statements.size(), size_t(2));
+		if (snapshot.statements.size() != 2)
+			return;
+		// Sorted by fingerprint
+		TEST_ASSERT(snapshot.statements[0].fingerprint < snapshot.statements[1].fingerprint);
+		const ConnectionMetrics::StatementStats* select = find(snapshot, SQLiteWrapper::Utilities::getQueryFingerprint("SELECT name FROM items WHERE id = 0;"));
+		TEST_ASSERT(select != nullptr);
+		if (!select)
+			return;
+		TEST_COMPARE(select->runs, uint64_t(3));
+		TEST_COMPARE(select->query, std::string("SELECT name FROM items WHERE id = 0;"));
+		TEST_ASSERT(select->maxDuration <= select->totalDuration);
+	}
+
+	TEST_FUNCTION(diffSubtractsCounters)
+	{
+		TEST_START;
+		ConnectionMetrics::Snapshot previous;
+		previous.cacheHit = 10;
+		previous.cacheMiss = 4;
+		previous.cacheUsed = 1000;
+		previous.memoryUsed = 5000;
+		previous.statements = { makeStats("a", 2, 20, 200), makeStats("b", 5, 50, 500) };
+
+		ConnectionMetrics::Snapshot current;
+		current.cacheHit = 25;
+		current.cacheMiss = 4;
+		current.cacheUsed = 1200;
+		current.memoryUsed = 4000;
+		current.statements = { makeStats("a", 3, 35, 260), makeStats("b", 5, 50, 500), makeStats("c", 1, 7, 70) };
+
+		ConnectionMetrics::Snapshot delta = current.diff(previous);
+		TEST_COMPARE(delta.cacheHit, int64_t(15));
+		TEST_COMPARE(delta.cacheMiss, int64_t(0));
+		// Gauges keep their current values
+		TEST_COMPARE(delta.cacheUsed, int64_t(1200));
+		TEST_COMPARE(delta.memoryUsed, int64_t(4000));
+
+		// "b" did not run in between, "c" is new
+		TEST_COMPARE(delta.statements.size(), size_t(2));
+		if (delta.statements.size() != 2)
+			return;
+		TEST_COMPARE(delta.statements[0].fingerprint, std::string("a"));
+		TEST_COMPARE(delta.statements[0].runs, uint64_t(1));
+		TEST_COMPARE(delta.statements[0].vmSteps, uint64_t(15));
+		TEST_COMPARE(delta.statements[0].totalDuration, std::chrono::microseconds(60));
+		TEST_COMPARE(delta.statements[0].durationBuckets[0], uint64_t(1));
+		TEST_COMPARE(delta.statements[1].fingerprint, std::string("c"));
+		TEST_COMPARE(delta.statements[1].runs, uint64_t(1));
+		TEST_COMPARE(delta.statements[1].vmSteps, uint64_t(7));
+
+		// A snapshot minus itself is empty
+		TEST_ASSERT(current.diff(current).statements.empty());
+	}
+
+	TEST_FUNCTION(diffAfterReset)
+	{
+		TEST_START;
+		ConnectionMetrics::Snapshot previous;
+		previous.cacheHit = 100;
+		previous.cacheMiss = 4;
+		previous.statements = { makeStats("a", 5, 50, 500), makeStats("b", 2, 50, 500) };
+
+		// The counters were cleared in between, "b" ran more often than before but with fewer steps
+		ConnectionMetrics::Snapshot current;
+		current.cacheHit = 30;
+		current.cacheMiss = 6;
+		current.statements = { makeStats("a", 2, 20, 200), makeStats("b", 4, 30, 300) };
+
+		ConnectionMetrics::Snapshot delta = current.diff(previous);
+		TEST_COMPARE(delta.cacheHit, int64_t(30));
+		TEST_COMPARE(delta.cacheMiss, int64_t(2));
+		TEST_COMPARE(delta.statements.size(), size_t(2));
+		if (delta.statements.size() != 2)
+			return;
+		TEST_COMPARE(delta.statements[0].runs, uint64_t(2));
+		TEST_COMPARE(delta.statements[0].vmSteps, uint64_t(20));
+		TEST_COMPARE(delta.statements[0].totalDuration, std::chrono::microseconds(200));
+		TEST_COMPARE(delta.statements[0].durationBuckets[0], uint64_t(2));
+		TEST_COMPARE(delta.statements[1].runs, uint64_t(4));
+		TEST_COMPARE(delta.statements[1].vmSteps, uint64_t(30));
+	}
+
+	TEST_FUNCTION(maxFingerprints)
+	{
+		TEST_START;
+		ConnectionMetrics metrics(2);
+		metrics.setEnabled(true);
+		metrics.recordStatement(nullptr, nullptr, "SELECT 1;", std::chrono::microseconds(5));
+		metrics.recordStatement(nullptr, nullptr, "SELECT a FROM t;", std::chrono::microseconds(500));
+		metrics.recordStatement(nullptr, nullptr, "SELECT b FROM t;", std::chrono::microseconds(5));
+		metrics.recordStatement(nullptr, nullptr, "SELECT 2;", std::chrono::microseconds(2000000));
+
+		ConnectionMetrics::Snapshot snapshot = metrics.takeSnapshot();
+		TEST_COMPARE(snapshot.statements.size(), size_t(2));
+		const ConnectionMetrics::StatementStats* constant = find(snapshot, SQLiteWrapper::Utilities::getQueryFingerprint("SELECT 1;"));
+		TEST_ASSERT(constant != nullptr);
+		if (!constant)
+			return;
+		TEST_COMPARE(constant->runs, uint64_t(2));
+		TEST_COMPARE(constant->durationBuckets[0], uint64_t(1));
+		TEST_COMPARE(constant->durationBuckets[ConnectionMetrics::durationBucketCount - 1], uint64_t(1));
+
+		metrics.clear();
+		TEST_ASSERT(metrics.takeSnapshot().statements.empty());
+	}
+};
+
+TEST_INSTANTIATE(TST_ConnectionMetrics);
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_DebouncePolicy : public UnitTest::Test
+{
+	TEST_CLASS(TST_DebouncePolicy)
+public:
+	TST_DebouncePolicy()
+		: Test("TST_DebouncePolicy")
+	{
+		ADD_TEST(TST_DebouncePolicy::emitsEveryChangeByDefault);
+		ADD_TEST(TST_DebouncePolicy::leadingAndTrailing);
+		ADD_TEST(TST_DebouncePolicy::trailingOnly);
+		ADD_TEST(TST_DebouncePolicy::leadingOnlyDropsBurst);
+		ADD_TEST(TST_DebouncePolicy::maxWaitDuringLongBurst);
+		ADD_TEST(TST_DebouncePolicy::rateLimitCoalesces);
+		ADD_TEST(TST_DebouncePolicy::rateLimitedLeadingSignalIsKept);
+		ADD_TEST(TST_DebouncePolicy::connectionForwardsCount);
+	}
+
+private:
+	typedef SQLiteWrapper::FileChangeWatcher FileChangeWatcher;
+
+	// Watcher in the dataVersion mode on a counter, each increment is one detected change
+	struct FakeDatabase
+	{
+		long long version = 0;
+		FileChangeWatcher watcher;
+		QObject receiver;
+		std::vector<unsigned int> counts; // count of each onFileChangesCoalesced signal
+
+		explicit FakeDatabase(const FileChangeWatcher::DebouncePolicy& policy)
+			: watcher("fake.db", FileChangeWatcher::Mode::dataVersion)
+		{
+			watcher.setDataVersionProvider([this]() { return version; });
+			watcher.setDebouncePolicy(policy);
+			QObject::connect(&watcher, &FileChangeWatcher::onFileChangesCoalesced, &receiver,
+				[this](const std::string&, unsigned int count) { counts.push_back(count); });
+			TestUtilities::processEventsFor(std::chrono::milliseconds(50));
+		}
+		// Changes spaced wider than the polling interval of the watcher
+		void change(unsigned int count, std::chrono::milliseconds spacing = std::chrono::milliseconds(25))
+		{
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				++version;
+				TestUtilities::processEventsFor(spacing);
+			}
+		}
+		unsigned int total() const
+		{
+			unsigned int sum = 0;
+			for (unsigned int count : counts)
+				sum += count;
+			return sum;
+		}
+	};
+	static FileChangeWatcher::DebouncePolicy makePolicy(bool leading, bool trailing, int window, int maxWait = 0, unsigned int maxEventsPerSecond = 0)
+	{
+		FileChangeWatcher::DebouncePolicy policy;
+		policy.leading = leading;
+		policy.trailing = trailing;
+		policy.window = std::chrono::milliseconds(window);
+		policy.maxWait = std::chrono::milliseconds(maxWait);
+		policy.maxEventsPerSecond = maxEventsPerSecond;
+		return policy;
+	}
+
+	// Tests
+	TEST_FUNCTION(emitsEveryChangeByDefault)
+	{
+		TEST_START;
+		FakeDatabase db{ FileChangeWatcher::DebouncePolicy() };
+		db.change(3);
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 1, 1 }));
+	}
+
+	TEST_FUNCTION(leadingAndTrailing)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(true, true, 150));
+		db.change(5);
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1 }));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return db.counts.size() == 2; }));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 4 }));
+	}
+
+	TEST_FUNCTION(trailingOnly)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(false, true, 150));
+		db.change(5);
+		TEST_ASSERT(db.counts.empty());
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return !db.counts.empty(); }));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 5 }));
+	}
+
+	TEST_FUNCTION(leadingOnlyDropsBurst)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(true, false, 150));
+		db.change(5);
+		TestUtilities::processEventsFor(std::chrono::milliseconds(300));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1 }));
+
+		// The next burst starts with a new leading signal
+		db.change(1);
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 1 }));
+	}
+
+	TEST_FUNCTION(maxWaitDuringLongBurst)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(false, true, 150, 200));
+		db.change(24); // about 600ms without a quiet window
+		TEST_ASSERT(db.counts.size() >= 2);
+		TestUtilities::processEventsFor(std::chrono::milliseconds(300));
+		TEST_COMPARE(db.total(), 24u);
+	}
+
+	TEST_FUNCTION(rateLimitCoalesces)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(true, true, 0, 0, 2));
+		db.change(5);
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 1 }));
+
+		// The held back changes are merged into the first signal of the next second
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return db.counts.size() == 3; }));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 1, 3 }));
+	}
+
+	TEST_FUNCTION(rateLimitedLeadingSignalIsKept)
+	{
+		TEST_START;
+		FakeDatabase db(makePolicy(true, false, 50, 0, 1));
+		db.change(1);
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1 }));
+
+		// The leading signal of the second burst exceeds the rate, the burst ends before the rate window reopens
+		db.change(1);
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1 }));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return db.counts.size() == 2; }));
+		TEST_ASSERT(db.counts == std::vector<unsigned int>({ 1, 1 }));
+	}
+
+	TEST_FUNCTION(connectionForwardsCount)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("debounce_connection.db");
+		SQLiteWrapper::SQLite db(path);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		db.setChangeDebouncePolicy(makePolicy(false, true, 200));
+
+		std::vector<unsigned int> counts;
+		unsigned int changed = 0;
+		QObject receiver;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::onDBChangesCoalesced, &receiver, [&counts](unsigned int count) { counts.push_back(count); });
+		QObject::connect(&db, &SQLiteWrapper::SQLite::onDBChanged, &receiver, [&changed]() { ++changed; });
+		TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+
+		SQLiteWrapper::SQLite writer(path);
+		TEST_ASSERT(writer.open());
+		for (int i = 0; i < 3; ++i)
+		{
+			TEST_ASSERT(writer.execute("INSERT INTO items DEFAULT VALUES;"));
+			TestUtilities::processEventsFor(std::chrono::milliseconds(30));
+		}
+		writer.close();
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return !counts.empty(); }));
+		TEST_ASSERT(counts == std::vector<unsigned int>({ 3 }));
+		TEST_COMPARE(changed, 1u);
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_DebouncePolicy);
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_ExecutionBudget : public UnitTest::Test
+{
+	TEST_CLASS(TST_ExecutionBudget)
+public:
+	TST_ExecutionBudget()
+		: Test("TST_ExecutionBudget")
+	{
+		ADD_TEST(TST_ExecutionBudget::succeeds);
+		ADD_TEST(TST_ExecutionBudget::reportsErrors);
+		ADD_TEST(TST_ExecutionBudget::deadlineStopsQuery);
+		ADD_TEST(TST_ExecutionBudget::deadlineStopsLockWait);
+		ADD_TEST(TST_ExecutionBudget::tokenCancelsQuery);
+		ADD_TEST(TST_ExecutionBudget::interruptStopsQuery);
+		ADD_TEST(TST_ExecutionBudget::interruptWhileClosing);
+	}
+
+private:
+	typedef SQLiteWrapper::SQLite SQLite;
+
+	// Never ends without a budget
+	static constexpr const char* endlessQuery = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT count(*) FROM c;";
+
+	// Tests
+	TEST_FUNCTION(succeeds)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_succeeds.db"));
+		TEST_ASSERT(db.open());
+		SQLite::ExecutionBudget budget = SQLite::ExecutionBudget::withTimeout(std::chrono::seconds(5));
+		TEST_COMPARE(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY); INSERT INTO items VALUES(1), (2);", budget), SQLite::ExecutionStatus::succeeded);
+		TEST_COMPARE(db.executeWithParams("INSERT INTO items VALUES(?);", { "3" }, budget), SQLite::ExecutionStatus::succeeded);
+
+		std::vector<std::vector<std::string>> rows = { { "stale" } };
+		TEST_COMPARE(db.fetchAll("SELECT id FROM items ORDER BY id;", rows, budget), SQLite::ExecutionStatus::succeeded);
+		TEST_COMPARE(rows, std::vector<std::vector<std::string>>({ { "1" }, { "2" }, { "3" } }));
+	}
+
+	TEST_FUNCTION(reportsErrors)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_errors.db"));
+		TEST_ASSERT(db.open());
+		SQLite::ExecutionBudget budget;
+		TEST_COMPARE(db.execute("NOT SQL;", budget), SQLite::ExecutionStatus::failed);
+
+		// Fails while stepping, after the first rows were fetched
+		std::vector<std::vector<std::string>> rows;
+		TEST_COMPARE(db.fetchAll("SELECT x, abs(x - 2) + CASE WHEN x = 3 THEN abs(-9223372036854775807 - 1) ELSE 0 END FROM (SELECT 1 AS x UNION ALL SELECT 2 UNION ALL SELECT 3);", rows, budget),
+			SQLite::ExecutionStatus::failed);
+		TEST_COMPARE(rows.size(), size_t(2));
+
+		// The connection works afterwards
+		TEST_COMPARE(db.fetchAll("SELECT 1;", rows, budget), SQLite::ExecutionStatus::succeeded);
+		TEST_COMPARE(rows, std::vector<std::vector<std::string>>({ { "1" } }));
+	}
+
+	TEST_FUNCTION(deadlineStopsQuery)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_deadline.db"));
+		TEST_ASSERT(db.open());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<std::vector<std::string>> rows;
+		TEST_COMPARE(db.fetchAll(endlessQuery, rows, SQLite::ExecutionBudget::withTimeout(std::chrono::milliseconds(50))), SQLite::ExecutionStatus::deadlineExceeded);
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2000));
+		TEST_COMPARE(db.execute(endlessQuery, SQLite::ExecutionBudget::withTimeout(std::chrono::milliseconds(50))), SQLite::ExecutionStatus::deadlineExceeded);
+
+		// The budget ends with the call
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER);"));
+	}
+
+	TEST_FUNCTION(deadlineStopsLockWait)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("budget_lock.db");
+		SQLite owner(path);
+		SQLite waiter(path);
+		TEST_ASSERT(owner.open());
+		TEST_ASSERT(waiter.open());
+		TEST_ASSERT(owner.execute("CREATE TABLE items(id INTEGER); BEGIN IMMEDIATE;"));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TEST_COMPARE(waiter.executeWithParams("INSERT INTO items VALUES(?);", { "1" }, SQLite::ExecutionBudget::withTimeout(std::chrono::milliseconds(50))),
+			SQLite::ExecutionStatus::deadlineExceeded);
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2000));
+		TEST_ASSERT(owner.execute("ROLLBACK;"));
+	}
+
+	TEST_FUNCTION(tokenCancelsQuery)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_cancel.db"));
+		TEST_ASSERT(db.open());
+		SQLite::ExecutionBudget budget;
+		SQLiteWrapper::CancellationToken token = budget.token;
+		std::thread canceller([token]() mutable
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				token.cancel();
+			});
+		SQLite::ExecutionStatus status = db.execute(endlessQuery, budget);
+		canceller.join();
+		TEST_COMPARE(status, SQLite::ExecutionStatus::cancelled);
+
+		// A cancelled token stops the next call right away, until it is reset
+		TEST_COMPARE(db.execute(endlessQuery, budget), SQLite::ExecutionStatus::cancelled);
+		budget.token.reset();
+		TEST_COMPARE(db.execute("SELECT 1;", budget), SQLite::ExecutionStatus::succeeded);
+	}
+
+	TEST_FUNCTION(interruptStopsQuery)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_interrupt.db"));
+		TEST_ASSERT(db.open());
+		std::thread interrupter([&db]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				db.interrupt();
+			});
+		std::vector<std::vector<std::string>> rows;
+		SQLite::ExecutionStatus status = db.fetchAll(endlessQuery, rows, SQLite::ExecutionBudget());
+		interrupter.join();
+		TEST_COMPARE(status, SQLite::ExecutionStatus::interrupted);
+		TEST_COMPARE(db.fetchAll("SELECT 1;", rows, SQLite::ExecutionBudget()), SQLite::ExecutionStatus::succeeded);
+	}
+
+	TEST_FUNCTION(interruptWhileClosing)
+	{
+		TEST_START;
+		SQLite db(TestUtilities::getTempDatabasePath("budget_interrupt_close.db"));
+		std::atomic<bool> done(false);
+		std::thread interrupter([&db, &done]()
+			{
+				while (!done.load())
+					db.interrupt();
+			});
+		size_t opened = 0;
+		for (int i = 0; i < 200; ++i)
+		{
+			if (db.open())
+				++opened;
+			db.close();
+		}
+		done.store(true);
+		interrupter.join();
+		TEST_COMPARE(opened, size_t(200));
+
+		// An interrupt without a running budgeted call does not stop the next one
+		TEST_ASSERT(db.open());
+		db.interrupt();
+		TEST_COMPARE(db.execute("SELECT 1;", SQLite::ExecutionBudget()), SQLite::ExecutionStatus::succeeded);
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_ExecutionBudget);
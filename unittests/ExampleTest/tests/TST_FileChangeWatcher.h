@@ -0,0 +1,218 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_FileChangeWatcher : public UnitTest::Test
+{
+	TEST_CLASS(TST_FileChangeWatcher)
+public:
+	TST_FileChangeWatcher()
+		: Test("TST_FileChangeWatcher")
+	{
+		ADD_TEST(TST_FileChangeWatcher::changeCounterFollowsCommits);
+		ADD_TEST(TST_FileChangeWatcher::changeCounterMode);
+		ADD_TEST(TST_FileChangeWatcher::dataVersionMode);
+		ADD_TEST(TST_FileChangeWatcher::pollingMode);
+		ADD_TEST(TST_FileChangeWatcher::changesMergeWhileConsumerIsBusy);
+		ADD_TEST(TST_FileChangeWatcher::stopWithUnconsumedChanges);
+#ifdef __linux__
+		ADD_TEST(TST_FileChangeWatcher::inotifyMode);
+		ADD_TEST(TST_FileChangeWatcher::inotifyIgnoresOtherFiles);
+#endif
+	}
+
+private:
+	typedef SQLiteWrapper::FileChangeWatcher FileChangeWatcher;
+
+	static std::string createDatabase(const std::string& name, bool wal = false)
+	{
+		std::string path = TestUtilities::getTempDatabasePath(name);
+		SQLiteWrapper::SQLite db(path);
+		db.open();
+		if (wal)
+			db.execute("PRAGMA journal_mode = WAL;");
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);");
+		db.close();
+		return path;
+	}
+	static bool insertRow(const std::string& path)
+	{
+		SQLiteWrapper::SQLite db(path);
+		bool success = db.open() && db.execute("INSERT INTO items(name) VALUES('x');");
+		db.close();
+		return success;
+	}
+
+	// Counts the onFileChanged received of the watcher, waits until the watcher is ready
+	struct SignalCounter
+	{
+		QObject receiver;
+		unsigned int received = 0;
+		unsigned int coalesced = 0;
+
+		explicit SignalCounter(FileChangeWatcher& watcher)
+		{
+			QObject::connect(&watcher, &FileChangeWatcher::onFileChanged, &receiver, [this](const std::string&) { ++received; });
+			QObject::connect(&watcher, &FileChangeWatcher::onFileChangesCoalesced, &receiver, [this](const std::string&, unsigned int count) { coalesced += count; });
+			TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+		}
+		bool waitFor(unsigned int count, std::chrono::milliseconds timeout = std::chrono::milliseconds(3000))
+		{
+			return TestUtilities::processEventsUntil([&]() { return received >= count; }, timeout);
+		}
+	};
+
+	// Tests
+	TEST_FUNCTION(changeCounterFollowsCommits)
+	{
+		TEST_START;
+		for (bool wal : { false, true })
+		{
+			std::string path = createDatabase(wal ? "counter_wal.db" : "counter.db", wal);
+			SQLiteWrapper::SQLite db(path);
+			TEST_ASSERT(db.open());
+			db.fetchAll("SELECT * FROM items;");
+			bool success = false;
+			std::string before = FileChangeWatcher::readChangeCounter(path, success);
+			TEST_ASSERT(success);
+
+			// Reading does not change the fingerprint
+			db.fetchAll("SELECT * FROM items;");
+			TEST_COMPARE(FileChangeWatcher::readChangeCounter(path, success), before);
+
+			TEST_ASSERT(db.execute("INSERT INTO items(name) VALUES('x');"));
+			TEST_ASSERT(FileChangeWatcher::readChangeCounter(path, success) != before);
+			db.close();
+		}
+		bool success = true;
+		FileChangeWatcher::readChangeCounter(TestUtilities::getTempDatabasePath("counter_missing.db"), success);
+		TEST_ASSERT(!success);
+	}
+
+	TEST_FUNCTION(changeCounterMode)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_counter.db");
+		FileChangeWatcher watcher(path, FileChangeWatcher::Mode::changeCounter);
+		SignalCounter counter(watcher);
+		TEST_COMPARE(counter.received, 0u);
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(counter.waitFor(1));
+		TEST_ASSERT(counter.coalesced >= counter.received);
+	}
+
+	TEST_FUNCTION(dataVersionMode)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_dataversion.db", true);
+		SQLiteWrapper::SQLite reader(path);
+		TEST_ASSERT(reader.open());
+		long long version = reader.getDataVersion();
+		TEST_ASSERT(version >= 0);
+
+		FileChangeWatcher watcher(path, FileChangeWatcher::Mode::dataVersion);
+		watcher.setDataVersionProvider([&reader]() { return reader.getDataVersion(); });
+		SignalCounter counter(watcher);
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(counter.waitFor(1));
+		TEST_ASSERT(reader.getDataVersion() != version);
+
+		// Commits of the connection itself do not change its data version
+		unsigned int received = counter.received;
+		TEST_ASSERT(reader.execute("INSERT INTO items(name) VALUES('y');"));
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_COMPARE(counter.received, received);
+		reader.close();
+	}
+
+	TEST_FUNCTION(pollingMode)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_polling.db");
+		FileChangeWatcher watcher(path, FileChangeWatcher::Mode::polling);
+		SignalCounter counter(watcher);
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(counter.waitFor(1));
+	}
+
+	TEST_FUNCTION(changesMergeWhileConsumerIsBusy)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_handoff.db");
+		FileChangeWatcher watcher(path, FileChangeWatcher::Mode::shared);
+		SignalCounter counter(watcher);
+
+		// The detecting thread publishes the changes without waiting for this thread
+		for (int i = 0; i < 5; ++i)
+		{
+			TEST_ASSERT(insertRow(path));
+			std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		}
+		TEST_COMPARE(counter.received, 0u);
+		TEST_ASSERT(counter.waitFor(1));
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_COMPARE(counter.received, 1u);
+		TEST_ASSERT(counter.coalesced >= 1u);
+	}
+
+	TEST_FUNCTION(stopWithUnconsumedChanges)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_handoff_stop.db");
+		std::chrono::steady_clock::time_point start;
+		{
+			FileChangeWatcher watcher(path, FileChangeWatcher::Mode::shared);
+			SignalCounter counter(watcher);
+			TEST_ASSERT(insertRow(path));
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			start = std::chrono::steady_clock::now();
+		}
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+
+		// The queued notification of the destroyed watcher is discarded
+		TestUtilities::processEventsFor(std::chrono::milliseconds(50));
+	}
+
+#ifdef __linux__
+	TEST_FUNCTION(inotifyMode)
+	{
+		TEST_START;
+		for (bool wal : { false, true })
+		{
+			std::string path = createDatabase(wal ? "watch_inotify_wal.db" : "watch_inotify.db", wal);
+			FileChangeWatcher watcher(path, FileChangeWatcher::Mode::inotify);
+			SignalCounter counter(watcher);
+			TEST_COMPARE(counter.received, 0u);
+			TEST_ASSERT(insertRow(path));
+			TEST_ASSERT(counter.waitFor(1));
+
+			// The paused watcher drops the changes
+			watcher.pause();
+			TestUtilities::processEventsFor(std::chrono::milliseconds(50));
+			unsigned int received = counter.received;
+			TEST_ASSERT(insertRow(path));
+			TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+			TEST_COMPARE(counter.received, received);
+			watcher.unpause();
+			TEST_ASSERT(insertRow(path));
+			TEST_ASSERT(counter.waitFor(received + 1));
+		}
+	}
+
+	TEST_FUNCTION(inotifyIgnoresOtherFiles)
+	{
+		TEST_START;
+		std::string path = createDatabase("watch_inotify_own.db");
+		std::string otherPath = createDatabase("watch_inotify_other.db");
+		FileChangeWatcher watcher(path, FileChangeWatcher::Mode::inotify);
+		SignalCounter counter(watcher);
+		TEST_ASSERT(insertRow(otherPath));
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_COMPARE(counter.received, 0u);
+	}
+#endif
+};
+
+TEST_INSTANTIATE(TST_FileChangeWatcher);
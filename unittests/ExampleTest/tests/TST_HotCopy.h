@@ -0,0 +1,119 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <fstream>
+#include <iterator>
+
+class TST_HotCopy : public UnitTest::Test
+{
+	TEST_CLASS(TST_HotCopy)
+public:
+	TST_HotCopy()
+		: Test("TST_HotCopy")
+	{
+		ADD_TEST(TST_HotCopy::reloadsAfterExternalChange);
+		ADD_TEST(TST_HotCopy::reloadsAgainAfterFailedLoad);
+		ADD_TEST(TST_HotCopy::reloadCancelsBackup);
+	}
+
+private:
+	static std::string countRows(SQLiteWrapper::SQLite& db)
+	{
+		std::vector<std::vector<std::string>> rows = db.fetchAll("SELECT COUNT(*) FROM items;");
+		return rows.size() == 1 && rows[0].size() == 1 ? rows[0][0] : std::string();
+	}
+	static bool createDatabase(const std::string& path, int rows)
+	{
+		SQLiteWrapper::SQLite db(path);
+		bool success = db.open() && db.execute("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY, data TEXT);");
+		for (int i = 0; i < rows; ++i)
+			success &= db.executeWithParams("INSERT INTO items(data) VALUES(?);", { std::string(100, 'x') });
+		db.close();
+		return success;
+	}
+	static void waitForWatcher()
+	{
+		// open() starts the watcher, it reads the initial state of the file in the background
+		TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+	}
+	static std::string readFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	static void writeFile(const std::string& path, const std::string& data)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << data;
+	}
+
+	// Tests
+	TEST_FUNCTION(reloadsAfterExternalChange)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("hotcopy.db");
+		TEST_ASSERT(createDatabase(path, 1));
+
+		SQLiteWrapper::SQLite reader(path);
+		reader.setInMemoryHotCopy(true);
+		TEST_ASSERT(reader.open());
+		waitForWatcher();
+		TEST_COMPARE(countRows(reader), std::string("1"));
+
+		// The copy is read only
+		TEST_ASSERT(!reader.execute("INSERT INTO items(data) VALUES('y');"));
+
+		TEST_ASSERT(createDatabase(path, 1));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return countRows(reader) == "2"; }));
+		reader.close();
+	}
+
+	TEST_FUNCTION(reloadsAgainAfterFailedLoad)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("hotcopy_fail.db");
+		std::string imagePath = TestUtilities::getTempDatabasePath("hotcopy_fail_image.db");
+		TEST_ASSERT(createDatabase(path, 1));
+		TEST_ASSERT(createDatabase(imagePath, 4));
+		std::string image = readFile(imagePath);
+
+		SQLiteWrapper::SQLite reader(path);
+		reader.setInMemoryHotCopy(true);
+		TEST_ASSERT(reader.open());
+		waitForWatcher();
+
+		// The reload of a corrupt file fails, the old copy stays in use
+		writeFile(path, std::string(4096, 'x'));
+		TestUtilities::processEventsFor(std::chrono::milliseconds(1000));
+		TEST_COMPARE(countRows(reader), std::string("1"));
+
+		// The failed reload does not block the next one
+		writeFile(path, image);
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return countRows(reader) == "4"; }));
+		reader.close();
+	}
+
+	TEST_FUNCTION(reloadCancelsBackup)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("hotcopy_backup.db");
+		TEST_ASSERT(createDatabase(path, 500));
+
+		SQLiteWrapper::SQLite reader(path);
+		reader.setInMemoryHotCopy(true);
+		TEST_ASSERT(reader.open());
+		waitForWatcher();
+
+		// Slow backup, still running when the copy gets replaced
+		std::string backupPath = TestUtilities::getTempDatabasePath("hotcopy_backup.bak");
+		TEST_ASSERT(reader.backupTo(backupPath, 1, std::chrono::milliseconds(50)));
+		TEST_ASSERT(createDatabase(path, 1));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return countRows(reader) == "501"; }));
+		TEST_ASSERT(!reader.isBackupRunning());
+		reader.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_HotCopy);
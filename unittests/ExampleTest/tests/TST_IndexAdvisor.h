@@ -0,0 +1,92 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <algorithm>
+
+class TST_IndexAdvisor : public UnitTest::Test
+{
+	TEST_CLASS(TST_IndexAdvisor)
+public:
+	TST_IndexAdvisor()
+		: Test("TST_IndexAdvisor")
+	{
+		ADD_TEST(TST_IndexAdvisor::workloadAggregatesByFingerprint);
+		ADD_TEST(TST_IndexAdvisor::workloadOnlyWhileCapturing);
+		ADD_TEST(TST_IndexAdvisor::suggestsIndexForScan);
+	}
+
+private:
+
+	// Tests
+	TEST_FUNCTION(workloadAggregatesByFingerprint)
+	{
+		TEST_START;
+		SQLiteWrapper::QueryWorkload workload;
+		workload.start();
+		workload.record("SELECT * FROM t WHERE a = 1", std::chrono::microseconds(10));
+		workload.record("SELECT * FROM t WHERE a = 2", std::chrono::microseconds(30));
+		workload.record("SELECT * FROM u", std::chrono::microseconds(100));
+		workload.stop();
+
+		std::vector<SQLiteWrapper::QueryWorkload::Entry> entries = workload.getEntries();
+		TEST_COMPARE(entries.size(), size_t(2));
+		if (entries.size() != 2)
+			return;
+		// Longest total duration first
+		TEST_COMPARE(entries[0].fingerprint, std::string("select * from u"));
+		TEST_COMPARE(entries[1].executions, size_t(2));
+		TEST_COMPARE(entries[1].query, std::string("SELECT * FROM t WHERE a = 1"));
+		TEST_ASSERT(entries[1].totalDuration == std::chrono::microseconds(40));
+		TEST_ASSERT(entries[1].maxDuration == std::chrono::microseconds(30));
+	}
+
+	TEST_FUNCTION(workloadOnlyWhileCapturing)
+	{
+		TEST_START;
+		SQLiteWrapper::QueryWorkload workload(1);
+		workload.record("SELECT 1", std::chrono::microseconds(10));
+		TEST_ASSERT(workload.getEntries().empty());
+
+		workload.start();
+		workload.record("SELECT * FROM a", std::chrono::microseconds(10));
+		workload.record("SELECT * FROM b", std::chrono::microseconds(10));
+		TEST_COMPARE(workload.getEntries().size(), size_t(1));
+	}
+
+	TEST_FUNCTION(suggestsIndexForScan)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("advisor.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT, price INTEGER);"));
+		for (int i = 0; i < 50; ++i)
+			TEST_ASSERT(db.executeWithParams("INSERT INTO items(name, price) VALUES(?, ?);", { "n" + std::to_string(i), std::to_string(i) }));
+
+		db.startWorkloadCapture();
+		db.fetchAll("SELECT * FROM items WHERE name = 'n7';");
+		db.fetchAll("SELECT * FROM items WHERE name = 'n8';");
+		db.stopWorkloadCapture();
+		TEST_COMPARE(db.getWorkload().getEntries().size(), size_t(1));
+
+		SQLiteWrapper::IndexAdvisor advisor(db);
+		advisor.setMeasureOnScratchCopy(true, 1);
+		SQLiteWrapper::IndexAdvisor::Report report = advisor.analyze(db.getWorkload().getEntries());
+		TEST_ASSERT_M(report.errors.empty(), report.toString());
+		TEST_COMPARE(report.recommendations.size(), size_t(1));
+		TEST_COMPARE(report.createIndexStatements.size(), size_t(1));
+		if (report.recommendations.size() != 1 || report.createIndexStatements.size() != 1)
+			return;
+		TEST_ASSERT(report.createIndexStatements[0].find("items(name") != std::string::npos);
+		TEST_ASSERT(!report.recommendations[0].resolvedIssues.empty());
+		TEST_ASSERT(report.recommendations[0].measured);
+
+		// The measurement leaves the database untouched
+		std::vector<std::vector<std::string>> indexes = db.fetchAll("SELECT name FROM sqlite_master WHERE type = 'index';");
+		TEST_ASSERT(indexes.empty());
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_IndexAdvisor);
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <filesystem>
+
+class TST_LockFile : public UnitTest::Test
+{
+	TEST_CLASS(TST_LockFile)
+public:
+	TST_LockFile()
+		: Test("TST_LockFile")
+	{
+		ADD_TEST(TST_LockFile::exclusiveLocksConflict);
+		ADD_TEST(TST_LockFile::sharedLocksCoexist);
+		ADD_TEST(TST_LockFile::releaseDeletesExclusiveFile);
+		ADD_TEST(TST_LockFile::invalidPath);
+		ADD_TEST(TST_LockFile::retryTimesOut);
+		ADD_TEST(TST_LockFile::acquireWaitsForRelease);
+		ADD_TEST(TST_LockFile::acquireTimesOut);
+		ADD_TEST(TST_LockFile::signalWakeupWaits);
+		ADD_TEST(TST_LockFile::statisticsAreConsistent);
+		ADD_TEST(TST_LockFile::cancelEndsWait);
+		ADD_TEST(TST_LockFile::cancelledTokenDoesNotWait);
+	}
+
+private:
+	typedef SQLiteWrapper::LockFile LockFile;
+
+	static size_t histogramSum(const LockFile::Statistics& statistics)
+	{
+		size_t sum = 0;
+		for (size_t count : statistics.acquireTimeHistogram)
+			sum += count;
+		return sum;
+	}
+
+	// Tests
+	TEST_FUNCTION(exclusiveLocksConflict)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("exclusive.lock");
+		LockFile first(path);
+		LockFile second(path);
+		TEST_COMPARE(first.tryGetLock(), LockFile::LockStatus::locked);
+		TEST_COMPARE(first.getLockMode(), LockFile::LockMode::exclusive);
+		TEST_COMPARE(first.tryGetLock(), LockFile::LockStatus::alreadyLocked);
+		TEST_COMPARE(second.tryGetExclusiveLock(), LockFile::LockStatus::unableToLock);
+		TEST_COMPARE(second.tryGetSharedLock(), LockFile::LockStatus::unableToLock);
+		TEST_ASSERT(!second.isLocked());
+
+		TEST_COMPARE(first.releaseLock(), LockFile::UnlockStatus::unlocked);
+		TEST_COMPARE(first.releaseLock(), LockFile::UnlockStatus::alreadyUnlocked);
+		TEST_COMPARE(second.tryGetExclusiveLock(), LockFile::LockStatus::locked);
+	}
+
+	TEST_FUNCTION(sharedLocksCoexist)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("shared.lock");
+		LockFile reader1(path);
+		LockFile reader2(path);
+		LockFile writer(path);
+		TEST_COMPARE(reader1.tryGetSharedLock(), LockFile::LockStatus::locked);
+		TEST_COMPARE(reader2.tryGetSharedLock(), LockFile::LockStatus::locked);
+		TEST_COMPARE(reader2.getLockMode(), LockFile::LockMode::shared);
+		TEST_COMPARE(writer.tryGetExclusiveLock(), LockFile::LockStatus::unableToLock);
+
+		reader1.releaseLock();
+		TEST_COMPARE(writer.tryGetExclusiveLock(), LockFile::LockStatus::unableToLock);
+		reader2.releaseLock();
+		TEST_COMPARE(writer.tryGetExclusiveLock(), LockFile::LockStatus::locked);
+		TEST_COMPARE(reader1.tryGetSharedLock(), LockFile::LockStatus::unableToLock);
+	}
+
+	TEST_FUNCTION(releaseDeletesExclusiveFile)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("delete.lock");
+		{
+			LockFile reader(path);
+			TEST_COMPARE(reader.tryGetSharedLock(), LockFile::LockStatus::locked);
+			reader.releaseLock();
+			TEST_ASSERT(std::filesystem::exists(path));
+		}
+		{
+			LockFile writer(path);
+			TEST_COMPARE(writer.tryGetExclusiveLock(), LockFile::LockStatus::locked);
+			TEST_ASSERT(std::filesystem::exists(path));
+		}
+		// Released by the destructor
+		TEST_ASSERT(!std::filesystem::exists(path));
+	}
+
+	TEST_FUNCTION(invalidPath)
+	{
+		TEST_START;
+		LockFile lock(TestUtilities::getTempDatabasePath("missing_directory/file.lock"));
+		TEST_COMPARE(lock.tryGetLock(), LockFile::LockStatus::unableToCreateLockFile);
+		TEST_COMPARE(lock.getStatistics().failures, size_t(1));
+	}
+
+	TEST_FUNCTION(retryTimesOut)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("retry.lock");
+		LockFile owner(path);
+		LockFile waiter(path);
+		TEST_COMPARE(owner.tryGetLock(), LockFile::LockStatus::locked);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TEST_COMPARE(waiter.tryGetExclusiveLock(std::chrono::milliseconds(100)), LockFile::LockStatus::timeout);
+		TEST_ASSERT(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100));
+		TEST_COMPARE(waiter.tryGetSharedLock(std::chrono::milliseconds(20)), LockFile::LockStatus::timeout);
+
+		const LockFile::Statistics& statistics = waiter.getStatistics();
+		TEST_COMPARE(statistics.attempts, size_t(2));
+		TEST_COMPARE(statistics.acquisitions, size_t(0));
+		TEST_COMPARE(statistics.failures, size_t(0));
+		TEST_ASSERT(statistics.contentions > 2);
+	}
+
+	TEST_FUNCTION(acquireWaitsForRelease)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("acquire.lock");
+		LockFile owner(path);
+		TEST_COMPARE(owner.acquire(std::chrono::milliseconds(100)), LockFile::LockStatus::locked);
+		std::thread releaser([&owner]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				owner.releaseLock();
+			});
+
+		LockFile waiter(path);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		LockFile::LockStatus status = waiter.acquire(std::chrono::milliseconds(3000), LockFile::LockMode::shared);
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+		releaser.join();
+		TEST_COMPARE(status, LockFile::LockStatus::locked);
+		TEST_COMPARE(waiter.getLockMode(), LockFile::LockMode::shared);
+		TEST_ASSERT(elapsed >= std::chrono::milliseconds(90));
+		TEST_ASSERT(elapsed < std::chrono::milliseconds(2000));
+
+		const LockFile::Statistics& statistics = waiter.getStatistics();
+		TEST_COMPARE(statistics.attempts, size_t(1));
+		TEST_COMPARE(statistics.acquisitions, size_t(1));
+		TEST_ASSERT(statistics.totalAcquireTime >= std::chrono::milliseconds(90));
+		TEST_ASSERT(statistics.totalAcquireTime <= std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+	}
+
+	TEST_FUNCTION(acquireTimesOut)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("acquire_timeout.lock");
+		LockFile owner(path);
+		LockFile waiter(path);
+		TEST_COMPARE(owner.tryGetSharedLock(), LockFile::LockStatus::locked);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TEST_COMPARE(waiter.acquire(std::chrono::milliseconds(100)), LockFile::LockStatus::timeout);
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+		TEST_ASSERT(elapsed >= std::chrono::milliseconds(100));
+		TEST_ASSERT(elapsed < std::chrono::milliseconds(1000));
+		TEST_ASSERT(!waiter.isLocked());
+
+		// A shared lock does not wait for a shared owner
+		TEST_COMPARE(waiter.acquire(std::chrono::milliseconds(100), LockFile::LockMode::shared), LockFile::LockStatus::locked);
+	}
+
+	TEST_FUNCTION(statisticsAreConsistent)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("statistics.lock");
+		LockFile lock(path);
+		for (int i = 0; i < 3; ++i)
+		{
+			TEST_COMPARE(lock.tryGetExclusiveLock(std::chrono::milliseconds(10)), LockFile::LockStatus::locked);
+			lock.releaseLock();
+			TEST_COMPARE(lock.acquire(std::chrono::milliseconds(10), LockFile::LockMode::shared), LockFile::LockStatus::locked);
+			lock.releaseLock();
+		}
+		const LockFile::Statistics& statistics = lock.getStatistics();
+		TEST_COMPARE(statistics.attempts, size_t(6));
+		TEST_COMPARE(statistics.acquisitions, size_t(6));
+		TEST_COMPARE(histogramSum(statistics), size_t(6));
+		TEST_ASSERT(statistics.maxAcquireTime <= statistics.totalAcquireTime);
+
+		lock.resetStatistics();
+		TEST_COMPARE(lock.getStatistics().attempts, size_t(0));
+		TEST_COMPARE(histogramSum(lock.getStatistics()), size_t(0));
+	}
+
+	TEST_FUNCTION(cancelEndsWait)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("cancel.lock");
+		LockFile owner(path);
+		LockFile waiter(path);
+		TEST_COMPARE(owner.tryGetExclusiveLock(), LockFile::LockStatus::locked);
+
+		LockFile::CancelToken token;
+		std::thread canceller([&token]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				token.cancel();
+			});
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		LockFile::LockStatus status = waiter.acquire(token);
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+		canceller.join();
+		TEST_COMPARE(status, LockFile::LockStatus::cancelled);
+		TEST_ASSERT(!waiter.isLocked());
+		TEST_ASSERT(elapsed >= std::chrono::milliseconds(90));
+		TEST_ASSERT(elapsed < std::chrono::milliseconds(1000));
+		TEST_COMPARE(waiter.getStatistics().attempts, size_t(1));
+		TEST_COMPARE(waiter.getStatistics().failures, size_t(0));
+
+		// After a reset the token waits again until the owner releases the lock
+		token.reset();
+		std::thread releaser([&owner]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				owner.releaseLock();
+			});
+		status = waiter.acquire(token);
+		releaser.join();
+		TEST_COMPARE(status, LockFile::LockStatus::locked);
+	}
+
+	TEST_FUNCTION(cancelledTokenDoesNotWait)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("cancelled.lock");
+		LockFile lock(path);
+		LockFile::CancelToken token;
+		token.cancel();
+		TEST_ASSERT(token.isCancelled());
+		TEST_ASSERT(token.waitFor(std::chrono::milliseconds(1000)));
+		TEST_COMPARE(lock.acquire(token), LockFile::LockStatus::cancelled);
+		TEST_ASSERT(!lock.isLocked());
+
+		token.reset();
+		TEST_ASSERT(!token.waitFor(std::chrono::milliseconds(1)));
+		TEST_COMPARE(lock.acquire(token, LockFile::LockMode::shared), LockFile::LockStatus::locked);
+	}
+
+	TEST_FUNCTION(signalWakeupWaits)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("signal_wakeup.lock");
+		LockFile owner(path);
+		LockFile waiter(path);
+		TEST_ASSERT(!LockFile::isSignalWakeupEnabled());
+		LockFile::setSignalWakeupEnabled(true);
+		TEST_COMPARE(owner.tryGetExclusiveLock(), LockFile::LockStatus::locked);
+
+		// Blocks in the kernel until the timeout signal, the cancellation or the release
+		LockFile::LockStatus timedOut = waiter.acquire(std::chrono::milliseconds(100));
+		LockFile::CancelToken token;
+		std::thread canceller([&token]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				token.cancel();
+			});
+		LockFile::LockStatus cancelled = waiter.acquire(token);
+		canceller.join();
+		std::thread releaser([&owner]()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				owner.releaseLock();
+			});
+		LockFile::LockStatus locked = waiter.acquire(std::chrono::milliseconds(3000));
+		releaser.join();
+		LockFile::setSignalWakeupEnabled(false);
+
+		TEST_COMPARE(timedOut, LockFile::LockStatus::timeout);
+		TEST_COMPARE(cancelled, LockFile::LockStatus::cancelled);
+		TEST_COMPARE(locked, LockFile::LockStatus::locked);
+		TEST_COMPARE(waiter.getStatistics().failures, size_t(0));
+	}
+};
+
+TEST_INSTANTIATE(TST_LockFile);
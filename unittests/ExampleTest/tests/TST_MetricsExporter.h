@@ -0,0 +1,232 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <fstream>
+#include <sstream>
+#include <set>
+
+class TST_MetricsExporter : public UnitTest::Test
+{
+	TEST_CLASS(TST_MetricsExporter)
+public:
+	TST_MetricsExporter()
+		: Test("TST_MetricsExporter")
+	{
+		ADD_TEST(TST_MetricsExporter::prometheusFormat);
+		ADD_TEST(TST_MetricsExporter::prometheusSeriesAreUnique);
+		ADD_TEST(TST_MetricsExporter::jsonFormat);
+		ADD_TEST(TST_MetricsExporter::exportToFileAndSink);
+		ADD_TEST(TST_MetricsExporter::snapshotsDuringQueries);
+	}
+
+private:
+	typedef SQLiteWrapper::ConnectionMetrics ConnectionMetrics;
+	typedef SQLiteWrapper::MetricsExporter MetricsExporter;
+
+	static ConnectionMetrics::Snapshot makeSnapshot(const std::string& connection)
+	{
+		ConnectionMetrics::Snapshot snapshot;
+		snapshot.database = "/data/app \"main\".db";
+		snapshot.connection = connection;
+		snapshot.cacheHit = 12;
+		snapshot.memoryUsed = 4096;
+		ConnectionMetrics::StatementStats stats;
+		stats.fingerprint = "SELECT * FROM items WHERE id = ?";
+		stats.query = "SELECT * FROM items WHERE id = 1";
+		stats.runs = 3;
+		stats.vmSteps = 30;
+		stats.totalDuration = std::chrono::microseconds(1500);
+		stats.maxDuration = std::chrono::microseconds(1000);
+		stats.durationBuckets = { 1, 1, 1, 0, 0, 0 };
+		snapshot.statements.push_back(stats);
+		return snapshot;
+	}
+	static std::vector<std::string> lines(const std::string& text)
+	{
+		std::vector<std::string> result;
+		std::istringstream stream(text);
+		std::string line;
+		while (std::getline(stream, line))
+			result.push_back(line);
+		return result;
+	}
+	static bool contains(const std::string& text, const std::string& part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+
+	// Tests
+	TEST_FUNCTION(prometheusFormat)
+	{
+		TEST_START;
+		std::string text = MetricsExporter::toPrometheus({ makeSnapshot("reader") });
+		std::string labels = "database=\"/data/app \\\"main\\\".db\",connection=\"reader\"";
+		TEST_ASSERT(contains(text, "# TYPE sqlite_cache_hits_total counter\n"));
+		TEST_ASSERT(contains(text, "sqlite_cache_hits_total{" + labels + "} 12\n"));
+		TEST_ASSERT(contains(text, "sqlite_memory_used_bytes 4096\n"));
+
+		std::string statement = labels + ",fingerprint=\"SELECT * FROM items WHERE id = ?\"";
+		TEST_ASSERT(contains(text, "sqlite_statement_runs_total{" + statement + "} 3\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_vm_steps_total{" + statement + "} 30\n"));
+
+		// The histogram buckets are cumulative
+		TEST_ASSERT(contains(text, "# TYPE sqlite_statement_duration_seconds histogram\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_seconds_bucket{" + statement + ",le=\"0.0001\"} 1\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_seconds_bucket{" + statement + ",le=\"0.001\"} 2\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_seconds_bucket{" + statement + ",le=\"+Inf\"} 3\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_seconds_sum{" + statement + "} 0.0015\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_seconds_count{" + statement + "} 3\n"));
+		TEST_ASSERT(contains(text, "sqlite_statement_duration_max_seconds{" + statement + "} 0.001\n"));
+
+		// Without connections only the headers are written
+		std::string empty = MetricsExporter::toPrometheus({});
+		for (const std::string& line : lines(empty))
+			TEST_ASSERT(line.rfind("# ", 0) == 0);
+	}
+
+	TEST_FUNCTION(prometheusSeriesAreUnique)
+	{
+		TEST_START;
+		// Two connections to the same database
+		std::string text = MetricsExporter::toPrometheus({ makeSnapshot("0"), makeSnapshot("1") });
+		std::set<std::string> series;
+		size_t samples = 0;
+		for (const std::string& line : lines(text))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+			++samples;
+			series.insert(line.substr(0, line.rfind(' ')));
+		}
+		TEST_ASSERT(samples > 0);
+		TEST_COMPARE(series.size(), samples);
+	}
+
+	TEST_FUNCTION(jsonFormat)
+	{
+		TEST_START;
+		ConnectionMetrics::Snapshot snapshot = makeSnapshot("writer");
+		snapshot.statements[0].query = "SELECT 'a\tb'\n";
+		std::string json = MetricsExporter::toJson({ snapshot });
+		TEST_ASSERT(json.front() == '{' && json.back() == '}');
+		TEST_ASSERT(contains(json, "\"process\":{\"sqlite_memory_used_bytes\":4096,"));
+		TEST_ASSERT(contains(json, "\"connections\":[{\"database\":\"/data/app \\\"main\\\".db\",\"connection\":\"writer\",\"timestamp\":"));
+		TEST_ASSERT(contains(json, "\"sqlite_cache_hits_total\":12"));
+		TEST_ASSERT(contains(json, "\"query\":\"SELECT 'a\\tb'\\n\""));
+		TEST_ASSERT(contains(json, "\"sqlite_statement_runs_total\":3"));
+		TEST_ASSERT(contains(json, "\"sqlite_statement_duration_seconds_sum\":0.0015"));
+		TEST_ASSERT(contains(json, "\"duration_buckets\":[{\"le\":0.0001,\"count\":1},"));
+		TEST_ASSERT(contains(json, "{\"le\":null,\"count\":0}]"));
+
+		// Balanced brackets outside of strings
+		int depth = 0;
+		bool inString = false;
+		for (size_t i = 0; i < json.size(); ++i)
+		{
+			char c = json[i];
+			if (inString)
+			{
+				if (c == '\\')
+					++i;
+				else if (c == '"')
+					inString = false;
+				continue;
+			}
+			if (c == '"')
+				inString = true;
+			else if (c == '{' || c == '[')
+				++depth;
+			else if (c == '}' || c == ']')
+				--depth;
+			TEST_ASSERT(depth >= 0);
+		}
+		TEST_COMPARE(depth, 0);
+		TEST_ASSERT(!inString);
+	}
+
+	TEST_FUNCTION(exportToFileAndSink)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("metrics_export.db");
+		SQLiteWrapper::SQLite first(path);
+		SQLiteWrapper::SQLite second(path);
+		TEST_ASSERT(first.open());
+		TEST_ASSERT(second.open());
+		first.setMetricsEnabled(true);
+		second.setMetricsEnabled(true);
+		TEST_ASSERT(first.execute("CREATE TABLE items(id INTEGER);"));
+		second.fetchAll("SELECT * FROM items;");
+
+		std::string file = TestUtilities::getTempDatabasePath("metrics_export.prom");
+		MetricsExporter exporter;
+		exporter.setFile(file);
+		std::string received;
+		exporter.setSink([&received](const std::string& content) { received = content; });
+		exporter.addConnection(&first);
+		exporter.addConnection(&second, "reader");
+		exporter.addConnection(&second, "ignored");
+		TEST_ASSERT(exporter.exportNow());
+
+		std::ifstream stream(file);
+		std::string written((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		TEST_COMPARE(written, received);
+		TEST_ASSERT(contains(written, "connection=\"0\""));
+		TEST_ASSERT(contains(written, "connection=\"reader\""));
+		TEST_ASSERT(!contains(written, "connection=\"ignored\""));
+
+		exporter.removeConnection(&second);
+		exporter.setFormat(MetricsExporter::Format::json);
+		TEST_ASSERT(exporter.exportNow());
+		TEST_ASSERT(contains(received, "\"connection\":\"0\""));
+		TEST_ASSERT(!contains(received, "\"connection\":\"reader\""));
+		exporter.removeConnection(&first);
+	}
+
+	TEST_FUNCTION(snapshotsDuringQueries)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("metrics_concurrent.db"));
+		TEST_ASSERT(db.open());
+		db.setMetricsEnabled(true);
+		db.setMetricsStatusInterval(std::chrono::milliseconds(0));
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER);"));
+
+		// New fingerprints and status values get published while another thread reads them
+		std::atomic<bool> done(false);
+		std::atomic<size_t> snapshots(0);
+		uint64_t lastRuns = 0;
+		bool monotonic = true;
+		std::thread reader([&]()
+			{
+				while (!done.load())
+				{
+					ConnectionMetrics::Snapshot snapshot = db.getMetricsSnapshot();
+					uint64_t runs = 0;
+					for (const ConnectionMetrics::StatementStats& stats : snapshot.statements)
+						runs += stats.runs;
+					monotonic = monotonic && runs >= lastRuns;
+					lastRuns = runs;
+					++snapshots;
+				}
+			});
+		for (int i = 0; i < 200; ++i)
+		{
+			// The reader may start late, the queries wait for its first snapshot halfway
+			if (i == 100)
+			{
+				while (snapshots.load() == 0)
+					std::this_thread::yield();
+			}
+			db.fetchAll("SELECT id" + std::string(i % 50, ' ') + ", " + std::to_string(i % 7) + " AS c" + std::to_string(i) + " FROM items;");
+		}
+		done.store(true);
+		reader.join();
+		TEST_ASSERT(snapshots > 0);
+		TEST_ASSERT(monotonic);
+		TEST_COMPARE(db.getMetricsSnapshot().statements.size(), size_t(201));
+	}
+};
+
+TEST_INSTANTIATE(TST_MetricsExporter);
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "Utilities.h"
+#include "TestUtilities.h"
+
+class TST_QueryPlanLinter : public UnitTest::Test
+{
+	TEST_CLASS(TST_QueryPlanLinter)
+public:
+	TST_QueryPlanLinter()
+		: Test("TST_QueryPlanLinter")
+	{
+		ADD_TEST(TST_QueryPlanLinter::fingerprintReplacesLiterals);
+		ADD_TEST(TST_QueryPlanLinter::fingerprintKeepsIdentifiers);
+		ADD_TEST(TST_QueryPlanLinter::analyzeFlagsProblematicSteps);
+		ADD_TEST(TST_QueryPlanLinter::analyzeSkipsSubqueryScans);
+		ADD_TEST(TST_QueryPlanLinter::lintsRealQueryPlans);
+		ADD_TEST(TST_QueryPlanLinter::cacheIsBounded);
+	}
+
+private:
+
+	// Tests
+	TEST_FUNCTION(fingerprintReplacesLiterals)
+	{
+		TEST_START;
+		using SQLiteWrapper::Utilities::getQueryFingerprint;
+		TEST_COMPARE(getQueryFingerprint("SELECT * FROM t WHERE a = 12 AND b = 'x''y';"),
+					 std::string("select * from t where a = ? and b = ?"));
+		TEST_COMPARE(getQueryFingerprint("SELECT  *\n FROM t WHERE a = 3.5"),
+					 getQueryFingerprint("select * from t where a = 42"));
+		TEST_COMPARE(getQueryFingerprint("  INSERT INTO t VALUES(0x1F, 1e5) ;  "),
+					 std::string("insert into t values(?, ?)"));
+	}
+
+	TEST_FUNCTION(fingerprintKeepsIdentifiers)
+	{
+		TEST_START;
+		using SQLiteWrapper::Utilities::getQueryFingerprint;
+		// Digits within names and quoted identifiers are no literals
+		TEST_COMPARE(getQueryFingerprint("SELECT col1 FROM table2"), std::string("select col1 from table2"));
+		TEST_COMPARE(getQueryFingerprint("SELECT \"My Col 1\" FROM [T 2]"), std::string("select \"My Col 1\" from [T 2]"));
+		TEST_ASSERT(getQueryFingerprint("SELECT a FROM t") != getQueryFingerprint("SELECT b FROM t"));
+	}
+
+	TEST_FUNCTION(analyzeFlagsProblematicSteps)
+	{
+		TEST_START;
+		using SQLiteWrapper::QueryPlanLinter;
+		std::vector<std::string> issues = QueryPlanLinter::analyze({
+			"SCAN items",
+			"SEARCH orders USING INDEX orders_item (item=?)",
+			"USE TEMP B-TREE FOR ORDER BY" });
+		TEST_COMPARE(issues.size(), size_t(2));
+
+		issues = QueryPlanLinter::analyze({
+			"SCAN items USING COVERING INDEX items_name",
+			"SCAN CONSTANT ROW",
+			"SCAN sqlite_master",
+			"SCAN series VIRTUAL TABLE INDEX 0:" });
+		TEST_ASSERT(issues.empty());
+
+		issues = QueryPlanLinter::analyze({ "SEARCH t USING AUTOMATIC COVERING INDEX (a=?)" });
+		TEST_COMPARE(issues.size(), size_t(1));
+	}
+
+	TEST_FUNCTION(analyzeSkipsSubqueryScans)
+	{
+		TEST_START;
+		using SQLiteWrapper::QueryPlanLinter;
+		std::vector<std::string> issues = QueryPlanLinter::analyze({
+			"MATERIALIZE recent",
+			"  SEARCH items USING INTEGER PRIMARY KEY (rowid>?)",
+			"SCAN recent",
+			"SCAN (subquery-1)",
+			"SCAN SUBQUERY 2" });
+		TEST_ASSERT(issues.empty());
+
+		// The steps inside the subquery are still inspected
+		issues = QueryPlanLinter::analyze({
+			"CO-ROUTINE sub",
+			"  SCAN items",
+			"SCAN sub" });
+		TEST_COMPARE(issues, std::vector<std::string>({ "Full table scan: SCAN items" }));
+	}
+
+	TEST_FUNCTION(lintsRealQueryPlans)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("linter.db"));
+		TEST_ASSERT(db.open());
+		db.setQueryPlanLintMode(SQLiteWrapper::QueryPlanLinter::Mode::warn);
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);"));
+
+		db.fetchAll("WITH recent AS MATERIALIZED (SELECT id FROM items WHERE id > 10) SELECT * FROM recent;");
+		db.fetchAll("SELECT * FROM (SELECT id FROM items WHERE id > 10 LIMIT 5);");
+		TEST_ASSERT(db.getQueryPlanLinter().getFindings().empty());
+
+		db.fetchAll("SELECT * FROM items WHERE name = 'a';");
+		db.fetchAll("SELECT * FROM items WHERE name = 'b';");
+		std::vector<SQLiteWrapper::QueryPlanLinter::Result> findings = db.getQueryPlanLinter().getFindings();
+		TEST_COMPARE(findings.size(), size_t(1));
+		TEST_ASSERT(findings.size() == 1 && findings[0].fingerprint == "select * from items where name = ?");
+		db.close();
+	}
+
+	TEST_FUNCTION(cacheIsBounded)
+	{
+		TEST_START;
+		using SQLiteWrapper::QueryPlanLinter;
+		QueryPlanLinter linter(2);
+		for (const char* fingerprint : { "a", "b" })
+		{
+			QueryPlanLinter::Result result;
+			result.fingerprint = fingerprint;
+			linter.store(std::move(result));
+		}
+		TEST_ASSERT(linter.isFull());
+		linter.clear();
+		TEST_ASSERT(!linter.isFull());
+	}
+};
+
+TEST_INSTANTIATE(TST_QueryPlanLinter);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_RowChanges : public UnitTest::Test
+{
+	TEST_CLASS(TST_RowChanges)
+public:
+	TST_RowChanges()
+		: Test("TST_RowChanges")
+	{
+		ADD_TEST(TST_RowChanges::deliveredPerCommit);
+		ADD_TEST(TST_RowChanges::rollbackDiscardsChanges);
+		ADD_TEST(TST_RowChanges::failedStatementInTransaction);
+		ADD_TEST(TST_RowChanges::queuedSignal);
+	}
+
+private:
+	typedef SQLiteWrapper::SQLite::RowChange RowChange;
+
+	// Operation and rowid of each change, e.g. "i1"
+	static std::string describe(const std::vector<RowChange>& changes)
+	{
+		std::string str;
+		for (const RowChange& change : changes)
+		{
+			str += change.operation == RowChange::Operation::insert ? "i" : change.operation == RowChange::Operation::update ? "u" : "d";
+			str += std::to_string(change.rowid) + " ";
+		}
+		return str;
+	}
+	static void open(SQLiteWrapper::SQLite& db, std::vector<std::string>& commits)
+	{
+		db.open();
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT UNIQUE);");
+		db.setRowChangeNotificationsEnabled(true);
+		db.setRowChangeCallback([&commits](const std::vector<RowChange>& changes) { commits.push_back(describe(changes)); });
+	}
+
+	// Tests
+	TEST_FUNCTION(deliveredPerCommit)
+	{
+		TEST_START;
+		std::vector<std::string> commits;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("rowchanges.db"));
+		open(db, commits);
+		TEST_ASSERT(db.execute("INSERT INTO items(id, name) VALUES(1, 'a');"));
+		TEST_ASSERT(db.execute("BEGIN; INSERT INTO items(id, name) VALUES(2, 'b'); UPDATE items SET name = 'c' WHERE id = 1;"));
+		TEST_COMPARE(commits.size(), size_t(1));
+		TEST_ASSERT(db.executeWithParams("DELETE FROM items WHERE id = ?;", { "2" }));
+		TEST_ASSERT(db.execute("COMMIT;"));
+		TEST_ASSERT(commits == std::vector<std::string>({ "i1 ", "i2 u1 d2 " }));
+		db.close();
+	}
+
+	TEST_FUNCTION(rollbackDiscardsChanges)
+	{
+		TEST_START;
+		std::vector<std::string> commits;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("rowchanges_rollback.db"));
+		open(db, commits);
+		TEST_ASSERT(db.execute("BEGIN; INSERT INTO items(id, name) VALUES(1, 'a'); ROLLBACK;"));
+		TEST_ASSERT(db.execute("INSERT INTO items(id, name) VALUES(2, 'b');"));
+		TEST_ASSERT(commits == std::vector<std::string>({ "i2 " }));
+		db.close();
+	}
+
+	TEST_FUNCTION(failedStatementInTransaction)
+	{
+		TEST_START;
+		std::vector<std::string> commits;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("rowchanges_failed.db"));
+		open(db, commits);
+
+		// The second insert fails and is undone, the first one stays in the transaction
+		TEST_ASSERT(!db.execute("BEGIN; INSERT INTO items(id, name) VALUES(1, 'a'); INSERT INTO items(id, name) VALUES(2, 'b'), (3, 'a');"));
+		TEST_ASSERT(!db.executeWithParams("INSERT INTO items(id, name) VALUES(4, 'd'), (5, ?);", { "a" }));
+		TEST_ASSERT(db.execute("INSERT INTO items(id, name) VALUES(6, 'f'); COMMIT;"));
+		TEST_ASSERT(commits == std::vector<std::string>({ "i1 i6 " }));
+		db.close();
+	}
+
+	TEST_FUNCTION(queuedSignal)
+	{
+		TEST_START;
+		std::vector<std::string> commits;
+		std::vector<std::string> signaled;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("rowchanges_signal.db"));
+		open(db, commits);
+		QObject receiver;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::onRowsChanged, &receiver,
+			[&signaled](const std::vector<RowChange>& changes) { signaled.push_back(describe(changes)); }, Qt::QueuedConnection);
+		TEST_ASSERT(db.execute("INSERT INTO items(id, name) VALUES(7, 'g');"));
+		TEST_ASSERT(signaled.empty());
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return !signaled.empty(); }));
+		TEST_ASSERT(signaled == std::vector<std::string>({ "i7 " }));
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_RowChanges);
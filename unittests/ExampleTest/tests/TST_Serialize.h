@@ -0,0 +1,96 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_Serialize : public UnitTest::Test
+{
+	TEST_CLASS(TST_Serialize)
+public:
+	TST_Serialize()
+		: Test("TST_Serialize")
+	{
+		ADD_TEST(TST_Serialize::roundTrip);
+		ADD_TEST(TST_Serialize::borrowedImage);
+		ADD_TEST(TST_Serialize::readOnlyImage);
+		ADD_TEST(TST_Serialize::rejectsInvalidImage);
+	}
+
+private:
+	typedef std::vector<std::vector<std::string>> Rows;
+
+	// Tests
+	TEST_FUNCTION(roundTrip)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite source(TestUtilities::getTempDatabasePath("serialize_source.db"));
+		TEST_ASSERT(source.open());
+		TEST_ASSERT(source.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);"));
+		TEST_ASSERT(source.execute("INSERT INTO items(name) VALUES('a'), ('b');"));
+
+		SQLiteWrapper::SerializedDatabase image = source.serialize();
+		TEST_ASSERT(!image.isEmpty());
+		TEST_ASSERT(!image.isBorrowed());
+		source.close();
+
+		SQLiteWrapper::SQLite target(TestUtilities::getTempDatabasePath("serialize_target.db"));
+		TEST_ASSERT(target.open());
+		TEST_ASSERT(target.deserialize(std::move(image), false));
+		TEST_ASSERT(image.isEmpty());
+		TEST_ASSERT(target.fetchAll("SELECT name FROM items ORDER BY id;") == Rows({ { "a" }, { "b" } }));
+		TEST_ASSERT(target.execute("INSERT INTO items(name) VALUES('c');"));
+		target.close();
+
+		// The file of the target is not modified
+		SQLiteWrapper::SQLite file(TestUtilities::getTempDatabasePath("serialize_target.db"));
+		TEST_ASSERT(file.open());
+		TEST_ASSERT(file.fetchAll("SELECT name FROM sqlite_master WHERE name = 'items';").empty());
+		file.close();
+	}
+
+	TEST_FUNCTION(borrowedImage)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite source(TestUtilities::getTempDatabasePath("serialize_borrow.db"));
+		TEST_ASSERT(source.open());
+		TEST_ASSERT(source.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		SQLiteWrapper::SerializedDatabase owned = source.serialize();
+		size_t size = owned.size();
+		TEST_ASSERT(source.deserialize(std::move(owned), false));
+
+		// A deserialized database is serialized without a copy
+		SQLiteWrapper::SerializedDatabase borrowed = source.serialize();
+		TEST_ASSERT(borrowed.isBorrowed());
+		TEST_COMPARE(borrowed.size(), size);
+
+		SQLiteWrapper::SerializedDatabase copy = borrowed.copy();
+		TEST_ASSERT(!copy.isBorrowed());
+		TEST_COMPARE(copy.size(), size);
+		source.close();
+	}
+
+	TEST_FUNCTION(readOnlyImage)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite source(TestUtilities::getTempDatabasePath("serialize_ro.db"));
+		TEST_ASSERT(source.open());
+		TEST_ASSERT(source.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		TEST_ASSERT(source.deserialize(source.serialize(), true));
+		TEST_ASSERT(source.fetchAll("SELECT COUNT(*) FROM items;") == Rows({ { "0" } }));
+		TEST_ASSERT(!source.execute("INSERT INTO items DEFAULT VALUES;"));
+		source.close();
+	}
+
+	TEST_FUNCTION(rejectsInvalidImage)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("serialize_invalid.db"));
+		TEST_ASSERT(!db.deserialize(SQLiteWrapper::SerializedDatabase::fromBytes("abc", 3), false));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(!db.deserialize(SQLiteWrapper::SerializedDatabase(), false));
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_Serialize);
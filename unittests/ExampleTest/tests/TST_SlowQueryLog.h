@@ -0,0 +1,117 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_SlowQueryLog : public UnitTest::Test
+{
+	TEST_CLASS(TST_SlowQueryLog)
+public:
+	TST_SlowQueryLog()
+		: Test("TST_SlowQueryLog")
+	{
+		ADD_TEST(TST_SlowQueryLog::ringKeepsNewestEntries);
+		ADD_TEST(TST_SlowQueryLog::capacityChangeKeepsNewestEntries);
+		ADD_TEST(TST_SlowQueryLog::logRateLimit);
+		ADD_TEST(TST_SlowQueryLog::capturesSlowStatements);
+		ADD_TEST(TST_SlowQueryLog::disabledWithoutThreshold);
+	}
+
+private:
+	static SQLiteWrapper::SlowQueryLog::Entry makeEntry(const std::string& query)
+	{
+		SQLiteWrapper::SlowQueryLog::Entry entry;
+		entry.query = query;
+		entry.duration = std::chrono::microseconds(1000);
+		return entry;
+	}
+	static std::vector<std::string> getQueries(const SQLiteWrapper::SlowQueryLog& log)
+	{
+		std::vector<std::string> queries;
+		for (const SQLiteWrapper::SlowQueryLog::Entry& entry : log.getEntries())
+			queries.push_back(entry.query);
+		return queries;
+	}
+
+	// Tests
+	TEST_FUNCTION(ringKeepsNewestEntries)
+	{
+		TEST_START;
+		SQLiteWrapper::SlowQueryLog log(3);
+		log.setMaxLogsPerSecond(100);
+		for (int i = 0; i < 5; ++i)
+			log.add(makeEntry("q" + std::to_string(i)));
+
+		TEST_ASSERT(getQueries(log) == std::vector<std::string>({ "q2", "q3", "q4" }));
+		log.clear();
+		TEST_ASSERT(log.getEntries().empty());
+	}
+
+	TEST_FUNCTION(capacityChangeKeepsNewestEntries)
+	{
+		TEST_START;
+		SQLiteWrapper::SlowQueryLog log(4);
+		for (int i = 0; i < 6; ++i)
+			log.add(makeEntry("q" + std::to_string(i)));
+
+		log.setCapacity(2);
+		TEST_COMPARE(log.getCapacity(), size_t(2));
+		TEST_ASSERT(getQueries(log) == std::vector<std::string>({ "q4", "q5" }));
+
+		log.setCapacity(3);
+		log.add(makeEntry("q6"));
+		log.add(makeEntry("q7"));
+		TEST_ASSERT(getQueries(log) == std::vector<std::string>({ "q5", "q6", "q7" }));
+	}
+
+	TEST_FUNCTION(logRateLimit)
+	{
+		TEST_START;
+		SQLiteWrapper::SlowQueryLog log(10);
+		log.setMaxLogsPerSecond(2);
+		TEST_ASSERT(log.add(makeEntry("a")));
+		TEST_ASSERT(log.add(makeEntry("b")));
+		TEST_ASSERT(!log.add(makeEntry("c")));
+		TEST_ASSERT(!log.add(makeEntry("d")));
+
+		// Suppressed entries are stored nevertheless
+		TEST_COMPARE(log.getEntries().size(), size_t(4));
+		TEST_COMPARE(log.getSuppressedLogCount(), size_t(2));
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+		TEST_ASSERT(log.add(makeEntry("e")));
+	}
+
+	TEST_FUNCTION(capturesSlowStatements)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("slowquery.db"));
+		TEST_ASSERT(db.open());
+		db.setSlowQueryThreshold(std::chrono::microseconds(1));
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);"));
+		TEST_ASSERT(db.executeWithParams("INSERT INTO items(name) VALUES(?);", { "a" }));
+		db.fetchAll("SELECT * FROM items WHERE name = 'a';");
+
+		// The query plans are captured after the calls
+		std::vector<SQLiteWrapper::SlowQueryLog::Entry> entries = db.getSlowQueries();
+		TEST_COMPARE(entries.size(), size_t(3));
+		TEST_COMPARE(entries[1].params, std::vector<std::string>({ "a" }));
+		TEST_ASSERT(entries[2].vmSteps > 0);
+		TEST_ASSERT(!entries[2].queryPlan.empty());
+		TEST_ASSERT(entries[2].queryPlan[0].find("items") != std::string::npos);
+		db.close();
+	}
+
+	TEST_FUNCTION(disabledWithoutThreshold)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("slowquery_disabled.db"));
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		TEST_ASSERT(db.getSlowQueries().empty());
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_SlowQueryLog);
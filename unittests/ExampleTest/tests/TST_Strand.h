@@ -0,0 +1,304 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <stdexcept>
+#include <thread>
+
+class TST_Strand : public UnitTest::Test
+{
+	TEST_CLASS(TST_Strand)
+public:
+	TST_Strand()
+		: Test("TST_Strand")
+	{
+		ADD_TEST(TST_Strand::callsRunOneAtATime);
+		ADD_TEST(TST_Strand::nestedCallsRunInline);
+		ADD_TEST(TST_Strand::exceptionsReachTheCaller);
+		ADD_TEST(TST_Strand::releaseHandsOver);
+		ADD_TEST(TST_Strand::signalsInObjectThread);
+		ADD_TEST(TST_Strand::settersFromOtherThreads);
+		ADD_TEST(TST_Strand::backupFinishedInObjectThread);
+	}
+
+private:
+	typedef SQLiteWrapper::Strand Strand;
+
+	// Holds the strand in a thread of its own until release is set
+	static std::thread* hold(Strand& strand, std::atomic<bool>& holding, std::atomic<bool>& release)
+	{
+		std::thread* holder = new std::thread([&strand, &holding, &release]()
+			{
+				strand.dispatch([&holding, &release]()
+					{
+						holding.store(true);
+						while (!release.load())
+							std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					});
+			});
+		while (!holding.load())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return holder;
+	}
+
+	// Tests
+	TEST_FUNCTION(callsRunOneAtATime)
+	{
+		TEST_START;
+		Strand strand;
+		const int threadCount = 8;
+		const int callCount = 500;
+		std::atomic<int> running(0);
+		int overlaps = 0;
+		std::vector<std::vector<int>> order(threadCount);
+		std::vector<std::thread*> threads;
+		for (int t = 0; t < threadCount; ++t)
+		{
+			threads.push_back(new std::thread([&, t]()
+				{
+					for (int i = 0; i < callCount; ++i)
+					{
+						strand.dispatch([&, t, i]()
+							{
+								if (running.fetch_add(1) != 0)
+									++overlaps;
+								order[t].push_back(i);
+								running.fetch_sub(1);
+							});
+					}
+				}));
+		}
+		for (std::thread* thread : threads)
+		{
+			thread->join();
+			delete thread;
+		}
+
+		TEST_COMPARE(overlaps, 0);
+		for (const std::vector<int>& calls : order)
+		{
+			// The calls of one thread keep their order
+			TEST_COMPARE(calls.size(), size_t(callCount));
+			for (int i = 0; i < callCount; ++i)
+				TEST_COMPARE(calls[i], i);
+		}
+	}
+
+	TEST_FUNCTION(nestedCallsRunInline)
+	{
+		TEST_START;
+		Strand strand;
+		TEST_ASSERT(!strand.isRunningInThisThread());
+		int result = strand.dispatch([&strand]()
+			{
+				std::thread::id outer = std::this_thread::get_id();
+				return strand.dispatch([&strand, outer]()
+					{
+						return strand.isRunningInThisThread() && std::this_thread::get_id() == outer ? 42 : 0;
+					});
+			});
+		TEST_COMPARE(result, 42);
+		TEST_ASSERT(!strand.isRunningInThisThread());
+
+		// Also inside a call queued behind another thread
+		std::atomic<bool> holding(false);
+		std::atomic<bool> release(false);
+		std::thread* holder = hold(strand, holding, release);
+		std::thread* queued = new std::thread([&strand, &result]()
+			{
+				result = strand.dispatch([&strand]() { return strand.dispatch([]() { return 7; }); });
+			});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		release.store(true);
+		queued->join();
+		holder->join();
+		delete queued;
+		delete holder;
+		TEST_COMPARE(result, 7);
+	}
+
+	TEST_FUNCTION(exceptionsReachTheCaller)
+	{
+		TEST_START;
+		Strand strand;
+		bool caught = false;
+		try
+		{
+			strand.dispatch([]() { throw std::runtime_error("inline"); });
+		}
+		catch (const std::runtime_error& e)
+		{
+			caught = std::string(e.what()) == "inline";
+		}
+		TEST_ASSERT(caught);
+		TEST_ASSERT(!strand.isRunningInThisThread());
+		TEST_COMPARE(strand.dispatch([]() { return 1; }), 1);
+
+		// A queued call throws in the thread which holds the strand, the exception reaches its caller
+		std::atomic<bool> holding(false);
+		std::atomic<bool> release(false);
+		std::thread* holder = hold(strand, holding, release);
+		bool queuedCaught = false;
+		std::thread* queued = new std::thread([&strand, &queuedCaught]()
+			{
+				try
+				{
+					strand.dispatch([]() { throw std::runtime_error("queued"); });
+				}
+				catch (const std::runtime_error& e)
+				{
+					queuedCaught = std::string(e.what()) == "queued";
+				}
+			});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		release.store(true);
+		queued->join();
+		holder->join();
+		delete queued;
+		delete holder;
+		TEST_ASSERT(queuedCaught);
+		TEST_COMPARE(strand.dispatch([]() { return 2; }), 2);
+	}
+
+	TEST_FUNCTION(releaseHandsOver)
+	{
+		TEST_START;
+		Strand strand;
+		const size_t callCount = Strand::maxQueuedCallsPerRelease * 2 + 8;
+		std::atomic<bool> holding(false);
+		std::atomic<bool> release(false);
+		std::thread* holder = hold(strand, holding, release);
+		std::thread::id holderId = holder->get_id();
+
+		std::mutex mutex;
+		std::vector<std::thread::id> runBy;
+		std::atomic<size_t> dispatched(0);
+		std::vector<std::thread*> threads;
+		for (size_t i = 0; i < callCount; ++i)
+		{
+			threads.push_back(new std::thread([&]()
+				{
+					dispatched.fetch_add(1);
+					strand.dispatch([&]()
+						{
+							std::unique_lock<std::mutex> lock(mutex);
+							runBy.push_back(std::this_thread::get_id());
+						});
+				}));
+		}
+		while (dispatched.load() < callCount)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		release.store(true);
+		for (std::thread* thread : threads)
+		{
+			thread->join();
+			delete thread;
+		}
+		holder->join();
+		delete holder;
+
+		// The holder runs a bounded number of foreign calls, the rest is handed over
+		size_t byHolder = 0;
+		for (const std::thread::id& id : runBy)
+			if (id == holderId)
+				++byHolder;
+		TEST_COMPARE(runBy.size(), callCount);
+		TEST_ASSERT(byHolder <= Strand::maxQueuedCallsPerRelease);
+		TEST_COMPARE(strand.dispatch([]() { return 3; }), 3);
+	}
+
+	TEST_FUNCTION(signalsInObjectThread)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("strand_signals.db"));
+		db.setThreadSafe(true);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		db.setRowChangeNotificationsEnabled(true);
+
+		QThread* signalThread = nullptr;
+		size_t changes = 0;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::onRowsChanged, [&](const std::vector<SQLiteWrapper::SQLite::RowChange>& rows)
+			{
+				signalThread = QThread::currentThread();
+				changes += rows.size();
+			});
+
+		bool inserted = false;
+		std::thread writer([&db, &inserted]() { inserted = db.execute("INSERT INTO items(id) VALUES(1);"); });
+		writer.join();
+		TestUtilities::processEventsUntil([&changes]() { return changes > 0; });
+
+		db.close();
+		TEST_ASSERT(inserted);
+		TEST_COMPARE(changes, size_t(1));
+		TEST_ASSERT(signalThread == QThread::currentThread());
+	}
+
+	TEST_FUNCTION(settersFromOtherThreads)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("strand_setters.db"));
+		db.setThreadSafe(true);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY);"));
+		db.setSlowQueryThreshold(std::chrono::microseconds(1));
+
+		// The configuration changes while another thread runs statements on the same connection
+		std::atomic<bool> done(false);
+		std::thread writer([&db, &done]()
+			{
+				for (int i = 0; i < 300; ++i)
+					db.executeWithParams("INSERT INTO items(id) VALUES(?);", { std::to_string(i) });
+				done.store(true);
+			});
+		size_t toggles = 0;
+		while (!done.load())
+		{
+			bool enable = (toggles++ % 2) == 0;
+			db.setMetricsEnabled(enable);
+			db.setMetricsStatusInterval(std::chrono::milliseconds(enable ? 0 : 10));
+			if (enable)
+				db.startWorkloadCapture();
+			else
+				db.stopWorkloadCapture();
+			db.setRowChangeCallback(nullptr);
+			db.getSlowQueries();
+		}
+		writer.join();
+
+		db.setMetricsEnabled(true);
+		TEST_ASSERT(db.execute("INSERT INTO items(id) VALUES(1000);"));
+		std::vector<std::vector<std::string>> count = db.fetchAll("SELECT COUNT(*) FROM items;");
+		db.close();
+		TEST_ASSERT(toggles > 0);
+		TEST_COMPARE(count.size(), size_t(1));
+		TEST_COMPARE(count[0][0], std::string("301"));
+	}
+
+	TEST_FUNCTION(backupFinishedInObjectThread)
+	{
+		TEST_START;
+		SQLiteWrapper::SQLite db(TestUtilities::getTempDatabasePath("strand_backup.db"));
+		db.setThreadSafe(true);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY);"));
+
+		QThread* signalThread = nullptr;
+		bool finished = false;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::backupFinished, [&](bool success)
+			{
+				signalThread = QThread::currentThread();
+				finished = success;
+			});
+		TEST_ASSERT(db.backupTo(TestUtilities::getTempDatabasePath("strand_backup.bak")));
+		db.waitForBackup();
+		TestUtilities::processEventsUntil([&finished]() { return finished; });
+		db.close();
+		TEST_ASSERT(finished);
+		TEST_ASSERT(signalThread == QThread::currentThread());
+	}
+};
+TEST_INSTANTIATE(TST_Strand);
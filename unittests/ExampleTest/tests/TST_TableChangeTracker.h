@@ -0,0 +1,181 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_TableChangeTracker : public UnitTest::Test
+{
+	TEST_CLASS(TST_TableChangeTracker)
+public:
+	TST_TableChangeTracker()
+		: Test("TST_TableChangeTracker")
+	{
+		ADD_TEST(TST_TableChangeTracker::fingerprintDiff);
+		ADD_TEST(TST_TableChangeTracker::schemaChanges);
+		ADD_TEST(TST_TableChangeTracker::triggersDetectInPlaceUpdates);
+		ADD_TEST(TST_TableChangeTracker::triggersInsideTransaction);
+		ADD_TEST(TST_TableChangeTracker::triggersSkipVirtualTables);
+		ADD_TEST(TST_TableChangeTracker::removeTriggers);
+		ADD_TEST(TST_TableChangeTracker::connectionEmitsChangedTables);
+	}
+
+private:
+	typedef SQLiteWrapper::TableChangeTracker TableChangeTracker;
+	typedef std::vector<std::string> Names;
+
+	static sqlite3* openMemory()
+	{
+		sqlite3* db = nullptr;
+		sqlite3_open(":memory:", &db);
+		sqlite3_exec(db, "CREATE TABLE a(id INTEGER PRIMARY KEY, v TEXT);"
+						 "CREATE TABLE b(id INTEGER PRIMARY KEY, v TEXT);"
+						 "INSERT INTO a(v) VALUES('1'), ('2'), ('3');"
+						 "INSERT INTO b(v) VALUES('1');", nullptr, nullptr, nullptr);
+		return db;
+	}
+	static bool exec(sqlite3* db, const char* sql)
+	{
+		return sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK;
+	}
+
+	// Tests
+	TEST_FUNCTION(fingerprintDiff)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::fingerprint);
+
+		// The first update only takes the snapshot
+		TEST_ASSERT(tracker.update(db).empty());
+		TEST_ASSERT(tracker.update(db).empty());
+
+		TEST_ASSERT(exec(db, "INSERT INTO b(v) VALUES('2');"));
+		TEST_ASSERT(tracker.update(db) == Names({ "b" }));
+		TEST_ASSERT(tracker.update(db).empty());
+
+		// The first and last rows are sampled
+		TEST_ASSERT(exec(db, "UPDATE a SET v = 'x' WHERE id = 3; DELETE FROM b WHERE id = 1;"));
+		TEST_ASSERT(tracker.update(db) == Names({ "a", "b" }));
+
+		tracker.setMode(TableChangeTracker::Mode::disabled);
+		TEST_ASSERT(exec(db, "INSERT INTO a(v) VALUES('4');"));
+		TEST_ASSERT(tracker.update(db).empty());
+		sqlite3_close(db);
+	}
+
+	TEST_FUNCTION(schemaChanges)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::fingerprint);
+		tracker.snapshot(db);
+		TEST_ASSERT(exec(db, "CREATE TABLE c(id INTEGER PRIMARY KEY); DROP TABLE b; ALTER TABLE a ADD COLUMN w TEXT;"));
+		TEST_ASSERT(tracker.update(db) == Names({ "a", "b", "c" }));
+		sqlite3_close(db);
+	}
+
+	TEST_FUNCTION(triggersDetectInPlaceUpdates)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::triggers);
+		TEST_ASSERT(tracker.installTriggers(db));
+		TEST_ASSERT(tracker.installTriggers(db)); // Installing twice is harmless
+		tracker.snapshot(db);
+
+		// Neither the count nor the sampled rows change
+		TEST_ASSERT(exec(db, "UPDATE a SET v = 'x' WHERE id = 2;"));
+		TEST_ASSERT(tracker.update(db) == Names({ "a" }));
+		TEST_ASSERT(exec(db, "DELETE FROM b;"));
+		TEST_ASSERT(tracker.update(db) == Names({ "b" }));
+		TEST_ASSERT(tracker.update(db).empty());
+		sqlite3_close(db);
+	}
+
+	TEST_FUNCTION(triggersInsideTransaction)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::triggers);
+		TEST_ASSERT(exec(db, "BEGIN; INSERT INTO a(v) VALUES('4');"));
+		TEST_ASSERT(tracker.installTriggers(db));
+		TEST_ASSERT(!sqlite3_get_autocommit(db));
+		TEST_ASSERT(exec(db, "COMMIT;"));
+		TEST_ASSERT(exec(db, "SELECT counter FROM _sqlw_table_changes;"));
+		sqlite3_close(db);
+	}
+
+	TEST_FUNCTION(triggersSkipVirtualTables)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		if (!exec(db, "CREATE VIRTUAL TABLE docs USING fts5(body);"))
+		{
+			// FTS5 is not compiled in
+			sqlite3_close(db);
+			return;
+		}
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::triggers);
+		TEST_ASSERT(tracker.installTriggers(db));
+		tracker.snapshot(db);
+		// Triggers on the shadow tables would recurse when FTS5 writes them
+		TEST_ASSERT(exec(db, "INSERT INTO docs(body) VALUES('text');"));
+		TEST_ASSERT(tracker.update(db) == Names({ "docs" }));
+		TEST_ASSERT(exec(db, "UPDATE a SET v = 'y' WHERE id = 1;"));
+		TEST_ASSERT(tracker.update(db) == Names({ "a" }));
+		sqlite3_close(db);
+	}
+
+	TEST_FUNCTION(removeTriggers)
+	{
+		TEST_START;
+		sqlite3* db = openMemory();
+		TEST_ASSERT(exec(db, "CREATE TRIGGER own AFTER INSERT ON a BEGIN SELECT 1; END;"));
+		TableChangeTracker tracker;
+		tracker.setMode(TableChangeTracker::Mode::triggers);
+		TEST_ASSERT(tracker.installTriggers(db));
+		TEST_ASSERT(tracker.removeTriggers(db));
+
+		// Only the own trigger of the user stays
+		sqlite3_stmt* stmt = nullptr;
+		sqlite3_prepare_v2(db, "SELECT group_concat(name) FROM sqlite_master WHERE type = 'trigger' OR name = '_sqlw_table_changes';", -1, &stmt, nullptr);
+		sqlite3_step(stmt);
+		const char* names = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+		std::string remaining = names ? names : "";
+		sqlite3_finalize(stmt);
+		sqlite3_close(db);
+		TEST_COMPARE(remaining, std::string("own"));
+	}
+
+	TEST_FUNCTION(connectionEmitsChangedTables)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("tablechanges.db");
+		SQLiteWrapper::SQLite db(path);
+		TEST_ASSERT(db.open());
+		TEST_ASSERT(db.execute("CREATE TABLE a(id INTEGER PRIMARY KEY); CREATE TABLE b(id INTEGER PRIMARY KEY);"));
+		TEST_ASSERT(db.setTableChangeTracking(TableChangeTracker::Mode::fingerprint));
+
+		std::vector<QStringList> received;
+		QObject receiver;
+		QObject::connect(&db, &SQLiteWrapper::SQLite::tablesChanged, &receiver, [&received](const QStringList& tables) { received.push_back(tables); });
+		TestUtilities::processEventsFor(std::chrono::milliseconds(200));
+
+		SQLiteWrapper::SQLite writer(path);
+		TEST_ASSERT(writer.open());
+		TEST_ASSERT(writer.execute("INSERT INTO b DEFAULT VALUES;"));
+		writer.close();
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return !received.empty(); }));
+		TEST_COMPARE(received.size(), size_t(1));
+		TEST_ASSERT(received.size() == 1 && received[0].size() == 1 && received[0].contains("b"));
+		db.close();
+	}
+};
+
+TEST_INSTANTIATE(TST_TableChangeTracker);
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <atomic>
+
+class TST_WatchService : public UnitTest::Test
+{
+	TEST_CLASS(TST_WatchService)
+public:
+	TST_WatchService()
+		: Test("TST_WatchService")
+	{
+		ADD_TEST(TST_WatchService::registrationsShareWatch);
+		ADD_TEST(TST_WatchService::reportsCommits);
+		ADD_TEST(TST_WatchService::noCallbackAfterRemove);
+		ADD_TEST(TST_WatchService::sharedWatcherMode);
+	}
+
+private:
+	typedef SQLiteWrapper::WatchService WatchService;
+
+	static std::string createDatabase(const std::string& name)
+	{
+		std::string path = TestUtilities::getTempDatabasePath(name);
+		SQLiteWrapper::SQLite db(path);
+		db.open();
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);");
+		db.close();
+		return path;
+	}
+	static bool insertRow(const std::string& path)
+	{
+		SQLiteWrapper::SQLite db(path);
+		bool success = db.open() && db.execute("INSERT INTO items(name) VALUES('x');");
+		db.close();
+		return success;
+	}
+	static bool waitFor(const std::atomic<int>& value, int expected)
+	{
+		return TestUtilities::processEventsUntil([&]() { return value.load() >= expected; });
+	}
+
+	// Tests
+	TEST_FUNCTION(registrationsShareWatch)
+	{
+		TEST_START;
+		WatchService& service = WatchService::instance();
+		size_t registrations = service.getRegistrationCount();
+		size_t paths = service.getWatchedPathCount();
+
+		std::string path = createDatabase("service_share.db");
+		WatchService::Id first = service.add(path, [](const std::string&) {});
+		WatchService::Id second = service.add(path, [](const std::string&) {});
+		TEST_ASSERT(first != 0 && second != 0 && first != second);
+		TEST_COMPARE(service.getRegistrationCount(), registrations + 2);
+		TEST_COMPARE(service.getWatchedPathCount(), paths + 1);
+
+		service.remove(first);
+		TEST_COMPARE(service.getWatchedPathCount(), paths + 1);
+		service.remove(second);
+		TEST_COMPARE(service.getRegistrationCount(), registrations);
+		TEST_COMPARE(service.getWatchedPathCount(), paths);
+	}
+
+	TEST_FUNCTION(reportsCommits)
+	{
+		TEST_START;
+		WatchService& service = WatchService::instance();
+		std::string pathA = createDatabase("service_a.db");
+		std::string pathB = createDatabase("service_b.db");
+		std::atomic<int> changesA(0);
+		std::atomic<int> changesB(0);
+		WatchService::Id idA = service.add(pathA, [&changesA](const std::string&) { ++changesA; });
+		WatchService::Id idB = service.add(pathB, [&changesB](const std::string&) { ++changesB; });
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+
+		TEST_ASSERT(insertRow(pathA));
+		TEST_ASSERT(waitFor(changesA, 1));
+		TEST_COMPARE(changesB.load(), 0);
+
+		// Reading does not count as change
+		int before = changesA.load();
+		SQLiteWrapper::SQLite reader(pathA);
+		TEST_ASSERT(reader.open());
+		reader.fetchAll("SELECT * FROM items;");
+		reader.close();
+		TestUtilities::processEventsFor(std::chrono::milliseconds(150));
+		TEST_COMPARE(changesA.load(), before);
+
+		service.remove(idA);
+		service.remove(idB);
+	}
+
+	TEST_FUNCTION(noCallbackAfterRemove)
+	{
+		TEST_START;
+		WatchService& service = WatchService::instance();
+		std::string path = createDatabase("service_remove.db");
+		std::atomic<int> changes(0);
+		WatchService::Id id = service.add(path, [&changes](const std::string&) { ++changes; });
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		service.remove(id);
+		TEST_ASSERT(insertRow(path));
+		TestUtilities::processEventsFor(std::chrono::milliseconds(150));
+		TEST_COMPARE(changes.load(), 0);
+	}
+
+	TEST_FUNCTION(sharedWatcherMode)
+	{
+		TEST_START;
+		std::string path = createDatabase("service_watcher.db");
+		unsigned int received = 0;
+		SQLiteWrapper::FileChangeWatcher watcher(path, SQLiteWrapper::FileChangeWatcher::Mode::shared);
+		QObject receiver;
+		QObject::connect(&watcher, &SQLiteWrapper::FileChangeWatcher::onFileChanged, &receiver, [&received](const std::string&) { ++received; });
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_ASSERT(insertRow(path));
+		TEST_ASSERT(TestUtilities::processEventsUntil([&]() { return received > 0; }));
+	}
+};
+
+TEST_INSTANTIATE(TST_WatchService);
@@ -0,0 +1,354 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+class TST_WriteForward : public UnitTest::Test
+{
+	TEST_CLASS(TST_WriteForward)
+public:
+	TST_WriteForward()
+		: Test("TST_WriteForward")
+	{
+		ADD_TEST(TST_WriteForward::requestRoundTrip);
+		ADD_TEST(TST_WriteForward::ackRoundTrip);
+		ADD_TEST(TST_WriteForward::incompleteFrames);
+		ADD_TEST(TST_WriteForward::malformedFrames);
+		ADD_TEST(TST_WriteForward::serverExecutesRequests);
+		ADD_TEST(TST_WriteForward::rollbackFailsEarlierRequests);
+		ADD_TEST(TST_WriteForward::oversizedRequestsAreRejected);
+		ADD_TEST(TST_WriteForward::unreadAcksStopReading);
+	}
+
+private:
+	typedef SQLiteWrapper::WriteForwardProtocol Protocol;
+
+	static std::string makeDatabase(const std::string& name)
+	{
+		std::string path = TestUtilities::getTempDatabasePath(name);
+		SQLiteWrapper::SQLite db(path);
+		db.open();
+		db.execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);");
+		db.close();
+		return path;
+	}
+
+	// Tests
+	TEST_FUNCTION(requestRoundTrip)
+	{
+		TEST_START;
+		Protocol::Request request;
+		request.id = 42;
+		request.statementId = 7;
+		request.params = { Protocol::Value(), Protocol::Value::fromInt(-5), Protocol::Value::fromReal(2.5),
+			Protocol::Value::fromText("text"), Protocol::Value::fromBlob(std::string("\0\1\2", 3)) };
+
+		std::string buffer;
+		Protocol::encodeRequest(request, buffer);
+		Protocol::encodeRequest(Protocol::Request(), buffer);
+
+		Protocol::Request decoded;
+		bool error = true;
+		size_t size = Protocol::decodeRequest(buffer.data(), buffer.size(), decoded, error);
+		TEST_ASSERT(!error);
+		TEST_ASSERT(size > 0 && size < buffer.size());
+		TEST_COMPARE(decoded.id, uint64_t(42));
+		TEST_COMPARE(decoded.statementId, uint32_t(7));
+		TEST_COMPARE(decoded.params.size(), size_t(5));
+		if (decoded.params.size() != 5)
+			return;
+		TEST_COMPARE(decoded.params[0].type, Protocol::Value::Type::null);
+		TEST_COMPARE(decoded.params[1].intValue, int64_t(-5));
+		TEST_COMPARE(decoded.params[2].realValue, 2.5);
+		TEST_COMPARE(decoded.params[3].type, Protocol::Value::Type::text);
+		TEST_COMPARE(decoded.params[3].bytes, std::string("text"));
+		TEST_COMPARE(decoded.params[4].type, Protocol::Value::Type::blob);
+		TEST_COMPARE(decoded.params[4].bytes, std::string("\0\1\2", 3));
+
+		// The second frame follows directly
+		size_t second = Protocol::decodeRequest(buffer.data() + size, buffer.size() - size, decoded, error);
+		TEST_ASSERT(!error);
+		TEST_COMPARE(size + second, buffer.size());
+		TEST_COMPARE(decoded.id, uint64_t(0));
+		TEST_ASSERT(decoded.params.empty());
+	}
+
+	TEST_FUNCTION(ackRoundTrip)
+	{
+		TEST_START;
+		Protocol::Ack ack;
+		ack.requestId = 9;
+		ack.resultCode = SQLITE_CONSTRAINT;
+		ack.changes = 3;
+		ack.lastInsertRowId = -1;
+
+		std::string buffer;
+		Protocol::encodeAck(ack, buffer);
+		Protocol::Ack decoded;
+		bool error = true;
+		TEST_COMPARE(Protocol::decodeAck(buffer.data(), buffer.size(), decoded, error), buffer.size());
+		TEST_ASSERT(!error);
+		TEST_COMPARE(decoded.requestId, uint64_t(9));
+		TEST_COMPARE(decoded.resultCode, int32_t(SQLITE_CONSTRAINT));
+		TEST_COMPARE(decoded.changes, int64_t(3));
+		TEST_COMPARE(decoded.lastInsertRowId, int64_t(-1));
+	}
+
+	TEST_FUNCTION(incompleteFrames)
+	{
+		TEST_START;
+		Protocol::Request request;
+		request.params = { Protocol::Value::fromText("abc") };
+		std::string buffer;
+		Protocol::encodeRequest(request, buffer);
+
+		// Every prefix waits for more data without an error
+		for (size_t size = 0; size < buffer.size(); ++size)
+		{
+			Protocol::Request decoded;
+			bool error = true;
+			TEST_COMPARE(Protocol::decodeRequest(buffer.data(), size, decoded, error), size_t(0));
+			TEST_ASSERT(!error);
+		}
+	}
+
+	TEST_FUNCTION(malformedFrames)
+	{
+		TEST_START;
+		Protocol::Request decoded;
+		bool error = false;
+
+		// Larger than the maximum frame size
+		uint32_t tooLarge = Protocol::maxFrameSize + 1;
+		std::string buffer(reinterpret_cast<const char*>(&tooLarge), sizeof(tooLarge));
+		TEST_COMPARE(Protocol::decodeRequest(buffer.data(), buffer.size(), decoded, error), size_t(0));
+		TEST_ASSERT(error);
+
+		// Unknown value type
+		Protocol::Request request;
+		request.params = { Protocol::Value::fromInt(1) };
+		buffer.clear();
+		Protocol::encodeRequest(request, buffer);
+		buffer[sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t)] = 99;
+		error = false;
+		TEST_COMPARE(Protocol::decodeRequest(buffer.data(), buffer.size(), decoded, error), size_t(0));
+		TEST_ASSERT(error);
+
+		// Text size beyond the payload
+		request.params = { Protocol::Value::fromText("abc") };
+		buffer.clear();
+		Protocol::encodeRequest(request, buffer);
+		uint32_t textSize = 1000;
+		std::memcpy(&buffer[sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t) + 1], &textSize, sizeof(textSize));
+		error = false;
+		TEST_COMPARE(Protocol::decodeRequest(buffer.data(), buffer.size(), decoded, error), size_t(0));
+		TEST_ASSERT(error);
+
+		// Payload with trailing bytes
+		buffer.clear();
+		Protocol::encodeRequest(Protocol::Request(), buffer);
+		buffer.push_back('x');
+		uint32_t payloadSize = static_cast<uint32_t>(buffer.size() - sizeof(uint32_t));
+		std::memcpy(&buffer[0], &payloadSize, sizeof(payloadSize));
+		error = false;
+		TEST_COMPARE(Protocol::decodeRequest(buffer.data(), buffer.size(), decoded, error), size_t(0));
+		TEST_ASSERT(error);
+
+		// Ack with a short payload
+		Protocol::Ack ack;
+		buffer.clear();
+		Protocol::encodeAck(ack, buffer);
+		payloadSize = sizeof(uint64_t);
+		std::memcpy(&buffer[0], &payloadSize, sizeof(payloadSize));
+		error = false;
+		TEST_COMPARE(Protocol::decodeAck(buffer.data(), buffer.size(), ack, error), size_t(0));
+		TEST_ASSERT(error);
+	}
+
+	TEST_FUNCTION(serverExecutesRequests)
+	{
+		TEST_START;
+		std::string path = makeDatabase("forward_execute.db");
+		std::string socketPath = SQLiteWrapper::WriteForwardServer::getDefaultSocketPath(path);
+		SQLiteWrapper::WriteForwardServer server(path, socketPath);
+		server.registerStatement(1, "INSERT INTO items(id, name) VALUES(?, ?);");
+		TEST_ASSERT(server.start());
+
+		SQLiteWrapper::WriteForwardClient client(socketPath);
+		TEST_ASSERT(client.connect());
+		for (int i = 1; i <= 10; ++i)
+			TEST_ASSERT(client.submit(1, { Protocol::Value::fromInt(i), Protocol::Value::fromText("item") }) != 0);
+		for (int i = 1; i <= 10; ++i)
+		{
+			Protocol::Ack ack;
+			TEST_ASSERT(client.waitForAck(ack));
+			TEST_COMPARE(ack.requestId, uint64_t(i));
+			TEST_COMPARE(ack.resultCode, int32_t(SQLITE_OK));
+			TEST_COMPARE(ack.lastInsertRowId, int64_t(i));
+		}
+
+		// Unknown statements and wrong parameter counts only fail their request
+		Protocol::Ack ack;
+		TEST_ASSERT(client.execute(2, {}, ack));
+		TEST_COMPARE(ack.resultCode, int32_t(SQLITE_NOTFOUND));
+		TEST_ASSERT(client.execute(1, { Protocol::Value::fromInt(11) }, ack));
+		TEST_COMPARE(ack.resultCode, int32_t(SQLITE_RANGE));
+		client.disconnect();
+
+		SQLiteWrapper::WriteForwardServer::Statistics statistics = server.getStatistics();
+		TEST_COMPARE(statistics.requests, size_t(12));
+		TEST_COMPARE(statistics.failedRequests, size_t(2));
+		server.stop();
+
+		SQLiteWrapper::SQLite db(path);
+		TEST_ASSERT(db.open());
+		TEST_COMPARE(db.fetchAll("SELECT COUNT(*) FROM items;"), std::vector<std::vector<std::string>>({ { "10" } }));
+	}
+
+	TEST_FUNCTION(rollbackFailsEarlierRequests)
+	{
+		TEST_START;
+		std::string path = makeDatabase("forward_rollback.db");
+		std::string socketPath = SQLiteWrapper::WriteForwardServer::getDefaultSocketPath(path);
+		SQLiteWrapper::WriteForwardServer server(path, socketPath);
+		server.registerStatement(1, "INSERT INTO items(id) VALUES(?);");
+		server.registerStatement(2, "INSERT OR ROLLBACK INTO items(id) VALUES(?);");
+		TEST_ASSERT(server.start());
+
+		// Pipelined, the three requests arrive in one batch
+		SQLiteWrapper::WriteForwardClient client(socketPath);
+		TEST_ASSERT(client.connect());
+		client.submit(1, { Protocol::Value::fromInt(1) });
+		client.submit(2, { Protocol::Value::fromInt(1) });
+		client.submit(1, { Protocol::Value::fromInt(3) });
+		std::vector<int32_t> results;
+		for (int i = 0; i < 3; ++i)
+		{
+			Protocol::Ack ack;
+			TEST_ASSERT(client.waitForAck(ack));
+			results.push_back(ack.resultCode & 0xff);
+		}
+		client.disconnect();
+		server.stop();
+
+		// The first insert was rolled back with the conflicting one, the last was committed afterwards
+		TEST_COMPARE(results, std::vector<int32_t>({ SQLITE_CONSTRAINT, SQLITE_CONSTRAINT, SQLITE_OK }));
+		SQLiteWrapper::SQLite db(path);
+		TEST_ASSERT(db.open());
+		TEST_COMPARE(db.fetchAll("SELECT id FROM items;"), std::vector<std::vector<std::string>>({ { "3" } }));
+	}
+
+	TEST_FUNCTION(oversizedRequestsAreRejected)
+	{
+		TEST_START;
+		std::string buffer;
+		Protocol::Request request;
+		request.params.resize(Protocol::maxParams + 1, Protocol::Value::fromInt(1));
+		TEST_ASSERT(!Protocol::encodeRequest(request, buffer));
+		request.params = { Protocol::Value::fromBlob(std::string(Protocol::maxFrameSize, 'x')) };
+		TEST_ASSERT(!Protocol::encodeRequest(request, buffer));
+		TEST_ASSERT(buffer.empty());
+
+		std::string path = makeDatabase("forward_oversized.db");
+		std::string socketPath = SQLiteWrapper::WriteForwardServer::getDefaultSocketPath(path);
+		SQLiteWrapper::WriteForwardServer server(path, socketPath);
+		server.registerStatement(1, "INSERT INTO items(id) VALUES(?);");
+		TEST_ASSERT(server.start());
+
+		// The rejected request is not sent, the pending ack of the connection is kept
+		SQLiteWrapper::WriteForwardClient client(socketPath);
+		TEST_ASSERT(client.connect());
+		uint64_t first = client.submit(1, { Protocol::Value::fromInt(1) });
+		TEST_ASSERT(first != 0);
+		TEST_COMPARE(client.submit(1, request.params), uint64_t(0));
+		Protocol::Ack ack;
+		TEST_ASSERT(client.waitForAck(ack));
+		TEST_COMPARE(ack.requestId, first);
+		TEST_COMPARE(ack.resultCode, int32_t(SQLITE_OK));
+		TEST_ASSERT(client.execute(1, { Protocol::Value::fromInt(2) }, ack));
+		TEST_COMPARE(ack.requestId, first + 1);
+		client.disconnect();
+		server.stop();
+	}
+
+	TEST_FUNCTION(unreadAcksStopReading)
+	{
+		TEST_START;
+#ifndef _WIN32
+		std::string path = makeDatabase("forward_backpressure.db");
+		std::string socketPath = SQLiteWrapper::WriteForwardServer::getDefaultSocketPath(path);
+		SQLiteWrapper::WriteForwardServer server(path, socketPath);
+		server.registerStatement(1, "INSERT OR REPLACE INTO items(id) VALUES(?);");
+		TEST_ASSERT(server.start());
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+		TEST_ASSERT(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+
+		// Pipeline requests without reading the acks until the socket is full
+		std::string frames;
+		for (int i = 0; i < 1000; ++i)
+		{
+			Protocol::Request request;
+			request.id = static_cast<uint64_t>(i + 1);
+			request.statementId = 1;
+			request.params = { Protocol::Value::fromInt(i % 10) };
+			Protocol::encodeRequest(request, frames);
+		}
+		size_t sent = 0;
+		size_t offset = 0;
+		const size_t limit = 64 * 1024 * 1024;
+		bool full = false;
+		while (sent < limit && !full)
+		{
+			ssize_t count = send(fd, frames.data() + offset, frames.size() - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (count < 0)
+			{
+				// A slow server fills the socket for a moment, a server which stopped reading keeps it full
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+				count = send(fd, frames.data() + offset, frames.size() - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (count < 0)
+				{
+					full = true;
+					continue;
+				}
+			}
+			sent += static_cast<size_t>(count);
+			offset = (offset + static_cast<size_t>(count)) % frames.size();
+		}
+
+		// Reading the acks lets the server continue with the buffered requests
+		const size_t frameSize = frames.size() / 1000;
+		const size_t ackSize = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int32_t) + 2 * sizeof(int64_t);
+		const size_t expected = (sent / frameSize) * ackSize;
+		timeval timeout{ 5, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		size_t received = 0;
+		char buffer[65536];
+		while (received < expected)
+		{
+			ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+			if (count <= 0)
+				break;
+			received += static_cast<size_t>(count);
+		}
+		::close(fd);
+		server.stop();
+		TEST_ASSERT(full);
+		TEST_ASSERT(sent < limit);
+		TEST_COMPARE(received, expected);
+#endif
+	}
+};
+
+TEST_INSTANTIATE(TST_WriteForward);
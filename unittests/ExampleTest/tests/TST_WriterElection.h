@@ -0,0 +1,83 @@
+#pragma once
+
+#include "UnitTest.h"
+#include "SQLiteWrapper.h"
+#include "TestUtilities.h"
+
+class TST_WriterElection : public UnitTest::Test
+{
+	TEST_CLASS(TST_WriterElection)
+public:
+	TST_WriterElection()
+		: Test("TST_WriterElection")
+	{
+		ADD_TEST(TST_WriterElection::firstProcessLeads);
+		ADD_TEST(TST_WriterElection::followerTakesOver);
+		ADD_TEST(TST_WriterElection::stopEndsFollowerWait);
+	}
+
+private:
+	typedef SQLiteWrapper::WriterElection WriterElection;
+
+	// Tests
+	TEST_FUNCTION(firstProcessLeads)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("election_first.db");
+		WriterElection leader(WriterElection::getDefaultLockPath(path));
+		WriterElection follower(WriterElection::getDefaultLockPath(path));
+		TEST_COMPARE(leader.getRole(), WriterElection::Role::none);
+		TEST_ASSERT(leader.start());
+		TEST_ASSERT(follower.start());
+		TEST_COMPARE(leader.getRole(), WriterElection::Role::leader);
+		TEST_COMPARE(follower.getRole(), WriterElection::Role::follower);
+		follower.stop();
+		leader.stop();
+		TEST_COMPARE(leader.getRole(), WriterElection::Role::none);
+	}
+
+	TEST_FUNCTION(followerTakesOver)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("election_takeover.db");
+		WriterElection leader(WriterElection::getDefaultLockPath(path));
+		WriterElection follower(WriterElection::getDefaultLockPath(path));
+		SQLiteWrapper::SQLite db(path);
+		follower.setDatabase(&db);
+		TEST_ASSERT(leader.start());
+		TEST_ASSERT(follower.start());
+		TEST_ASSERT(db.isReadOnly());
+
+		std::vector<WriterElection::Role> roles;
+		QObject::connect(&follower, &WriterElection::roleChanged, [&roles](WriterElection::Role role) { roles.push_back(role); });
+		leader.stop();
+		TEST_ASSERT(TestUtilities::processEventsUntil([&follower]() { return follower.isLeader(); }));
+		TEST_COMPARE(roles, std::vector<WriterElection::Role>({ WriterElection::Role::leader }));
+		TEST_ASSERT(!db.isReadOnly());
+		follower.stop();
+	}
+
+	TEST_FUNCTION(stopEndsFollowerWait)
+	{
+		TEST_START;
+		std::string path = TestUtilities::getTempDatabasePath("election_stop.db");
+		WriterElection leader(WriterElection::getDefaultLockPath(path));
+		WriterElection follower(WriterElection::getDefaultLockPath(path));
+		TEST_ASSERT(leader.start());
+		TEST_ASSERT(follower.start());
+
+		// The follower blocks in the kernel without a timeout, stop() has to wake it
+		TestUtilities::processEventsFor(std::chrono::milliseconds(50));
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		follower.stop();
+		TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+		TEST_COMPARE(follower.getRole(), WriterElection::Role::none);
+
+		// The stopped follower does not take over
+		leader.stop();
+		TestUtilities::processEventsFor(std::chrono::milliseconds(100));
+		TEST_COMPARE(follower.getRole(), WriterElection::Role::none);
+	}
+};
+
+TEST_INSTANTIATE(TST_WriterElection);
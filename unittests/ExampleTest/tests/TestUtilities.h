@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <filesystem>
+#include <QCoreApplication>
+
+namespace TestUtilities
+{
+	/**
+	 * @brief Returns a path in the temp directory, an existing database with that name is removed.
+	 */
+	inline std::string getTempDatabasePath(const std::string& name)
+	{
+		std::string path = (std::filesystem::temp_directory_path() / ("sqlw_test_" + name)).string();
+		for (const char* suffix : { "", "-wal", "-shm", "-journal" })
+			std::remove((path + suffix).c_str());
+		return path;
+	}
+
+	/**
+	 * @brief Processes events until the condition is met or the timeout has elapsed.
+	 * @return The last result of the condition
+	 */
+	inline bool processEventsUntil(const std::function<bool()>& condition, std::chrono::milliseconds timeout = std::chrono::milliseconds(3000))
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+		while (!condition())
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+				return condition();
+			QCoreApplication::processEvents();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	inline void processEventsFor(std::chrono::milliseconds duration)
+	{
+		processEventsUntil([]() { return false; }, duration);
+	}
+}